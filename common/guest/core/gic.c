@@ -47,6 +47,8 @@ struct gic {
     uint32_t lines;
     uint32_t cpus;
     gic_irq_handler_t handlers[GIC_NUM_MAX_IRQS];
+    /* PMCCNTR cycles the last Completion & Deactivation took */
+    uint32_t eoi_cycles;
     uint32_t initialized;
 };
 
@@ -165,6 +167,16 @@ hvmm_status_t gic_disable_irq(uint32_t irq)
     return HVMM_STATUS_SUCCESS;
 }
 
+volatile uint32_t *gic_gicd_baseaddr(void)
+{
+    return _gic.ba_gicd;
+}
+
+uint32_t gic_eoi_cycles(void)
+{
+    return _gic.eoi_cycles;
+}
+
 hvmm_status_t gic_set_irq_handler(int irq, gic_irq_handler_t handler,
                 void *pdata)
 {
@@ -210,12 +222,12 @@ void gic_interrupt(int fiq, void *pregs)
      */
     uint32_t iar;
     uint32_t irq;
+    uint32_t start;
     struct arch_regs *regs = pregs;
     /* ACK */
     iar = _gic.ba_gicc[GICC_IAR];
     irq = iar & GICC_IAR_INTID_MASK;
     if (irq < _gic.lines) {
-        uart_print(".");
         if (irq == 0) {
             uart_print("ba_gicd:");
             uart_print_hex32((uint32_t) _gic.ba_gicd);
@@ -229,8 +241,12 @@ void gic_interrupt(int fiq, void *pregs)
             _gic.handlers[irq](irq, regs, 0);
 
         /* Completion & Deactivation */
+        start = read_pmccntr();
         _gic.ba_gicc[GICC_EOIR] = irq;
         _gic.ba_gicc[GICC_DIR] = irq;
+        _gic.eoi_cycles = read_pmccntr() - start;
+        /* Printed last, not to delay the handler */
+        uart_print(".");
     } else {
         uart_print("end of irq(no pending):");
         uart_print_hex32(irq);
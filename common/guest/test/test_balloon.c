@@ -0,0 +1,79 @@
+#include <arch_types.h>
+#include <armv7_p15.h>
+#include <log/uart_print.h>
+
+/*
+ * Inflates the balloon by BALLOON_PAGES pages from BALLOON_BASE, deflates
+ * it again and prints the virtual counter ticks each direction took.
+ * The pages must be RAM the guest does not use otherwise.
+ */
+#define BALLOON_BASE        0x88000000
+#define BALLOON_PAGES       4096
+#define BALLOON_BATCH       256
+#define BALLOON_PAGE_SIZE   0x1000
+
+static uint32_t balloon_inflate(uint32_t ipa, uint32_t pages)
+{
+    register uint32_t r0 asm("r0") = ipa;
+    register uint32_t r1 asm("r1") = pages;
+
+    asm volatile("hvc #0xFFF9" : "+r" (r0) : "r" (r1) : "memory");
+
+    return r0;
+}
+
+static uint32_t balloon_deflate(uint32_t ipa, uint32_t pages)
+{
+    register uint32_t r0 asm("r0") = ipa;
+    register uint32_t r1 asm("r1") = pages;
+
+    asm volatile("hvc #0xFFF8" : "+r" (r0) : "r" (r1) : "memory");
+
+    return r0;
+}
+
+static void balloon_print_result(const char *name, uint32_t pages,
+                uint64_t ticks)
+{
+    uart_print("balloon: ");
+    uart_print(name);
+    uart_print(" pages:");
+    uart_print_hex32(pages);
+    uart_print(" ticks:");
+    uart_print_hex32((uint32_t) ticks);
+    uart_print("\n\r");
+}
+
+void test_balloon()
+{
+    volatile uint32_t *first = (uint32_t *) BALLOON_BASE;
+    uint32_t ipa, pages;
+    uint64_t start;
+
+    uart_print("balloon: Starting test..., base:");
+    uart_print_hex32(BALLOON_BASE);
+    uart_print("\n\r");
+    *first = 0xCAFEBABE;
+
+    pages = 0;
+    start = read_cntvct();
+    for (ipa = BALLOON_BASE; ipa < BALLOON_BASE +
+            BALLOON_PAGES * BALLOON_PAGE_SIZE;
+            ipa += BALLOON_BATCH * BALLOON_PAGE_SIZE)
+        pages += balloon_inflate(ipa, BALLOON_BATCH);
+    balloon_print_result("inflate", pages, read_cntvct() - start);
+
+    pages = 0;
+    start = read_cntvct();
+    for (ipa = BALLOON_BASE; ipa < BALLOON_BASE +
+            BALLOON_PAGES * BALLOON_PAGE_SIZE;
+            ipa += BALLOON_BATCH * BALLOON_PAGE_SIZE)
+        pages += balloon_deflate(ipa, BALLOON_BATCH);
+    balloon_print_result("deflate", pages, read_cntvct() - start);
+
+    /* Pages come back zeroed */
+    if (*first == 0)
+        uart_print("balloon: End - OK\n\r");
+    else
+        uart_print("balloon: End - FAILED\n\r");
+}
@@ -0,0 +1,26 @@
+#ifndef __TEST_SHADOW_H__
+#define __TEST_SHADOW_H__
+#include <arch_types.h>
+
+/*
+ * Helpers of the tests reading a page the hypervisor shares with the
+ * guest(memory_map_shadow): the trace buffer and the statistics page.
+ */
+
+/* Hypervisor calls a test makes between its two samples */
+#ifndef SHADOW_PINGS
+#define SHADOW_PINGS        64
+#endif
+
+#define shadow_hvc_ping()   asm volatile("hvc #0xFFFE" : : : "memory")
+/*
+ * The MMU is off, the page is read uncached: writes of the hypervisor
+ * still in the cache are cleaned to memory first(DCCIMVAC). The hypervisor
+ * cleans what it publishes too, this keeps the reader right if it did not.
+ */
+#define shadow_clean_line(addr) asm volatile(\
+                            " mcr     p15, 0, %0, c7, c14, 1\n\t" \
+                            " dsb\n\t" \
+                            : : "r" ((uint32_t) (addr)) : "memory")
+
+#endif
@@ -0,0 +1,76 @@
+#include <arch_types.h>
+#include <stats_page.h>
+#include <log/uart_print.h>
+#include "test_shadow.h"
+
+/*
+ * Reader of the statistics page(stats_page.h) of the guest: samples the
+ * page around SHADOW_PINGS hypervisor calls without any hypercall of its
+ * own, and prints how many traps, switches and virqs the hypervisor
+ * counted for the guest in between.
+ */
+
+#ifndef STATS_IPA
+#define STATS_IPA           0x3FFFC000
+#endif
+/* HSR.EC of a hypervisor call */
+#define STATS_EC_HVC        0x12
+
+static void stats_sample(volatile struct stats_page *page,
+                struct stats_page *copy)
+{
+    uint32_t offset;
+
+    do {
+        for (offset = 0; offset < sizeof(*page); offset += 64)
+            shadow_clean_line((uint8_t *) page + offset);
+    } while (stats_page_read(page, copy));
+}
+
+void test_stats()
+{
+    volatile struct stats_page *page = (volatile struct stats_page *) STATS_IPA;
+    struct stats_page before, after;
+    uint32_t i, traps = 0;
+
+    uart_print("stats: Starting test..., page:");
+    uart_print_hex32(STATS_IPA);
+    uart_print("\n\r");
+    shadow_clean_line(page);
+    if (page->magic != STATS_MAGIC || page->version != STATS_VERSION ||
+            page->size != sizeof(struct stats_page)) {
+        uart_print("stats: no statistics page\n\r");
+        return;
+    }
+
+    stats_sample(page, &before);
+    for (i = 0; i < SHADOW_PINGS; i++)
+        shadow_hvc_ping();
+    stats_sample(page, &after);
+
+    for (i = 0; i < STATS_NUM_EC; i++)
+        traps += after.guest.traps[i] - before.guest.traps[i];
+    uart_print("stats: vmid:");
+    uart_print_hex32(after.vmid);
+    uart_print(" sequence:");
+    uart_print_hex32(after.sequence);
+    uart_print("\n\r");
+    uart_print("stats: hvc:");
+    uart_print_hex32(after.guest.traps[STATS_EC_HVC] -
+            before.guest.traps[STATS_EC_HVC]);
+    uart_print(" traps:");
+    uart_print_hex32(traps);
+    uart_print(" switches:");
+    uart_print_hex32(after.guest.switches - before.guest.switches);
+    uart_print(" virqs:");
+    uart_print_hex32(after.guest.virqs - before.guest.virqs);
+    uart_print("\n\r");
+    uart_print("stats: timer expiries:");
+    uart_print_hex32(after.global.timer_expiries);
+    uart_print(" traps:");
+    uart_print_hex32(after.global.traps);
+    uart_print(" virqs:");
+    uart_print_hex32(after.global.virqs);
+    uart_print("\n\r");
+    uart_print("stats: End\n\r");
+}
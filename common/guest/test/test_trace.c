@@ -0,0 +1,92 @@
+#include <arch_types.h>
+#include <trace_buffer.h>
+#include <log/uart_print.h>
+#include "test_shadow.h"
+
+/*
+ * Reader of the hypervisor event trace(trace_buffer.h) of the control
+ * guest: makes the hypervisor trace SHADOW_PINGS hypervisor calls, then
+ * consumes the records of the boot CPU's buffer without any hypercall and
+ * prints how many of each event it read, and how many it lost to the
+ * hypervisor overwriting them first.
+ */
+
+#ifndef TRACE_IPA
+#define TRACE_IPA           0x3FFE0000
+#endif
+
+static const char *_trace_names[TRACE_EVENT_MAX] = {
+    "none", "switch", "trap", "inject", "flush", "eoi", "timer", "vdev"
+};
+
+void test_trace()
+{
+    volatile struct trace_header *header =
+        (volatile struct trace_header *) TRACE_IPA;
+    struct trace_record record;
+    uint32_t count[TRACE_EVENT_MAX];
+    uint32_t seq, head, lost = 0;
+    int i;
+
+    uart_print("trace: Starting test..., header:");
+    uart_print_hex32(TRACE_IPA);
+    uart_print("\n\r");
+    shadow_clean_line(header);
+    if (header->magic != TRACE_MAGIC || header->version != TRACE_VERSION ||
+            header->record_size != sizeof(struct trace_record)) {
+        uart_print("trace: no trace buffer\n\r");
+        return;
+    }
+
+    for (i = 0; i < TRACE_EVENT_MAX; i++)
+        count[i] = 0;
+    head = header->head;
+    seq = head > header->capacity ? head - header->capacity : 0;
+    for (i = 0; i < SHADOW_PINGS; i++)
+        shadow_hvc_ping();
+
+    shadow_clean_line(header);
+    head = header->head;
+    while (seq != head) {
+        shadow_clean_line(header);
+        shadow_clean_line(&trace_buffer_records(header)
+                [seq & (header->capacity - 1)]);
+        switch (trace_buffer_read(header, seq, &record)) {
+        case 0:
+            if (record.event < TRACE_EVENT_MAX)
+                count[record.event]++;
+            seq++;
+            break;
+        case -1:
+            /* Overwritten, skip to the oldest record left */
+            head = header->head;
+            if (head - seq > header->capacity) {
+                lost += head - header->capacity - seq;
+                seq = head - header->capacity;
+            } else {
+                lost++;
+                seq++;
+            }
+            break;
+        default:
+            seq = head;
+            break;
+        }
+    }
+
+    uart_print("trace: cpu:");
+    uart_print_hex32(header->cpu);
+    uart_print(" head:");
+    uart_print_hex32(head);
+    uart_print(" lost:");
+    uart_print_hex32(lost);
+    uart_print("\n\r");
+    for (i = 1; i < TRACE_EVENT_MAX; i++) {
+        uart_print("trace: ");
+        uart_print(_trace_names[i]);
+        uart_print(":");
+        uart_print_hex32(count[i]);
+        uart_print("\n\r");
+    }
+    uart_print("trace: End\n\r");
+}
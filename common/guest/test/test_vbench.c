@@ -0,0 +1,204 @@
+#include <arch_types.h>
+#include <armv7_p15.h>
+#include <asm-arm_inline.h>
+#include <gic.h>
+#include <gic_regs.h>
+#include <log/uart_print.h>
+
+/*
+ * Virtualization microbenchmarks.
+ *
+ * Times the hot paths of the hypervisor with the PMU cycle counter, Hyp
+ * mode included, and prints one line per benchmark:
+ *
+ *  vbench: name:<name> n:<samples> min:<cycles> med:<cycles> p99:<cycles>
+ *
+ * All numbers are hexadecimal. "base" is the cost of reading PMCCNTR back
+ * to back, it is included in the other numbers. "yield" includes the time
+ * the other guest ran until the scheduler switched back. "virq" is the time
+ * from the last instruction of a wait loop to the entry of the handler of
+ * the virtual timer interrupt, and "veoi" the GICV_EOIR and GICV_DIR writes
+ * of that interrupt. "ipi" is the time from the GICD_SGIR write of an SGI
+ * to the vCPU itself to the entry of its handler: the cost of an IPI
+ * between the vCPUs of one physical CPU, the trap to the distributor
+ * emulation included. "cp15" reads ACTLR, trapped by HCR.TAC and emulated
+ * by emulate_access_to_cp15().
+ * "hvc.l1i" and "yield.l1i" count L1 instruction cache refills instead of
+ * cycles, to compare layouts of the trap and switch path of the hypervisor.
+ * Compare them between two hypervisor images on the same board: the counts
+ * depend on the core and on what the other guest ran, not only on the layout.
+ */
+
+#ifndef VBENCH_ITERATIONS
+#define VBENCH_ITERATIONS           4096
+#endif
+/* A yield or a virtual timer interrupt takes up to a scheduler tick */
+#ifndef VBENCH_SWITCH_ITERATIONS
+#define VBENCH_SWITCH_ITERATIONS    256
+#endif
+#ifndef VBENCH_IRQ_ITERATIONS
+#define VBENCH_IRQ_ITERATIONS       256
+#endif
+
+#define VBENCH_VTIMER_IRQ           30
+/* SGI 0 is taken by the diagnostics of gic_interrupt() */
+#define VBENCH_SGI                  1
+
+#define VBENCH_MEASURE_COUNTER(counter, samples, n, op)     \
+    do {                                                    \
+        uint32_t _i, _start;                                \
+        for (_i = 0; _i < (n); _i++) {                      \
+            _start = counter;                               \
+            op;                                             \
+            (samples)[_i] = counter - _start;               \
+        }                                                   \
+    } while (0)
+
+#define VBENCH_MEASURE(samples, n, op)                      \
+    VBENCH_MEASURE_COUNTER(read_pmccntr(), samples, n, op)
+
+/* Event counter 0, selected by vbench_pmu_init() */
+#define VBENCH_MEASURE_EVENT(samples, n, op)                \
+    VBENCH_MEASURE_COUNTER(read_pmxevcntr(), samples, n, op)
+
+#define vbench_hvc_ping()   asm volatile("hvc #0xFFFE" : : : "memory")
+#define vbench_hvc_yield()  asm volatile("hvc #0xFFFD" : : : "memory")
+#define vbench_read_actlr() ({ uint32_t rval; asm volatile(\
+                            " mrc     p15, 0, %0, c1, c0, 1\n\t" \
+                            : "=r" (rval) : : "memory", "cc"); rval; })
+
+static uint32_t _samples[VBENCH_ITERATIONS];
+static uint32_t _samples_eoi[VBENCH_IRQ_ITERATIONS];
+
+/* PMCCNTR the wait loop read last, and at the entry of the handler */
+static volatile uint32_t _spin;
+static volatile uint32_t _irq_latency;
+static volatile uint32_t _irq_count;
+
+static void vbench_pmu_init(void)
+{
+    /* Counts the cycles spent in Hyp mode too */
+    write_pmselr(PMSELR_CYCLE);
+    write_pmxevtyper(PMCCFILTR_NSH);
+    write_pmcntenset(PMCNTEN_C);
+    /* Event counter 0 counts the L1 i-cache refills, Hyp mode included */
+    write_pmselr(PMSELR_P0);
+    write_pmxevtyper(PMXEVTYPER_NSH | PMU_EVENT_L1I_CACHE_REFILL);
+    write_pmcntenset(PMCNTEN_P0);
+    write_pmcr(read_pmcr() | PMCR_E | PMCR_P | PMCR_C);
+    isb();
+}
+
+static void vbench_sort(uint32_t *samples, uint32_t n)
+{
+    uint32_t i, j, v;
+
+    for (i = 1; i < n; i++) {
+        v = samples[i];
+        for (j = i; j > 0 && samples[j - 1] > v; j--)
+            samples[j] = samples[j - 1];
+        samples[j] = v;
+    }
+}
+
+static void vbench_report(const char *name, uint32_t *samples, uint32_t n)
+{
+    vbench_sort(samples, n);
+    uart_print("vbench: name:");
+    uart_print(name);
+    uart_print(" n:");
+    uart_print_hex32(n);
+    uart_print(" min:");
+    uart_print_hex32(samples[0]);
+    uart_print(" med:");
+    uart_print_hex32(samples[n / 2]);
+    uart_print(" p99:");
+    uart_print_hex32(samples[n - 1 - n / 100]);
+    uart_print("\n\r");
+}
+
+static void vbench_irq_handler(int irq, void *regs, void *pdata)
+{
+    _irq_latency = read_pmccntr() - _spin;
+    _irq_count++;
+}
+
+static void vbench_virq(void)
+{
+    uint32_t i, count;
+
+    gic_set_irq_handler(VBENCH_VTIMER_IRQ, vbench_irq_handler, 0);
+    for (i = 0; i < VBENCH_IRQ_ITERATIONS; i++) {
+        count = _irq_count;
+        while (_irq_count == count)
+            _spin = read_pmccntr();
+        _samples[i] = _irq_latency;
+        _samples_eoi[i] = gic_eoi_cycles();
+    }
+    gic_set_irq_handler(VBENCH_VTIMER_IRQ, 0, 0);
+
+    vbench_report("virq", _samples, VBENCH_IRQ_ITERATIONS);
+    vbench_report("veoi", _samples_eoi, VBENCH_IRQ_ITERATIONS);
+}
+
+static void vbench_ipi(volatile uint32_t *gicd)
+{
+    uint32_t i, count;
+
+    gic_set_irq_handler(VBENCH_SGI, vbench_irq_handler, 0);
+    for (i = 0; i < VBENCH_IRQ_ITERATIONS; i++) {
+        count = _irq_count;
+        _spin = read_pmccntr();
+        gicd[GICD_SGIR] = (GICD_SGIR_FILTER_SELF << GICD_SGIR_FILTER_SHIFT)
+                | VBENCH_SGI;
+        while (_irq_count == count)
+            ;
+        _samples[i] = _irq_latency;
+    }
+    gic_set_irq_handler(VBENCH_SGI, 0, 0);
+
+    vbench_report("ipi", _samples, VBENCH_IRQ_ITERATIONS);
+}
+
+void test_vbench()
+{
+    volatile uint32_t *gicd = gic_gicd_baseaddr();
+    uint32_t v;
+
+    uart_print("vbench: Starting test..., gicd:");
+    uart_print_hex32((uint32_t) gicd);
+    uart_print("\n\r");
+    vbench_pmu_init();
+
+    VBENCH_MEASURE(_samples, VBENCH_ITERATIONS, );
+    vbench_report("base", _samples, VBENCH_ITERATIONS);
+
+    VBENCH_MEASURE(_samples, VBENCH_ITERATIONS, vbench_hvc_ping());
+    vbench_report("hvc", _samples, VBENCH_ITERATIONS);
+
+    VBENCH_MEASURE_EVENT(_samples, VBENCH_ITERATIONS, vbench_hvc_ping());
+    vbench_report("hvc.l1i", _samples, VBENCH_ITERATIONS);
+
+    VBENCH_MEASURE(_samples, VBENCH_ITERATIONS, v = gicd[GICD_TYPER]);
+    vbench_report("gicd_read", _samples, VBENCH_ITERATIONS);
+
+    VBENCH_MEASURE(_samples, VBENCH_ITERATIONS,
+            gicd[GICD_ISENABLER] = (1u << VBENCH_VTIMER_IRQ));
+    vbench_report("gicd_write", _samples, VBENCH_ITERATIONS);
+
+    VBENCH_MEASURE(_samples, VBENCH_ITERATIONS, v = vbench_read_actlr());
+    vbench_report("cp15", _samples, VBENCH_ITERATIONS);
+
+    vbench_virq();
+    vbench_ipi(gicd);
+
+    VBENCH_MEASURE(_samples, VBENCH_SWITCH_ITERATIONS, vbench_hvc_yield());
+    vbench_report("yield", _samples, VBENCH_SWITCH_ITERATIONS);
+
+    VBENCH_MEASURE_EVENT(_samples, VBENCH_SWITCH_ITERATIONS,
+            vbench_hvc_yield());
+    vbench_report("yield.l1i", _samples, VBENCH_SWITCH_ITERATIONS);
+
+    (void) v;
+    uart_print("vbench: End\n\r");
+}
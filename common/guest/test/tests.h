@@ -2,5 +2,9 @@
 #define __TESTS_H__
 
 void test_vdev_sample();
+void test_balloon();
+void test_vbench();
+void test_trace();
+void test_stats();
 
 #endif
@@ -119,6 +119,10 @@
                                 " mcr     p15, 4, %0, c1, c0, 0\n\t" \
                                 : : "r" ((val)) : "memory", "cc")
 
+#define read_actlr()            ({ uint32_t rval; asm volatile(\
+                                " mrc     p15, 0, %0, c1, c0, 1\n\t" \
+                                : "=r" (rval) : : "memory", "cc"); rval; })
+
 #define read_sctlr()           ({ uint32_t rval; asm volatile(\
                                 " mrc     p15, 0, %0, c1, c0, 0\n\t" \
                                 : "=r" (rval) : : "memory", "cc"); rval; })
@@ -163,6 +167,46 @@
                                 " mcr     p15, 4, %0, c1, c1, 0\n\t" \
                                 : : "r" ((val)) : "memory", "cc")
 
+/* HCPTR: traps of the Non-secure accesses to CP10/CP11(VFP, Advanced SIMD) */
+#define HCPTR_TCP10     (1 << 10)
+#define HCPTR_TCP11     (1 << 11)
+#define HCPTR_TASE      (1 << 15)
+#define HCPTR_TVFP      (HCPTR_TCP10 | HCPTR_TCP11)
+
+#define read_hcptr()            ({ uint32_t rval; asm volatile(\
+                                " mrc     p15, 4, %0, c1, c1, 2\n\t" \
+                                : "=r" (rval) : : "memory", "cc"); rval; })
+
+#define write_hcptr(val)        asm volatile(\
+                                " mcr     p15, 4, %0, c1, c1, 2\n\t" \
+                                : : "r" ((val)) : "memory", "cc")
+
+/*
+ * VFP system registers. Not trapped by HCPTR in Hyp mode once TCP10/TCP11
+ * are clear, FPEXC.EN must be set for anything else than FPEXC.
+ */
+#define FPEXC_EN        (1 << 30)
+
+#define read_fpexc()            ({ uint32_t rval; asm volatile(\
+                                " .fpu    neon\n\t" \
+                                " vmrs    %0, fpexc\n\t" \
+                                : "=r" (rval) : : "memory", "cc"); rval; })
+
+#define write_fpexc(val)        asm volatile(\
+                                " .fpu    neon\n\t" \
+                                " vmsr    fpexc, %0\n\t" \
+                                : : "r" ((val)) : "memory", "cc")
+
+#define read_fpscr()            ({ uint32_t rval; asm volatile(\
+                                " .fpu    neon\n\t" \
+                                " vmrs    %0, fpscr\n\t" \
+                                : "=r" (rval) : : "memory", "cc"); rval; })
+
+#define write_fpscr(val)        asm volatile(\
+                                " .fpu    neon\n\t" \
+                                " vmsr    fpscr, %0\n\t" \
+                                : : "r" ((val)) : "memory", "cc")
+
 #define read_midr()              ({ uint32_t rval; asm volatile(\
                                 " mrc     p15, 0, %0, c0, c0, 0\n\t" \
                                 : "=r" (rval) : : "memory", "cc"); rval; })
@@ -171,6 +215,13 @@
                                 " mrc     p15, 0, %0, c0, c0, 5\n\t" \
                                 : "=r" (rval) : : "memory", "cc"); rval; })
 
+#define read_htpidr()           ({ uint32_t rval; asm volatile(\
+                                " mrc     p15, 4, %0, c13, c0, 2\n\t" \
+                                : "=r" (rval) : : "memory", "cc"); rval; })
+#define write_htpidr(val)       asm volatile(\
+                                " mcr     p15, 4, %0, c13, c0, 2\n\t" \
+                                : : "r" ((val)) : "memory", "cc")
+
 /* Generic Timer */
 
 #define read_cntfrq()           ({ uint32_t rval; asm volatile(\
@@ -319,12 +370,93 @@
                                 " mcr     p15, 4, %0, c6, c0, 4\n\t" \
                                 : : "r" ((val)) : "memory", "cc")
 
+/* Address translation: stage 1 and 2 of a Non-secure PL1 read/write */
+#define PAR_F           (1 << 0)
+#define PAR_PA_MASK     0xFFFFF000
+
+#define write_ats12nsopr(va)    asm volatile(\
+                                " mcr     p15, 4, %0, c7, c8, 4\n\t" \
+                                : : "r" ((va)) : "memory", "cc")
+
+#define write_ats12nsopw(va)    asm volatile(\
+                                " mcr     p15, 4, %0, c7, c8, 5\n\t" \
+                                : : "r" ((va)) : "memory", "cc")
+
+#define read_par()              ({ uint32_t v1, v2; asm volatile(\
+                                " mrrc     p15, 0, %0, %1, c7\n\t" \
+                                : "=r" (v1), "=r" (v2) : : "memory", "cc"); \
+                                (((uint64_t)v2 << 32) + (uint64_t)v1); })
+
+#define write_par(val)          asm volatile(\
+                                " mcrr     p15, 0, %0, %1, c7\n\t" \
+                                : : "r" ((uint32_t)(val)), \
+                                "r" ((uint32_t)((val) >> 32)) \
+                                : "memory", "cc")
+
+/* Performance Monitors */
+#define PMCR_E          (1 << 0)
+#define PMCR_P          (1 << 1)
+#define PMCR_C          (1 << 2)
+#define PMCNTEN_C       (1u << 31)
+#define PMCNTEN_P0      (1 << 0)
+#define PMSELR_CYCLE    0x1F
+#define PMSELR_P0       0x0
+#define PMCCFILTR_NSH   (1 << 27)
+/* PMXEVTYPER: count in Hyp mode too, and the event */
+#define PMXEVTYPER_NSH  (1 << 27)
+#define PMU_EVENT_L1I_CACHE_REFILL  0x01
+
+#define read_pmcr()             ({ uint32_t rval; asm volatile(\
+                                " mrc     p15, 0, %0, c9, c12, 0\n\t" \
+                                : "=r" (rval) : : "memory", "cc"); rval; })
+
+#define write_pmcr(val)         asm volatile(\
+                                " mcr     p15, 0, %0, c9, c12, 0\n\t" \
+                                : : "r" ((val)) : "memory", "cc")
+
+#define write_pmcntenset(val)   asm volatile(\
+                                " mcr     p15, 0, %0, c9, c12, 1\n\t" \
+                                : : "r" ((val)) : "memory", "cc")
+
+#define write_pmselr(val)       asm volatile(\
+                                " mcr     p15, 0, %0, c9, c12, 5\n\t" \
+                                : : "r" ((val)) : "memory", "cc")
+
+#define write_pmxevtyper(val)   asm volatile(\
+                                " mcr     p15, 0, %0, c9, c13, 1\n\t" \
+                                : : "r" ((val)) : "memory", "cc")
+
+#define read_pmccntr()          ({ uint32_t rval; asm volatile(\
+                                " mrc     p15, 0, %0, c9, c13, 0\n\t" \
+                                : "=r" (rval) : : "memory", "cc"); rval; })
+
+#define read_pmxevcntr()        ({ uint32_t rval; asm volatile(\
+                                " mrc     p15, 0, %0, c9, c13, 2\n\t" \
+                                : "=r" (rval) : : "memory", "cc"); rval; })
+
+/* Cache maintenance operations */
+
+/* Clean and invalidate data cache line by MVA to PoC */
+#define clean_invalidate_dcache_mva(va)  asm volatile(\
+                " mcr     p15, 0, %0, c7, c14, 1\n\t" \
+                : : "r" ((va)) : "memory", "cc")
+
 /* TLB maintenance operations */
 
 /* Invalidate entire unified TLB */
 #define invalidate_unified_tlb(val)      asm volatile(\
                 " mcr     p15, 0, %0, c8, c7, 0\n\t" \
                 : : "r" ((val)) : "memory", "cc")
+
+/* Invalidate entire Non-secure Non-Hyp unified TLB, for all VMIDs */
+#define invalidate_tlb_allnsnh(val)      asm volatile(\
+                " mcr     p15, 4, %0, c8, c7, 4\n\t" \
+                : : "r" ((val)) : "memory", "cc")
+
+/* Invalidate stage 2 unified TLB entries by IPA, for the VMID of VTTBR */
+#define invalidate_tlb_ipas2(ipa)        asm volatile(\
+                " mcr     p15, 4, %0, c8, c4, 1\n\t" \
+                : : "r" ((uint32_t) (ipa) >> 12) : "memory", "cc")
 #endif
 
 
@@ -0,0 +1,133 @@
+#ifndef __ATOMIC_H__
+#define __ATOMIC_H__
+#include "arch_types.h"
+
+/*
+ * Atomic operations on 32-bit words with the exclusive monitor of ARMv7
+ * (LDREX/STREX), and the barriers and IRQ masking the locks of spinlock.h
+ * are built on.
+ *
+ * The read-modify-write operations are not barriers: the locks order the
+ * accesses of their critical section with smp_mb(). A plain aligned word
+ * load or store is atomic, atomic_read()/atomic_set() only keep the
+ * compiler from caching or tearing it.
+ */
+
+#define smp_mb()        asm volatile("dmb ish" : : : "memory")
+#define cpu_relax()     asm volatile("" : : : "memory")
+#define wfe()           asm volatile("wfe" : : : "memory")
+/* Publishes the preceding stores before waking up the waiters */
+#define sev()           asm volatile("dsb ishst\n\tsev" : : : "memory")
+
+#define atomic_read(ptr)        (*(volatile uint32_t *) (ptr))
+#define atomic_set(ptr, val)    (*(volatile uint32_t *) (ptr) = (val))
+
+/**
+ * @brief Adds \a val to \a *ptr.
+ * @return The new value.
+ */
+static inline uint32_t atomic_add_return(volatile uint32_t *ptr, uint32_t val)
+{
+    uint32_t result, failed;
+
+    asm volatile(
+            "1: ldrex   %0, [%2]\n\t"
+            "   add     %0, %0, %3\n\t"
+            "   strex   %1, %0, [%2]\n\t"
+            "   teq     %1, #0\n\t"
+            "   bne     1b"
+            : "=&r" (result), "=&r" (failed)
+            : "r" (ptr), "Ir" (val)
+            : "memory", "cc");
+
+    return result;
+}
+
+/**
+ * @brief Stores \a new to \a *ptr if it holds \a old.
+ * @return The value \a *ptr held, \a old on success.
+ */
+static inline uint32_t atomic_cmpxchg(volatile uint32_t *ptr, uint32_t old,
+                uint32_t new)
+{
+    uint32_t prev, failed;
+
+    do {
+        asm volatile(
+                "   ldrex   %1, [%2]\n\t"
+                "   mov     %0, #0\n\t"
+                "   teq     %1, %3\n\t"
+                "   strexeq %0, %4, [%2]"
+                : "=&r" (failed), "=&r" (prev)
+                : "r" (ptr), "Ir" (old), "r" (new)
+                : "memory", "cc");
+    } while (failed);
+
+    return prev;
+}
+
+/**
+ * @brief Sets the bits \a mask of \a *ptr.
+ * @return The value before.
+ */
+static inline uint32_t atomic_set_mask(volatile uint32_t *ptr, uint32_t mask)
+{
+    uint32_t prev, tmp, failed;
+
+    asm volatile(
+            "1: ldrex   %0, [%3]\n\t"
+            "   orr     %1, %0, %4\n\t"
+            "   strex   %2, %1, [%3]\n\t"
+            "   teq     %2, #0\n\t"
+            "   bne     1b"
+            : "=&r" (prev), "=&r" (tmp), "=&r" (failed)
+            : "r" (ptr), "Ir" (mask)
+            : "memory", "cc");
+
+    return prev;
+}
+
+/**
+ * @brief Clears the bits \a mask of \a *ptr.
+ * @return The value before.
+ */
+static inline uint32_t atomic_clear_mask(volatile uint32_t *ptr,
+                uint32_t mask)
+{
+    uint32_t prev, tmp, failed;
+
+    asm volatile(
+            "1: ldrex   %0, [%3]\n\t"
+            "   bic     %1, %0, %4\n\t"
+            "   strex   %2, %1, [%3]\n\t"
+            "   teq     %2, #0\n\t"
+            "   bne     1b"
+            : "=&r" (prev), "=&r" (tmp), "=&r" (failed)
+            : "r" (ptr), "Ir" (mask)
+            : "memory", "cc");
+
+    return prev;
+}
+
+/**
+ * @brief Masks the IRQs of the current CPU.
+ * @return The CPSR to give back to irq_restore().
+ */
+static inline uint32_t irq_save(void)
+{
+    uint32_t flags;
+
+    asm volatile(
+            "   mrs     %0, cpsr\n\t"
+            "   cpsid   i"
+            : "=r" (flags) : : "memory", "cc");
+
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags)
+{
+    asm volatile("msr cpsr_c, %0" : : "r" (flags) : "memory", "cc");
+}
+
+#endif
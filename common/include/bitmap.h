@@ -0,0 +1,53 @@
+#ifndef __BITMAP_H__
+#define __BITMAP_H__
+#include "arch_types.h"
+#include <atomic.h>
+
+/*
+ * Bitmaps of 32-bit words that several CPUs update concurrently. Each
+ * update is an atomic read-modify-write of the word of the bit, reading a
+ * bit takes no lock.
+ */
+
+#define BITMAP_BITS_PER_WORD    32
+#define BITMAP_WORDS(bits) \
+    (((bits) + BITMAP_BITS_PER_WORD - 1) / BITMAP_BITS_PER_WORD)
+#define DECLARE_BITMAP(name, bits)  uint32_t name[BITMAP_WORDS(bits)]
+
+#define BITMAP_WORD(nr)         ((nr) / BITMAP_BITS_PER_WORD)
+#define BITMAP_MASK(nr)         (1u << ((nr) % BITMAP_BITS_PER_WORD))
+
+static inline void bitmap_set(volatile uint32_t *map, uint32_t nr)
+{
+    atomic_set_mask(&map[BITMAP_WORD(nr)], BITMAP_MASK(nr));
+}
+
+static inline void bitmap_clear(volatile uint32_t *map, uint32_t nr)
+{
+    atomic_clear_mask(&map[BITMAP_WORD(nr)], BITMAP_MASK(nr));
+}
+
+/**
+ * @return The value of the bit before it was set.
+ */
+static inline int bitmap_test_and_set(volatile uint32_t *map, uint32_t nr)
+{
+    return !!(atomic_set_mask(&map[BITMAP_WORD(nr)], BITMAP_MASK(nr)) &
+            BITMAP_MASK(nr));
+}
+
+/**
+ * @return The value of the bit before it was cleared.
+ */
+static inline int bitmap_test_and_clear(volatile uint32_t *map, uint32_t nr)
+{
+    return !!(atomic_clear_mask(&map[BITMAP_WORD(nr)], BITMAP_MASK(nr)) &
+            BITMAP_MASK(nr));
+}
+
+static inline int bitmap_test(const volatile uint32_t *map, uint32_t nr)
+{
+    return !!(map[BITMAP_WORD(nr)] & BITMAP_MASK(nr));
+}
+
+#endif
@@ -20,6 +20,7 @@
 #define GICD_IPRIORITYR    (0x400/4)
 #define GICD_ITARGETSR    (0x800/4)
 #define GICD_ICFGR    (0xC00/4)
+#define GICD_SGIR    (0xF00/4)
 
 /* CPU Interface */
 #define GICC_CTLR    (0x0000/4)
@@ -46,6 +47,14 @@
 #define GICD_TYPE_LINES_MASK    0x01f
 #define GICD_TYPE_CPUS_MASK    0x0e0
 #define GICD_TYPE_CPUS_SHIFT    5
+#define GICD_SGIR_SGIINTID_MASK     0xF
+#define GICD_SGIR_TARGET_SHIFT      16
+#define GICD_SGIR_TARGET_MASK       (0xFF << GICD_SGIR_TARGET_SHIFT)
+#define GICD_SGIR_FILTER_SHIFT      24
+#define GICD_SGIR_FILTER_MASK       (0x3 << GICD_SGIR_FILTER_SHIFT)
+#define GICD_SGIR_FILTER_LIST       0   /* CPUTargetList */
+#define GICD_SGIR_FILTER_OTHERS     1   /* All but the requesting CPU */
+#define GICD_SGIR_FILTER_SELF       2   /* The requesting CPU only */
 
 /* CPU Interface Register Fields */
 #define GICC_CTL_ENABLE     0x1
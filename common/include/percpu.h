@@ -0,0 +1,60 @@
+#ifndef __PERCPU_H__
+#define __PERCPU_H__
+#include "arch_types.h"
+#include <k-hypervisor-config.h>
+#include <armv7_p15.h>
+
+/*
+ * Per-CPU variables.
+ *
+ * DEFINE_PER_CPU() places a variable in the .percpu section, which the
+ * linker script follows with room for a copy of the section per secondary
+ * CPU. The section itself is the area of CPU 0. A CPU finds its area at the
+ * offset held in HTPIDR, so this_cpu() is a register read and an add, with
+ * no lock and no CPU ID lookup. TPIDRPRW would do as well but belongs to
+ * the guest kernel, HTPIDR is the thread ID register of Hyp mode.
+ *
+ * percpu_init() copies the initial values of the section to the area of
+ * every CPU. The boot CPU calls it before anything touches a per-CPU
+ * variable, each CPU then calls percpu_cpu_init() with its ID.
+ */
+
+#define PERCPU_ALIGN    64
+
+#define DEFINE_PER_CPU(type, name) \
+    __attribute__((section(".percpu"))) type per_cpu__##name
+#define DECLARE_PER_CPU(type, name) extern type per_cpu__##name
+
+extern uint8_t __percpu_start[];
+extern uint8_t __percpu_end[];
+
+#define percpu_size()           ((uint32_t) (__percpu_end - __percpu_start))
+#define percpu_offset(cpu)      ((cpu) * percpu_size())
+
+#define per_cpu_ptr(name, cpu) \
+    ((__typeof__(per_cpu__##name) *) \
+     ((uint8_t *) &per_cpu__##name + percpu_offset(cpu)))
+#define this_cpu_ptr(name) \
+    ((__typeof__(per_cpu__##name) *) \
+     ((uint8_t *) &per_cpu__##name + read_htpidr()))
+
+#define per_cpu(name, cpu)      (*per_cpu_ptr(name, cpu))
+#define this_cpu(name)          (*this_cpu_ptr(name))
+
+static inline void percpu_init(void)
+{
+    uint32_t size = percpu_size();
+    uint32_t cpu, i;
+
+    for (cpu = 1; cpu < CFG_NUMBER_OF_CPUS; cpu++) {
+        for (i = 0; i < size; i++)
+            __percpu_start[cpu * size + i] = __percpu_start[i];
+    }
+}
+
+static inline void percpu_cpu_init(uint32_t cpu)
+{
+    write_htpidr(percpu_offset(cpu));
+}
+
+#endif
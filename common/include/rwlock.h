@@ -0,0 +1,71 @@
+#ifndef __RWLOCK_H__
+#define __RWLOCK_H__
+#include "arch_types.h"
+#include <atomic.h>
+
+/*
+ * Reader-writer locks for read-mostly tables(virtual device registrations,
+ * interrupt routing).
+ *
+ * The lock word holds the number of readers, and RWLOCK_WRITER while a
+ * writer holds it. The lock is not fair: the tables it protects are written
+ * rarely, at initialization or on a guest reconfiguration. The hot read
+ * paths of these tables(trap dispatch, interrupt injection) take no lock at
+ * all: the writers publish each entry with a single aligned store after
+ * filling it in, the read side is only for readers that need a consistent
+ * view of several entries.
+ */
+
+#define RWLOCK_WRITER       0x80000000
+
+struct rwlock {
+    volatile uint32_t lock;
+};
+
+#define RWLOCK_INIT         { 0 }
+#define DEFINE_RWLOCK(name) struct rwlock name = RWLOCK_INIT
+
+static inline void rwlock_init(struct rwlock *rw)
+{
+    atomic_set(&rw->lock, 0);
+}
+
+static inline void read_lock(struct rwlock *rw)
+{
+    uint32_t lock;
+
+    for (;;) {
+        lock = atomic_read(&rw->lock);
+        if (lock & RWLOCK_WRITER)
+            wfe();
+        else if (atomic_cmpxchg(&rw->lock, lock, lock + 1) == lock)
+            break;
+        else
+            cpu_relax();
+    }
+    smp_mb();
+}
+
+static inline void read_unlock(struct rwlock *rw)
+{
+    smp_mb();
+    /* The last reader wakes up the writers */
+    if (!atomic_add_return(&rw->lock, -1))
+        sev();
+}
+
+static inline void write_lock(struct rwlock *rw)
+{
+    while (atomic_cmpxchg(&rw->lock, 0, RWLOCK_WRITER))
+        wfe();
+    smp_mb();
+}
+
+static inline void write_unlock(struct rwlock *rw)
+{
+    smp_mb();
+    atomic_set(&rw->lock, 0);
+    sev();
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __SECTIONS_H__
+#define __SECTIONS_H__
+#include "arch_types.h"
+
+/*
+ * Code and data placement, laid out by the linker script(model.lds.S).
+ *
+ * __hot:  trap, switch and IRQ path. Packed in one cache-line aligned
+ *         region of .text, between __hot_text_start and __hot_text_end.
+ * __cold: error and dump paths, after the rest of .text.
+ * __init, __initdata: code and data used only until the first guest runs.
+ *         The .init section is given to the heap by memory_free_init(),
+ *         nothing may call or read them after it.
+ */
+
+/* L1 and L2 line of the Cortex-A15 */
+#define CACHE_LINE_SIZE         64
+
+#define __hot           __attribute__((__hot__, __section__(".text.hot")))
+#define __cold          __attribute__((__cold__, __section__(".text.cold")))
+#define __init          __attribute__((__cold__, __section__(".init.text")))
+#define __initdata      __attribute__((__section__(".init.data")))
+
+/* Keeps the data of each guest off the cache lines of the other ones */
+#define __cacheline_aligned     __attribute__((__aligned__(CACHE_LINE_SIZE)))
+
+extern uint8_t __text_start[], __text_end[];
+extern uint8_t __hot_text_start[], __hot_text_end[];
+extern uint8_t __init_start[], __init_end[];
+
+#endif
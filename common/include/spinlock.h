@@ -0,0 +1,100 @@
+#ifndef __SPINLOCK_H__
+#define __SPINLOCK_H__
+#include "arch_types.h"
+#include <atomic.h>
+
+/*
+ * Ticket spinlocks.
+ *
+ * A CPU takes the next ticket with one atomic add and waits until the owner
+ * field reaches it, so the lock is granted in arrival order. Only the holder
+ * writes the owner field. The waiters sleep in WFE, the unlock wakes them
+ * up with SEV.
+ *
+ * A lock also taken by an interrupt handler must be taken with its IRQs
+ * masked: spin_lock_irqsave() and spin_unlock_irqrestore().
+ */
+
+struct spinlock {
+    union {
+        volatile uint32_t slock;
+        struct {
+            volatile uint16_t owner;
+            volatile uint16_t next;
+        } tickets;
+    } u;
+};
+
+#define SPINLOCK_TICKET_SHIFT   16
+#define SPINLOCK_INIT           { { 0 } }
+#define DEFINE_SPINLOCK(name)   struct spinlock name = SPINLOCK_INIT
+
+static inline void spin_lock_init(struct spinlock *lock)
+{
+    atomic_set(&lock->u.slock, 0);
+}
+
+static inline void spin_lock(struct spinlock *lock)
+{
+    uint16_t ticket;
+
+    ticket = (atomic_add_return(&lock->u.slock, 1 << SPINLOCK_TICKET_SHIFT)
+            >> SPINLOCK_TICKET_SHIFT) - 1;
+    while (lock->u.tickets.owner != ticket)
+        wfe();
+    smp_mb();
+}
+
+/**
+ * @brief Takes the lock if nobody holds or waits for it.
+ * @return 1 if taken, 0 otherwise.
+ */
+static inline int spin_trylock(struct spinlock *lock)
+{
+    uint32_t slock = atomic_read(&lock->u.slock);
+
+    if ((slock >> SPINLOCK_TICKET_SHIFT) != (slock & 0xFFFF))
+        return 0;
+    if (atomic_cmpxchg(&lock->u.slock, slock,
+                slock + (1 << SPINLOCK_TICKET_SHIFT)) != slock)
+        return 0;
+    smp_mb();
+
+    return 1;
+}
+
+static inline void spin_unlock(struct spinlock *lock)
+{
+    smp_mb();
+    lock->u.tickets.owner++;
+    sev();
+}
+
+static inline int spin_is_locked(struct spinlock *lock)
+{
+    uint32_t slock = atomic_read(&lock->u.slock);
+
+    return (slock >> SPINLOCK_TICKET_SHIFT) != (slock & 0xFFFF);
+}
+
+/**
+ * @brief Masks the IRQs of the current CPU and takes the lock.
+ * @return The IRQ state to give back to spin_unlock_irqrestore().
+ */
+static inline uint32_t spin_lock_irqsave(struct spinlock *lock)
+{
+    uint32_t flags = irq_save();
+
+    spin_lock(lock);
+
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(struct spinlock *lock,
+                uint32_t flags)
+{
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __STATS_PAGE_H__
+#define __STATS_PAGE_H__
+#include "arch_types.h"
+#include <atomic.h>
+
+/*
+ * Statistics page of the hypervisor, as a guest sees it.
+ *
+ * Each guest has its own page, mapped read-only from the hypervisor's
+ * CFG_STATS_IPA with normal write-back cacheable memory attributes: the
+ * counters of the system and those of the guest, none of another guest.
+ * The hypervisor cleans what it updates to the point of coherency, so a
+ * monitoring agent samples it without any hypercall, with any memory
+ * attributes.
+ *
+ * The hypervisor updates the page while the guest is out, and on each
+ * return to the guest. sequence is odd during an update and changes at
+ * each return: stats_page_read() retries until it copies the page between
+ * the same even sequence.
+ */
+
+#define STATS_MAGIC             0x4154534B  /* "KSTA" */
+#define STATS_VERSION           1
+#define STATS_PAGE_SIZE         0x1000
+/* HSR.EC is 6 bits */
+#define STATS_NUM_EC            64
+
+/* Counters of the whole system */
+struct stats_global {
+    /* Callbacks of the hypervisor timers run */
+    uint32_t timer_expiries;
+    /* Traps and virqs injected, all guests */
+    uint32_t traps;
+    uint32_t virqs;
+    uint32_t reserved;
+};
+
+/* Counters of the guest the page is mapped in, times in CNTPCT ticks */
+struct stats_guest {
+    /* Running, in the hypervisor for it, runnable while another ran */
+    uint64_t run;
+    uint64_t hyp;
+    uint64_t wait;
+    uint32_t switches;
+    uint32_t virqs;
+    /* Traps by HSR.EC */
+    uint32_t traps[STATS_NUM_EC];
+};
+
+struct stats_page {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t vmid;
+    volatile uint32_t sequence;
+    struct stats_global global;
+    struct stats_guest guest;
+};
+
+/**
+ * @brief Copies the statistics page \a page.
+ *
+ * @return 0 on success, -1 if the hypervisor updated the page during the
+ *         copy: the caller retries.
+ */
+static inline int stats_page_read(volatile struct stats_page *page,
+                struct stats_page *copy)
+{
+    uint32_t sequence = page->sequence;
+
+    if (sequence & 1)
+        return -1;
+
+    smp_mb();
+    *copy = *((struct stats_page *) page);
+    smp_mb();
+
+    return page->sequence == sequence ? 0 : -1;
+}
+
+#endif
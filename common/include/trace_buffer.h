@@ -0,0 +1,117 @@
+#ifndef __TRACE_BUFFER_H__
+#define __TRACE_BUFFER_H__
+#include "arch_types.h"
+#include <atomic.h>
+
+/*
+ * Binary event trace of the hypervisor, as a reader sees it.
+ *
+ * Each physical CPU writes its own buffer: a header page(struct
+ * trace_header) followed by TRACE_RECORD_PAGES pages of records, used as a
+ * ring that overwrites the oldest records. The buffers are mapped read-only
+ * in the control guest, one after the other, from the hypervisor's
+ * CFG_TRACE_IPA, with normal write-back cacheable memory attributes. The
+ * hypervisor cleans the record and then the head to the point of coherency
+ * after each event, so the guest reads them without any hypercall, with
+ * any memory attributes.
+ *
+ * Record n goes to slot n % capacity. The hypervisor marks the slot busy,
+ * fills it in, stores n to its seq field and then head = n + 1. A reader
+ * copies a record with trace_buffer_read(), which rejects a record that
+ * was being written or overwritten during the copy.
+ */
+
+#define TRACE_MAGIC             0x4352544B  /* "KTRC" */
+#define TRACE_VERSION           1
+#define TRACE_PAGE_SIZE         0x1000
+#define TRACE_SEQ_BUSY          0xFFFFFFFF
+
+enum trace_event {
+    /* arg0: guest switched out, arg1: guest switched in */
+    TRACE_EVENT_SWITCH = 1,
+    /* arg0: HSR.EC, arg1: HSR.ISS, arg2: faulting IPA */
+    TRACE_EVENT_TRAP,
+    /* arg0: virq, arg1: pirq, arg2: target guest, bit 8 set for a hw virq */
+    TRACE_EVENT_VIRQ_INJECT,
+    /* arg0: virqs moved to the List Registers, arg1: their guest */
+    TRACE_EVENT_VIRQ_FLUSH,
+    /* arg0: List Register, arg1: pirq deactivated */
+    TRACE_EVENT_VIRQ_EOI,
+    /* arg0: timer index, arg1: interval in us */
+    TRACE_EVENT_TIMER,
+    /* arg0: IPA, arg1: value, arg2: 1 for a write */
+    TRACE_EVENT_VDEV,
+    TRACE_EVENT_MAX
+};
+
+#define TRACE_EVENTS_ALL        (((1u << TRACE_EVENT_MAX) - 1) & ~1u)
+
+struct trace_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t cpu;
+    /* Records the ring holds, a power of 2 */
+    uint32_t capacity;
+    /* Events traced, 1 << enum trace_event */
+    uint32_t mask;
+    /* Records written so far */
+    volatile uint32_t head;
+};
+
+struct trace_record {
+    volatile uint32_t seq;
+    uint16_t event;
+    uint8_t vmid;
+    uint8_t cpu;
+    /* CNTPCT */
+    uint64_t time;
+    uint32_t arg0;
+    uint32_t arg1;
+    uint32_t arg2;
+    uint32_t reserved;
+};
+
+#define trace_buffer_size(pages)    (((pages) + 1) * TRACE_PAGE_SIZE)
+#define trace_buffer_capacity(pages) \
+    ((pages) * TRACE_PAGE_SIZE / sizeof(struct trace_record))
+#define trace_buffer_records(header) \
+    ((volatile struct trace_record *) \
+     ((uint8_t *) (header) + TRACE_PAGE_SIZE))
+
+/**
+ * @brief Copies the record \a seq of the buffer \a header.
+ *
+ * @return 0 on success, 1 if not written yet, -1 if overwritten: the
+ *         reader lost the records from \a seq to head - capacity.
+ */
+static inline int trace_buffer_read(volatile struct trace_header *header,
+                uint32_t seq, struct trace_record *record)
+{
+    volatile struct trace_record *slot;
+    uint32_t head = header->head;
+
+    if ((int32_t) (head - seq) <= 0)
+        return 1;
+    if (head - seq > header->capacity)
+        return -1;
+
+    smp_mb();
+    slot = &trace_buffer_records(header)[seq & (header->capacity - 1)];
+    if (slot->seq != seq)
+        return -1;
+    record->seq = seq;
+    record->event = slot->event;
+    record->vmid = slot->vmid;
+    record->cpu = slot->cpu;
+    record->time = slot->time;
+    record->arg0 = slot->arg0;
+    record->arg1 = slot->arg1;
+    record->arg2 = slot->arg2;
+    record->reserved = 0;
+    smp_mb();
+
+    return slot->seq == seq ? 0 : -1;
+}
+
+#endif
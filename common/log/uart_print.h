@@ -1,6 +1,7 @@
 #ifndef __UART_PRINT_H__
 #define __UART_PRINT_H__
 #include "arch_types.h"
+#include "hvmm_types.h"
 
 /** @brief Writes a character to the uart.
  *  @param v Character for print.
@@ -44,6 +45,25 @@ void uart_gets(char *s, int max_column);
  */
 void uart_init(void);
 
+/** @brief Switches the console to interrupt-driven transmit.
+ *
+ *  Characters are queued to a ring drained by the UART TX interrupt,
+ *  requested with interrupt_request(): printing only waits for the line
+ *  when the ring is full. Until then, and after uart_console_sync(),
+ *  the console busy-waits on the TX FIFO.
+ *  @return HVMM_STATUS_BUSY if a guest owns the interrupt of the UART.
+ */
+hvmm_status_t uart_console_init(void);
+
+/** @brief Transmits the queued characters, busy-waiting on the FIFO.
+ */
+void uart_console_flush(void);
+
+/** @brief Flushes and goes back to the synchronous console for good,
+ *         to print before a panic.
+ */
+void uart_console_sync(void);
+
 /** @brief   Checks whether there is a data or not in the FIFO
  *  @return  There is a data in the FIFO then returns 1, otherwise returns 0.
  */
@@ -0,0 +1,145 @@
+#include <k-hypervisor-config.h>
+#include <boot_profile.h>
+#include <armv7_p15.h>
+#include <log/print.h>
+#include <log/uart_print.h>
+#include <sections.h>
+
+#define BOOT_NAME_WIDTH     20
+#define BOOT_TIME_WIDTH     10
+
+struct boot_phase_record {
+    const char *name;
+    uint32_t depth;
+    uint32_t time;
+};
+
+struct boot_log_record {
+    const char *label;
+    uint32_t value;
+};
+
+static struct boot_phase_record _boot_phases[BOOT_PHASE_MAX] __initdata;
+static uint32_t _boot_num_phases __initdata;
+static uint32_t _boot_phases_dropped __initdata;
+
+#ifdef CFG_BOOT_QUIET
+static struct boot_log_record _boot_logs[BOOT_LOG_MAX] __initdata;
+static uint32_t _boot_num_logs __initdata;
+static uint32_t _boot_logs_dropped __initdata;
+#endif
+
+/*
+ * The system counter runs from the reset and the boot takes far less than
+ * a wrap of its low word, the low word is enough for the durations.
+ */
+static void __init boot_record(const char *name, uint32_t depth)
+{
+    struct boot_phase_record *record;
+
+    if (_boot_num_phases == BOOT_PHASE_MAX) {
+        _boot_phases_dropped++;
+        return;
+    }
+    record = &_boot_phases[_boot_num_phases++];
+    record->name = name;
+    record->depth = depth;
+    record->time = (uint32_t) read_cntpct();
+}
+
+void __init boot_phase(const char *name)
+{
+    boot_record(name, 0);
+}
+
+void __init boot_subphase(const char *name)
+{
+    boot_record(name, 1);
+}
+
+void __init boot_log(const char *label, uint32_t value)
+{
+#ifdef CFG_BOOT_QUIET
+    if (_boot_num_logs == BOOT_LOG_MAX) {
+        _boot_logs_dropped++;
+        return;
+    }
+    _boot_logs[_boot_num_logs].label = label;
+    _boot_logs[_boot_num_logs].value = value;
+    _boot_num_logs++;
+#else
+    uart_print(label);
+    uart_print(":");
+    uart_print_hex32(value);
+    uart_print("\n\r");
+#endif
+}
+
+static void __init boot_print_pad(uint32_t len, uint32_t width)
+{
+    while (len++ < width)
+        printH("%c", ' ');
+}
+
+static void __init boot_print_name(const char *name, uint32_t depth)
+{
+    uint32_t len = depth * 2;
+
+    boot_print_pad(0, len);
+    printH("%s", name);
+    while (*name++)
+        len++;
+    boot_print_pad(len, BOOT_NAME_WIDTH);
+}
+
+static void __init boot_print_usec(uint32_t count)
+{
+    uint32_t usec = count / COUNT_PER_USEC;
+    uint32_t len = 1;
+    uint32_t v;
+
+    for (v = usec; v >= 10; v /= 10)
+        len++;
+    boot_print_pad(len, BOOT_TIME_WIDTH);
+    printH("%d", usec);
+}
+
+/* A phase ends where the next phase of its level or of an upper one starts */
+static uint32_t __init boot_phase_end(uint32_t index, uint32_t end)
+{
+    uint32_t i;
+
+    for (i = index + 1; i < _boot_num_phases; i++) {
+        if (_boot_phases[i].depth <= _boot_phases[index].depth)
+            return _boot_phases[i].time;
+    }
+
+    return end;
+}
+
+void __init boot_profile_print(void)
+{
+    uint32_t end = (uint32_t) read_cntpct();
+    uint32_t start = _boot_num_phases ? _boot_phases[0].time : end;
+    uint32_t i;
+
+    printH("[boot] phase               start(us)  time(us)\n");
+    for (i = 0; i < _boot_num_phases; i++) {
+        printH("[boot] ");
+        boot_print_name(_boot_phases[i].name, _boot_phases[i].depth);
+        boot_print_usec(_boot_phases[i].time);
+        boot_print_usec(boot_phase_end(i, end) - _boot_phases[i].time);
+        printH("\n");
+    }
+    if (_boot_phases_dropped)
+        printH("[boot] %d phases not recorded\n", _boot_phases_dropped);
+    printH("[boot] first guest %dus after reset, %dus in main_cpu_init\n",
+            end / COUNT_PER_USEC, (end - start) / COUNT_PER_USEC);
+
+#ifdef CFG_BOOT_QUIET
+    for (i = 0; i < _boot_num_logs; i++)
+        printH("[boot] %s:%x\n", _boot_logs[i].label, _boot_logs[i].value);
+    if (_boot_logs_dropped)
+        printH("[boot] %d records not logged\n", _boot_logs_dropped);
+#endif
+}
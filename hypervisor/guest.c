@@ -1,11 +1,17 @@
 #include <k-hypervisor-config.h>
 #include <guest.h>
+#include <armv7_p15.h>
+#include <smp.h>
+#include <percpu.h>
 #include <timer.h>
 #include <interrupt.h>
 #include <memory.h>
 #include <vdev.h>
 #include <log/print.h>
 #include <hvmm_trace.h>
+#include <trace.h>
+#include <stats.h>
+#include <sections.h>
 
 #define NUM_GUEST_CONTEXTS        NUM_GUESTS_STATIC
 
@@ -13,6 +19,8 @@
     (guest_first_vmid() <= vmid && guest_last_vmid() >= vmid)
 
 static struct guest_struct guests[NUM_GUEST_CONTEXTS];
+static struct guest_struct _guest_checkpoints[NUM_GUEST_CONTEXTS];
+static uint8_t _guest_checkpointed[NUM_GUEST_CONTEXTS];
 static int _current_guest_vmid = VMID_INVALID;
 static int _next_guest_vmid = VMID_INVALID;
 struct guest_struct *_current_guest;
@@ -20,8 +28,23 @@ struct guest_struct *_current_guest;
 /* further switch request will be ignored if set */
 static uint8_t _switch_locked;
 
+#define GUEST_AFFINITY_ALL  ((1u << CFG_NUMBER_OF_CPUS) - 1)
 
-static hvmm_status_t guest_save(struct guest_struct *guest,
+/* Physical CPUs each guest may run on */
+static uint8_t _guest_affinity[NUM_GUEST_CONTEXTS];
+
+static struct guest_time_stats _guest_time[NUM_GUEST_CONTEXTS];
+/* CNTPCT when each guest was switched out */
+static uint64_t _guest_switched_out[NUM_GUEST_CONTEXTS];
+/* CNTPCT at the last exception entry or return of each CPU */
+static DEFINE_PER_CPU(uint64_t, _time_mark);
+#ifdef CFG_GUEST_STEAL_TIME_IPA
+static uint32_t _steal_time[NUM_GUEST_CONTEXTS][1024]
+        __attribute((__aligned__(4096)));
+#endif
+
+
+static hvmm_status_t __hot guest_save(struct guest_struct *guest,
                         struct arch_regs *regs)
 {
     /* save the current guest's context */
@@ -32,7 +55,7 @@ static hvmm_status_t guest_save(struct guest_struct *guest,
     return HVMM_STATUS_UNKNOWN_ERROR;
 }
 
-static hvmm_status_t guest_restore(struct guest_struct *guest,
+static hvmm_status_t __hot guest_restore(struct guest_struct *guest,
                         struct arch_regs *regs)
 {
     /* The next becomes the current */
@@ -42,7 +65,74 @@ static hvmm_status_t guest_restore(struct guest_struct *guest,
      return HVMM_STATUS_UNKNOWN_ERROR;
 }
 
-static hvmm_status_t perform_switch(struct arch_regs *regs, vmid_t next_vmid)
+/* Brings the saved context of a guest that is not running up to date */
+static hvmm_status_t guest_sync(struct guest_struct *guest)
+{
+    if (_guest_module.ops->sync)
+        return _guest_module.ops->sync(guest);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static void __hot guest_steal_time_update(vmid_t vmid)
+{
+#ifdef CFG_GUEST_STEAL_TIME_IPA
+    volatile struct guest_steal_time *page =
+        (volatile struct guest_steal_time *) _steal_time[vmid];
+    struct guest_time_stats *time = &_guest_time[vmid];
+
+    page->sequence++;
+    page->run = time->run;
+    page->hyp = time->hyp;
+    page->wait = time->wait;
+    page->steal = time->hyp + time->wait;
+    page->sequence++;
+    memory_sync_shadow((void *) page, sizeof(*page));
+#endif
+}
+
+void __hot guest_account_entry(void)
+{
+    uint64_t now = read_cntpct();
+
+    if (_current_guest_vmid != VMID_INVALID)
+        _guest_time[_current_guest_vmid].run += now - this_cpu(_time_mark);
+    this_cpu(_time_mark) = now;
+}
+
+/*
+ * Return to the current guest from an exception taken while the guest
+ * from ran: the time since the entry is charged to from.
+ */
+static void __hot guest_account_exit(vmid_t from)
+{
+    uint64_t now = read_cntpct();
+    vmid_t to = _current_guest_vmid;
+
+    if (from != VMID_INVALID)
+        _guest_time[from].hyp += now - this_cpu(_time_mark);
+    if (from != to) {
+        if (from != VMID_INVALID)
+            _guest_switched_out[from] = now;
+        _guest_time[to].wait += now - _guest_switched_out[to];
+        _guest_time[to].switches++;
+    }
+    this_cpu(_time_mark) = now;
+    guest_steal_time_update(to);
+    stats_update(to, &_guest_time[to]);
+}
+
+hvmm_status_t guest_time_stats(vmid_t vmid, struct guest_time_stats *stats)
+{
+    if (!_valid_vmid(vmid))
+        return HVMM_STATUS_BAD_ACCESS;
+
+    *stats = _guest_time[vmid];
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t __hot perform_switch(struct arch_regs *regs,
+                vmid_t next_vmid)
 {
     /* _curreng_guest_vmid -> next_vmid */
     hvmm_status_t result = HVMM_STATUS_UNKNOWN_ERROR;
@@ -72,9 +162,10 @@ static hvmm_status_t perform_switch(struct arch_regs *regs, vmid_t next_vmid)
     return result;
 }
 
-hvmm_status_t guest_perform_switch(struct arch_regs *regs)
+hvmm_status_t __hot guest_perform_switch(struct arch_regs *regs)
 {
     hvmm_status_t result = HVMM_STATUS_IGNORED;
+    vmid_t from = _current_guest_vmid;
 
     if (_current_guest_vmid == VMID_INVALID) {
         /*
@@ -82,6 +173,11 @@ hvmm_status_t guest_perform_switch(struct arch_regs *regs)
          * first guest. It occur in initial time.
          */
         printh("context: launching the first guest\n");
+        _current_guest_vmid = _next_guest_vmid;
+        guest_account_exit(VMID_INVALID);
+        _current_guest_vmid = VMID_INVALID;
+        trace_event(TRACE_EVENT_SWITCH, VMID_INVALID, _next_guest_vmid, 0);
+        interrupt_guest_migrate(_next_guest_vmid, 1u << smp_processor_id());
         result = perform_switch(0, _next_guest_vmid);
         /* DOES NOT COME BACK HERE */
     } else if (_next_guest_vmid != VMID_INVALID &&
@@ -89,8 +185,11 @@ hvmm_status_t guest_perform_switch(struct arch_regs *regs)
         printh("curr: %x\n", _current_guest_vmid);
         printh("next: %x\n", _next_guest_vmid);
         /* Only if not from Hyp */
+        trace_event(TRACE_EVENT_SWITCH, from, _next_guest_vmid, 0);
         result = perform_switch(regs, _next_guest_vmid);
         _next_guest_vmid = VMID_INVALID;
+        guest_account_exit(from);
+        interrupt_guest_migrate(_current_guest_vmid, 1u << smp_processor_id());
     } else {
         /*
          * Staying at the currently active guest.
@@ -99,6 +198,7 @@ hvmm_status_t guest_perform_switch(struct arch_regs *regs)
          * this time
          */
         vgic_flush_virqs(_current_guest_vmid);
+        guest_account_exit(from);
     }
     _switch_locked = 0;
     return result;
@@ -145,6 +245,14 @@ vmid_t guest_next_vmid(vmid_t ofvmid)
     return next;
 }
 
+struct arch_context *guest_context(vmid_t vmid)
+{
+    if (!_valid_vmid(vmid))
+        return 0;
+
+    return &guests[vmid].context;
+}
+
 vmid_t guest_current_vmid(void)
 {
     return _current_guest_vmid;
@@ -155,7 +263,7 @@ vmid_t guest_waiting_vmid(void)
     return _next_guest_vmid;
 }
 
-void guest_dump_regs(struct arch_regs *regs)
+void __cold guest_dump_regs(struct arch_regs *regs)
 {
     _guest_module.ops->dump(GUEST_VERBOSE_ALL, regs);
 }
@@ -182,15 +290,124 @@ hvmm_status_t guest_switchto(vmid_t vmid, uint8_t locked)
     return result;
 }
 
+/**
+ * @brief Takes a checkpoint of a guest that is not running.
+ *
+ * The saved context of the guest (registers and arch_context), the
+ * interrupt state, the virtual device state and the guest RAM are copied
+ * aside, in the same order perform_switch() saves them. Only the RAM pages
+ * written since the previous checkpoint are copied after the first one.
+ *
+ * @param vmid Guest to take a checkpoint of.
+ * @return HVMM_STATUS_BUSY if the guest is running, otherwise the result of
+ *         the failing subsystem or HVMM_STATUS_SUCCESS.
+ */
+hvmm_status_t guest_checkpoint(vmid_t vmid)
+{
+    hvmm_status_t result;
+
+    if (!_valid_vmid(vmid))
+        return HVMM_STATUS_BAD_ACCESS;
+    if (vmid == _current_guest_vmid)
+        return HVMM_STATUS_BUSY;
+
+    result = memory_checkpoint(vmid);
+    if (result == HVMM_STATUS_SUCCESS)
+        result = interrupt_checkpoint(vmid);
+    if (result == HVMM_STATUS_SUCCESS)
+        result = vdev_checkpoint(vmid);
+    if (result != HVMM_STATUS_SUCCESS) {
+        printh("context: checkpoint of vmid %d failed:%d\n", vmid, result);
+        _guest_checkpointed[vmid] = 0;
+        return result;
+    }
+    guest_sync(&guests[vmid]);
+    _guest_checkpoints[vmid] = guests[vmid];
+    _guest_checkpointed[vmid] = 1;
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Rolls a guest that is not running back to its last checkpoint.
+ *
+ * The guest resumes from the checkpoint the next time it is switched in.
+ *
+ * @param vmid Guest to roll back.
+ * @return HVMM_STATUS_NOT_FOUND if there is no checkpoint of the guest,
+ *         HVMM_STATUS_BUSY if the guest is running.
+ */
+hvmm_status_t guest_rollback(vmid_t vmid)
+{
+    hvmm_status_t result;
+
+    if (!_valid_vmid(vmid))
+        return HVMM_STATUS_BAD_ACCESS;
+    if (vmid == _current_guest_vmid)
+        return HVMM_STATUS_BUSY;
+    if (!_guest_checkpointed[vmid])
+        return HVMM_STATUS_NOT_FOUND;
+
+    result = memory_rollback(vmid);
+    if (result == HVMM_STATUS_SUCCESS)
+        result = interrupt_rollback(vmid);
+    if (result == HVMM_STATUS_SUCCESS)
+        result = vdev_rollback(vmid);
+    if (result != HVMM_STATUS_SUCCESS) {
+        printh("context: rollback of vmid %d failed:%d\n", vmid, result);
+        return result;
+    }
+    /* Nothing of the guest may stay in the CPU past its old context */
+    guest_sync(&guests[vmid]);
+    guests[vmid] = _guest_checkpoints[vmid];
+
+    return HVMM_STATUS_SUCCESS;
+}
+
 vmid_t sched_policy_determ_next(void)
 {
-    vmid_t next = guest_next_vmid(guest_current_vmid());
+    vmid_t next = guest_current_vmid();
+    uint8_t cpumask = 1u << smp_processor_id();
+    int i;
 
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        next = guest_next_vmid(next);
+        if (next == VMID_INVALID)
+            next = guest_first_vmid();
+        if (_guest_affinity[next] & cpumask)
+            return next;
+    }
+    /* No guest may run here, keep the current one */
+    next = guest_current_vmid();
     if (next == VMID_INVALID)
         next = guest_first_vmid();
     return next;
 }
 
+hvmm_status_t guest_set_affinity(vmid_t vmid, uint8_t cpumask)
+{
+    if (!_valid_vmid(vmid))
+        return HVMM_STATUS_BAD_ACCESS;
+    if (!(cpumask & GUEST_AFFINITY_ALL))
+        return HVMM_STATUS_BAD_ACCESS;
+
+    _guest_affinity[vmid] = cpumask & GUEST_AFFINITY_ALL;
+    /* Moves the guest off this CPU at the next switch point */
+    if (vmid == _current_guest_vmid &&
+            !(_guest_affinity[vmid] & (1u << smp_processor_id())))
+        guest_switchto(sched_policy_determ_next(), 0);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+uint8_t guest_affinity(vmid_t vmid)
+{
+    if (!_valid_vmid(vmid))
+        return 0;
+
+    return _guest_affinity[vmid];
+}
+
 void guest_schedule(void *pdata)
 {
     struct arch_regs *regs = pdata;
@@ -224,6 +441,12 @@ hvmm_status_t guest_init()
         guest->vmid = i;
         if (_guest_module.ops->init)
             _guest_module.ops->init(guest, regs);
+        _guest_switched_out[i] = read_cntpct();
+        _guest_affinity[i] = GUEST_AFFINITY_ALL;
+#ifdef CFG_GUEST_STEAL_TIME_IPA
+        if (memory_map_shadow(i, CFG_GUEST_STEAL_TIME_IPA, _steal_time[i]))
+            printh("[hyp] init_guests: steal time page not mapped\n");
+#endif
     }
     printh("[hyp] init_guests: return\n");
 
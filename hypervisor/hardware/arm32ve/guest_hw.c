@@ -3,16 +3,22 @@
 #include <hvmm_trace.h>
 #include <guest.h>
 #include <guest_hw.h>
+#include <smp.h>
+#include <percpu.h>
+#include <asm-arm_inline.h>
+#include <sections.h>
 
-#define CPSR_MODE_USER  0x10
-#define CPSR_MODE_FIQ   0x11
-#define CPSR_MODE_IRQ   0x12
-#define CPSR_MODE_SVC   0x13
-#define CPSR_MODE_MON   0x16
-#define CPSR_MODE_ABT   0x17
-#define CPSR_MODE_HYP   0x1A
-#define CPSR_MODE_UND   0x1B
-#define CPSR_MODE_SYS   0x1F
+/*
+ * The VFP/Advanced SIMD registers stay in the CPU with the last guest that
+ * used them, its owner, and HCPTR traps the accesses of the other guests
+ * to CP10/CP11. The first access of a guest since it was switched in saves
+ * the registers of the owner and loads its own(guest_hw_vfp_trap()), so a
+ * guest that does not use them costs nothing at the switch.
+ */
+static DEFINE_PER_CPU(struct guest_struct *, _vfp_owner);
+
+/* CP15 context just saved, still the one in the CPU until a restore */
+static DEFINE_PER_CPU(struct regs_cop *, _cop_live);
 
 static void context_copy_regs(struct arch_regs *regs_dst,
                 struct arch_regs *regs_src)
@@ -51,7 +57,7 @@ static void context_init_banked(struct regs_banked *regs_banked)
     /* Cortex-A15 processor does not support sp_fiq */
 }
 
-static void context_save_banked(struct regs_banked *regs_banked)
+static void __hot context_save_banked(struct regs_banked *regs_banked)
 {
     /* USR banked register */
     asm volatile(" mrs     %0, sp_usr\n\t"
@@ -101,7 +107,7 @@ static void context_save_banked(struct regs_banked *regs_banked)
                  : "=r"(regs_banked->r12_fiq) : : "memory", "cc");
 }
 
-static void context_restore_banked(struct regs_banked *regs_banked)
+static void __hot context_restore_banked(struct regs_banked *regs_banked)
 {
     /* USR banked register */
     asm volatile(" msr    sp_usr, %0\n\t"
@@ -154,29 +160,123 @@ static void context_restore_banked(struct regs_banked *regs_banked)
 /* Co-processor state management: init/save/restore */
 static void context_init_cops(struct regs_cop *regs_cop)
 {
-    regs_cop->vbar = 0;
-    regs_cop->ttbr0 = 0;
-    regs_cop->ttbr1 = 0;
-    regs_cop->ttbcr = 0;
-    regs_cop->sctlr = 0;
+    uint32_t *reg = (uint32_t *) regs_cop;
+    int i;
+
+    for (i = 0; i < sizeof(*regs_cop) / sizeof(uint32_t); i++)
+        reg[i] = 0;
 }
 
-static void context_save_cops(struct regs_cop *regs_cop)
+static void __hot context_save_cops(struct regs_cop *regs_cop)
 {
-    regs_cop->vbar = read_vbar();
-    regs_cop->ttbr0 = read_ttbr0();
-    regs_cop->ttbr1 = read_ttbr1();
-    regs_cop->ttbcr = read_ttbcr();
-    regs_cop->sctlr = read_sctlr();
+    __cop_save(regs_cop);
+    this_cpu(_cop_live) = regs_cop;
 }
 
-static void context_restore_cops(struct regs_cop *regs_cop)
+/*
+ * The translation control registers of two guests that never changed them
+ * from the same values are the same: they are not written again.
+ */
+static void __hot context_restore_cops(struct regs_cop *regs_cop)
 {
-    write_vbar(regs_cop->vbar);
-    write_ttbr0(regs_cop->ttbr0);
-    write_ttbr1(regs_cop->ttbr1);
-    write_ttbcr(regs_cop->ttbcr);
-    write_sctlr(regs_cop->sctlr);
+    uint32_t *live = (uint32_t *) this_cpu(_cop_live);
+    uint32_t *reg = (uint32_t *) regs_cop;
+    uint32_t translation = 0;
+    int i;
+
+    if (!live)
+        translation = 1;
+    for (i = 0; !translation && i < REGS_COP_TRANSLATION_NUM; i++)
+        translation = reg[i] != live[i];
+    __cop_restore(regs_cop, translation);
+    this_cpu(_cop_live) = 0;
+}
+
+/* VFP/Advanced SIMD state management: init/save/restore */
+static void context_init_vfp(struct regs_vfp *regs_vfp)
+{
+    int i;
+
+    for (i = 0; i < VFP_NUM_DREGS; i++)
+        regs_vfp->d[i] = 0;
+    regs_vfp->fpscr = 0;
+    /* Disabled, as after a reset */
+    regs_vfp->fpexc = 0;
+}
+
+/* CP10/CP11 must not be trapped, FPEXC.EN is left set */
+static void context_save_vfp(struct regs_vfp *regs_vfp)
+{
+    uint64_t *d = regs_vfp->d;
+
+    regs_vfp->fpexc = read_fpexc();
+    write_fpexc(regs_vfp->fpexc | FPEXC_EN);
+    regs_vfp->fpscr = read_fpscr();
+    asm volatile(" .fpu    neon\n\t"
+                 " vstmia  %0!, {d0-d15}\n\t"
+                 " vstmia  %0!, {d16-d31}\n\t"
+                 : "+r"(d) : : "memory", "cc");
+}
+
+/* CP10/CP11 must not be trapped */
+static void context_restore_vfp(struct regs_vfp *regs_vfp)
+{
+    uint64_t *d = regs_vfp->d;
+
+    write_fpexc(FPEXC_EN);
+    asm volatile(" .fpu    neon\n\t"
+                 " vldmia  %0!, {d0-d15}\n\t"
+                 " vldmia  %0!, {d16-d31}\n\t"
+                 : "+r"(d) : : "memory", "cc");
+    write_fpscr(regs_vfp->fpscr);
+    write_fpexc(regs_vfp->fpexc);
+}
+
+/* Writes the registers of the owner back and leaves them without owner */
+static void context_flush_vfp(void)
+{
+    struct guest_struct *owner = this_cpu(_vfp_owner);
+    uint32_t hcptr = read_hcptr();
+
+    if (!owner)
+        return;
+
+    write_hcptr(hcptr & ~HCPTR_TVFP);
+    isb();
+    context_save_vfp(&owner->context.regs_vfp);
+    write_hcptr(hcptr);
+    isb();
+    this_cpu(_vfp_owner) = 0;
+}
+
+/* Traps CP10/CP11 unless the incoming guest owns the registers */
+static void __hot context_trap_vfp(struct guest_struct *guest)
+{
+    uint32_t hcptr = read_hcptr();
+
+    if (this_cpu(_vfp_owner) == guest)
+        hcptr &= ~HCPTR_TVFP;
+    else
+        hcptr |= HCPTR_TVFP;
+    /* Synchronized by the exception return to the guest */
+    write_hcptr(hcptr);
+}
+
+hvmm_status_t guest_hw_vfp_trap(struct guest_struct *guest)
+{
+    struct guest_struct *owner = this_cpu(_vfp_owner);
+
+    write_hcptr(read_hcptr() & ~HCPTR_TVFP);
+    isb();
+    if (owner == guest)
+        return HVMM_STATUS_SUCCESS;
+
+    if (owner)
+        context_save_vfp(&owner->context.regs_vfp);
+    context_restore_vfp(&guest->context.regs_vfp);
+    this_cpu(_vfp_owner) = guest;
+
+    return HVMM_STATUS_SUCCESS;
 }
 
 #ifdef DEBUG
@@ -216,7 +316,7 @@ static char *_modename(uint8_t mode)
 }
 #endif
 
-static hvmm_status_t guest_hw_save(struct guest_struct *guest,
+static hvmm_status_t __hot guest_hw_save(struct guest_struct *guest,
                 struct arch_regs *current_regs)
 {
     struct arch_regs *regs = &guest->regs;
@@ -228,6 +328,10 @@ static hvmm_status_t guest_hw_save(struct guest_struct *guest,
     context_copy_regs(regs, current_regs);
     context_save_cops(&context->regs_cop);
     context_save_banked(&context->regs_banked);
+    /* Leaving a CPU it may not come back to: its registers are needed */
+    if (this_cpu(_vfp_owner) == guest &&
+            !(guest_affinity(guest->vmid) & (1u << smp_processor_id())))
+        context_flush_vfp();
     printh("context: saving vmid[%d] mode(%x):%s pc:0x%x\n",
             _current_guest->vmid,
            regs->cpsr & 0x1F,
@@ -237,7 +341,7 @@ static hvmm_status_t guest_hw_save(struct guest_struct *guest,
     return HVMM_STATUS_SUCCESS;
 }
 
-static hvmm_status_t guest_hw_restore(struct guest_struct *guest,
+static hvmm_status_t __hot guest_hw_restore(struct guest_struct *guest,
                 struct arch_regs *current_regs)
 {
     struct arch_context *context = &guest->context;
@@ -248,6 +352,7 @@ static hvmm_status_t guest_hw_restore(struct guest_struct *guest,
          * The actual context switching (Hyp to Normal mode)
          * handled in the asm code
          */
+        context_trap_vfp(guest);
         __mon_switch_to_guest_context(&guest->regs);
         return HVMM_STATUS_SUCCESS;
     }
@@ -256,6 +361,19 @@ static hvmm_status_t guest_hw_restore(struct guest_struct *guest,
     context_copy_regs(current_regs, &guest->regs);
     context_restore_cops(&context->regs_cop);
     context_restore_banked(&context->regs_banked);
+    context_trap_vfp(guest);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/*
+ * Registers of a guest not running that are still in the CPU, written back
+ * before its context is copied or replaced.
+ */
+static hvmm_status_t guest_hw_sync(struct guest_struct *guest)
+{
+    if (this_cpu(_vfp_owner) == guest)
+        context_flush_vfp();
 
     return HVMM_STATUS_SUCCESS;
 }
@@ -271,11 +389,13 @@ static hvmm_status_t guest_hw_init(struct guest_struct *guest,
     /* regs->gpr[] = whatever */
     context_init_cops(&context->regs_cop);
     context_init_banked(&context->regs_banked);
+    context_init_vfp(&context->regs_vfp);
 
     return HVMM_STATUS_SUCCESS;
 }
 
-static hvmm_status_t guest_hw_dump(uint8_t verbose, struct arch_regs *regs)
+static hvmm_status_t __cold guest_hw_dump(uint8_t verbose,
+                struct arch_regs *regs)
 {
     if (verbose & GUEST_VERBOSE_LEVEL_0) {
         uart_print("cpsr: ");
@@ -324,6 +444,7 @@ struct guest_ops _guest_ops = {
     .init = guest_hw_init,
     .save = guest_hw_save,
     .restore = guest_hw_restore,
+    .sync = guest_hw_sync,
     .dump = guest_hw_dump,
 };
 
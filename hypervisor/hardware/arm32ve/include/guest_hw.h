@@ -10,13 +10,66 @@
 
 #define ARCH_REGS_NUM_GPR    13
 
-/* co-processor registers: cp15, cp2 */
+#define CPSR_MODE_MASK  0x1F
+#define CPSR_MODE_USER  0x10
+#define CPSR_MODE_FIQ   0x11
+#define CPSR_MODE_IRQ   0x12
+#define CPSR_MODE_SVC   0x13
+#define CPSR_MODE_MON   0x16
+#define CPSR_MODE_ABT   0x17
+#define CPSR_MODE_HYP   0x1A
+#define CPSR_MODE_UND   0x1B
+#define CPSR_MODE_SYS   0x1F
+#define CPSR_THUMB      (1 << 5)
+#define CPSR_C_SHIFT    29
+/* ITSTATE: IT[1:0] in CPSR[26:25], IT[7:2] in CPSR[15:10] */
+#define CPSR_IT_MASK    0x0600FC00
+
+/*
+ * co-processor registers: cp15 context of the guest.
+ *
+ * The layout is the order __cop_save and __cop_restore(context_cop.S) move
+ * the registers in, keep them in step. TTBR0/1 and PAR are the 64-bit
+ * forms(MRRC/MCRR), which keep the ASID and the address bits above 31 of
+ * a guest with TTBCR.EAE set.
+ */
 struct regs_cop {
-    uint32_t vbar;
-    uint32_t ttbr0;
-    uint32_t ttbr1;
-    uint32_t ttbcr;
+    /* Translation control, REGS_COP_TRANSLATION_NUM words */
+    uint64_t ttbr0;
+    uint64_t ttbr1;
     uint32_t sctlr;
+    uint32_t ttbcr;
+    uint32_t dacr;
+    uint32_t prrr;          /* MAIR0 with TTBCR.EAE */
+    uint32_t nmrr;          /* MAIR1 with TTBCR.EAE */
+    uint32_t contextidr;
+
+    uint64_t par;
+    uint32_t vbar;
+    uint32_t tpidrurw;
+    uint32_t tpidruro;
+    uint32_t tpidrprw;
+    uint32_t csselr;
+    uint32_t cpacr;
+    uint32_t cntkctl;
+    uint32_t dfsr;
+    uint32_t ifsr;
+    uint32_t dfar;
+    uint32_t ifar;
+};
+
+#define REGS_COP_TRANSLATION_NUM    10
+
+/*
+ * VFP and Advanced SIMD registers: d0-d31 on the Cortex-A15, switched
+ * lazily(guest_hw_vfp_trap()).
+ */
+#define VFP_NUM_DREGS   32
+
+struct regs_vfp {
+    uint64_t d[VFP_NUM_DREGS];
+    uint32_t fpscr;
+    uint32_t fpexc;
 };
 
 /* banked registers */
@@ -58,6 +111,20 @@ struct arch_regs {
 struct arch_context {
     struct regs_cop regs_cop;
     struct regs_banked regs_banked;
+    struct regs_vfp regs_vfp;
 };
 
+struct guest_struct;
+
+extern void __cop_save(struct regs_cop *regs_cop);
+extern void __cop_restore(struct regs_cop *regs_cop, uint32_t translation);
+
+/**
+ * @brief Gives the VFP/Advanced SIMD registers to \a guest, on its first
+ * access to CP10/CP11 since it was switched in.
+ *
+ * Called for the HCPTR trap, the guest then replays the access.
+ */
+hvmm_status_t guest_hw_vfp_trap(struct guest_struct *guest);
+
 #endif
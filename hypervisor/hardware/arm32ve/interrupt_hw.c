@@ -3,26 +3,28 @@
 #include <vgic.h>
 #include <log/print.h>
 #include <log/uart_print.h>
+#include <boot_profile.h>
+#include <sections.h>
 
 static struct vgic_status _vgic_status[NUM_GUESTS_STATIC];
+static struct vgic_status _vgic_status_checkpoint[NUM_GUESTS_STATIC];
 
-static hvmm_status_t host_interrupt_init(void)
+static hvmm_status_t __init host_interrupt_init(void)
 {
     hvmm_status_t result = HVMM_STATUS_UNKNOWN_ERROR;
 
-    /* Route IRQ/IFQ to Hyp Exception Vector */
+    /*
+     * Route IRQ/IFQ to Hyp Exception Vector, trap ACTLR accesses
+     * (emulate_access_to_cp15)
+     */
     {
         uint32_t hcr;
         hcr = read_hcr();
-        uart_print("hcr:");
-        uart_print_hex32(hcr);
-        uart_print("\n\r");
-        hcr |= HCR_IMO | HCR_FMO;
+        boot_log("hcr", hcr);
+        hcr |= HCR_IMO | HCR_FMO | HCR_TAC;
         write_hcr(hcr);
         hcr = read_hcr();
-        uart_print("hcr:");
-        uart_print_hex32(hcr);
-        uart_print("\n\r");
+        boot_log("hcr", hcr);
     }
 
     /* Physical Interrupt: GIC Distributor & CPU Interface */
@@ -31,6 +33,14 @@ static hvmm_status_t host_interrupt_init(void)
     return result;
 }
 
+static hvmm_status_t host_interrupt_init_cpu(void)
+{
+    write_hcr(read_hcr() | HCR_IMO | HCR_FMO | HCR_TAC);
+
+    /* The distributor is up already, only the CPU interface is left */
+    return gic_init_cpu();
+}
+
 static hvmm_status_t host_interrupt_enable(uint32_t irq)
 {
     return gic_enable_irq(irq);
@@ -41,13 +51,28 @@ static hvmm_status_t host_interrupt_disable(uint32_t irq)
     return gic_disable_irq(irq);
 }
 
+static hvmm_status_t host_interrupt_pend(uint32_t irq)
+{
+    return gic_pend_irq(irq);
+}
+
 static hvmm_status_t host_interrupt_configure(uint32_t irq)
 {
     return gic_configure_irq(irq, GIC_INT_POLARITY_LEVEL,
             gic_cpumask_current(), GIC_INT_PRIORITY_DEFAULT);
 }
 
-static hvmm_status_t host_interrupt_end(uint32_t irq)
+static hvmm_status_t host_interrupt_target(uint32_t irq, uint8_t cpumask)
+{
+    return gic_set_target(irq, cpumask);
+}
+
+static hvmm_status_t host_interrupt_sgi(uint32_t sgi, uint8_t cpumask)
+{
+    return gic_send_sgi(sgi, cpumask);
+}
+
+static hvmm_status_t __hot host_interrupt_end(uint32_t irq)
 {
     /* Completion & Deactivation */
     gic_completion_irq(irq);
@@ -62,7 +87,7 @@ static hvmm_status_t host_interrupt_dump(void)
     return HVMM_STATUS_SUCCESS;
 }
 
-static hvmm_status_t guest_interrupt_init(void)
+static hvmm_status_t __init guest_interrupt_init(void)
 {
     hvmm_status_t result = HVMM_STATUS_UNKNOWN_ERROR;
 
@@ -76,28 +101,50 @@ static hvmm_status_t guest_interrupt_init(void)
     return result;
 }
 
+static hvmm_status_t guest_interrupt_init_cpu(void)
+{
+    return vgic_init_cpu();
+}
+
 static hvmm_status_t guest_interrupt_end(uint32_t irq)
 {
     return gic_completion_irq(irq);
 }
 
-static hvmm_status_t guest_interrupt_inject(vmid_t vmid, uint32_t virq,
+static hvmm_status_t guest_interrupt_deactivate(uint32_t irq)
+{
+    return gic_deactivate_irq(irq);
+}
+
+static hvmm_status_t __hot guest_interrupt_inject(vmid_t vmid, uint32_t virq,
                         uint32_t pirq, uint8_t hw)
 {
     /* TODO : checking the injected bitmap */
     return virq_inject(vmid, virq, pirq, hw);
 }
 
-static hvmm_status_t guest_interrupt_save(vmid_t vmid)
+static hvmm_status_t __hot guest_interrupt_save(vmid_t vmid)
 {
     return vgic_save_status(&_vgic_status[vmid]);
 }
 
-static hvmm_status_t guest_interrupt_restore(vmid_t vmid)
+static hvmm_status_t __hot guest_interrupt_restore(vmid_t vmid)
 {
     return vgic_restore_status(&_vgic_status[vmid], vmid);
 }
 
+static hvmm_status_t guest_interrupt_checkpoint(vmid_t vmid)
+{
+    _vgic_status_checkpoint[vmid] = _vgic_status[vmid];
+    return virq_checkpoint(vmid);
+}
+
+static hvmm_status_t guest_interrupt_rollback(vmid_t vmid)
+{
+    _vgic_status[vmid] = _vgic_status_checkpoint[vmid];
+    return virq_rollback(vmid);
+}
+
 static hvmm_status_t guest_interrupt_dump(void)
 {
     /* TODO : dumpping the injected bitmap */
@@ -106,19 +153,27 @@ static hvmm_status_t guest_interrupt_dump(void)
 
 struct interrupt_ops _host_interrupt_ops = {
     .init = host_interrupt_init,
+    .init_cpu = host_interrupt_init_cpu,
     .enable = host_interrupt_enable,
     .disable = host_interrupt_disable,
+    .pend = host_interrupt_pend,
     .configure = host_interrupt_configure,
+    .target = host_interrupt_target,
+    .sgi = host_interrupt_sgi,
     .end = host_interrupt_end,
     .dump = host_interrupt_dump,
 };
 
 struct interrupt_ops _guest_interrupt_ops = {
     .init = guest_interrupt_init,
+    .init_cpu = guest_interrupt_init_cpu,
     .end = guest_interrupt_end,
+    .deactivate = guest_interrupt_deactivate,
     .inject = guest_interrupt_inject,
     .save = guest_interrupt_save,
     .restore = guest_interrupt_restore,
+    .checkpoint = guest_interrupt_checkpoint,
+    .rollback = guest_interrupt_rollback,
     .dump = guest_interrupt_dump,
 };
 
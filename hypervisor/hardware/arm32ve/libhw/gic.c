@@ -8,7 +8,10 @@
 #include <hvmm_types.h>
 #include <log/print.h>
 #include <log/uart_print.h>
+#include <boot_profile.h>
+#include <asm-arm_inline.h>
 #include <k-hypervisor-config.h>
+#include <sections.h>
 
 #define CBAR_PERIPHBASE_MSB_MASK    0x000000FF
 
@@ -41,46 +44,26 @@ struct gic {
 
 static struct gic _gic;
 
-static void gic_dump_registers(void)
+static void __init gic_dump_registers(void)
 {
     uint32_t midr;
     HVMM_TRACE_ENTER();
     midr = read_midr();
-    uart_print("midr:");
-    uart_print_hex32(midr);
-    uart_print("\n\r");
+    boot_log("midr", midr);
     if ((midr & MIDR_MASK_PPN) == MIDR_PPN_CORTEXA15) {
         uint32_t value;
-        uart_print("cbar:");
-        uart_print_hex32(_gic.baseaddr);
-        uart_print("\n\r");
-        uart_print("ba_gicd:");
-        uart_print_hex32((uint32_t)_gic.ba_gicd);
-        uart_print("\n\r");
-        uart_print("ba_gicc:");
-        uart_print_hex32((uint32_t)_gic.ba_gicc);
-        uart_print("\n\r");
-        uart_print("ba_gich:");
-        uart_print_hex32((uint32_t)_gic.ba_gich);
-        uart_print("\n\r");
-        uart_print("ba_gicv:");
-        uart_print_hex32((uint32_t)_gic.ba_gicv);
-        uart_print("\n\r");
-        uart_print("ba_gicvi:");
-        uart_print_hex32((uint32_t)_gic.ba_gicvi);
-        uart_print("\n\r");
+        boot_log("cbar", _gic.baseaddr);
+        boot_log("ba_gicd", (uint32_t) _gic.ba_gicd);
+        boot_log("ba_gicc", (uint32_t) _gic.ba_gicc);
+        boot_log("ba_gich", (uint32_t) _gic.ba_gich);
+        boot_log("ba_gicv", (uint32_t) _gic.ba_gicv);
+        boot_log("ba_gicvi", (uint32_t) _gic.ba_gicvi);
         value = _gic.ba_gicd[GICD_CTLR];
-        uart_print("GICD_CTLR:");
-        uart_print_hex32(value);
-        uart_print("\n\r");
+        boot_log("GICD_CTLR", value);
         value = _gic.ba_gicd[GICD_TYPER];
-        uart_print("GICD_TYPER:");
-        uart_print_hex32(value);
-        uart_print("\n\r");
+        boot_log("GICD_TYPER", value);
         value = _gic.ba_gicd[GICD_IIDR];
-        uart_print("GICD_IIDR:");
-        uart_print_hex32(value);
-        uart_print("\n\r");
+        boot_log("GICD_IIDR", value);
     }
     HVMM_TRACE_EXIT();
 }
@@ -90,7 +73,7 @@ static void gic_dump_registers(void)
  *
  * When 40 bit address supports, This function wil use.
  */
-static uint64_t gic_periphbase_pa(void)
+static uint64_t __init gic_periphbase_pa(void)
 {
     /* CBAR:   4,  c0,   0 */
     /*
@@ -111,7 +94,7 @@ static uint64_t gic_periphbase_pa(void)
  * @return  If target architecture is Cortex-A15 then return success,
  *          otherwise return failed.
  */
-static hvmm_status_t gic_init_baseaddr(uint32_t *va_base)
+static hvmm_status_t __init gic_init_baseaddr(uint32_t *va_base)
 {
     /* MIDR[15:4], CRn:c0, Op1:0, CRm:c0, Op2:0  == 0xC0F (Cortex-A15) */
     /* Cortex-A15 C15 System Control, C15 Registers */
@@ -120,9 +103,6 @@ static hvmm_status_t gic_init_baseaddr(uint32_t *va_base)
     hvmm_status_t result = HVMM_STATUS_UNKNOWN_ERROR;
     HVMM_TRACE_ENTER();
     midr = read_midr();
-    uart_print("midr:");
-    uart_print_hex32(midr);
-    uart_print("\n\r");
     /*
      * Note:
      * We currently support GICv2 with Cortex-A15 only.
@@ -136,9 +116,6 @@ static hvmm_status_t gic_init_baseaddr(uint32_t *va_base)
                     0x00000000FFFFFFFFULL);
         }
         _gic.baseaddr = (uint32_t) va_base;
-        uart_print("cbar:");
-        uart_print_hex32(_gic.baseaddr);
-        uart_print("\n\r");
         _gic.ba_gicd = (uint32_t *)(_gic.baseaddr + GIC_OFFSET_GICD);
         _gic.ba_gicc = (uint32_t *)(_gic.baseaddr + GIC_OFFSET_GICC);
         _gic.ba_gich = (uint32_t *)(_gic.baseaddr + GIC_OFFSET_GICH);
@@ -167,7 +144,7 @@ static hvmm_status_t gic_init_baseaddr(uint32_t *va_base)
  * </pre>
  * @return Always return success.
  */
-static hvmm_status_t gic_init_dist(void)
+static hvmm_status_t __init gic_init_dist(void)
 {
     uint32_t type;
     int i;
@@ -178,13 +155,8 @@ static hvmm_status_t gic_init_dist(void)
     type = _gic.ba_gicd[GICD_TYPER];
     _gic.lines = 32 * ((type & GICD_TYPE_LINES_MASK) + 1);
     _gic.cpus = 1 + ((type & GICD_TYPE_CPUS_MASK) >> GICD_TYPE_CPUS_SHIFT);
-    uart_print("GIC: lines:");
-    uart_print_hex32(_gic.lines);
-    uart_print(" cpus:");
-    uart_print_hex32(_gic.cpus);
-    uart_print(" IID:");
-    uart_print_hex32(_gic.ba_gicd[GICD_IIDR]);
-    uart_print("\n\r");
+    boot_log("GIC: lines", _gic.lines);
+    boot_log("GIC: cpus", _gic.cpus);
     /* Interrupt polarity for SPIs (Global Interrupts) active-low */
     for (i = 32; i < _gic.lines; i += 16)
         _gic.ba_gicd[GICD_ICFGR + i / 16] = 0x0;
@@ -260,13 +232,48 @@ hvmm_status_t gic_disable_irq(uint32_t irq)
     return HVMM_STATUS_SUCCESS;
 }
 
-hvmm_status_t gic_completion_irq(uint32_t irq)
+hvmm_status_t gic_pend_irq(uint32_t irq)
+{
+    /* A level-sensitive interrupt is pending again while its line is high */
+    if (!(_gic.ba_gicd[GICD_ICFGR + irq / 16] & (2u << ((irq % 16) * 2))))
+        return HVMM_STATUS_SUCCESS;
+    _gic.ba_gicd[GICD_ISPENDR + irq / 32] = (1u << (irq % 32));
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t gic_set_target(uint32_t irq, uint8_t cpumask)
+{
+    volatile uint8_t *reg8;
+
+    /* ITARGETSR of the SGIs and PPIs is read-only */
+    if (irq < 32 || irq >= _gic.lines)
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    reg8 = (uint8_t *) &(_gic.ba_gicd[GICD_ITARGETSR]);
+    reg8[irq] = cpumask;
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t gic_send_sgi(uint32_t sgi, uint8_t cpumask)
+{
+    if (sgi > GICD_SGIR_SGIINTID_MASK)
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    /* The memory written for the target CPU before it is interrupted */
+    dsb();
+    _gic.ba_gicd[GICD_SGIR] =
+            (GICD_SGIR_FILTER_LIST << GICD_SGIR_FILTER_SHIFT) |
+            (cpumask << GICD_SGIR_TARGET_SHIFT) | sgi;
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t __hot gic_completion_irq(uint32_t irq)
 {
     _gic.ba_gicc[GICC_EOIR] = irq;
     return HVMM_STATUS_SUCCESS;
 }
 
-hvmm_status_t gic_deactivate_irq(uint32_t irq)
+hvmm_status_t __hot gic_deactivate_irq(uint32_t irq)
 {
     _gic.ba_gicc[GICC_DIR] = irq;
     return HVMM_STATUS_SUCCESS;
@@ -282,7 +289,7 @@ volatile uint32_t *gic_vgic_baseaddr(void)
     return _gic.ba_gich;
 }
 
-hvmm_status_t gic_init(void)
+hvmm_status_t __init gic_init(void)
 {
     hvmm_status_t result = HVMM_STATUS_UNKNOWN_ERROR;
     HVMM_TRACE_ENTER();
@@ -309,6 +316,14 @@ hvmm_status_t gic_init(void)
     return result;
 }
 
+hvmm_status_t gic_init_cpu(void)
+{
+    if (_gic.initialized != GIC_SIGNATURE_INITIALIZED)
+        return HVMM_STATUS_BAD_ACCESS;
+
+    return gic_init_cpui();
+}
+
 hvmm_status_t gic_configure_irq(uint32_t irq,
                 enum gic_int_polarity polarity,  uint8_t cpumask,
                 uint8_t priority)
@@ -349,7 +364,7 @@ hvmm_status_t gic_configure_irq(uint32_t irq,
 }
 
 
-uint32_t gic_get_irq_number(void)
+uint32_t __hot gic_get_irq_number(void)
 {
     /*
      * 1. ACK - CPU Interface - GICC_IAR read
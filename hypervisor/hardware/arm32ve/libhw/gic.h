@@ -30,6 +30,12 @@ hvmm_status_t gic_disable_irq(uint32_t irq);
  * otherwise return "unknown error".
  */
 hvmm_status_t gic_init(void);
+/**
+ * @brief   Initializes and enables the GIC CPU Interface, the SGIs and the
+ *          PPIs of a secondary CPU, once gic_init() ran on the boot CPU.
+ * @return  "bad access" if the GIC is not initialized.
+ */
+hvmm_status_t gic_init_cpu(void);
 hvmm_status_t gic_deactivate_irq(uint32_t irq);
 hvmm_status_t gic_completion_irq(uint32_t irq);
 /**
@@ -51,6 +57,35 @@ hvmm_status_t gic_configure_irq(uint32_t irq,
                 enum gic_int_polarity polarity, uint8_t cpumask,
                 uint8_t priority);
 
+/**
+ * @brief           Sets an edge-triggered interrupt pending again.
+ * @param irq       Interrupt number.
+ * @return  Success, a level-sensitive interrupt is left to its line.
+ */
+hvmm_status_t gic_pend_irq(uint32_t irq);
+
+/**
+ * @brief           Routes a shared peripheral interrupt.
+ * @param irq       Interrupt number, 32 or more.
+ * @param cpumask   Targets processor mask, 0 to forward it to none.
+ * @return  "unsupported feature" for an SGI, a PPI or an invalid number.
+ */
+hvmm_status_t gic_set_target(uint32_t irq, uint8_t cpumask);
+
+/**
+ * @brief           Sends a software generated interrupt.
+ * @param sgi       Interrupt number, 0 to 15.
+ * @param cpumask   Targets processor mask.
+ * @return  "unsupported feature" for an invalid number.
+ */
+hvmm_status_t gic_send_sgi(uint32_t sgi, uint8_t cpumask);
+
 uint32_t gic_get_irq_number(void);
 
+/*
+ * The GIC updates GICH_ELSR/EISR/MISR itself when a List Register is
+ * written, nothing to do.
+ */
+#define gic_vgic_lr_update(slot)
+
 #endif
@@ -29,29 +29,27 @@
  * Level 2 Block, 2MB, entry in LPAE Descriptor format
  * for the given physical address
  */
-union lpaed lpaed_host_l2_block(uint64_t pa,
-        enum memattr mattr)
+union lpaed lpaed_host_l2_block(uint64_t pa, uint8_t attr_idx)
 {
-    /* lpae.c */
-    union lpaed lpaed;
+    union lpaed lpaed = { .bits = 0 };
     /* Valid Block Entry */
     lpaed.pt.valid = 1;
     lpaed.pt.table = 0;
     lpaed.bits &= ~TTBL_L2_OUTADDR_MASK;
     lpaed.bits |= pa & TTBL_L2_OUTADDR_MASK;
-    lpaed.p2m.sbz3 = 0;
+    lpaed.pt.sbz = 0;
     /* Lower block attributes */
-    lpaed.p2m.mattr = mattr & 0x0F;
-    lpaed.p2m.read = 1;        /* Read/Write */
-    lpaed.p2m.write = 1;
-    lpaed.p2m.sh = 0;    /* Non-shareable */
-    lpaed.p2m.af = 1;    /* Access Flag set to 1?  */
-    lpaed.p2m.sbz4 = 0;
+    lpaed.pt.ai = attr_idx;
+    lpaed.pt.ns = 1;    /* Allow Non-secure access */
+    lpaed.pt.user = 1;
+    lpaed.pt.ro = 0;
+    lpaed.pt.sh = 2;    /* Outher Shareable */
+    lpaed.pt.af = 1;    /* Access Flag set to 1? */
+    lpaed.pt.ng = 1;
     /* Upper block attributes */
-    lpaed.p2m.hint = 0;
-    lpaed.p2m.sbz2 = 0;
-    lpaed.p2m.xn = 0;    /* eXecute Never = 0 */
-    lpaed.p2m.sbz1 = 0;
+    lpaed.pt.hint = 0;
+    lpaed.pt.pxn = 0;
+    lpaed.pt.xn = 0;    /* eXecute Never = 0 */
     return lpaed;
 }
 
@@ -62,7 +60,7 @@ union lpaed lpaed_host_l2_block(uint64_t pa,
 union lpaed lpaed_host_l1_block(uint64_t pa, uint8_t attr_idx)
 {
     /* lpae.c */
-    union lpaed lpaed;
+    union lpaed lpaed = { .bits = 0 };
     printh("[mm] hvmm_mm_lpaed_l1_block:\n\r");
     printh(" pa:");
     uart_print_hex64(pa);
@@ -94,7 +92,7 @@ union lpaed lpaed_host_l1_block(uint64_t pa, uint8_t attr_idx)
 /* Level 1 Table, 1GB, each entry refer level2 page table */
 union lpaed lpaed_host_l1_table(uint64_t pa)
 {
-    union lpaed lpaed;
+    union lpaed lpaed = { .bits = 0 };
     /* Valid Table Entry */
     lpaed.pt.valid = 1;
     lpaed.pt.table = 1;
@@ -115,7 +113,7 @@ union lpaed lpaed_host_l1_table(uint64_t pa)
 /* Level 2 Table, 2MB, each entry refer level3 page table.*/
 union lpaed lpaed_host_l2_table(uint64_t pa)
 {
-    union lpaed lpaed;
+    union lpaed lpaed = { .bits = 0 };
     /* Valid Table Entry */
     lpaed.pt.valid = 1;
     lpaed.pt.table = 1;
@@ -137,7 +135,7 @@ union lpaed lpaed_host_l2_table(uint64_t pa)
 union lpaed lpaed_host_l3_table(uint64_t pa,
         uint8_t attr_idx, uint8_t valid)
 {
-    union lpaed lpaed;
+    union lpaed lpaed = { .bits = 0 };
     /*  Valid Table Entry */
     lpaed.pt.valid = valid;
     lpaed.pt.table = 1;
@@ -211,6 +209,16 @@ void lpaed_guest_stage2_map_page(union lpaed *pte, uint64_t pa,
     pte->p2m.sbz1 = 0;
 }
 
+void lpaed_guest_stage2_set_write(union lpaed *pte, uint8_t write)
+{
+    pte->p2m.write = write ? 1 : 0;
+}
+
+uint64_t lpaed_guest_stage2_page_pa(union lpaed *pte)
+{
+    return pte->bits & TTBL_L3_OUTADDR_MASK;
+}
+
 void lpaed_guest_stage1_conf_l3_table(union lpaed *ttbl3,
         uint64_t baddr, uint8_t valid)
 {
@@ -430,25 +430,20 @@ union lpaed {
  */
 union lpaed lpaed_host_l1_block(uint64_t pa, uint8_t attr_idx);
 /**
- * @brief Level 2 block, 2MB, entry in LPAE Descriptor format
+ * @brief Level 2 block, 2MB, entry in LPAE descriptor format
  * for the given physical address.
  *
- * Generates a new stage-2 level 2 block LPAE descriptor which has 2MB block.
- * It returns the descriptor after generating.
+ * Generates a new hyp stage-1 level 2 block LPAE descriptor which has 2MB
+ * block. It returns the descriptor after generating.
  *
  * - Initial configuration
- *   - Valid and block.
- *   - Memory attribute is configured by parameter 'mattr'.
- *   - read / write are allowed, non-shareable, executable.
- *   - Access flag is enabled.
- *   - physical address = pa
+ *   - The same as lpaed_host_l1_block().
  *
- * @param pa Physical address of the block.
- * @param mattr Memory attribute index.
- * @return Generated level 2 block LPAE descriptor.
+ * @param  pa Physical address of the block.
+ * @param  attr_idx Attribute index for memory this descriptor.
+ * @return  Generated level2 block LPAE descriptor.
  */
-union lpaed lpaed_host_l2_block(uint64_t pa,
-                enum memattr mattr);
+union lpaed lpaed_host_l2_block(uint64_t pa, uint8_t attr_idx);
 /**
  * @brief Level 1, 1GB, each entry refer level2 page table
  *
@@ -608,5 +603,25 @@ void lpaed_guest_stage2_enable_l2_table(union lpaed *ttbl2);
  * @return void
  */
 void lpaed_guest_stage2_disable_l2_table(union lpaed *ttbl2);
+/**
+ * @brief Grants or revokes the write permission of a stage-2 level 3
+ * page descriptor.
+ *
+ * - State
+ *   - write = write ? 1 : 0
+ *
+ * @param *pte The stage-2 level 3 page descriptor.
+ * @param write Write permission.
+ * @return void
+ */
+void lpaed_guest_stage2_set_write(union lpaed *pte, uint8_t write);
+/**
+ * @brief Returns the output (physical) address of a stage-2 level 3 page
+ * descriptor.
+ *
+ * @param *pte The stage-2 level 3 page descriptor.
+ * @return Physical address of the page.
+ */
+uint64_t lpaed_guest_stage2_page_pa(union lpaed *pte);
 
 #endif
@@ -0,0 +1,345 @@
+#include <k-hypervisor-config.h>
+#include <vdev.h>
+#include "mmio_decode.h"
+
+/* Per guest, direct mapped by PC */
+static struct mmio_insn _decode_cache[NUM_GUESTS_STATIC]
+                        [MMIO_DECODE_CACHE_ENTRIES];
+
+/* Thumb 16-bit load/store register offset: opB, from STR to LDRSH */
+static const uint8_t _thumb_ldst_reg[8][3] = {
+    /* load, size, sign */
+    { 0, VDEV_ACCESS_WORD, 0 },
+    { 0, VDEV_ACCESS_HWORD, 0 },
+    { 0, VDEV_ACCESS_BYTE, 0 },
+    { 1, VDEV_ACCESS_BYTE, 1 },
+    { 1, VDEV_ACCESS_WORD, 0 },
+    { 1, VDEV_ACCESS_HWORD, 0 },
+    { 1, VDEV_ACCESS_BYTE, 0 },
+    { 1, VDEV_ACCESS_HWORD, 1 },
+};
+
+static void mmio_decode_clear(struct mmio_insn *decoded, uint8_t thumb,
+                uint8_t len)
+{
+    decoded->thumb = thumb;
+    decoded->len = len;
+    decoded->load = 0;
+    decoded->size = VDEV_ACCESS_WORD;
+    decoded->sign = 0;
+    decoded->block = 0;
+    decoded->rt = MMIO_INSN_NO_REG;
+    decoded->rt2 = MMIO_INSN_NO_REG;
+    decoded->rn = MMIO_INSN_NO_REG;
+    decoded->rm = MMIO_INSN_NO_REG;
+    decoded->shift_type = MMIO_SHIFT_LSL;
+    decoded->shift_imm = 0;
+    decoded->index = 1;
+    decoded->add = 1;
+    decoded->wback = 0;
+    decoded->imm = 0;
+    decoded->list = 0;
+}
+
+/* PC as a base, a loaded or a stored register is not emulated */
+static hvmm_status_t mmio_decode_check(struct mmio_insn *decoded)
+{
+    if (decoded->rn == 15 || decoded->rt == 15 || decoded->rt2 == 15 ||
+            decoded->rm == 15 || (decoded->list & (1 << 15)))
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    if (decoded->block && !decoded->list)
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t mmio_decode_arm(uint32_t insn, struct mmio_insn *decoded)
+{
+    uint32_t op2;
+
+    mmio_decode_clear(decoded, 0, 4);
+    if ((insn >> 28) == 0xF)
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    decoded->load = (insn >> 20) & 1;
+    decoded->rn = (insn >> 16) & 0xF;
+    decoded->index = (insn >> 24) & 1;
+    decoded->add = (insn >> 23) & 1;
+    decoded->wback = (insn >> 21) & 1;
+
+    switch ((insn >> 25) & 0x7) {
+    case 0x2:
+    case 0x3:
+        /* LDR, STR, LDRB, STRB */
+        if ((insn & (1 << 25)) && (insn & (1 << 4)))
+            return HVMM_STATUS_UNSUPPORTED_FEATURE;
+        decoded->size = (insn & (1 << 22)) ? VDEV_ACCESS_BYTE :
+                        VDEV_ACCESS_WORD;
+        decoded->rt = (insn >> 12) & 0xF;
+        if (insn & (1 << 25)) {
+            decoded->rm = insn & 0xF;
+            decoded->shift_type = (insn >> 5) & 0x3;
+            decoded->shift_imm = (insn >> 7) & 0x1F;
+        } else
+            decoded->imm = insn & 0xFFF;
+        break;
+    case 0x0:
+        /* LDRH, STRH, LDRSB, LDRSH, LDRD, STRD */
+        op2 = (insn >> 5) & 0x3;
+        if ((insn & 0x90) != 0x90 || !op2)
+            return HVMM_STATUS_UNSUPPORTED_FEATURE;
+        decoded->rt = (insn >> 12) & 0xF;
+        if (insn & (1 << 22))
+            decoded->imm = ((insn >> 4) & 0xF0) | (insn & 0xF);
+        else
+            decoded->rm = insn & 0xF;
+        if (op2 == 1) {
+            decoded->size = VDEV_ACCESS_HWORD;
+        } else if (decoded->load) {
+            decoded->size = (op2 == 2) ? VDEV_ACCESS_BYTE : VDEV_ACCESS_HWORD;
+            decoded->sign = 1;
+        } else {
+            if ((decoded->rt & 1) || (!decoded->index && decoded->wback))
+                return HVMM_STATUS_UNSUPPORTED_FEATURE;
+            decoded->load = (op2 == 2);
+            decoded->rt2 = decoded->rt + 1;
+        }
+        break;
+    case 0x4:
+        /* LDM, STM, without the user registers and exception return */
+        if (insn & (1 << 22))
+            return HVMM_STATUS_UNSUPPORTED_FEATURE;
+        decoded->block = 1;
+        decoded->list = insn & 0xFFFF;
+        break;
+    default:
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    }
+    /*
+     * Post-indexed: always writes back, W selects LDRT/STRT and the other
+     * unprivileged forms, which a vdev access can not check
+     */
+    if (!decoded->index && !decoded->block) {
+        if (decoded->wback)
+            return HVMM_STATUS_UNSUPPORTED_FEATURE;
+        decoded->wback = 1;
+    }
+
+    return mmio_decode_check(decoded);
+}
+
+static hvmm_status_t mmio_decode_thumb16(uint16_t hw1,
+                struct mmio_insn *decoded)
+{
+    uint32_t op;
+
+    decoded->load = (hw1 >> 11) & 1;
+    decoded->rn = (hw1 >> 3) & 0x7;
+    decoded->rt = hw1 & 0x7;
+    switch (hw1 >> 12) {
+    case 0x5:
+        op = (hw1 >> 9) & 0x7;
+        decoded->load = _thumb_ldst_reg[op][0];
+        decoded->size = _thumb_ldst_reg[op][1];
+        decoded->sign = _thumb_ldst_reg[op][2];
+        decoded->rm = (hw1 >> 6) & 0x7;
+        break;
+    case 0x6:
+        decoded->imm = ((hw1 >> 6) & 0x1F) << 2;
+        break;
+    case 0x7:
+        decoded->size = VDEV_ACCESS_BYTE;
+        decoded->imm = (hw1 >> 6) & 0x1F;
+        break;
+    case 0x8:
+        decoded->size = VDEV_ACCESS_HWORD;
+        decoded->imm = ((hw1 >> 6) & 0x1F) << 1;
+        break;
+    case 0x9:
+        decoded->rn = 13;
+        decoded->rt = (hw1 >> 8) & 0x7;
+        decoded->imm = (hw1 & 0xFF) << 2;
+        break;
+    case 0xC:
+        /* LDMIA, STMIA: LDM writes back unless Rn is loaded */
+        decoded->block = 1;
+        decoded->rn = (hw1 >> 8) & 0x7;
+        decoded->rt = MMIO_INSN_NO_REG;
+        decoded->list = hw1 & 0xFF;
+        decoded->index = 0;
+        decoded->wback = !decoded->load ||
+                         !(decoded->list & (1 << decoded->rn));
+        break;
+    default:
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    }
+
+    return mmio_decode_check(decoded);
+}
+
+static hvmm_status_t mmio_decode_thumb32(uint16_t hw1, uint16_t hw2,
+                struct mmio_insn *decoded)
+{
+    uint32_t op;
+
+    decoded->load = (hw1 >> 4) & 1;
+    decoded->rn = hw1 & 0xF;
+    if ((hw1 & 0xFE00) == 0xF800) {
+        /* LDR{B,H,SB,SH}, STR{B,H} */
+        decoded->size = (hw1 >> 5) & 0x3;
+        decoded->sign = (hw1 >> 8) & 1;
+        decoded->rt = hw2 >> 12;
+        if (decoded->size == VDEV_ACCESS_RESERVED || (decoded->sign &&
+                (!decoded->load || decoded->size == VDEV_ACCESS_WORD)))
+            return HVMM_STATUS_UNSUPPORTED_FEATURE;
+        if (hw1 & (1 << 7)) {
+            decoded->imm = hw2 & 0xFFF;
+        } else if (hw2 & (1 << 11)) {
+            /* PUW = 110 is LDRT/STRT */
+            if (((hw2 >> 8) & 0x7) == 0x6)
+                return HVMM_STATUS_UNSUPPORTED_FEATURE;
+            decoded->index = (hw2 >> 10) & 1;
+            decoded->add = (hw2 >> 9) & 1;
+            decoded->wback = (hw2 >> 8) & 1;
+            decoded->imm = hw2 & 0xFF;
+            if (!decoded->index && !decoded->wback)
+                return HVMM_STATUS_UNSUPPORTED_FEATURE;
+        } else if (!(hw2 & 0x0FC0)) {
+            decoded->rm = hw2 & 0xF;
+            decoded->shift_imm = (hw2 >> 4) & 0x3;
+        } else
+            return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    } else if ((hw1 & 0xFE40) == 0xE840) {
+        /* LDRD, STRD, P = W = 0 is load/store exclusive */
+        decoded->index = (hw1 >> 8) & 1;
+        decoded->add = (hw1 >> 7) & 1;
+        decoded->wback = (hw1 >> 5) & 1;
+        if (!decoded->index && !decoded->wback)
+            return HVMM_STATUS_UNSUPPORTED_FEATURE;
+        decoded->rt = hw2 >> 12;
+        decoded->rt2 = (hw2 >> 8) & 0xF;
+        decoded->imm = (hw2 & 0xFF) << 2;
+    } else if ((hw1 & 0xFE40) == 0xE800) {
+        /* LDMIA, LDMDB, STMIA, STMDB, not SRS and RFE */
+        op = (hw1 >> 7) & 0x3;
+        if (op != 0x1 && op != 0x2)
+            return HVMM_STATUS_UNSUPPORTED_FEATURE;
+        decoded->block = 1;
+        decoded->index = (op == 0x2);
+        decoded->add = (op == 0x1);
+        decoded->wback = (hw1 >> 5) & 1;
+        decoded->list = hw2 & 0xDFFF;
+        if (hw2 & (1 << 13))
+            return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    } else
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    return mmio_decode_check(decoded);
+}
+
+hvmm_status_t mmio_decode_thumb(uint16_t hw1, uint16_t hw2,
+                struct mmio_insn *decoded)
+{
+    if (!MMIO_THUMB_IS_32BIT(hw1)) {
+        mmio_decode_clear(decoded, 1, 2);
+        return mmio_decode_thumb16(hw1, decoded);
+    }
+    mmio_decode_clear(decoded, 1, 4);
+    return mmio_decode_thumb32(hw1, hw2, decoded);
+}
+
+uint32_t mmio_insn_count(const struct mmio_insn *decoded)
+{
+    uint32_t list = decoded->list;
+    uint32_t count = 0;
+
+    if (!decoded->block)
+        return decoded->rt2 == MMIO_INSN_NO_REG ? 1 : 2;
+
+    for (; list; list &= list - 1)
+        count++;
+    return count;
+}
+
+uint32_t mmio_insn_reg(const struct mmio_insn *decoded, uint32_t i)
+{
+    uint32_t reg;
+
+    if (!decoded->block)
+        return i ? decoded->rt2 : decoded->rt;
+
+    for (reg = 0; reg < 16; reg++) {
+        if (!(decoded->list & (1 << reg)))
+            continue;
+        if (!i--)
+            break;
+    }
+    return reg;
+}
+
+static uint32_t mmio_insn_shift(const struct mmio_insn *decoded,
+                uint32_t rm, uint32_t carry)
+{
+    uint32_t n = decoded->shift_imm;
+
+    switch (decoded->shift_type) {
+    case MMIO_SHIFT_LSL:
+        return rm << n;
+    case MMIO_SHIFT_LSR:
+        /* Immediate 0 encodes 32 */
+        return n ? rm >> n : 0;
+    case MMIO_SHIFT_ASR:
+        return (uint32_t) ((int32_t) rm >> (n ? n : 31));
+    default:
+        if (!n)
+            return (carry << 31) | (rm >> 1);
+        return (rm >> n) | (rm << (32 - n));
+    }
+}
+
+uint32_t mmio_insn_address(const struct mmio_insn *decoded, uint32_t rn,
+                uint32_t rm, uint32_t carry, uint32_t *wback)
+{
+    uint32_t offset;
+    uint32_t offset_addr;
+
+    if (decoded->block)
+        offset = mmio_insn_count(decoded) * 4;
+    else if (decoded->rm != MMIO_INSN_NO_REG)
+        offset = mmio_insn_shift(decoded, rm, carry);
+    else
+        offset = decoded->imm;
+    offset_addr = decoded->add ? rn + offset : rn - offset;
+    *wback = decoded->wback ? offset_addr : rn;
+
+    if (!decoded->block)
+        return decoded->index ? offset_addr : rn;
+    /* IA, IB, DA, DB */
+    if (decoded->add)
+        return decoded->index ? rn + 4 : rn;
+    return decoded->index ? offset_addr : offset_addr + 4;
+}
+
+const struct mmio_insn *mmio_decode_lookup(vmid_t vmid, uint32_t pc,
+                uint32_t ctx, uint32_t encoding, uint8_t thumb)
+{
+    struct mmio_insn *entry;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return 0;
+
+    entry = &_decode_cache[vmid][(pc >> 1) % MMIO_DECODE_CACHE_ENTRIES];
+    if (!entry->len || entry->pc != pc || entry->ctx != ctx ||
+            entry->encoding != encoding || entry->thumb != thumb)
+        return 0;
+    return entry;
+}
+
+void mmio_decode_insert(vmid_t vmid, const struct mmio_insn *decoded)
+{
+    if (vmid >= NUM_GUESTS_STATIC)
+        return;
+
+    _decode_cache[vmid][(decoded->pc >> 1) % MMIO_DECODE_CACHE_ENTRIES] =
+        *decoded;
+}
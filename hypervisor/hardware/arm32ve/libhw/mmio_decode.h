@@ -0,0 +1,113 @@
+#ifndef __MMIO_DECODE_H__
+#define __MMIO_DECODE_H__
+#include <arch_types.h>
+#include <hvmm_types.h>
+
+/*
+ * Decoder of the load/store instructions a guest can access an emulated
+ * device with when the Data Abort syndrome is not valid(HSR.ISV = 0):
+ * writeback addressing, register offsets, LDRD/STRD and LDM/STM, in the
+ * ARM and the Thumb-2 instruction sets.
+ */
+
+#define MMIO_DECODE_CACHE_ENTRIES   16
+#define MMIO_INSN_NO_REG            0xFF
+
+/* Thumb: first halfword of a 32-bit instruction */
+#define MMIO_THUMB_IS_32BIT(hw1)    (((hw1) >> 11) >= 0x1D)
+
+enum mmio_shift {
+    MMIO_SHIFT_LSL = 0,
+    MMIO_SHIFT_LSR,
+    MMIO_SHIFT_ASR,
+    MMIO_SHIFT_ROR,     /* RRX if shift_imm is 0 */
+};
+
+/**
+ * @brief Decoded load/store.
+ *
+ * A single or dual transfer accesses rt(and rt2) at Rn +/- offset, or at
+ * Rn for post-indexed forms. A block transfer(LDM/STM) accesses the
+ * registers of list in ascending order from the lowest address.
+ */
+struct mmio_insn {
+    /*
+     * Key of the decode cache: guest PC and TTBR0, 0 if empty, and the
+     * encoding, first halfword in the low bits for Thumb
+     */
+    uint32_t pc;
+    uint32_t ctx;
+    uint32_t encoding;
+    uint8_t thumb;
+    /* Length of the instruction in bytes */
+    uint8_t len;
+    uint8_t load;
+    /* enum vdev_access_size of each transfer */
+    uint8_t size;
+    uint8_t sign;
+    uint8_t block;
+    uint8_t rt;
+    uint8_t rt2;
+    uint8_t rn;
+    /* MMIO_INSN_NO_REG for an immediate offset */
+    uint8_t rm;
+    uint8_t shift_type;
+    uint8_t shift_imm;
+    /* P, U and W bits */
+    uint8_t index;
+    uint8_t add;
+    uint8_t wback;
+    uint16_t imm;
+    uint16_t list;
+};
+
+/**
+ * @brief Decodes an ARM instruction.
+ * @return HVMM_STATUS_UNSUPPORTED_FEATURE if not a supported load/store.
+ */
+hvmm_status_t mmio_decode_arm(uint32_t insn, struct mmio_insn *decoded);
+
+/**
+ * @brief Decodes a Thumb instruction.
+ * @param hw2 Second halfword, ignored for a 16-bit instruction.
+ * @return HVMM_STATUS_UNSUPPORTED_FEATURE if not a supported load/store.
+ */
+hvmm_status_t mmio_decode_thumb(uint16_t hw1, uint16_t hw2,
+                struct mmio_insn *decoded);
+
+/**
+ * @brief Number of registers a decoded instruction transfers, and the
+ * register of transfer \a i.
+ */
+uint32_t mmio_insn_count(const struct mmio_insn *decoded);
+uint32_t mmio_insn_reg(const struct mmio_insn *decoded, uint32_t i);
+
+/**
+ * @brief Computes the address of the first transfer.
+ *
+ * @param rn Value of the base register.
+ * @param rm Value of the offset register, if any.
+ * @param carry CPSR.C, for RRX.
+ * @param wback Output value of the base register after the instruction.
+ * @return Address of the first transfer, the next ones follow it.
+ */
+uint32_t mmio_insn_address(const struct mmio_insn *decoded, uint32_t rn,
+                uint32_t rm, uint32_t carry, uint32_t *wback);
+
+/**
+ * @brief Looks the instruction of a guest up in its decode cache.
+ *
+ * The encoding is part of the key: the guest may have rewritten the
+ * instruction without a TLB or a cache maintenance the hypervisor sees.
+ * @return 0 on a miss.
+ */
+const struct mmio_insn *mmio_decode_lookup(vmid_t vmid, uint32_t pc,
+                uint32_t ctx, uint32_t encoding, uint8_t thumb);
+
+/**
+ * @brief Caches a decoded instruction of a guest, replacing the entry of
+ * its PC.
+ */
+void mmio_decode_insert(vmid_t vmid, const struct mmio_insn *decoded);
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef __PGTABLE_H__
+#define __PGTABLE_H__
+#include <k-hypervisor-config.h>
+#include <lpae.h>
+
+/**
+ * @file pgtable.h
+ *
+ * Layout of the translation tables of the hypervisor(PL2 stage-1) and of
+ * the guests(stage-2).
+ *
+ * The tables are static configuration: pgtable_gen(tools/pgtable_gen.c)
+ * builds them on the build host from k-hypervisor-config.h and the guest
+ * memory maps of the board(guest_map.h). pgtables.S reserves them in
+ * .pgtables, which the boot code does not zero, and holds the runs of the
+ * descriptors the MMU or the hypervisor may read, memory_hw.c writes the
+ * runs out at boot. The next-level table address of a table descriptor is
+ * built as an offset from the level 1 table of its hierarchy, memory_hw.c
+ * adds the link address of the level 1 table then.
+ *
+ * The hyp flat map is made of 1GB and 2MB blocks, only the image of the
+ * hypervisor, from CFG_MEMMAP_MON_OFFSET to the heap, is mapped by pages:
+ * its code is cacheable, the rest of it is not.
+ *
+ * The level 3 table of a guest level 2 entry is only written if the entry
+ * is valid or covers the guest RAM. memory_hw.c clears it before it makes
+ * another level 2 entry valid.
+ */
+
+/* PL2 Stage 1 Level 1 */
+#define HMM_L1_PTE_NUM  512
+
+/* PL2 Stage 1 Level 2 */
+#define HMM_L2_PTE_NUM  512
+
+/* PL2 Stage 1 Level 3 */
+#define HMM_L3_PTE_NUM  512
+/* Level 3 tables of the image, from CFG_MEMMAP_MON_OFFSET to HEAP_ADDR */
+#define HMM_L3_TABLE_NUM    ((HEAP_ADDR - CFG_MEMMAP_MON_OFFSET) >> L2_SHIFT)
+
+#define HEAP_ADDR (CFG_MEMMAP_MON_OFFSET + 0x02000000)
+#define HEAP_SIZE 0x0D000000
+
+#define L2_ENTRY_MASK 0x1FF
+#define L2_SHIFT 21
+
+#define L3_ENTRY_MASK 0x1FF
+#define L3_SHIFT 12
+
+#define HEAP_END_ADDR (HEAP_ADDR + HEAP_SIZE)
+
+/**
+ * @brief Total number of entries of the hypervisor tables.
+ *
+ * The level 1, the level 2 and the level 3 tables follow each other:
+ * _hmm_pgtable, _hmm_pgtable_l2 and _hmm_pgtable_l3.
+ */
+#define HMM_PTE_NUM_TOTAL   (HMM_L1_PTE_NUM + HMM_L2_PTE_NUM \
+        + HMM_L3_TABLE_NUM * HMM_L3_PTE_NUM)
+
+/* Stage 2 Level 1 */
+#define VMM_L1_PTE_NUM          4
+#define VMM_L1_PADDING_PTE_NUM   (512 - VMM_L1_PTE_NUM)
+/* Stage 2 Level 2 */
+#define VMM_L2_PTE_NUM          512
+#define VMM_L3_PTE_NUM          512
+/**
+ * @brief Gets total number of level 2 and level 3 page table entry.
+ *
+ * <pre>
+ * VMM_L2_PTE_NUM * VMM_L3_PTE_NUM = /
+ * Total Number Of Level 3 Page Table Entry
+ * + VMM_L2_PTE_NUM = Total Number Of Level 2 Page Table Entry
+ * </pre>
+ *
+ * @return Total number of l2, l3 table entry.
+ */
+#define VMM_L2L3_PTE_NUM_TOTAL  (VMM_L2_PTE_NUM \
+        * VMM_L3_PTE_NUM + VMM_L2_PTE_NUM)
+/**
+ * @brief Gets total number of all page table entries.
+ */
+#define VMM_PTE_NUM_TOTAL  (VMM_L1_PTE_NUM                  \
+        + VMM_L1_PADDING_PTE_NUM + VMM_L2L3_PTE_NUM_TOTAL   \
+        * VMM_L1_PTE_NUM)
+
+/* Cacheable(outer) normal memory: the RAM of a guest */
+#define MEMATTR_OUTER_MASK      0xC
+
+/**
+ * @brief Obtains TTBL_L3 entry.
+ * Returns the address of TTBL l3 at 'index_l2' entry of L2.
+ *
+ * - union lpaed *TTBL_L3(union lpaed *ttbl_l2, uint32_t index_l2);
+ *
+ */
+#define TTBL_L3(ttbl_l2, index_l2) \
+    (&ttbl_l2[VMM_L2_PTE_NUM + (VMM_L3_PTE_NUM * (index_l2))])
+/**
+ * @brief Obtains TTBL_L2 Entry.
+ * Returns the address of TTBL l2 at 'index_l1' entry of L1.
+ *
+ * - union lpaed *TTBL_L2(union lpaed *ttbl_l1, uint32_t index_l1);
+ *
+ */
+#define TTBL_L2(ttbl_l1, index_l1) \
+    (&ttbl_l1[(VMM_L1_PTE_NUM + VMM_L1_PADDING_PTE_NUM) \
+              + (VMM_L2L3_PTE_NUM_TOTAL * (index_l1))])
+
+/**
+ * @brief Run of generated descriptors: count entries from entry index of
+ * _pgtables, desc, desc + stride, desc + 2 * stride...
+ */
+struct pgtable_run {
+    uint32_t index;
+    uint32_t count;
+    uint64_t desc;
+    uint32_t stride;
+    uint32_t reserved;
+};
+
+/* Generated tables, pgtables.S. _pgtables is the start of all of them */
+extern union lpaed _pgtables[];
+extern const struct pgtable_run _pgtable_runs[];
+extern const struct pgtable_run _pgtable_runs_end[];
+extern union lpaed _hmm_pgtable[HMM_L1_PTE_NUM];
+extern union lpaed _hmm_pgtable_l2[HMM_L2_PTE_NUM];
+extern union lpaed _hmm_pgtable_l3[HMM_L3_TABLE_NUM][HMM_L3_PTE_NUM];
+extern union lpaed _ttbl_guest0[VMM_PTE_NUM_TOTAL];
+extern union lpaed _ttbl_guest1[VMM_PTE_NUM_TOTAL];
+
+#endif
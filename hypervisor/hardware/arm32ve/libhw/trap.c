@@ -3,12 +3,32 @@
 #include <gic.h>
 #include <trap.h>
 #include <guest.h>
+#include <trace.h>
+#include <stats.h>
 #include <vdev.h>
 #include <traps.h>
 
 #define DEBUG
 #include <log/print.h>
 #include <interrupt.h>
+#include <memory.h>
+#include <asm-arm_inline.h>
+#include <mmio_decode.h>
+#include <sections.h>
+
+#define TRAP_BANKED_READ(reg)   ({ uint32_t rval; asm volatile(\
+                                " mrs     %0, " #reg "\n\t" \
+                                : "=r" (rval) : : "memory", "cc"); rval; })
+#define TRAP_BANKED_WRITE(reg, val) asm volatile(\
+                                " msr     " #reg ", %0\n\t" \
+                                : : "r" ((val)) : "memory", "cc")
+#define TRAP_BANKED(reg, write, pvalue) \
+    do { \
+        if (write) \
+            TRAP_BANKED_WRITE(reg, *(pvalue)); \
+        else \
+            *(pvalue) = TRAP_BANKED_READ(reg); \
+    } while (0)
 
 /**\defgroup ARM
  * <pre> ARM registers.
@@ -22,7 +42,7 @@
  * \ref ARM
  * @return Returns HVMM_STATUS_UNKNOWN_ERROR only.
  */
-hvmm_status_t _hyp_dabort(struct arch_regs *regs)
+hvmm_status_t __cold _hyp_dabort(struct arch_regs *regs)
 {
     guest_dump_regs(regs);
     hyp_abort_infinite();
@@ -35,9 +55,10 @@ hvmm_status_t _hyp_dabort(struct arch_regs *regs)
  * \ref ARM
  * @return Returns HVMM_STATUS_SUCCESS only.
  */
-hvmm_status_t _hyp_irq(struct arch_regs *regs)
+hvmm_status_t __hot _hyp_irq(struct arch_regs *regs)
 {
     uint32_t irq;
+    guest_account_entry();
     irq = gic_get_irq_number();
     interrupt_service_routine(irq, (void *)regs, 0);
     guest_perform_switch(regs);
@@ -51,7 +72,7 @@ hvmm_status_t _hyp_irq(struct arch_regs *regs)
  * \ref ARM
  * @return Returns HVMM_STATUS_UNKNOWN_ERROR only.
  */
-hvmm_status_t _hyp_unhandled(struct arch_regs *regs)
+hvmm_status_t __cold _hyp_unhandled(struct arch_regs *regs)
 {
     guest_dump_regs(regs);
     hyp_abort_infinite();
@@ -64,14 +85,14 @@ hvmm_status_t _hyp_unhandled(struct arch_regs *regs)
  * @return Returns the result is the same as _hyp_hvc_service().
  * @todo Within the near future, this function will be deleted.
  */
-enum hyp_hvc_result _hyp_hvc(struct arch_regs *regs)
+enum hyp_hvc_result __hot _hyp_hvc(struct arch_regs *regs)
 {
     return _hyp_hvc_service(regs);
 }
 
 /**@brief Shows temporary banked registers for debugging.
  */
-static void _trap_dump_bregs(void)
+static void __cold _trap_dump_bregs(void)
 {
     uint32_t spsr, lr, sp;
 
@@ -89,6 +110,218 @@ static void _trap_dump_bregs(void)
     printh(" - irq: spsr:%x sp:%x lr:%x\n", spsr, sp, lr);
 }
 
+/**@brief Reads or writes a register of the guest in its current mode.
+ * SP and LR of the guest mode are banked registers, r8-r12 of FIQ mode
+ * are not emulated.
+ * @param n Register number, from 0 to 14.
+ * @return HVMM_STATUS_UNSUPPORTED_FEATURE if not emulated.
+ */
+static hvmm_status_t trap_guest_reg(struct arch_regs *regs, uint32_t n,
+                uint32_t write, uint32_t *value)
+{
+    uint32_t mode = regs->cpsr & CPSR_MODE_MASK;
+
+    if (mode == CPSR_MODE_FIQ && n >= 8)
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    if (n < ARCH_REGS_NUM_GPR) {
+        if (write)
+            regs->gpr[n] = *value;
+        else
+            *value = regs->gpr[n];
+        return HVMM_STATUS_SUCCESS;
+    }
+
+    switch (mode) {
+    case CPSR_MODE_USER:
+    case CPSR_MODE_SYS:
+        if (n == 13)
+            TRAP_BANKED(sp_usr, write, value);
+        else if (write)
+            regs->lr = *value;
+        else
+            *value = regs->lr;
+        break;
+    case CPSR_MODE_SVC:
+        if (n == 13)
+            TRAP_BANKED(sp_svc, write, value);
+        else
+            TRAP_BANKED(lr_svc, write, value);
+        break;
+    case CPSR_MODE_IRQ:
+        if (n == 13)
+            TRAP_BANKED(sp_irq, write, value);
+        else
+            TRAP_BANKED(lr_irq, write, value);
+        break;
+    case CPSR_MODE_ABT:
+        if (n == 13)
+            TRAP_BANKED(sp_abt, write, value);
+        else
+            TRAP_BANKED(lr_abt, write, value);
+        break;
+    case CPSR_MODE_UND:
+        if (n == 13)
+            TRAP_BANKED(sp_und, write, value);
+        else
+            TRAP_BANKED(lr_und, write, value);
+        break;
+    default:
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    }
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**@brief Reads a halfword or a word of the guest at virtual address va,
+ * through the stage 1 and 2 translations of the guest.
+ */
+static hvmm_status_t trap_fetch_guest(uint32_t va, uint32_t size,
+                uint32_t *value)
+{
+    *value = 0;
+    return memory_copy_from_guest(guest_current_vmid(), value, va, size,
+            MEMORY_GUEST_VA);
+}
+
+/* Thumb: the first halfword in the low bits */
+static hvmm_status_t trap_fetch_insn(struct arch_regs *regs, uint32_t *insn)
+{
+    uint32_t hw2 = 0;
+
+    if (trap_fetch_guest(regs->pc, (regs->cpsr & CPSR_THUMB) ? 2 : 4, insn))
+        return HVMM_STATUS_BAD_ACCESS;
+    if ((regs->cpsr & CPSR_THUMB) && MMIO_THUMB_IS_32BIT(*insn)) {
+        if (trap_fetch_guest(regs->pc + 2, 2, &hw2))
+            return HVMM_STATUS_BAD_ACCESS;
+        *insn |= hw2 << 16;
+    }
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t trap_decode_mmio(struct arch_regs *regs, uint32_t ctx,
+                uint32_t insn, struct mmio_insn *decoded)
+{
+    hvmm_status_t result;
+
+    if (!(regs->cpsr & CPSR_THUMB))
+        result = mmio_decode_arm(insn, decoded);
+    else
+        result = mmio_decode_thumb(insn & 0xFFFF, insn >> 16, decoded);
+    if (result)
+        printh("[hyp] mmio: cannot emulate %x at pc %x\n", insn, regs->pc);
+    decoded->pc = regs->pc;
+    decoded->ctx = ctx;
+    decoded->encoding = insn;
+
+    return result;
+}
+
+/* Steps ITSTATE past the emulated instruction of an IT block */
+static void trap_advance_it(struct arch_regs *regs)
+{
+    uint32_t it = ((regs->cpsr >> 25) & 0x3) | ((regs->cpsr >> 8) & 0xFC);
+
+    if (!it)
+        return;
+    if (it & 0x7)
+        it = (it & 0xE0) | ((it << 1) & 0x1F);
+    else
+        it = 0;
+    regs->cpsr = (regs->cpsr & ~CPSR_IT_MASK) | ((it & 0x3) << 25) |
+                 ((it & 0xFC) << 8);
+}
+
+/**@brief Emulates a data abort on an emulated device without a valid
+ * instruction syndrome(HSR.ISV = 0), e.g. LDM/STM, LDRD/STRD or
+ * writeback addressing.
+ *
+ * The instruction is fetched on every abort. Its decoding is kept in a
+ * decode cache, one entry per guest PC and encoding. Each transfer is a
+ * vdev access. The transfers have to stay in the page of the faulting
+ * address.
+ * @return VDEV_ERROR if the instruction can not be emulated.
+ */
+static int32_t trap_emulate_mmio(struct arch_regs *regs, uint32_t fipa,
+                uint32_t far, uint32_t iss)
+{
+    vmid_t vmid = guest_current_vmid();
+    uint32_t ctx = read_ttbr0();
+    const struct mmio_insn *decoded;
+    struct mmio_insn insn;
+    struct arch_vdev_trigger_info info;
+    uint32_t rn, rm = 0, wback;
+    uint32_t va, step, count;
+    uint32_t i, value, encoding;
+    int32_t vdev_num;
+
+    if (trap_fetch_insn(regs, &encoding))
+        return VDEV_ERROR;
+    decoded = mmio_decode_lookup(vmid, regs->pc, ctx, encoding,
+            (regs->cpsr & CPSR_THUMB) != 0);
+    if (!decoded) {
+        if (trap_decode_mmio(regs, ctx, encoding, &insn))
+            return VDEV_ERROR;
+        mmio_decode_insert(vmid, &insn);
+        decoded = &insn;
+    }
+
+    if (trap_guest_reg(regs, decoded->rn, 0, &rn) ||
+            (decoded->rm != MMIO_INSN_NO_REG &&
+             trap_guest_reg(regs, decoded->rm, 0, &rm)))
+        return VDEV_ERROR;
+    va = mmio_insn_address(decoded, rn, rm,
+            (regs->cpsr >> CPSR_C_SHIFT) & 1, &wback);
+    step = 1 << decoded->size;
+    count = mmio_insn_count(decoded);
+    if (((va ^ far) | ((va + count * step - 1) ^ far)) &
+            ~HPFAR_FIPA_PAGE_MASK)
+        return VDEV_ERROR;
+
+    info.ec = TRAP_EC_NON_ZERO_DATA_ABORT_FROM_OTHER_MODE;
+    info.iss = iss;
+    info.il = decoded->len == 4;
+    info.sas = decoded->size;
+    info.value = &value;
+    /* The loaded registers take precedence over the base */
+    if (decoded->load && trap_guest_reg(regs, decoded->rn, 1, &wback))
+        return VDEV_ERROR;
+    for (i = 0; i < count; i++, va += step) {
+        info.fipa = (fipa & ~HPFAR_FIPA_PAGE_MASK) |
+                    (va & HPFAR_FIPA_PAGE_MASK);
+        vdev_num = vdev_find(VDEV_LEVEL_LOW, &info, regs);
+        if (vdev_num < 0)
+            return VDEV_ERROR;
+
+        if (!decoded->load) {
+            if (trap_guest_reg(regs, mmio_insn_reg(decoded, i), 0, &value) ||
+                    vdev_write(VDEV_LEVEL_LOW, vdev_num, &info, regs) < 0)
+                return VDEV_ERROR;
+            continue;
+        }
+        if (vdev_read(VDEV_LEVEL_LOW, vdev_num, &info, regs) < 0)
+            return VDEV_ERROR;
+        if (decoded->size == VDEV_ACCESS_BYTE) {
+            value &= 0xFF;
+            if (decoded->sign)
+                value = (value ^ 0x80) - 0x80;
+        } else if (decoded->size == VDEV_ACCESS_HWORD) {
+            value &= 0xFFFF;
+            if (decoded->sign)
+                value = (value ^ 0x8000) - 0x8000;
+        }
+        if (trap_guest_reg(regs, mmio_insn_reg(decoded, i), 1, &value))
+            return VDEV_ERROR;
+    }
+    if (!decoded->load && trap_guest_reg(regs, decoded->rn, 1, &wback))
+        return VDEV_ERROR;
+
+    /* Instead of vdev_post(), which assumes a 16-bit Thumb instruction */
+    regs->pc += decoded->len;
+    if (decoded->thumb)
+        trap_advance_it(regs);
+
+    return 0;
+}
+
 /*
  * hvc #imm handler
  *
@@ -127,7 +360,7 @@ static void _trap_dump_bregs(void)
  * If hypervisor can b handled the exception then it returns HYP_RESULT_ERET.
  * If not, hypervisor should be stopped into trap_error in handler.
  */
-enum hyp_hvc_result _hyp_hvc_service(struct arch_regs *regs)
+enum hyp_hvc_result __hot _hyp_hvc_service(struct arch_regs *regs)
 {
     int32_t vdev_num = -1;
     uint32_t hsr = read_hsr();
@@ -140,6 +373,7 @@ enum hyp_hvc_result _hyp_hvc_service(struct arch_regs *regs)
     struct arch_vdev_trigger_info info;
     int level = VDEV_LEVEL_LOW;
 
+    guest_account_entry();
     printh("[hvc] _hyp_hvc_service: enter\n\r");
     fipa = (read_hpfar() & HPFAR_FIPA_MASK) >> HPFAR_FIPA_SHIFT;
     fipa = fipa << HPFAR_FIPA_PAGE_SHIFT;
@@ -150,6 +384,8 @@ enum hyp_hvc_result _hyp_hvc_service(struct arch_regs *regs)
     info.sas = (iss & ISS_SAS_MASK) >> ISS_SAS_SHIFT;
     srt = (iss & ISS_SRT_MASK) >> ISS_SRT_SHIFT;
     info.value = &(regs->gpr[srt]);
+    trace_event(TRACE_EVENT_TRAP, ec, iss, fipa);
+    stats_trap(ec);
 
     switch (ec) {
     case TRAP_EC_ZERO_UNKNOWN:
@@ -161,8 +397,8 @@ enum hyp_hvc_result _hyp_hvc_service(struct arch_regs *regs)
         regs->pc += 4;
         break;
     case TRAP_EC_ZERO_MCR_MRC_CP15:
-        printH("Trapped MCR or MRC access to CP15: %x\n", hsr);
-        emulate_access_to_cp15(iss, il);
+        /* Prints the accesses it does not emulate */
+        emulate_access_to_cp15(regs, iss, il);
         regs->pc += 4;
         break;
     case TRAP_EC_ZERO_MCRR_MRRC_CP15:
@@ -177,6 +413,12 @@ enum hyp_hvc_result _hyp_hvc_service(struct arch_regs *regs)
         printH("Trapped LDC or STC access to CP14: %x\n", hsr);
         break;
     case TRAP_EC_ZERO_HCRTR_CP0_CP13:
+        /* VFP/Advanced SIMD registers owned by another guest, replayed */
+        if (((iss & ISS_HCPTR_TA) ||
+                (iss & ISS_HCPTR_COPROC) == ISS_HCPTR_CP10 ||
+                (iss & ISS_HCPTR_COPROC) == ISS_HCPTR_CP11) &&
+                guest_hw_vfp_trap(_current_guest) == HVMM_STATUS_SUCCESS)
+            break;
         printH("HCPTR-trapped access to CP0-CP13: %x\n", hsr);
         break;
     case TRAP_EC_ZERO_MRC_VMRS_CP10:
@@ -199,6 +441,10 @@ enum hyp_hvc_result _hyp_hvc_service(struct arch_regs *regs)
         regs->pc += 4;
         break;
     case TRAP_EC_NON_ZERO_PREFETCH_ABORT_FROM_OTHER_MODE:
+        /* Instruction fetch from a page the working set sampler aged */
+        if (memory_fault(guest_current_vmid(), fipa, iss) ==
+                HVMM_STATUS_SUCCESS)
+            break;
         printH("Prefetch Abort routed to Hyp mode: %x\n", hsr);
         break;
     case TRAP_EC_NON_ZERO_PREFETCH_ABORT_FROM_HYP_MODE:
@@ -239,6 +485,18 @@ enum hyp_hvc_result _hyp_hvc_service(struct arch_regs *regs)
         vdev_post(level, vdev_num, &info, regs);
         break;
     case TRAP_EC_NON_ZERO_DATA_ABORT_FROM_OTHER_MODE:
+        /* Stage-2 faults on guest RAM replay the access once resolved */
+        if (memory_fault(guest_current_vmid(), fipa, iss) ==
+                HVMM_STATUS_SUCCESS)
+            break;
+        if (!(iss & ISS_VALID)) {
+            if (trap_emulate_mmio(regs, fipa, far, iss) < 0)
+                goto trap_error;
+            break;
+        }
+        /* Posted write to a coalesced zone */
+        if ((iss & ISS_WNR) && !vdev_coalesce_write(&info, regs))
+            break;
         level = VDEV_LEVEL_LOW;
         vdev_num = vdev_find(level, &info, regs);
         if (vdev_num < 0) {
@@ -267,6 +525,7 @@ enum hyp_hvc_result _hyp_hvc_service(struct arch_regs *regs)
     guest_perform_switch(regs);
     return HYP_RESULT_ERET;
 trap_error:
+    uart_console_sync();
     _trap_dump_bregs();
     hyp_abort_infinite();
 }
@@ -32,6 +32,12 @@
 #define EXTRACT_IL      25
 #define HSR_ISS_BIT     0x01FFFFFF
 
+/* ISS encoding for HCPTR traps: Advanced SIMD access, coprocessor number */
+#define ISS_HCPTR_TA        (1 << 5)
+#define ISS_HCPTR_COPROC    0xF
+#define ISS_HCPTR_CP10      10
+#define ISS_HCPTR_CP11      11
+
 /*
  * ISS encoding for Data Abort exceptions taken to Hyp mode as beloww
  * ISS[24] : instruction syndrome valid. 0 is invalid information in ISS.
@@ -69,6 +75,9 @@
 #define ACCESS_FAULT_LEVEL1                 0x09
 #define ACCESS_FAULT_LEVEL2                 0x0A
 #define ACCESS_FAULT_LEVEL3                 0x0B
+#define PERMISSION_FAULT_LEVEL1             0x0D
+#define PERMISSION_FAULT_LEVEL2             0x0E
+#define PERMISSION_FAULT_LEVEL3             0x0F
 
 #define ISS_WNR_SHIFT                       6
 #define ISS_WNR                             (1 << ISS_WNR_SHIFT)
@@ -4,10 +4,13 @@
 #include <gic.h>
 #include <gic_regs.h>
 #include <guest.h>
+#include <trace.h>
 #include <k-hypervisor-config.h>
 #include <asm-arm_inline.h>
 
 #include <log/print.h>
+#include <boot_profile.h>
+#include <sections.h>
 
 /* for test, surpress traces */
 #define __VGIC_DISABLE_TRACE__
@@ -96,7 +99,22 @@ static uint32_t _guest_virqatslot[NUM_GUESTS_STATIC][VGIC_NUM_MAX_SLOTS];
 
 static struct virq_entry _guest_virqs[NUM_GUESTS_STATIC][VIRQ_MAX_ENTRIES + 1];
 
-void vgic_slotpirq_init(void)
+/* Copies of the per-guest tables taken by virq_checkpoint() */
+static uint32_t _ckpt_pirqatslot[NUM_GUESTS_STATIC][VGIC_NUM_MAX_SLOTS];
+static uint32_t _ckpt_virqatslot[NUM_GUESTS_STATIC][VGIC_NUM_MAX_SLOTS];
+static struct virq_entry _ckpt_virqs[NUM_GUESTS_STATIC][VIRQ_MAX_ENTRIES + 1];
+
+/*
+ * Writes a List Register. gic_vgic_lr_update() lets a GIC that is not the
+ * hardware one refresh GICH_ELSR/EISR/MISR from the new List Registers.
+ */
+static inline void vgic_write_lr(uint32_t slot, uint32_t lr_desc)
+{
+    _vgic.base[GICH_LR + slot] = lr_desc;
+    gic_vgic_lr_update(slot);
+}
+
+void __init vgic_slotpirq_init(void)
 {
     int i, j;
     for (i = 0; i < NUM_GUESTS_STATIC; i++) {
@@ -163,7 +181,7 @@ void vgic_slotvirq_clear(vmid_t vmid, uint32_t slot)
     vgic_slotvirq_set(vmid, slot, VIRQ_INVALID);
 }
 
-hvmm_status_t virq_inject(vmid_t vmid, uint32_t virq,
+hvmm_status_t __hot virq_inject(vmid_t vmid, uint32_t virq,
                 uint32_t pirq, uint8_t hw)
 {
     hvmm_status_t result = HVMM_STATUS_BUSY;
@@ -191,7 +209,7 @@ hvmm_status_t virq_inject(vmid_t vmid, uint32_t virq,
     }
     return result;
 }
-hvmm_status_t vgic_flush_virqs(vmid_t vmid)
+hvmm_status_t __hot vgic_flush_virqs(vmid_t vmid)
 {
     /* Actual injection of queued VIRQs takes place here */
     int i;
@@ -206,6 +224,11 @@ hvmm_status_t vgic_flush_virqs(vmid_t vmid)
                         entries[i].pirq);
                 if (slot != VGIC_SLOT_NOTFOUND)
                     vgic_slotpirq_set(vmid, slot, entries[i].pirq);
+            } else if (entries[i].virq < VIRQ_NUM_SGIS) {
+                /* GICV_IAR gives the source vCPU of an SGI */
+                slot = vgic_inject_virq_sw(entries[i].virq,
+                        VIRQ_STATE_PENDING, GIC_INT_PRIORITY_DEFAULT,
+                        entries[i].pirq, 1);
             } else {
                 slot = vgic_inject_virq_sw(entries[i].virq,
                         VIRQ_STATE_PENDING, GIC_INT_PRIORITY_DEFAULT,
@@ -219,8 +242,10 @@ hvmm_status_t vgic_flush_virqs(vmid_t vmid)
             count++;
         }
     }
-    if (count > 0)
+    if (count > 0) {
+        trace_event(TRACE_EVENT_VIRQ_FLUSH, count, vmid, 0);
         printh("virq: injected %d virqs to vmid %d\n", count, vmid);
+    }
 
     return HVMM_STATUS_SUCCESS;
 }
@@ -277,10 +302,10 @@ static uint32_t vgic_is_free_slot(uint32_t slot)
  * <pre>
  * Initialized  : Whether the initialization VGIC.
  * Num ListRegs : The number of List registers.
- * LR_MASK      : Mask of the Number of Valid List Register.
+ * VTR          : VGIC Type Register.
  * </pre>
  */
-static void _vgic_dump_status(void)
+static void __init _vgic_dump_status(void)
 {
     /*
      * === VGIC Status Summary ===
@@ -303,16 +328,9 @@ static void _vgic_dump_status(void)
      * Virtual Machine Control
      *  -
      */
-    uart_print("=== VGIC Status ===\n\r");
-    uart_print(" Initialized:");
-    uart_print((VGIC_READY() ? "Yes" : "No"));
-    uart_print("\n\r");
-    uart_print(" Num ListRegs:");
-    uart_print_hex32(_vgic.num_lr);
-    uart_print("\n\r");
-    uart_print(" LR_MASK:");
-    uart_print_hex64(_vgic.valid_lr_mask);
-    uart_print("\n\r");
+    boot_log("vgic: initialized", VGIC_READY());
+    boot_log("vgic: num_lr", _vgic.num_lr);
+    boot_log("vgic: vtr", _vgic.base[GICH_VTR]);
 }
 
 /**
@@ -386,9 +404,10 @@ static void _vgic_isr_maintenance_irq(int irq, void *pregs, void *pdata)
         while (eisr) {
             slot = (31 - asm_clz(eisr));
             eisr &= ~(1 << slot);
-            _vgic.base[GICH_LR + slot] = 0;
+            vgic_write_lr(slot, 0);
             /* deactivate associated pirq at the slot */
             pirq = vgic_slotpirq_get(vmid, slot);
+            trace_event(TRACE_EVENT_VIRQ_EOI, slot, pirq, 0);
             if (pirq != PIRQ_INVALID) {
                 gic_deactivate_irq(pirq);
                 vgic_slotpirq_clear(vmid, slot);
@@ -402,9 +421,10 @@ static void _vgic_isr_maintenance_irq(int irq, void *pregs, void *pdata)
         while (eisr) {
             slot = (31 - asm_clz(eisr));
             eisr &= ~(1 << slot);
-            _vgic.base[GICH_LR + slot + 32] = 0;
+            vgic_write_lr(slot + 32, 0);
             /* deactivate associated pirq at the slot */
             pirq = vgic_slotpirq_get(vmid, slot + 32);
+            trace_event(TRACE_EVENT_VIRQ_EOI, slot + 32, pirq, 0);
             if (pirq != PIRQ_INVALID) {
                 gic_deactivate_irq(pirq);
                 vgic_slotpirq_clear(vmid, slot + 32);
@@ -517,7 +537,7 @@ uint32_t vgic_inject_virq(
     HVMM_TRACE_HEX32("lr_desc:", lr_desc);
     HVMM_TRACE_HEX32("free slot:", slot);
     if (slot != VGIC_SLOT_NOTFOUND) {
-        _vgic.base[GICH_LR + slot] = lr_desc;
+        vgic_write_lr(slot, lr_desc);
         vgic_injection_enable(1);
         vgic_enable(1);
     }
@@ -566,7 +586,7 @@ uint32_t vgic_inject_virq_sw(uint32_t virq, enum virq_state state,
  * @brief   Enables Virtual Maintenance Interrupt.
  * @return  Result status. Always return success.
  */
-static hvmm_status_t _vgic_maintenance_irq_enable(uint8_t enable)
+static hvmm_status_t __init _vgic_maintenance_irq_enable(uint8_t enable)
 {
     uint32_t irq = VGIC_MAINTENANCE_INTERRUPT_IRQ;
     HVMM_TRACE_ENTER();
@@ -605,7 +625,41 @@ hvmm_status_t virq_init(void)
     return HVMM_STATUS_SUCCESS;
 }
 
-hvmm_status_t vgic_init(void)
+hvmm_status_t virq_checkpoint(vmid_t vmid)
+{
+    int i;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return HVMM_STATUS_BAD_ACCESS;
+
+    for (i = 0; i < VGIC_NUM_MAX_SLOTS; i++) {
+        _ckpt_pirqatslot[vmid][i] = _guest_pirqatslot[vmid][i];
+        _ckpt_virqatslot[vmid][i] = _guest_virqatslot[vmid][i];
+    }
+    for (i = 0; i < (VIRQ_MAX_ENTRIES + 1); i++)
+        _ckpt_virqs[vmid][i] = _guest_virqs[vmid][i];
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t virq_rollback(vmid_t vmid)
+{
+    int i;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return HVMM_STATUS_BAD_ACCESS;
+
+    for (i = 0; i < VGIC_NUM_MAX_SLOTS; i++) {
+        _guest_pirqatslot[vmid][i] = _ckpt_pirqatslot[vmid][i];
+        _guest_virqatslot[vmid][i] = _ckpt_virqatslot[vmid][i];
+    }
+    for (i = 0; i < (VIRQ_MAX_ENTRIES + 1); i++)
+        _guest_virqs[vmid][i] = _ckpt_virqs[vmid][i];
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t __init vgic_init(void)
 {
     hvmm_status_t result = HVMM_STATUS_UNKNOWN_ERROR;
     HVMM_TRACE_ENTER();
@@ -623,6 +677,14 @@ hvmm_status_t vgic_init(void)
     return result;
 }
 
+hvmm_status_t vgic_init_cpu(void)
+{
+    /* The maintenance PPI and GICH are banked, its handler is shared */
+    interrupt_host_configure(VGIC_MAINTENANCE_INTERRUPT_IRQ);
+
+    return vgic_enable(1);
+}
+
 hvmm_status_t vgic_init_status(struct vgic_status *status, vmid_t vmid)
 {
     hvmm_status_t result = HVMM_STATUS_SUCCESS;
@@ -636,7 +698,7 @@ hvmm_status_t vgic_init_status(struct vgic_status *status, vmid_t vmid)
     return result;
 }
 
-hvmm_status_t vgic_save_status(struct vgic_status *status)
+hvmm_status_t __hot vgic_save_status(struct vgic_status *status)
 {
     hvmm_status_t result = HVMM_STATUS_SUCCESS;
     int i;
@@ -650,12 +712,12 @@ hvmm_status_t vgic_save_status(struct vgic_status *status)
     return result;
 }
 
-hvmm_status_t vgic_restore_status(struct vgic_status *status, vmid_t vmid)
+hvmm_status_t __hot vgic_restore_status(struct vgic_status *status, vmid_t vmid)
 {
     hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
     int i;
     for (i = 0; i < _vgic.num_lr; i++)
-        _vgic.base[GICH_LR + i] = status->lr[i];
+        vgic_write_lr(i, status->lr[i]);
     _vgic.base[GICH_APR] = status->apr;
     _vgic.base[GICH_VMCR] = status->vmcr;
     _vgic.base[GICH_HCR] = status->hcr;
@@ -2,6 +2,7 @@
 #define __VGIC_H__
 #include <arch_types.h>
 #include <hvmm_types.h>
+#include <sections.h>
 
 #define VGIC_NUM_MAX_SLOTS              64
 #define VGIC_SLOT_NOTFOUND              (0xFFFFFFFF)
@@ -20,7 +21,7 @@ struct vgic_status {
     uint32_t hcr;           /**< Hypervisor Control Register */
     uint32_t apr;           /**< Active Priorities Register */
     uint32_t vmcr;          /**< Virtual Machine Control Register */
-};
+} __cacheline_aligned;
 /**
  * @brief           Enable/Disable Virtual CPU interface operation.
  *
@@ -40,6 +41,13 @@ hvmm_status_t vgic_enable(uint8_t enable);
  * @return  Always returns "success".
  */
 hvmm_status_t vgic_init(void);
+/**
+ * @brief   Enables the Virtual Maintenance interrupt and the Virtual
+ *          Interface Control of a secondary CPU, once vgic_init() ran.
+ * @return  If Virtual Interface Control intialized, then returns "success",
+ *          otherwise returns "bad access".
+ */
+hvmm_status_t vgic_init_cpu(void);
 /**
  * @brief           Initializes Virtual Interface Control status for each guest.
  * @param status    vgic status. Refer to vgic_status.
@@ -86,4 +94,15 @@ hvmm_status_t virq_inject(vmid_t vmid, uint32_t virq,
  * @return  Always returns "success".
  */
 hvmm_status_t virq_init(void);
+/**
+ * @brief   Copies the slot tables and the queued virqs of a guest aside.
+ * @return  "bad access" for an invalid vmid, otherwise "success".
+ */
+hvmm_status_t virq_checkpoint(vmid_t vmid);
+/**
+ * @brief   Puts back the slot tables and queued virqs copied aside by
+ *          virq_checkpoint().
+ * @return  "bad access" for an invalid vmid, otherwise "success".
+ */
+hvmm_status_t virq_rollback(vmid_t vmid);
 #endif
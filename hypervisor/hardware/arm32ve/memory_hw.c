@@ -3,9 +3,15 @@
 #include <arch_types.h>
 #include <hvmm_trace.h>
 #include <lpae.h>
+#include <pgtable.h>
 #include <memory.h>
 #include <log/print.h>
 #include <log/uart_print.h>
+#include <boot_profile.h>
+#include <log/string.h>
+#include <trap.h>
+#include <guest.h>
+#include <sections.h>
 
 /**
  * \defgroup Memory_Attribute_Indirection_Register
@@ -148,52 +154,8 @@
 #define HTCR_T0SZ_SHIFT             0
 /** @} */
 
-/* PL2 Stage 1 Level 1 */
-#define HMM_L1_PTE_NUM  512
-
-/* PL2 Stage 1 Level 2 */
-#define HMM_L2_PTE_NUM  512
-
-/* PL2 Stage 1 Level 3 */
-#define HMM_L3_PTE_NUM  512
-
-#define HEAP_ADDR (CFG_MEMMAP_MON_OFFSET + 0x02000000)
-#define HEAP_SIZE 0x0D000000
-
-#define L2_ENTRY_MASK 0x1FF
-#define L2_SHIFT 21
-
-#define L3_ENTRY_MASK 0x1FF
-#define L3_SHIFT 12
-
-#define HEAP_END_ADDR (HEAP_ADDR + HEAP_SIZE)
 #define NALLOC 1024
 
-/* Stage 2 Level 1 */
-#define VMM_L1_PTE_NUM          4
-#define VMM_L1_PADDING_PTE_NUM   (512 - VMM_L1_PTE_NUM)
-/* Stage 2 Level 2 */
-#define VMM_L2_PTE_NUM          512
-#define VMM_L3_PTE_NUM          512
-/**
- * @brief Gets total number of level 2 and level 3 page table entry.
- *
- * <pre>
- * VMM_L2_PTE_NUM * VMM_L3_PTE_NUM = /
- * Total Number Of Level 3 Page Table Entry
- * + VMM_L2_PTE_NUM = Total Number Of Level 2 Page Table Entry
- * </pre>
- *
- * @return Total number of l2, l3 table entry.
- */
-#define VMM_L2L3_PTE_NUM_TOTAL  (VMM_L2_PTE_NUM \
-        * VMM_L3_PTE_NUM + VMM_L2_PTE_NUM)
-/**
- * @brief Gets total number of all page table entries.
- */
-#define VMM_PTE_NUM_TOTAL  (VMM_L1_PTE_NUM                  \
-        + VMM_L1_PADDING_PTE_NUM + VMM_L2L3_PTE_NUM_TOTAL   \
-        * VMM_L1_PTE_NUM)
 /**
  * \defgroup VTTBR
  *
@@ -267,37 +229,63 @@
  */
 
 static union lpaed *_vmid_ttbl[NUM_GUESTS_STATIC];
-static union lpaed
-_ttbl_guest0[VMM_PTE_NUM_TOTAL] __attribute((__aligned__(4096)));
-static union lpaed
-_ttbl_guest1[VMM_PTE_NUM_TOTAL] __attribute((__aligned__(4096)));
+
+#define LPAE_BLOCK_L1_SHIFT     30
 
 /**
- * @brief Obtains TTBL_L3 entry.
- * Returns the address of TTBL l3 at 'index_l2' entry of L2.
- *
- * - union lpaed *TTBL_L3(union lpaed *ttbl_l2, uint32_t index_l2);
- *
+ * @brief Guest RAM region.
+ *
+ * The first normal memory descriptor of a guest memory map, recorded to
+ * find the RAM pages of the guest in its stage-2 translation table.
+ * - ipa Intermediate physical address of the region.
+ * - pa Physical address of the region.
+ * - size Size of the region.
+ * - attr Memory attribute of the region.
  */
-#define TTBL_L3(ttbl_l2, index_l2) \
-    (&ttbl_l2[VMM_L2_PTE_NUM + (VMM_L3_PTE_NUM * (index_l2))])
+struct guest_ram_region {
+    uint64_t ipa;
+    uint64_t pa;
+    uint32_t size;
+    enum memattr attr;
+};
+
+static struct guest_ram_region _guest_ram[NUM_GUESTS_STATIC];
+
+#ifdef CFG_MEMMAP_CHECKPOINT_OFFSET
 /**
- * @brief Obtains TTBL_L2 Entry.
- * Returns the address of TTBL l2 at 'index_l1' entry of L1.
- *
- * - union lpaed *TTBL_L2(union lpaed *ttbl_l1, uint32_t index_l1);
- *
+ * \defgroup Guest_checkpoint
+ *
+ * CFG_MEMMAP_CHECKPOINT_OFFSET ~ + CFG_MEMMAP_CHECKPOINT_SIZE is split
+ * evenly among the guests. A slice keeps the copy of the first
+ * CFG_CHECKPOINT_RAM_SIZE bytes of the guest RAM at the last checkpoint,
+ * the RAM past them is not rolled back.
+ * Once the whole slice has been copied (base snapshot), the RAM pages are
+ * write-protected in stage-2 and a page is only copied again (checkpoint)
+ * or back (rollback) if the guest wrote to it in between.
+ * @{
  */
-#define TTBL_L2(ttbl_l1, index_l1) \
-    (&ttbl_l1[(VMM_L1_PTE_NUM + VMM_L1_PADDING_PTE_NUM) \
-              + (VMM_L2L3_PTE_NUM_TOTAL * (index_l1))])
+#define CKPT_SLICE_SIZE     (CFG_MEMMAP_CHECKPOINT_SIZE / NUM_GUESTS_STATIC)
+#ifndef CFG_CHECKPOINT_RAM_SIZE
+#define CFG_CHECKPOINT_RAM_SIZE CKPT_SLICE_SIZE
+#endif
+#if CFG_CHECKPOINT_RAM_SIZE > CKPT_SLICE_SIZE
+#error "CFG_CHECKPOINT_RAM_SIZE does not fit in a checkpoint slice"
+#endif
+#define CKPT_SLICE_PAGES    (CKPT_SLICE_SIZE >> LPAE_PAGE_SHIFT)
+#define CKPT_RAM_PAGES      (CFG_CHECKPOINT_RAM_SIZE >> LPAE_PAGE_SHIFT)
+#define CKPT_BITMAP_WORDS   ((CKPT_SLICE_PAGES + 31) / 32)
+
+struct guest_checkpoint_store {
+    uint32_t base;      /**< Physical address of the slice */
+    uint32_t pages;     /**< Number of guest RAM pages covered */
+    uint32_t based;     /**< Base snapshot has been taken */
+    uint32_t dirty[CKPT_BITMAP_WORDS]; /**< Pages written since then */
+    uint32_t absent[CKPT_BITMAP_WORDS]; /**< Pages ballooned at the time */
+};
 
-static union lpaed _hmm_pgtable[HMM_L1_PTE_NUM] \
-                __attribute((__aligned__(4096)));
-static union lpaed _hmm_pgtable_l2[HMM_L2_PTE_NUM] \
-                __attribute((__aligned__(4096)));
-static union lpaed _hmm_pgtable_l3[HMM_L2_PTE_NUM][HMM_L3_PTE_NUM] \
-                __attribute((__aligned__(4096)));
+static struct guest_checkpoint_store _ckpt_store[NUM_GUESTS_STATIC];
+/** @}*/
+#endif
 
 /* used malloc, free, sbrk */
 union header {
@@ -324,7 +312,7 @@ static union header *freep; /* start of free list */
  *
  * @return void
  */
-static void host_memory_heap_init(void)
+static void __init host_memory_heap_init(void)
 {
     mm_break = HEAP_ADDR;
     mm_prev_break = HEAP_ADDR;
@@ -332,94 +320,6 @@ static void host_memory_heap_init(void)
     freep = 0;
 }
 
-/**
- * @brief Flush the TLB
- *
- * Invalidate entire unified TLB.
- *
- * @return void
- */
-static void host_memory_flushTLB(void)
-{
-    /* Invalidate entire unified TLB */
-    invalidate_unified_tlb(0);
-    asm volatile("dsb");
-    asm volatile("isb");
-}
-
-/**
- * @brief Returns the level 3 table entry.
- *
- * Returns the level 3 translation table descriptor by matching the virtual
- * address and number of pages. If delivered virtual address is over the max
- * memory size, returns zero value.
- *
- * @param virt Virtual address.
- * @param npages Number of pages.
- * @return The level 3 table entry.
- */
-static union lpaed *host_memory_get_l3_table_entry(unsigned long virt,
-                unsigned long npages)
-{
-    int l2_index = (virt >> L2_SHIFT) & L2_ENTRY_MASK;
-    int l3_index = (virt >> L3_SHIFT) & L3_ENTRY_MASK;
-    int maxsize = ((HMM_L2_PTE_NUM * HMM_L3_PTE_NUM) - \
-            ((l2_index + 1) * (l3_index + 1)) + 1);
-    if (maxsize < npages) {
-        printh("%s[%d] : Map size \"pages\" is exceeded memory size\n",
-                __func__, __LINE__);
-        if (maxsize > 0)
-            printh("%s[%d] : Available pages are %d\n", maxsize);
-        else
-            printh("%s[%d] : Do not have available pages for map\n");
-        return 0;
-    }
-    return &_hmm_pgtable_l3[l2_index][l3_index];
-}
-
-/**
- * @brief Unmaps level3 table entry in virtual address.
- *
- * Obtains the level3 table entry by using hmm_get_l3_table_entry function.
- * And disables the valid bit and table bit of the entry.
- *
- * @param virt Virtual address.
- * @param npages Number of pages.
- * @return void
- */
-#if 0 /* unused */
-static void host_memory_umap(unsigned long virt, unsigned long npages)
-{
-    int  i;
-    union lpaed *map_table_p = host_memory_get_l3_table_entry(virt, npages);
-    for (i = 0; i < npages; i++)
-        lpaed_guest_stage1_disable_l3_table(&map_table_p[i]);
-    host_memory_flushTLB();
-}
-#endif
-
-/**
- * @brief Maps virtual address to level 3 table entries.
- *
- * Mapping the physical address to level 3 table entries.
- * This entries are obtained by given virtual address.
- * And then configure this entries valid bit to 1.
- *
- * @param phys Target physical address.
- * @param virt Target virtal address.
- * @param npages Number of pages.
- * @return void
- */
-static void host_memory_map(unsigned long phys, unsigned long virt,
-        unsigned long npages)
-{
-    int i;
-    union lpaed *map_table_p = host_memory_get_l3_table_entry(virt, npages);
-    for (i = 0; i < npages; i++)
-        lpaed_guest_stage1_conf_l3_table(&map_table_p[i], (uint64_t)phys, 1);
-    host_memory_flushTLB();
-}
-
 /**
  * @brief General-purpose sbrk, basic memory management system calls.
  *
@@ -432,12 +332,10 @@ static void host_memory_map(unsigned long phys, unsigned long virt,
 static void *host_memory_sbrk(unsigned int incr)
 {
     unsigned int required_addr;
-    unsigned int virt;
-    unsigned int required_pages = 0;
 
     mm_prev_break = mm_break;
-    virt = mm_break;
     mm_break += incr;
+    /* The heap is mapped by the generated tables, only its end is kept */
     if (mm_break > last_valid_address) {
         required_addr = mm_break - last_valid_address;
         for (; required_addr > 0x0; required_addr -= 0x1000) {
@@ -447,9 +345,7 @@ static void *host_memory_sbrk(unsigned int incr)
                 return (void *)-1;
             }
             last_valid_address += 0x1000;
-            required_pages++;
         }
-        host_memory_map(virt, virt, required_pages);
     }
     return (void *)mm_prev_break;
 }
@@ -511,6 +407,25 @@ static union header *morecore(unsigned int nu)
     return freep;
 }
 
+/**
+ * @brief Gives a region outside of the heap to the free list.
+ *
+ * @param start Start of the region, aligned to the block header.
+ * @param size Size of the region in bytes.
+ * @return void
+ */
+static void host_memory_heap_add(void *start, unsigned long size)
+{
+    union header *up = (union header *) start;
+
+    if (freep == 0) { /* no free list yet */
+        freep_base.s.ptr = freep = &freep_base;
+        freep_base.s.size = 0;
+    }
+    up->s.size = size / sizeof(union header);
+    host_memory_free((void *)(up + 1));
+}
+
 /**
  * @brief Hyp mode general-purpose storage allocator.
  *
@@ -554,277 +469,6 @@ static void *host_memory_malloc(unsigned long size)
         }
     }
 }
-/**
- * @brief Maps physical address of the guest to level 3 descriptors.
- *
- * Maps physical address to the target level 3 translation table descriptor.
- * Configure bits of the target descriptor whiche are initialized by initial
- * function. (lpaed_guest_stage2_map_page)
- *
- * @param *ttbl3 Level 3 translation table descriptor.
- * @param offset Offset from the level 3 table descriptor.
- *        - 0 ~ (2MB - pages * 4KB), start contiguous virtual address within
- *          level 2 block (2MB).
- *        - It is aligned L3 descriptor lock size(4KB).
- * @param pages Number of pages.
- *        - 0 ~ 512
- * @param pa Physical address.
- * @param mattr Memory Attribute.
- * @return void
- */
-static void guest_memory_ttbl3_map(union lpaed *ttbl3, uint64_t offset,
-                uint32_t pages, uint64_t pa, enum memattr mattr)
-{
-    int index_l3 = 0;
-    int index_l3_last = 0;
-    printh("%s[%d]: ttbl3:%x offset:%x pte:%x pages:%d, pa:%x\n",
-            __func__, __LINE__, (uint32_t) ttbl3, (uint32_t) offset,
-            &ttbl3[offset], pages, (uint32_t) pa);
-    /* Initialize the address spaces with 'invalid' state */
-    index_l3 = offset;
-    index_l3_last = index_l3 + pages;
-    for (; index_l3 < index_l3_last; index_l3++) {
-        lpaed_guest_stage2_map_page(&ttbl3[index_l3], pa, mattr);
-        pa += LPAE_PAGE_SIZE;
-    }
-}
-
-/**
- * @brief Unmap level 3 descriptors.
- *
- * Unmap descriptors of ttbl3 which is in between offset and offset + pages and
- * makes valid bit zero.
- *
- * @param *ttbl3 Level 3 translation table descriptor.
- * @param offset Offset from the level 3 table descriptor.
- *        - 0 ~ (2MB - pages * 4KB), start contiguous virtual address within
- *          level 2 block (2MB).
- *        - It is aligned L3 descriptor lock size(4KB).
- * @param pages Number of pages.
- *        - 0 ~ 512
- * @return void
- */
-static void guest_memory_ttbl3_unmap(union lpaed *ttbl3, uint64_t offset,
-                uint32_t pages)
-{
-    int index_l3 = 0;
-    int index_l3_last = 0;
-    /* Initialize the address spaces with 'invalid' state */
-    index_l3 = offset >> LPAE_PAGE_SHIFT;
-    index_l3_last = index_l3 + pages;
-    for (; index_l3 < index_l3_last; index_l3++)
-        ttbl3[index_l3].pt.valid = 0;
-}
-
-/**
- * @brief Unmap ttbl2 and ttbl3 descriptors which is in target virtual
- *        address area.
- *
- * Unmap descriptors of ttbl2 and ttbl3 by making valid bit to zero.
- *
- * - First, make level 2 descriptors invalidate.
- * - Second, if lefts space which can't be covered by level 2 descriptor
- *   (to small), make level 3 descriptors invalidate.
- *
- * @param *ttbl2 Level 2 translation table descriptor.
- * @param va_offset Offset of the virtual address.
- *        - 0 ~ (1GB - size), start contiguous virtual address within level 1
- *          block (1GB).
- *        - It is aligned L2 descriptor lock size(2MB).
- * @param size
- *        - <= 1GB.
- *        - It is aligned page size.
- * @return void
- */
-static void guest_memory_ttbl2_unmap(union lpaed *ttbl2, uint64_t va_offset,
-                uint32_t size)
-{
-    int index_l2 = 0;
-    int index_l2_last = 0;
-    int num_blocks = 0;
-    /* Initialize the address spaces with 'invalid' state */
-    num_blocks = size >> LPAE_BLOCK_L2_SHIFT;
-    index_l2 = va_offset >> LPAE_BLOCK_L2_SHIFT;
-    index_l2_last = index_l2 + num_blocks;
-
-    for (; index_l2 < index_l2_last; index_l2++)
-        ttbl2[index_l2].pt.valid = 0;
-
-    size &= LPAE_BLOCK_L2_MASK;
-    if (size) {
-        /* last partial block */
-        union lpaed *ttbl3 = TTBL_L3(ttbl2, index_l2);
-        guest_memory_ttbl3_unmap(ttbl3, 0x00000000, size >> LPAE_PAGE_SHIFT);
-    }
-}
-
-/**
- * @brief Map ttbl2 descriptors.
- *
- * Maps physical address to ttbl2 and ttbl3 descriptors and apply memory
- * attributes.
- *
- * - First, compute index of the target ttbl2 descriptor and block offset.
- * - Second, maps physical address to ttbl3 descriptors if head of block is
- *   not fits size of the ttbl2 descriptor.
- * - Third, maps left physical address to ttbl2 descriptors.
- * - Finally, if lefts the memory, maps it to ttbl3 descriptors.
- *
- * @param *ttbl2 Level 2 translation table descriptor.
- * @param va_offset
- *        - 0 ~ (1GB - size), start contiguous virtual address within level 1
- *          block (1GB).
- *        - It is aligned l2 descriptor lock size(2MB).
- * @param pa Physical address
- * @param size Size of target memory.
- *        - <= 1GB.
- *        - It is aligned page size.
- * @param Memory Attribute
- * @return void
- */
-static void guest_memory_ttbl2_map(union lpaed *ttbl2, uint64_t va_offset,
-                uint64_t pa, uint32_t size, enum memattr mattr)
-{
-    uint64_t block_offset;
-    uint32_t index_l2;
-    uint32_t index_l2_last;
-    uint32_t num_blocks;
-    uint32_t pages;
-    union lpaed *ttbl3;
-    int i;
-    HVMM_TRACE_ENTER();
-
-    printh("ttbl2:%x va_offset:%x pa:%x size:%d\n",
-            (uint32_t) ttbl2, (uint32_t) va_offset, (uint32_t) pa, size);
-    index_l2 = va_offset >> LPAE_BLOCK_L2_SHIFT;
-    block_offset = va_offset & LPAE_BLOCK_L2_MASK;
-    printh("- index_l2:%d block_offset:%x\n",
-            index_l2, (uint32_t) block_offset);
-    /* head < BLOCK */
-    if (block_offset) {
-        uint64_t offset;
-        offset = block_offset >> LPAE_PAGE_SHIFT;
-        pages = size >> LPAE_PAGE_SHIFT;
-        if (pages > VMM_L3_PTE_NUM)
-            pages = VMM_L3_PTE_NUM;
-
-        ttbl3 = TTBL_L3(ttbl2, index_l2);
-        guest_memory_ttbl3_map(ttbl3, offset, pages, pa, mattr);
-        lpaed_guest_stage2_enable_l2_table(&ttbl2[index_l2]);
-        va_offset |= ~LPAE_BLOCK_L2_MASK;
-        size -= pages * LPAE_PAGE_SIZE;
-        pa += pages * LPAE_PAGE_SIZE;
-        index_l2++;
-    }
-    /* body : n BLOCKS */
-    if (size > 0) {
-        num_blocks = size >> LPAE_BLOCK_L2_SHIFT;
-        index_l2_last = index_l2 + num_blocks;
-        printh("- index_l2_last:%d num_blocks:%d size:%d\n"
-                index_l2_last, (uint32_t) num_blocks, size);
-        for (i = index_l2; i < index_l2_last; i++) {
-            lpaed_guest_stage2_enable_l2_table(&ttbl2[i]);
-            guest_memory_ttbl3_map(TTBL_L3(ttbl2, i), 0,
-                    VMM_L3_PTE_NUM, pa, mattr);
-            pa += LPAE_BLOCK_L2_SIZE;
-            size -= LPAE_BLOCK_L2_SIZE;
-        }
-    }
-    /* tail < BLOCK */
-    if (size > 0) {
-        pages = size >> LPAE_PAGE_SHIFT;
-        printh("- pages:%d size:%d\n", pages, size);
-        if (pages) {
-            ttbl3 = TTBL_L3(ttbl2, index_l2_last);
-            guest_memory_ttbl3_map(ttbl3, 0, pages, pa, mattr);
-            lpaed_guest_stage2_enable_l2_table(&ttbl2[index_l2_last]);
-        }
-    }
-    HVMM_TRACE_EXIT();
-}
-
-/**
- * @brief Initialize ttbl2 entries.
- *
- * Configures ttbl2 descriptor by mapping address of ttbl3 descriptor.
- * And configure all valid bit of ttbl3 descriptors to zero.
- *
- * @param *ttbl2 Level 2 translation table descriptor.
- * @return void
- */
-static void guest_memory_ttbl2_init_entries(union lpaed *ttbl2)
-{
-    int i, j;
-    HVMM_TRACE_ENTER();
-    union lpaed *ttbl3;
-    for (i = 0; i < VMM_L2_PTE_NUM; i++) {
-        ttbl3 = TTBL_L3(ttbl2, i);
-        printh("ttbl2[%d]:%x ttbl3[]:%x\n", i, &ttbl2[i], ttbl3);
-        lpaed_guest_stage2_conf_l2_table(&ttbl2[i],
-                (uint64_t)((uint32_t) ttbl3), 0);
-        for (j = 0; j < VMM_L2_PTE_NUM; j++)
-            ttbl3[j].pt.valid = 0;
-    }
-    HVMM_TRACE_EXIT();
-}
-
-/**
- * @brief Initialize delivered ttbl2 descriptors.
- *
- * Initialize ttbl2 descriptors and unmap the descriptors.
- * Finally, map the ttbl2 descriptors by memory map descriptors.
- *
- * @param *ttbl2 Level 2 translation table descriptor.
- * @param *md Device memory map descriptor.
- * @return void
- */
-static void guest_memory_init_ttbl2(union lpaed *ttbl2, struct memmap_desc *md)
-{
-    int i = 0;
-    HVMM_TRACE_ENTER();
-    printh(" - ttbl2:%x\n", (uint32_t) ttbl2);
-    if (((uint64_t)((uint32_t) ttbl2)) & 0x0FFFULL)
-        printh(" - error: invalid ttbl2 address alignment\n");
-
-    /* construct l2-l3 table hirerachy with invalid pages */
-    guest_memory_ttbl2_init_entries(ttbl2);
-    guest_memory_ttbl2_unmap(ttbl2, 0x00000000, 0x40000000);
-    while (md[i].label != 0) {
-        guest_memory_ttbl2_map(ttbl2, md[i].va, md[i].pa,
-                md[i].size, md[i].attr);
-        i++;
-    }
-    HVMM_TRACE_EXIT();
-}
-
-/**
- * @brief Configure stage-2 translation table descriptors of guest.
- *
- * Configures the translation table based on the memory descriptor list.
- *
- * @param *ttbl Target translation table descriptor.
- * @param *mdlist[] Memory map descriptor list.
- * @return void
- */
-static void guest_memory_init_ttbl(union lpaed *ttbl,
-            struct memmap_desc *mdlist[])
-{
-    int i = 0;
-    HVMM_TRACE_ENTER();
-    while (mdlist[i]) {
-        struct memmap_desc *md = mdlist[i];
-        if (md[0].label == 0)
-            lpaed_guest_stage2_conf_l1_table(&ttbl[i], 0, 0);
-        else {
-            lpaed_guest_stage2_conf_l1_table(&ttbl[i],
-                    (uint64_t)((uint32_t) TTBL_L2(ttbl, i)), 1);
-            guest_memory_init_ttbl2(TTBL_L2(ttbl, i), md);
-        }
-        i++;
-    }
-    HVMM_TRACE_EXIT();
-}
-
 /**
  * @brief Configures Virtualization Translation Control Register(VTCR).
  *
@@ -840,12 +484,9 @@ static void guest_memory_init_ttbl(union lpaed *ttbl,
  */
 static void guest_memory_init_mmu(void)
 {
-    uint32_t vtcr, vttbr;
+    uint32_t vtcr;
     HVMM_TRACE_ENTER();
     vtcr = read_vtcr();
-    uart_print("vtcr:");
-    uart_print_hex32(vtcr);
-    uart_print("\n\r");
     /* start lookup at level 1 table */
     vtcr &= ~VTCR_SL0_MASK;
     vtcr |= (0x01 << VTCR_SL0_SHIFT) & VTCR_SL0_MASK;
@@ -854,23 +495,6 @@ static void guest_memory_init_mmu(void)
     vtcr &= ~VTCR_IRGN0_MASK;
     vtcr |= (0x3 << VTCR_IRGN0_SHIFT) & VTCR_IRGN0_MASK;
     write_vtcr(vtcr);
-    vtcr = read_vtcr();
-    uart_print("vtcr:");
-    uart_print_hex32(vtcr);
-    uart_print("\n\r");
-    {
-        uint32_t sl0 = (vtcr & VTCR_SL0_MASK) >> VTCR_SL0_SHIFT;
-        uint32_t t0sz = vtcr & 0xF;
-        uint32_t baddr_x = (sl0 == 0 ? 14 - t0sz : 5 - t0sz);
-        uart_print("vttbr.baddr.x:");
-        uart_print_hex32(baddr_x);
-        uart_print("\n\r");
-    }
-    /* VTTBR */
-    vttbr = read_vttbr();
-    uart_print("vttbr:");
-    uart_print_hex64(vttbr);
-    uart_print("\n\r");
     HVMM_TRACE_EXIT();
 }
 
@@ -911,7 +535,8 @@ static void guest_memory_stage2_enable(int enable)
  * @param ttbl Level 1 translation table of the guest.
  * @return HVMM_STATUS_SUCCESS only.
  */
-static hvmm_status_t guest_memory_set_vmid_ttbl(vmid_t vmid, union lpaed *ttbl)
+static hvmm_status_t __hot guest_memory_set_vmid_ttbl(vmid_t vmid,
+                union lpaed *ttbl)
 {
     uint64_t vttbr;
     /*
@@ -948,82 +573,23 @@ static int memory_enable(void)
  *    HTTBR
  *     HTCTLR
  */
-    uint32_t mair, htcr, hsctlr, hcr;
+    uint32_t hsctlr;
     uint64_t httbr;
 
     /* MAIR/HMAIR */
-    uart_print(" --- MAIR ----\n\r");
-    mair = read_mair0();
-    uart_print("mair0:");
-    uart_print_hex32(mair);
-    uart_print("\n\r");
-    mair = read_mair1();
-    uart_print("mair1:");
-    uart_print_hex32(mair);
-    uart_print("\n\r");
-    mair = read_hmair0();
-    uart_print("hmair0:");
-    uart_print_hex32(mair);
-    uart_print("\n\r");
-    mair = read_hmair1();
-    uart_print("hmair1:");
-    uart_print_hex32(mair);
-    uart_print("\n\r");
-
     write_mair0(INITIAL_MAIR0VAL);
     write_mair1(INITIAL_MAIR1VAL);
     write_hmair0(INITIAL_MAIR0VAL);
     write_hmair1(INITIAL_MAIR1VAL);
 
-    mair = read_mair0();
-    uart_print("mair0:");
-    uart_print_hex32(mair);
-    uart_print("\n\r");
-    mair = read_mair1();
-    uart_print("mair1:");
-    uart_print_hex32(mair);
-    uart_print("\n\r");
-    mair = read_hmair0();
-    uart_print("hmair0:");
-    uart_print_hex32(mair);
-    uart_print("\n\r");
-    mair = read_hmair1();
-    uart_print("hmair1:");
-    uart_print_hex32(mair);
-    uart_print("\n\r");
-
     /* HTCR */
-    uart_print(" --- HTCR ----\n\r");
-    htcr = read_htcr();
-    uart_print("htcr:");
-    uart_print_hex32(htcr);
-    uart_print("\n\r");
     write_htcr(0x80002500);
-    htcr = read_htcr();
-    uart_print("htcr:");
-    uart_print_hex32(htcr);
-    uart_print("\n\r");
 
     /* HSCTLR */
     /* i-Cache and Alignment Checking Enabled */
     /* MMU, D-cache, Write-implies-XN, Low-latency IRQs Disabled */
-    hsctlr = read_hsctlr();
-    uart_print("hsctlr:");
-    uart_print_hex32(hsctlr);
-    uart_print("\n\r");
     hsctlr = HSCTLR_BASE | SCTLR_A;
     write_hsctlr(hsctlr);
-    hsctlr = read_hsctlr();
-    uart_print("hsctlr:");
-    uart_print_hex32(hsctlr);
-    uart_print("\n\r");
-
-
-    /* HCR */
-    hcr = read_hcr();
-    uart_print("hcr:");
-    uart_print_hex32(hcr);
-    uart_print("\n\r");
 
     /* HTCR */
     /*
@@ -1036,9 +602,6 @@ static int memory_enable(void)
     /* Untested code commented */
 /*
     htcr = read_htcr();
-    uart_print("htcr:");
-    uart_print_hex32(htcr);
-    uart_print("\n\r");
     htcr &= ~HTCR_SH0_MASK;
     htcr |= (0x0 << HTCR_SH0_SHIFT) & HTCR_SH0_MASK;
     htcr &= ~HTCR_ORGN0_MASK;
@@ -1048,35 +611,18 @@ static int memory_enable(void)
     htcr &= ~VTCR_T0SZ_MASK;
     htcr |= (0x0 << HTCR_T0SZ_SHIFT) & HTCR_T0SZ_MASK;
     write_htcr(htcr);
-    htcr = read_htcr();
-    uart_print("htcr:");
-    uart_print_hex32(htcr);
-    uart_print("\n\r");
 */
 
     /* HTTBR = &__hmm_pgtable */
     httbr = read_httbr();
-    uart_print("httbr:");
-    uart_print_hex64(httbr);
-    uart_print("\n\r");
     httbr &= 0xFFFFFFFF00000000ULL;
     httbr |= (uint32_t) &_hmm_pgtable;
     httbr &= HTTBR_BADDR_MASK;
-    uart_print("writing httbr:");
-    uart_print_hex64(httbr);
-    uart_print("\n\r");
     write_httbr(httbr);
-    httbr = read_httbr();
-    uart_print("read back httbr:");
-    uart_print_hex64(httbr);
-    uart_print("\n\r");
 
     /* Enable PL2 Stage 1 MMU */
 
     hsctlr = read_hsctlr();
-    uart_print("hsctlr:");
-    uart_print_hex32(hsctlr);
-    uart_print("\n\r");
 
     /* HSCTLR Enable MMU and D-cache */
     hsctlr |= (SCTLR_M | SCTLR_C);
@@ -1089,114 +635,1459 @@ static int memory_enable(void)
     /* Flush iCache */
     asm("isb");
 
-    hsctlr = read_hsctlr();
-    uart_print("hsctlr:");
-    uart_print_hex32(hsctlr);
-    uart_print("\n\r");
-
     return HVMM_STATUS_SUCCESS;
 }
 
+/**
+ * @brief Relocates level 1 or level 2 entries of a generated translation
+ * table.
+ *
+ * pgtable_gen builds each table hierarchy at address 0: a table
+ * descriptor, valid or not yet, holds the offset of its next-level table
+ * from the level 1 table. Block descriptors hold physical addresses and
+ * are left as they are, so are the entries without any address.
+ *
+ * @param *ttbl Level 1 table of the hierarchy.
+ * @param *entries Entries to relocate.
+ * @param num Number of entries.
+ * @return void
+ */
+static void __init memory_relocate_ttbl(union lpaed *ttbl,
+                union lpaed *entries, uint32_t num)
+{
+    uint32_t i;
+
+    for (i = 0; i < num; i++) {
+        if (entries[i].pt.valid && !entries[i].pt.table)
+            continue;
+        if (entries[i].walk.base)
+            entries[i].bits += (uint32_t) ttbl;
+    }
+}
+
+/**
+ * @brief Writes the generated translation tables out of their runs.
+ *
+ * The tables are in .pgtables, which the boot code does not zero:
+ * pgtables.S holds the runs of the descriptors the MMU or the hypervisor
+ * may read, in .init.data.
+ *
+ * @return void
+ */
+static void __init memory_expand_ttbl(void)
+{
+    const struct pgtable_run *run;
+    union lpaed *entry;
+    uint64_t desc;
+    uint32_t i;
+
+    for (run = _pgtable_runs; run < _pgtable_runs_end; run++) {
+        entry = &_pgtables[run->index];
+        desc = run->desc;
+        for (i = 0; i < run->count; i++, desc += run->stride)
+            entry[i].bits = desc;
+    }
+}
+
 /**
  * @brief Initializes the hyp mode memory management.
  *
- * Initialize and setting the translation table descriptors of the Hyp mode.
- * - Target environment.
- *   - PL2, stage-1 translation table.
- *   - Virtual address -> Physical address
- * - Generate configurations.
- *   - Translation table level1, level2, and level3.
+ * The translation table descriptors of the Hyp mode(PL2 stage-1, virtual
+ * address -> physical address) are generated at build time by pgtable_gen,
+ * only the level 1 and level 2 table descriptors are relocated here.
  * <pre>
  * Name         Physical address range    Location     Attribute Index Setting
  * Partition 0: 0x00000000 ~ 0x3FFFFFFF - Peripheral - ATTR_IDX_DEV_SHARED
  * Partition 1: 0x40000000 ~ 0x7FFFFFFF - Unused     - ATTR_IDX_UNCACHED
- * Partition 2: 0x80000000 ~ 0xBFFFFFFF - Guest      - ATTR_IDX_UNCACHED
+ * Partition 2: 0x80000000 ~ 0xBFFFFFFF - Guest      - ATTR_IDX_WRITEALLOC
  * Partition 3: 0xC0000000 ~ 0xFFFFFFFF - Hypervisor
- *                                      - Level2 and level3 translation table
+ *                                      - Level2 blocks, ATTR_IDX_UNCACHED,
+ *                                        the heap ATTR_IDX_WRITEALLOC
+ *                                      - Level3 tables for the image,
+ *                                        the code ATTR_IDX_WRITEALLOC
  * </pre>
  *
+ * The code of the image, from __text_start to __text_end, is mapped
+ * cacheable here: the instruction fetches from Strongly-ordered memory
+ * bypass the i-cache. Nothing writes to it. An image in a level 1 block
+ * is cacheable already.
+ *
  * @return void
  */
-static void host_memory_init(void)
+static void __init host_memory_init(void)
 {
-    int i, j;
-    uint64_t pa = 0x00000000ULL;
+    uint32_t va = (uint32_t) __text_start & ~(0x1000 - 1);
 
-    _hmm_pgtable[0] = lpaed_host_l1_block(pa, ATTR_IDX_DEV_SHARED);
-    pa += 0x40000000;
-    uart_print("&_hmm_pgtable[0]:");
-    uart_print_hex32((uint32_t) &_hmm_pgtable[0]);
-    uart_print("\n\r");
-    uart_print("lpaed:");
-    uart_print_hex64(_hmm_pgtable[0].bits);
-    uart_print("\n\r");
-    _hmm_pgtable[1] = lpaed_host_l1_block(pa, ATTR_IDX_UNCACHED);
-    pa += 0x40000000;
-    uart_print("&_hmm_pgtable[1]:");
-    uart_print_hex32((uint32_t) &_hmm_pgtable[1]);
-    uart_print("\n\r");
-    uart_print("lpaed:");
-    uart_print_hex64(_hmm_pgtable[1].bits);
-    uart_print("\n\r");
-    _hmm_pgtable[2] = lpaed_host_l1_block(pa, ATTR_IDX_WRITEALLOC);
-    pa += 0x40000000;
-    uart_print("&_hmm_pgtable[2]:");
-    uart_print_hex32((uint32_t) &_hmm_pgtable[2]);
-    uart_print("\n\r");
-    uart_print("lpaed:");
-    uart_print_hex64(_hmm_pgtable[2].bits);
-    uart_print("\n\r");
-    /* _hmm_pgtable[3] refers Lv2 page table address. */
-    _hmm_pgtable[3] = lpaed_host_l1_table((uint32_t) _hmm_pgtable_l2);
-    uart_print("&_hmm_pgtable[3]:");
-    uart_print_hex32((uint32_t) &_hmm_pgtable[3]);
-    uart_print("\n\r");
-    uart_print("lpaed:");
-    uart_print_hex64(_hmm_pgtable[3].bits);
-    uart_print("\n\r");
-    for (i = 0; i < HMM_L2_PTE_NUM; i++) {
-        /*
-         * _hvmm_pgtable_lv2[i] refers Lv3 page table address.
-         * each element correspond 2MB
-         */
-        _hmm_pgtable_l2[i] =
-                lpaed_host_l2_table((uint32_t) _hmm_pgtable_l3[i]);
-        /* _hvmm_pgtable_lv3[i][j] refers page, that size is 4KB */
-        for (j = 0; j < HMM_L3_PTE_NUM; pa += 0x1000, j++) {
-            /* 0xF2000000 ~ 0xFF000000 - Heap memory 208MB */
-            if (pa >= HEAP_ADDR && pa < HEAP_ADDR + HEAP_SIZE) {
-                _hmm_pgtable_l3[i][j] =
-                        lpaed_host_l3_table(pa, ATTR_IDX_WRITEALLOC, 0);
-            } else {
-                _hmm_pgtable_l3[i][j] =
-                        lpaed_host_l3_table(pa, ATTR_IDX_UNCACHED, 1);
-            }
-        }
+    memory_relocate_ttbl(_hmm_pgtable, _hmm_pgtable, HMM_L1_PTE_NUM);
+    memory_relocate_ttbl(_hmm_pgtable, _hmm_pgtable_l2, HMM_L2_PTE_NUM);
+
+    if (!_hmm_pgtable[va >> LPAE_BLOCK_L1_SHIFT].pt.table)
+        return;
+    for (; va < (uint32_t) __text_end && va < HEAP_ADDR; va += 0x1000) {
+        _hmm_pgtable_l3[(va - CFG_MEMMAP_MON_OFFSET) >> L2_SHIFT]
+                [(va >> L3_SHIFT) & L3_ENTRY_MASK] =
+                lpaed_host_l3_table(va, ATTR_IDX_WRITEALLOC, 1);
     }
-    for (i = 4; i < HMM_L1_PTE_NUM; i++)
-        _hmm_pgtable[i].pt.valid = 0;
 }
 
 /**
- * @brief Initializes the virtual mode(guest mode) memory management
- * stage-2 translation.
- *
- * Configure translation tables of guests for stage-2 translation (IPA -> PA).
+ * @brief Records the RAM region of a guest.
  *
- * - First, maps physical address of guest start address to descriptors.
- * - And configure the translation table descriptors based on the memory
- *   map descriptor lists.
- * - Last, initializes mmu.
+ * Takes the first normal memory descriptor in the memory map descriptor
+ * list. The index of the list is the level 1 entry (1GB) of the IPA.
  *
+ * @param vmid Guest the memory map belongs to.
+ * @param *mdlist[] Memory map descriptor list.
  * @return void
  */
-static void guest_memory_init(struct memmap_desc **guest_map,
-        struct memmap_desc **guest2_map)
+static void __init guest_memory_init_ram_region(vmid_t vmid,
+            struct memmap_desc *mdlist[])
 {
-    /*
-     * Initializes Translation Table for Stage2 Translation (IPA -> PA)
-     */
-    int i;
+    int i, j;
+    struct memmap_desc *md;
+
+    _guest_ram[vmid].size = 0;
+    for (i = 0; mdlist[i]; i++) {
+        md = mdlist[i];
+        for (j = 0; md[j].label != 0; j++) {
+            if (!(md[j].attr & MEMATTR_OUTER_MASK))
+                continue;
+            _guest_ram[vmid].ipa = ((uint64_t) i << LPAE_BLOCK_L1_SHIFT)
+                    + md[j].va;
+            _guest_ram[vmid].pa = md[j].pa;
+            _guest_ram[vmid].size = md[j].size;
+            _guest_ram[vmid].attr = md[j].attr;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Finds the stage-2 level 2 descriptor of a guest page.
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the page.
+ * @return The level 2 descriptor, 0 if the level 1 entry is not a table.
+ */
+static union lpaed *guest_memory_lookup_l2(vmid_t vmid, uint64_t ipa)
+{
+    union lpaed *ttbl = _vmid_ttbl[vmid];
+    uint32_t index_l1 = ipa >> LPAE_BLOCK_L1_SHIFT;
+    uint32_t index_l2 = (ipa >> L2_SHIFT) & L2_ENTRY_MASK;
+
+    if (!ttbl || index_l1 >= VMM_L1_PTE_NUM || !ttbl[index_l1].pt.valid)
+        return 0;
+
+    return &TTBL_L2(ttbl, index_l1)[index_l2];
+}
+
+/**
+ * @brief Finds the stage-2 level 3 descriptor of a guest page.
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the page.
+ * @return The level 3 descriptor, 0 if the level 1 entry is not a table.
+ */
+static union lpaed *guest_memory_lookup_l3(vmid_t vmid, uint64_t ipa)
+{
+    union lpaed *ttbl = _vmid_ttbl[vmid];
+    union lpaed *ttbl2;
+    uint32_t index_l1 = ipa >> LPAE_BLOCK_L1_SHIFT;
+    uint32_t index_l2 = (ipa >> L2_SHIFT) & L2_ENTRY_MASK;
+    uint32_t index_l3 = (ipa >> L3_SHIFT) & L3_ENTRY_MASK;
+
+    if (!ttbl || index_l1 >= VMM_L1_PTE_NUM || !ttbl[index_l1].pt.valid)
+        return 0;
+    ttbl2 = TTBL_L2(ttbl, index_l1);
+
+    return &TTBL_L3(ttbl2, index_l2)[index_l3];
+}
+
+/* Bumped on each stage-2 update, outdates the translation cache */
+static uint32_t _stage2_gen = 1;
+
+/**
+ * @brief Invalidates the stage-2 translations of all guests.
+ *
+ * Needed after permissions in a stage-2 translation table change, since
+ * the table may belong to a guest other than the current one.
+ *
+ * @return void
+ */
+static void guest_memory_flush_tlb(void)
+{
+    _stage2_gen++;
+    invalidate_tlb_allnsnh(0);
+    asm volatile("dsb");
+    asm volatile("isb");
+}
+
+/**
+ * @brief Invalidates the stage-2 translation of a guest page.
+ *
+ * TLBIIPAS2 works on the VMID of VTTBR: it is switched to the guest's for
+ * the invalidation if another guest is loaded. TLBIIPAS2 leaves the
+ * entries combining stage 1 and stage 2, which are not tagged by IPA: they
+ * go with the stage 1 entries of the guest(TLBIALL of its VMID) unless the
+ * caller can live with the old translation until it is evicted.
+ *
+ * @param vmid Guest of the page.
+ * @param ipa Intermediate physical address of the page.
+ * @param stage1 Also invalidate the stage 1 entries of the guest.
+ * @return void
+ */
+static void guest_memory_flush_ipa(vmid_t vmid, uint32_t ipa, uint8_t stage1)
+{
+    uint64_t vttbr = read_vttbr();
+    uint64_t guest = vttbr;
+
+    _stage2_gen++;
+    /* The descriptor is written before its translation goes */
+    asm volatile("dsb");
+    guest &= ~(VTTBR_VMID_MASK);
+    guest |= ((uint64_t)vmid << VTTBR_VMID_SHIFT) & VTTBR_VMID_MASK;
+    if (guest != vttbr) {
+        write_vttbr(guest);
+        asm volatile("isb");
+    }
+    invalidate_tlb_ipas2(ipa);
+    asm volatile("dsb");
+    if (stage1) {
+        invalidate_unified_tlb(0);
+        asm volatile("dsb");
+    }
+    if (guest != vttbr)
+        write_vttbr(vttbr);
+    asm volatile("isb");
+}
+
+/**
+ * @brief Cleans and invalidates a page from the data cache.
+ *
+ * The hypervisor does not map all of the guest RAM with the attributes the
+ * guests use, so a page is cleaned before the hypervisor looks at it and
+ * after the hypervisor has written to it.
+ *
+ * @param pa Physical address of the page.
+ * @return void
+ */
+static void guest_memory_clean_page(uint32_t pa)
+{
+    uint32_t line;
+
+    for (line = 0; line < LPAE_PAGE_SIZE; line += 64)
+        clean_invalidate_dcache_mva(pa + line);
+    asm volatile("dsb");
+}
+
+/**
+ * @brief Copies a page, keeping the guest's cacheable view of its RAM and
+ * the hypervisor's view coherent.
+ *
+ * @param dst Destination physical address.
+ * @param src Source physical address.
+ * @return void
+ */
+static void guest_memory_copy_page(uint32_t dst, uint32_t src)
+{
+    guest_memory_clean_page(src);
+    guest_memory_clean_page(dst);
+    memcpy((void *) dst, (void *) src, LPAE_PAGE_SIZE);
+    guest_memory_clean_page(dst);
+}
+
+/**
+ * \defgroup Guest_frame_pool
+ *
+ * Physical frames taken away from the guests. The free frames are linked
+ * through their first word, so the pool needs no memory of its own.
+ * The frames sharing put into the pool are reserved for the copy-on-write
+ * of the shared mappings, the balloon only gets the frames left over.
+ * @{
+ */
+static uint32_t _frame_pool_head;
+static uint32_t _frame_pool_free;
+static uint32_t _frame_pool_reserved;
+
+/**
+ * @brief Puts a physical frame into the pool.
+ *
+ * Lines the last owner left in the data cache are written back first, so
+ * they cannot overwrite the frame later on.
+ *
+ * @param pa Physical address of the frame.
+ * @return void
+ */
+static void guest_memory_frame_free(uint32_t pa)
+{
+    guest_memory_clean_page(pa);
+    *(volatile uint32_t *) pa = _frame_pool_head;
+    _frame_pool_head = pa;
+    _frame_pool_free++;
+}
+
+/**
+ * @brief Takes a physical frame from the pool.
+ *
+ * @param reserved Take one of the frames reserved for copy-on-write.
+ * @return Physical address of the frame, 0 if no frame is left.
+ */
+static uint32_t guest_memory_frame_alloc(uint8_t reserved)
+{
+    uint32_t pa = _frame_pool_head;
+
+    if (!reserved && _frame_pool_free <= _frame_pool_reserved)
+        return 0;
+    if (pa) {
+        _frame_pool_head = *(volatile uint32_t *) pa;
+        _frame_pool_free--;
+    }
+
+    return pa;
+}
+/** @}*/
+
+/**
+ * \defgroup Guest_page_sharing
+ *
+ * Content-based page sharing among the guest RAM pages.
+ *
+ * The scanner walks the RAM of all guests a few pages at a time and
+ * hashes each page. A page identical to a shared frame (stable table) is
+ * mapped read-only to that frame. A page identical to a page seen earlier
+ * in the same pass (candidate table) turns that page into a new shared
+ * frame. Either way the frame of the page goes to the frame pool.
+ * A write to a shared page takes a permission fault and gets a private
+ * copy (copy-on-write) from the frame pool. Each merge puts one frame into
+ * the pool and adds one mapping to a shared frame, that frame stays
+ * reserved until the mapping goes, so copy-on-write always finds one.
+ * The shared frames are also indexed by physical address, the frame of a
+ * guest page is found from its stage-2 descriptor without hashing it.
+ * @{
+ */
+#define STAGE2_AVAIL_SHARED     0x1 /**< Descriptor maps a shared frame */
+#define SHARE_TABLE_SIZE        4096
+#define SHARE_TABLE_MASK        (SHARE_TABLE_SIZE - 1)
+#define SHARE_TABLE_PROBE       8
+
+struct share_frame {
+    uint32_t hash;
+    uint32_t pa;        /**< Physical address, 0 if the slot is free */
+    uint32_t refs;      /**< Number of mappings */
+};
+
+struct share_candidate {
+    uint32_t hash;
+    uint32_t ipa;       /**< 0 if the slot is free */
+    vmid_t vmid;
+};
+
+static struct share_frame _share_frames[SHARE_TABLE_SIZE];
+/* Slot of _share_frames + 1 by physical address, 0 if free */
+static uint16_t _share_index[SHARE_TABLE_SIZE];
+static struct share_candidate _share_candidates[SHARE_TABLE_SIZE];
+static struct memory_share_stats _share_stats;
+static vmid_t _share_scan_vmid;
+static uint32_t _share_scan_page;
+
+/**
+ * @brief FNV-1a hash of a page, word by word.
+ *
+ * @param pa Physical address of the page.
+ * @return Hash of the page content.
+ */
+static uint32_t guest_memory_hash_page(uint32_t pa)
+{
+    uint32_t *word = (uint32_t *) pa;
+    uint32_t hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < (LPAE_PAGE_SIZE >> 2); i++) {
+        hash ^= word[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Finds a shared frame with the given hash.
+ *
+ * @param hash Hash of the frame content.
+ * @param start Slot to start from, to iterate over frames with the hash.
+ * @return The shared frame, 0 if not found.
+ */
+static struct share_frame *guest_memory_share_find(uint32_t hash, int *start)
+{
+    struct share_frame *frame;
+    int i;
+
+    for (i = *start; i < SHARE_TABLE_PROBE; i++) {
+        frame = &_share_frames[(hash + i) & SHARE_TABLE_MASK];
+        if (frame->pa && frame->hash == hash) {
+            *start = i + 1;
+            return frame;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Finds the index entry of a shared frame by physical address.
+ *
+ * @param pa Physical address of the frame.
+ * @param free Find a free entry for the frame instead.
+ * @return The index entry, 0 if not found.
+ */
+static uint16_t *guest_memory_share_index(uint32_t pa, uint8_t free)
+{
+    uint16_t *slot;
+    int i;
+
+    for (i = 0; i < SHARE_TABLE_PROBE; i++) {
+        slot = &_share_index[((pa >> LPAE_PAGE_SHIFT) + i) &
+                SHARE_TABLE_MASK];
+        if (free ? !*slot : (*slot && _share_frames[*slot - 1].pa == pa))
+            return slot;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Finds the shared frame a guest page maps.
+ *
+ * @param *pte Stage-2 level 3 descriptor of the page.
+ * @return The shared frame, 0 if not found.
+ */
+static struct share_frame *guest_memory_share_lookup(union lpaed *pte)
+{
+    uint16_t *slot;
+
+    slot = guest_memory_share_index(
+            (uint32_t) lpaed_guest_stage2_page_pa(pte), 0);
+    if (!slot)
+        return 0;
+
+    return &_share_frames[*slot - 1];
+}
+
+/**
+ * @brief Frees the slot of a shared frame after its last mapping.
+ *
+ * @param *frame Shared frame.
+ * @return void
+ */
+static void guest_memory_share_free(struct share_frame *frame)
+{
+    uint16_t *slot = guest_memory_share_index(frame->pa, 0);
+
+    if (slot)
+        *slot = 0;
+    frame->pa = 0;
+}
+
+/**
+ * @brief Takes a free slot for a new shared frame.
+ *
+ * @param hash Hash of the frame content.
+ * @return The slot, 0 if all slots for the hash are taken.
+ */
+static struct share_frame *guest_memory_share_slot(uint32_t hash)
+{
+    struct share_frame *frame;
+    int i;
+
+    for (i = 0; i < SHARE_TABLE_PROBE; i++) {
+        frame = &_share_frames[(hash + i) & SHARE_TABLE_MASK];
+        if (!frame->pa)
+            return frame;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Maps a guest page read-only to a shared frame and puts the frame
+ * the page had into the frame pool.
+ *
+ * @param *pte Stage-2 level 3 descriptor of the page.
+ * @param *frame Shared frame.
+ * @return void
+ */
+static void guest_memory_share_map(union lpaed *pte, struct share_frame *frame)
+{
+    uint32_t old_pa = (uint32_t) lpaed_guest_stage2_page_pa(pte);
+
+    lpaed_guest_stage2_map_page(pte, frame->pa, pte->p2m.mattr);
+    lpaed_guest_stage2_set_write(pte, 0);
+    pte->p2m.avail |= STAGE2_AVAIL_SHARED;
+    frame->refs++;
+    if (old_pa != frame->pa) {
+        guest_memory_frame_free(old_pa);
+        _frame_pool_reserved++;
+    }
+    _share_stats.pages_shared++;
+}
+
+/**
+ * @brief Gives a guest page mapping a shared frame a private, writable
+ * frame (copy-on-write).
+ *
+ * The last mapping of a shared frame keeps the frame, the others take
+ * the frame their merge reserved.
+ *
+ * @param *pte Stage-2 level 3 descriptor of the page.
+ * @return HVMM_STATUS_SUCCESS, or HVMM_STATUS_BUSY if no frame is left.
+ */
+static hvmm_status_t guest_memory_unshare(union lpaed *pte)
+{
+    uint32_t pa = (uint32_t) lpaed_guest_stage2_page_pa(pte);
+    uint32_t new_pa;
+    struct share_frame *frame = guest_memory_share_lookup(pte);
+
+    if (frame && frame->refs > 1) {
+        new_pa = guest_memory_frame_alloc(1);
+        if (!new_pa)
+            return HVMM_STATUS_BUSY;
+        _frame_pool_reserved--;
+        guest_memory_copy_page(new_pa, pa);
+        lpaed_guest_stage2_map_page(pte, new_pa, pte->p2m.mattr);
+        frame->refs--;
+    } else if (frame)
+        guest_memory_share_free(frame);
+    lpaed_guest_stage2_set_write(pte, 1);
+    pte->p2m.avail &= ~STAGE2_AVAIL_SHARED;
+    _share_stats.pages_unshared++;
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Drops the mapping of a shared frame by a guest page.
+ *
+ * @param *pte Stage-2 level 3 descriptor of the page.
+ * @return Physical address of the frame if that was its last mapping,
+ *         otherwise 0.
+ */
+static uint32_t guest_memory_share_drop(union lpaed *pte)
+{
+    uint32_t pa = (uint32_t) lpaed_guest_stage2_page_pa(pte);
+    struct share_frame *frame = guest_memory_share_lookup(pte);
+
+    /* The frame reserved by the merge of this mapping is free again */
+    if (frame && frame->refs > 1) {
+        frame->refs--;
+        _frame_pool_reserved--;
+        return 0;
+    }
+    if (frame)
+        guest_memory_share_free(frame);
+
+    return pa;
+}
+
+/**
+ * @brief Tries to share one guest page.
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the page.
+ * @return 1 if a stage-2 mapping changed, otherwise 0.
+ */
+static uint8_t guest_memory_share_page(vmid_t vmid, uint32_t ipa)
+{
+    union lpaed *pte = guest_memory_lookup_l3(vmid, ipa);
+    union lpaed *cpte;
+    struct share_frame *frame;
+    struct share_candidate *cand;
+    uint32_t pa, cpa, hash;
+    uint16_t *slot;
+    int start = 0;
+
+    if (!pte || !pte->pt.valid || (pte->p2m.avail & STAGE2_AVAIL_SHARED))
+        return 0;
+    pa = (uint32_t) lpaed_guest_stage2_page_pa(pte);
+    guest_memory_clean_page(pa);
+    hash = guest_memory_hash_page(pa);
+    _share_stats.pages_scanned++;
+
+    /* identical to a shared frame */
+    while ((frame = guest_memory_share_find(hash, &start))) {
+        if (!memcmp((void *) frame->pa, (void *) pa, LPAE_PAGE_SIZE)) {
+            guest_memory_share_map(pte, frame);
+            return 1;
+        }
+    }
+
+    /* identical to a page seen before in this pass */
+    cand = &_share_candidates[hash & SHARE_TABLE_MASK];
+    if (cand->ipa && cand->hash == hash &&
+            !(cand->vmid == vmid && cand->ipa == ipa)) {
+        cpte = guest_memory_lookup_l3(cand->vmid, cand->ipa);
+        frame = guest_memory_share_slot(hash);
+        if (frame && cpte && cpte->pt.valid &&
+                !(cpte->p2m.avail & STAGE2_AVAIL_SHARED)) {
+            /* the candidate may have been written since it was hashed */
+            cpa = (uint32_t) lpaed_guest_stage2_page_pa(cpte);
+            guest_memory_clean_page(cpa);
+            slot = guest_memory_share_index(cpa, 1);
+            if (slot && !memcmp((void *) cpa, (void *) pa, LPAE_PAGE_SIZE)) {
+                frame->hash = hash;
+                frame->pa = cpa;
+                frame->refs = 0;
+                *slot = (frame - _share_frames) + 1;
+                guest_memory_share_map(cpte, frame);
+                guest_memory_share_map(pte, frame);
+                /* the candidate did not give up its frame */
+                _share_stats.pages_shared--;
+                cand->ipa = 0;
+                return 1;
+            }
+        }
+    }
+    cand->hash = hash;
+    cand->ipa = ipa;
+    cand->vmid = vmid;
+
+    return 0;
+}
+
+/**
+ * @brief Scans the guest RAM pages for sharing.
+ *
+ * Continues from where the previous call stopped. The candidate table is
+ * forgotten after every pass over all the guests. The TLBs are only
+ * flushed if a page was merged.
+ *
+ * @param pages Number of pages to scan.
+ * @return HVMM_STATUS_SUCCESS only.
+ */
+static hvmm_status_t memory_hw_share(uint32_t pages)
+{
+    struct guest_ram_region *ram;
+    uint8_t changed = 0;
+    int i;
+
+    while (pages--) {
+        ram = &_guest_ram[_share_scan_vmid];
+        if ((_share_scan_page << LPAE_PAGE_SHIFT) >= ram->size) {
+            _share_scan_page = 0;
+            if (++_share_scan_vmid >= NUM_GUESTS_STATIC) {
+                _share_scan_vmid = 0;
+                for (i = 0; i < SHARE_TABLE_SIZE; i++)
+                    _share_candidates[i].ipa = 0;
+                _share_stats.passes++;
+            }
+            continue;
+        }
+        changed |= guest_memory_share_page(_share_scan_vmid,
+                (uint32_t) ram->ipa + (_share_scan_page << LPAE_PAGE_SHIFT));
+        _share_scan_page++;
+    }
+    _share_stats.frames_pooled = _frame_pool_free;
+    if (changed)
+        guest_memory_flush_tlb();
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t memory_hw_share_stats(struct memory_share_stats *stats)
+{
+    _share_stats.frames_pooled = _frame_pool_free;
+    *stats = _share_stats;
+
+    return HVMM_STATUS_SUCCESS;
+}
+/** @}*/
+
+/**
+ * \defgroup Guest_working_set
+ *
+ * Working set estimation with the stage-2 access flag.
+ *
+ * The sampler walks the RAM pages of all guests a chunk at a time. A page
+ * whose access flag is set has been accessed since the previous pass and
+ * gets age 0, otherwise its age grows up to MEMORY_WSS_AGES - 1. The flag
+ * is then cleared, and the next access of the guest takes an access flag
+ * fault which only sets it again. The age lives in the software bits of
+ * the stage-2 descriptor. The histogram of ages is published at the end
+ * of every pass over a guest.
+ * @{
+ */
+#define STAGE2_AVAIL_AGE_SHIFT  1
+#define STAGE2_AVAIL_AGE_MASK   (0x7 << STAGE2_AVAIL_AGE_SHIFT)
+
+static struct memory_wss_stats _wss_stats[NUM_GUESTS_STATIC];
+static struct memory_wss_stats _wss_pass[NUM_GUESTS_STATIC];
+static vmid_t _wss_scan_vmid;
+static uint32_t _wss_scan_page;
+
+/**
+ * @brief Samples the access flags of a number of guest RAM pages.
+ *
+ * Continues from where the previous call stopped.
+ *
+ * @param pages Number of pages to sample.
+ * @return HVMM_STATUS_SUCCESS only.
+ */
+static hvmm_status_t memory_hw_wss_scan(uint32_t pages)
+{
+    struct guest_ram_region *ram;
+    struct memory_wss_stats *pass;
+    union lpaed *pte;
+    uint32_t ipa;
+    uint32_t age;
+
+    while (pages--) {
+        ram = &_guest_ram[_wss_scan_vmid];
+        pass = &_wss_pass[_wss_scan_vmid];
+        if ((_wss_scan_page << LPAE_PAGE_SHIFT) >= ram->size) {
+            pass->passes = _wss_stats[_wss_scan_vmid].passes + 1;
+            _wss_stats[_wss_scan_vmid] = *pass;
+            memset(pass, 0, sizeof(*pass));
+            _wss_scan_page = 0;
+            if (++_wss_scan_vmid >= NUM_GUESTS_STATIC)
+                _wss_scan_vmid = 0;
+            continue;
+        }
+        ipa = ram->ipa + (_wss_scan_page << LPAE_PAGE_SHIFT);
+        pte = guest_memory_lookup_l3(_wss_scan_vmid, ipa);
+        _wss_scan_page++;
+        if (!pte || !pte->pt.valid)
+            continue;
+        age = (pte->p2m.avail & STAGE2_AVAIL_AGE_MASK)
+                >> STAGE2_AVAIL_AGE_SHIFT;
+        if (pte->p2m.af)
+            age = 0;
+        else if (age < MEMORY_WSS_AGES - 1)
+            age++;
+        pte->p2m.avail = (pte->p2m.avail & ~STAGE2_AVAIL_AGE_MASK)
+                | (age << STAGE2_AVAIL_AGE_SHIFT);
+        pass->pages++;
+        pass->hist[age]++;
+        if (age)
+            continue;
+        pass->wss++;
+        /*
+         * A combined entry left in the TLB only hides accesses until it is
+         * evicted: the estimate is a little low, the guest is not slowed
+         */
+        pte->p2m.af = 0;
+        guest_memory_flush_ipa(_wss_scan_vmid, ipa, 0);
+    }
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t memory_hw_wss_stats(vmid_t vmid,
+            struct memory_wss_stats *stats)
+{
+    if (vmid >= NUM_GUESTS_STATIC)
+        return HVMM_STATUS_NOT_FOUND;
+    *stats = _wss_stats[vmid];
+
+    return HVMM_STATUS_SUCCESS;
+}
+/** @}*/
+
+/**
+ * @brief Maps a zeroed frame from the frame pool at a guest RAM page.
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the page.
+ * @param *pte Stage-2 level 3 descriptor of the page.
+ * @return HVMM_STATUS_SUCCESS, or HVMM_STATUS_NOT_FOUND if the frame pool
+ *         has no frame left that copy-on-write does not need.
+ */
+static hvmm_status_t guest_memory_map_zeroed(vmid_t vmid, uint64_t ipa,
+            union lpaed *pte)
+{
+    uint32_t pa = guest_memory_frame_alloc(0);
+
+    if (!pa)
+        return HVMM_STATUS_NOT_FOUND;
+    memset((void *) pa, 0, LPAE_PAGE_SIZE);
+    guest_memory_clean_page(pa);
+    lpaed_guest_stage2_map_page(pte, pa, _guest_ram[vmid].attr);
+    pte->p2m.avail = 0;
+    lpaed_guest_stage2_enable_l2_table(guest_memory_lookup_l2(vmid, ipa));
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * \defgroup Guest_memory_balloon
+ *
+ * Guest RAM pages handed back by the guest (inflate) are unmapped and
+ * their frames go to the frame pool. Pages asked back (deflate) are mapped
+ * to zeroed frames from the pool. A guest only gets pages back at the IPAs
+ * it inflated, the balloon never grows a guest past its RAM region.
+ * Both mark the pages dirty for the checkpoint, a rollback maps or unmaps
+ * them again.
+ * @{
+ */
+static uint32_t _balloon_pages[NUM_GUESTS_STATIC];
+
+/**
+ * @brief Marks a guest RAM page for the next checkpoint or rollback.
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the page.
+ * @return void
+ */
+static void guest_memory_balloon_dirty(vmid_t vmid, uint64_t ipa)
+{
+#ifdef CFG_MEMMAP_CHECKPOINT_OFFSET
+    struct guest_checkpoint_store *store = &_ckpt_store[vmid];
+    uint32_t page = (ipa - _guest_ram[vmid].ipa) >> LPAE_PAGE_SHIFT;
+
+    if (store->based && page < store->pages)
+        store->dirty[page >> 5] |= (1u << (page & 31));
+#endif
+}
+
+/**
+ * @brief Unmaps a guest RAM page and puts its frame into the frame pool.
+ *
+ * @param vmid Guest.
+ * @param *pte Valid stage-2 level 3 descriptor of the page.
+ * @return void
+ */
+static void guest_memory_balloon_take(vmid_t vmid, union lpaed *pte)
+{
+    uint32_t pa;
+
+    if (pte->p2m.avail & STAGE2_AVAIL_SHARED)
+        pa = guest_memory_share_drop(pte);
+    else
+        pa = (uint32_t) lpaed_guest_stage2_page_pa(pte);
+    pte->pt.valid = 0;
+    pte->p2m.avail = 0;
+    if (pa)
+        guest_memory_frame_free(pa);
+    _balloon_pages[vmid]++;
+}
+
+/**
+ * @brief Maps a zeroed frame from the frame pool at a ballooned page.
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the page.
+ * @param *pte Invalid stage-2 level 3 descriptor of the page.
+ * @return HVMM_STATUS_SUCCESS, or HVMM_STATUS_NOT_FOUND if no frame is
+ *         left.
+ */
+static hvmm_status_t guest_memory_balloon_give(vmid_t vmid, uint64_t ipa,
+            union lpaed *pte)
+{
+    if (guest_memory_map_zeroed(vmid, ipa, pte) != HVMM_STATUS_SUCCESS)
+        return HVMM_STATUS_NOT_FOUND;
+    if (_balloon_pages[vmid])
+        _balloon_pages[vmid]--;
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Takes contiguous guest RAM pages away from a guest.
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the first page.
+ * @param pages Number of pages.
+ * @return Number of pages processed, less than 'pages' if the range
+ *         leaves the guest RAM.
+ */
+static uint32_t memory_hw_balloon_inflate(vmid_t vmid, uint64_t ipa,
+            uint32_t pages)
+{
+    struct guest_ram_region *ram;
+    union lpaed *pte;
+    uint32_t done;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return 0;
+    ram = &_guest_ram[vmid];
+    ipa &= ~((uint64_t) LPAE_PAGE_SIZE - 1);
+    for (done = 0; done < pages; done++, ipa += LPAE_PAGE_SIZE) {
+        if (ipa < ram->ipa || ipa >= ram->ipa + ram->size)
+            break;
+        pte = guest_memory_lookup_l3(vmid, ipa);
+        if (!pte)
+            break;
+        if (!pte->pt.valid)
+            continue;
+        guest_memory_balloon_take(vmid, pte);
+        guest_memory_balloon_dirty(vmid, ipa);
+    }
+    guest_memory_flush_tlb();
+
+    return done;
+}
+
+/**
+ * @brief Gives contiguous guest RAM pages back to a guest.
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the first page.
+ * @param pages Number of pages.
+ * @return Number of pages processed, less than 'pages' if the range
+ *         leaves the guest RAM or the frame pool runs dry.
+ */
+static uint32_t memory_hw_balloon_deflate(vmid_t vmid, uint64_t ipa,
+            uint32_t pages)
+{
+    struct guest_ram_region *ram;
+    union lpaed *pte;
+    uint32_t done;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return 0;
+    ram = &_guest_ram[vmid];
+    ipa &= ~((uint64_t) LPAE_PAGE_SIZE - 1);
+    for (done = 0; done < pages; done++, ipa += LPAE_PAGE_SIZE) {
+        if (ipa < ram->ipa || ipa >= ram->ipa + ram->size)
+            break;
+        pte = guest_memory_lookup_l3(vmid, ipa);
+        if (!pte)
+            break;
+        if (pte->pt.valid)
+            continue;
+        if (guest_memory_balloon_give(vmid, ipa, pte) != HVMM_STATUS_SUCCESS)
+            break;
+        guest_memory_balloon_dirty(vmid, ipa);
+    }
+    asm volatile("dsb");
+    asm volatile("isb");
+
+    return done;
+}
+/** @}*/
+
+#ifdef CFG_MEMMAP_CHECKPOINT_OFFSET
+/**
+ * @brief Copies guest RAM pages between the guest and its checkpoint slice.
+ *
+ * Copies every page of the slice if 'all' is set, otherwise only the dirty
+ * ones. Copied pages are cleaned from the dirty bitmap and write-protected
+ * again to catch the next write. A checkpoint records the pages ballooned
+ * at the time, a rollback unmaps them again and maps back the others the
+ * balloon took since.
+ *
+ * @param vmid Guest.
+ * @param to_guest Copy from the slice to the guest RAM (rollback).
+ * @param all Copy all pages regardless of the dirty bitmap.
+ * @return Number of copied pages.
+ */
+static uint32_t guest_memory_ckpt_copy(vmid_t vmid, uint8_t to_guest,
+            uint8_t all)
+{
+    struct guest_checkpoint_store *store = &_ckpt_store[vmid];
+    struct guest_ram_region *ram = &_guest_ram[vmid];
+    union lpaed *pte;
+    uint64_t ipa;
+    uint32_t page, bit, guest_pa, slice_pa;
+    uint32_t copied = 0;
+
+    for (page = 0; page < store->pages; page++) {
+        bit = 1u << (page & 31);
+        if (!all && !(store->dirty[page >> 5] & bit))
+            continue;
+        store->dirty[page >> 5] &= ~bit;
+        ipa = ram->ipa + (page << LPAE_PAGE_SHIFT);
+        pte = guest_memory_lookup_l3(vmid, ipa);
+        if (!pte)
+            continue;
+        if (!to_guest) {
+            if (!pte->pt.valid) {
+                store->absent[page >> 5] |= bit;
+                continue;
+            }
+            store->absent[page >> 5] &= ~bit;
+        } else if (store->absent[page >> 5] & bit) {
+            if (pte->pt.valid)
+                guest_memory_balloon_take(vmid, pte);
+            continue;
+        } else if (!pte->pt.valid &&
+                guest_memory_balloon_give(vmid, ipa, pte) !=
+                HVMM_STATUS_SUCCESS) {
+            /* Left for the next rollback */
+            store->dirty[page >> 5] |= bit;
+            printH("[memory] rollback vmid:%d no frame for %x\n", vmid,
+                    (uint32_t) ipa);
+            continue;
+        }
+        if (to_guest && (pte->p2m.avail & STAGE2_AVAIL_SHARED) &&
+                guest_memory_unshare(pte) != HVMM_STATUS_SUCCESS)
+            continue;
+        guest_pa = (uint32_t) lpaed_guest_stage2_page_pa(pte);
+        slice_pa = store->base + (page << LPAE_PAGE_SHIFT);
+        if (to_guest)
+            guest_memory_copy_page(guest_pa, slice_pa);
+        else
+            guest_memory_copy_page(slice_pa, guest_pa);
+        lpaed_guest_stage2_set_write(pte, 0);
+        copied++;
+    }
+    guest_memory_flush_tlb();
+
+    return copied;
+}
+#endif
+
+/**
+ * @brief Copies the guest RAM pages aside into the checkpoint slice.
+ *
+ * The first call takes a base snapshot of the whole slice. Later calls copy
+ * only the pages written since the previous checkpoint or rollback.
+ *
+ * @param vmid Guest, which must not be running.
+ * @return HVMM_STATUS_UNSUPPORTED_FEATURE if no checkpoint region is
+ *         configured, otherwise HVMM_STATUS_SUCCESS.
+ */
+static hvmm_status_t memory_hw_checkpoint(vmid_t vmid)
+{
+#ifdef CFG_MEMMAP_CHECKPOINT_OFFSET
+    struct guest_checkpoint_store *store = &_ckpt_store[vmid];
+    uint32_t copied;
+
+    if (!store->pages)
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    copied = guest_memory_ckpt_copy(vmid, 0, !store->based);
+    store->based = 1;
+    printH("[memory] checkpoint vmid:%d pages:%d\n", vmid, copied);
+
+    return HVMM_STATUS_SUCCESS;
+#else
+    return HVMM_STATUS_UNSUPPORTED_FEATURE;
+#endif
+}
+
+/**
+ * @brief Copies the guest RAM pages written since the last checkpoint back
+ * from the checkpoint slice.
+ *
+ * @param vmid Guest, which must not be running.
+ * @return HVMM_STATUS_NOT_FOUND if no checkpoint has been taken yet.
+ */
+static hvmm_status_t memory_hw_rollback(vmid_t vmid)
+{
+#ifdef CFG_MEMMAP_CHECKPOINT_OFFSET
+    struct guest_checkpoint_store *store = &_ckpt_store[vmid];
+    uint32_t copied;
+
+    if (!store->based)
+        return HVMM_STATUS_NOT_FOUND;
+    copied = guest_memory_ckpt_copy(vmid, 1, 0);
+    printH("[memory] rollback vmid:%d pages:%d\n", vmid, copied);
+
+    return HVMM_STATUS_SUCCESS;
+#else
+    return HVMM_STATUS_UNSUPPORTED_FEATURE;
+#endif
+}
+
+/**
+ * @brief Resolves a stage-2 fault of the current guest.
+ *
+ * - Access flag fault: sets the access flag cleared by the working set
+ *   sampler.
+ * - Write permission fault on a shared page: copy-on-write.
+ * - Write permission fault on a write-protected page of the checkpoint
+ *   slice: marks the page dirty and gives the write permission back.
+ *
+ * @param vmid Guest that took the fault.
+ * @param ipa Faulting intermediate physical address.
+ * @param iss Instruction specific syndrome of the data abort.
+ * @return HVMM_STATUS_SUCCESS if resolved, HVMM_STATUS_NOT_FOUND otherwise.
+ */
+static hvmm_status_t memory_hw_fault(vmid_t vmid, uint64_t ipa, uint32_t iss)
+{
+    uint32_t fsc = iss & ISS_FSR_MASK;
+    struct guest_ram_region *ram;
+    union lpaed *pte;
+    uint8_t resolved = 0;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return HVMM_STATUS_NOT_FOUND;
+    ram = &_guest_ram[vmid];
+    if (ipa < ram->ipa || ipa >= ram->ipa + ram->size)
+        return HVMM_STATUS_NOT_FOUND;
+
+    pte = guest_memory_lookup_l3(vmid, ipa);
+    if (!pte)
+        return HVMM_STATUS_NOT_FOUND;
+    if (!pte->pt.valid)
+        return HVMM_STATUS_NOT_FOUND;
+
+    if (fsc == ACCESS_FAULT_LEVEL3) {
+        /* Faulting descriptors are not held in the TLB */
+        pte->p2m.af = 1;
+        asm volatile("dsb");
+        asm volatile("isb");
+        return HVMM_STATUS_SUCCESS;
+    }
+    if (fsc == PERMISSION_FAULT_LEVEL3 && (iss & ISS_WNR)) {
+#ifdef CFG_MEMMAP_CHECKPOINT_OFFSET
+        struct guest_checkpoint_store *store = &_ckpt_store[vmid];
+        uint32_t page = (ipa - ram->ipa) >> LPAE_PAGE_SHIFT;
+#endif
+        if (pte->p2m.avail & STAGE2_AVAIL_SHARED) {
+            if (guest_memory_unshare(pte) != HVMM_STATUS_SUCCESS)
+                return HVMM_STATUS_NOT_FOUND;
+            resolved = 1;
+        }
+#ifdef CFG_MEMMAP_CHECKPOINT_OFFSET
+        if (store->based && page < store->pages) {
+            store->dirty[page >> 5] |= (1u << (page & 31));
+            lpaed_guest_stage2_set_write(pte, 1);
+            resolved = 1;
+        }
+#endif
+    }
+    if (!resolved)
+        return HVMM_STATUS_NOT_FOUND;
+    /* Only the faulting page changed, a read-only entry would fault again */
+    guest_memory_flush_ipa(vmid, (uint32_t) ipa & ~(LPAE_PAGE_SIZE - 1), 1);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Maps a hypervisor page read-only at a guest page.
+ *
+ * The page is mapped as normal write-back memory in stage-2, the guest
+ * reads it with the attributes of its own stage-1 mapping, which are
+ * device attributes for a device page, hence memory_hw_sync_range().
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the page.
+ * @param page Page aligned hypervisor page, mapped flat.
+ * @return HVMM_STATUS_BAD_ACCESS if the guest page is already mapped or
+ *         there is no level 3 table for it.
+ */
+static hvmm_status_t memory_hw_map_shadow(vmid_t vmid, uint64_t ipa,
+            void *page)
+{
+    union lpaed *l2;
+    union lpaed *pte;
+
+    if (vmid >= NUM_GUESTS_STATIC ||
+            ((uint32_t) page & (LPAE_PAGE_SIZE - 1)))
+        return HVMM_STATUS_BAD_ACCESS;
+    ipa &= ~((uint64_t) LPAE_PAGE_SIZE - 1);
+    l2 = guest_memory_lookup_l2(vmid, ipa);
+    pte = guest_memory_lookup_l3(vmid, ipa);
+    if (!pte)
+        return HVMM_STATUS_BAD_ACCESS;
+    /* The level 3 table of an invalid level 2 entry is not generated */
+    if (!l2->pt.valid)
+        memset(pte - ((ipa >> L3_SHIFT) & L3_ENTRY_MASK), 0, LPAE_PAGE_SIZE);
+    if (pte->pt.valid)
+        return HVMM_STATUS_BAD_ACCESS;
+
+    guest_memory_clean_page((uint32_t) page);
+    lpaed_guest_stage2_map_page(pte, (uint32_t) page,
+            MEMATTR_NORMAL_OWB | MEMATTR_NORMAL_IWB);
+    lpaed_guest_stage2_set_write(pte, 0);
+    pte->p2m.avail = 0;
+    lpaed_guest_stage2_enable_l2_table(l2);
+    guest_memory_flush_tlb();
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Cleans and invalidates a range of memory to the point of coherency.
+ *
+ * Used after the hypervisor wrote a shadow page or guest memory, and
+ * before it reads guest memory.
+ *
+ * @param addr Start of the range.
+ * @param size Size of the range in bytes.
+ * @return HVMM_STATUS_SUCCESS.
+ */
+static hvmm_status_t memory_hw_sync_range(void *addr, uint32_t size)
+{
+    uint32_t line = (uint32_t) addr & ~(64 - 1);
+    uint32_t end = (uint32_t) addr + size;
+
+    for (; line < end; line += 64)
+        clean_invalidate_dcache_mva(line);
+    asm volatile("dsb");
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/* Short-descriptor stage-1 translation of the guests */
+#define TTBCR_EAE               (1u << 31)
+#define TTBCR_N_MASK            0x7
+#define S1_L1_TYPE_TABLE        0x1
+#define S1_L1_SECTION           (1 << 1)
+#define S1_L1_SUPERSECTION      (1 << 18)
+#define S1_L1_SECTION_APX       (1 << 15)
+#define S1_L2_TYPE_MASK         0x3
+#define S1_L2_TYPE_LARGE        0x1
+#define S1_L2_APX               (1 << 9)
+
+#define GUEST_XLATE_ENTRIES     8
+#define GUEST_XLATE_VALID       (1 << 11)
+
+/**
+ * @brief Stage-1 registers of a guest, the context of its virtual
+ * addresses.
+ */
+struct guest_stage1 {
+    uint32_t sctlr;
+    uint32_t ttbr0;
+    uint32_t ttbr1;
+    uint32_t ttbcr;
+};
+
+/**
+ * @brief Entry of the translation cache of memory_hw_translate().
+ *
+ * tag is the guest page, its MEMORY_GUEST_VA and MEMORY_GUEST_WRITE flags
+ * and GUEST_XLATE_VALID. A virtual address entry only hits with the same
+ * stage-1 registers, any entry only in the stage-2 generation it was
+ * walked in.
+ */
+struct guest_xlate_entry {
+    uint32_t tag;
+    uint32_t gen;
+    struct guest_stage1 s1;
+    uint32_t pa;
+};
+
+static struct guest_xlate_entry
+        _xlate_cache[NUM_GUESTS_STATIC][GUEST_XLATE_ENTRIES];
+
+static void guest_memory_stage1_regs(vmid_t vmid, struct guest_stage1 *s1)
+{
+    struct arch_context *context;
+
+    if (vmid == guest_current_vmid()) {
+        s1->sctlr = read_sctlr();
+        s1->ttbr0 = read_ttbr0();
+        s1->ttbr1 = read_ttbr1();
+        s1->ttbcr = read_ttbcr();
+        return;
+    }
+    context = guest_context(vmid);
+    s1->sctlr = context->regs_cop.sctlr;
+    /* The short-descriptor walk only uses the low word */
+    s1->ttbr0 = (uint32_t) context->regs_cop.ttbr0;
+    s1->ttbr1 = (uint32_t) context->regs_cop.ttbr1;
+    s1->ttbcr = context->regs_cop.ttbcr;
+}
+
+/**
+ * @brief Stage-2 translation of a guest page, resolving the faults a guest
+ * access would have the hypervisor resolve(memory_hw_fault()).
+ */
+static hvmm_status_t guest_memory_stage2(vmid_t vmid, uint32_t ipa,
+            uint32_t write, uint32_t *pa)
+{
+    union lpaed *l2 = guest_memory_lookup_l2(vmid, ipa);
+    union lpaed *pte = guest_memory_lookup_l3(vmid, ipa);
+    uint32_t iss = 0;
+
+    if (!l2 || !pte)
+        return HVMM_STATUS_BAD_ACCESS;
+    if (!l2->pt.valid)
+        iss = TRANS_FAULT_LEVEL2;
+    else if (!pte->pt.valid)
+        iss = TRANS_FAULT_LEVEL3;
+    else if (write && !pte->p2m.write)
+        iss = PERMISSION_FAULT_LEVEL3 | ISS_WNR;
+    if (iss) {
+        if (memory_hw_fault(vmid, ipa, iss) != HVMM_STATUS_SUCCESS)
+            return HVMM_STATUS_BAD_ACCESS;
+        if (!l2->pt.valid || !pte->pt.valid || (write && !pte->p2m.write))
+            return HVMM_STATUS_BAD_ACCESS;
+    }
+    *pa = (uint32_t) lpaed_guest_stage2_page_pa(pte) |
+            (ipa & (LPAE_PAGE_SIZE - 1));
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/* Reads a word of a guest table, written with the guest's attributes */
+static hvmm_status_t guest_memory_read_desc(vmid_t vmid, uint32_t ipa,
+            uint32_t *desc)
+{
+    uint32_t pa;
+
+    if (guest_memory_stage2(vmid, ipa, 0, &pa))
+        return HVMM_STATUS_BAD_ACCESS;
+    memory_hw_sync_range((void *) pa, 4);
+    *desc = *(volatile uint32_t *) pa;
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Walks the short-descriptor stage-1 tables of a guest.
+ *
+ * Write permission is checked with AP[2] only, domains are not.
+ *
+ * @return HVMM_STATUS_UNSUPPORTED_FEATURE for the long-descriptor format,
+ *         HVMM_STATUS_BAD_ACCESS on a translation or permission fault.
+ */
+static hvmm_status_t guest_memory_stage1(vmid_t vmid,
+            const struct guest_stage1 *s1, uint32_t va, uint32_t write,
+            uint32_t *ipa)
+{
+    uint32_t n = s1->ttbcr & TTBCR_N_MASK;
+    uint32_t table;
+    uint32_t desc;
+
+    if (!(s1->sctlr & SCTLR_M)) {
+        *ipa = va;
+        return HVMM_STATUS_SUCCESS;
+    }
+    if (s1->ttbcr & TTBCR_EAE)
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    if (n && (va >> (32 - n)))
+        table = (s1->ttbr1 & 0xFFFFC000) | ((va >> 20) << 2);
+    else
+        table = (s1->ttbr0 & ~((1u << (14 - n)) - 1)) |
+                (((va << n) >> (n + 20)) << 2);
+    if (guest_memory_read_desc(vmid, table, &desc))
+        return HVMM_STATUS_BAD_ACCESS;
+
+    if (desc & S1_L1_SECTION) {
+        if (write && (desc & S1_L1_SECTION_APX))
+            return HVMM_STATUS_BAD_ACCESS;
+        if (desc & S1_L1_SUPERSECTION)
+            *ipa = (desc & 0xFF000000) | (va & 0x00FFFFFF);
+        else
+            *ipa = (desc & 0xFFF00000) | (va & 0x000FFFFF);
+        return HVMM_STATUS_SUCCESS;
+    }
+    if ((desc & 0x3) != S1_L1_TYPE_TABLE)
+        return HVMM_STATUS_BAD_ACCESS;
+
+    table = (desc & 0xFFFFFC00) | (((va >> 12) & 0xFF) << 2);
+    if (guest_memory_read_desc(vmid, table, &desc))
+        return HVMM_STATUS_BAD_ACCESS;
+    if (!(desc & S1_L2_TYPE_MASK) || (write && (desc & S1_L2_APX)))
+        return HVMM_STATUS_BAD_ACCESS;
+    if ((desc & S1_L2_TYPE_MASK) == S1_L2_TYPE_LARGE)
+        *ipa = (desc & 0xFFFF0000) | (va & 0x0000FFFF);
+    else
+        *ipa = (desc & 0xFFFFF000) | (va & 0x00000FFF);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/*
+ * Stage 1 and 2 translation of the running guest by the MMU. The result
+ * lands in the Non-secure PAR, which belongs to the guest: it is restored.
+ */
+static hvmm_status_t guest_memory_ats(uint32_t va, uint32_t write,
+            uint32_t *pa)
+{
+    uint64_t guest_par = read_par();
+    uint64_t par;
+
+    if (write)
+        write_ats12nsopw(va);
+    else
+        write_ats12nsopr(va);
+    asm volatile("isb");
+    par = read_par();
+    write_par(guest_par);
+    asm volatile("isb");
+    if (par & PAR_F)
+        return HVMM_STATUS_BAD_ACCESS;
+    *pa = ((uint32_t) par & PAR_PA_MASK) | (va & ~PAR_PA_MASK);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Translates a guest address, through the translation cache.
+ *
+ * The MMU translates the virtual addresses of the running guest(ATS12NSO*),
+ * the tables are walked otherwise or if that faults: a stage-2 fault may
+ * be one the hypervisor resolves. Long-descriptor stage-1 tables are only
+ * supported for the running guest.
+ */
+static hvmm_status_t memory_hw_translate(vmid_t vmid, uint32_t addr,
+            uint32_t flags, uint64_t *pa)
+{
+    struct guest_xlate_entry *entry;
+    struct guest_stage1 s1 = { 0, };
+    uint32_t write = flags & MEMORY_GUEST_WRITE;
+    uint32_t offset = addr & (LPAE_PAGE_SIZE - 1);
+    uint32_t tag;
+    uint32_t ipa;
+    uint32_t page;
+    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return HVMM_STATUS_BAD_ACCESS;
+
+    tag = (addr - offset) | (flags & (MEMORY_GUEST_VA | MEMORY_GUEST_WRITE)) |
+            GUEST_XLATE_VALID;
+    if (flags & MEMORY_GUEST_VA)
+        guest_memory_stage1_regs(vmid, &s1);
+    entry = &_xlate_cache[vmid][(addr >> LPAE_PAGE_SHIFT) %
+            GUEST_XLATE_ENTRIES];
+    if (!(flags & MEMORY_GUEST_NOCACHE) && entry->tag == tag &&
+            entry->gen == _stage2_gen && entry->s1.sctlr == s1.sctlr &&
+            entry->s1.ttbr0 == s1.ttbr0 && entry->s1.ttbr1 == s1.ttbr1 &&
+            entry->s1.ttbcr == s1.ttbcr) {
+        *pa = entry->pa | offset;
+        return HVMM_STATUS_SUCCESS;
+    }
+
+    if (!(flags & MEMORY_GUEST_VA)) {
+        result = guest_memory_stage2(vmid, addr, write, &page);
+    } else {
+        if (vmid == guest_current_vmid())
+            result = guest_memory_ats(addr, write, &page);
+        if (result != HVMM_STATUS_SUCCESS) {
+            result = guest_memory_stage1(vmid, &s1, addr, write, &ipa);
+            if (result == HVMM_STATUS_SUCCESS)
+                result = guest_memory_stage2(vmid, ipa, write, &page);
+        }
+    }
+    if (result != HVMM_STATUS_SUCCESS)
+        return result;
+
+    /* A resolved fault may have bumped the generation */
+    entry->tag = tag;
+    entry->gen = _stage2_gen;
+    entry->s1 = s1;
+    entry->pa = page & ~(LPAE_PAGE_SIZE - 1);
+    *pa = page;
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Initializes the virtual mode(guest mode) memory management
+ * stage-2 translation.
+ *
+ * Configure translation tables of guests for stage-2 translation (IPA -> PA).
+ *
+ * - First, relocates the translation tables pgtable_gen built from the
+ *   memory map descriptor lists.
+ * - And records the RAM region of each guest from the lists.
+ * - Last, initializes mmu.
+ *
+ * @return void
+ */
+static void __init guest_memory_init(struct memmap_desc **guest_map,
+        struct memmap_desc **guest2_map)
+{
+    /*
+     * Initializes Translation Table for Stage2 Translation (IPA -> PA)
+     */
+    int i, j;
 
     HVMM_TRACE_ENTER();
     for (i = 0; i < NUM_GUESTS_STATIC; i++)
@@ -1205,8 +2096,32 @@ static void guest_memory_init(struct memmap_desc **guest_map,
     _vmid_ttbl[0] = &_ttbl_guest0[0];
     _vmid_ttbl[1] = &_ttbl_guest1[0];
 
-    guest_memory_init_ttbl(&_ttbl_guest0[0], guest_map);
-    guest_memory_init_ttbl(&_ttbl_guest1[0], guest2_map);
+    /*
+     * The tables are generated, only their base address is left. The level
+     * 2 table of an invalid level 1 entry is not written.
+     */
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        memory_relocate_ttbl(_vmid_ttbl[i], _vmid_ttbl[i],
+                VMM_L1_PTE_NUM);
+        for (j = 0; j < VMM_L1_PTE_NUM; j++) {
+            if (!_vmid_ttbl[i][j].pt.valid)
+                continue;
+            memory_relocate_ttbl(_vmid_ttbl[i],
+                    TTBL_L2(_vmid_ttbl[i], j), VMM_L2_PTE_NUM);
+        }
+    }
+    guest_memory_init_ram_region(0, guest_map);
+    guest_memory_init_ram_region(1, guest2_map);
+#ifdef CFG_MEMMAP_CHECKPOINT_OFFSET
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        _ckpt_store[i].base = CFG_MEMMAP_CHECKPOINT_OFFSET
+                + CKPT_SLICE_SIZE * i;
+        _ckpt_store[i].pages = _guest_ram[i].size >> LPAE_PAGE_SHIFT;
+        if (_ckpt_store[i].pages > CKPT_RAM_PAGES)
+            _ckpt_store[i].pages = CKPT_RAM_PAGES;
+        _ckpt_store[i].based = 0;
+    }
+#endif
     guest_memory_init_mmu();
     HVMM_TRACE_EXIT();
 }
@@ -1216,7 +2131,8 @@ static void guest_memory_init(struct memmap_desc **guest_map,
  *
  * Configure all features of the memory management.
  *
- * - Generate and confgirue hyp mode & virtual mode translation tables.
+ * - Write out and relocate the generated hyp mode & virtual mode
+ *   translation tables.
  * - Configure MAIRx, HMAIRx register.
  *   - \ref Memory_Attribute_Indirection_Register.
  *   - \ref Attribute_Indexes.
@@ -1239,15 +2155,35 @@ static void guest_memory_init(struct memmap_desc **guest_map,
  *
  * @return HVMM_STATUS_SUCCESS, Always success.
  */
-static int memory_hw_init(struct memmap_desc **guest0,
+static int __init memory_hw_init(struct memmap_desc **guest0,
             struct memmap_desc **guest1)
 {
-    uart_print("[memory] memory_init: enter\n\r");
+    printh("[memory] memory_init: enter\n\r");
+    boot_subphase("ttbl runs");
+    memory_expand_ttbl();
+    boot_subphase("guest ttbl");
     guest_memory_init(guest0, guest1);
+    boot_subphase("host ttbl");
     host_memory_init();
+    boot_subphase("mmu enable");
     memory_enable();
+    boot_subphase("heap");
     host_memory_heap_init();
-    uart_print("[memory] memory_init: exit\n\r");
+    printh("[memory] memory_init: exit\n\r");
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Sets up the stage-2 translation control and enables the hyp MMU
+ * of a secondary CPU, the registers are banked per CPU.
+ *
+ * @return HVMM_STATUS_SUCCESS, Always success.
+ */
+static hvmm_status_t memory_hw_init_cpu(void)
+{
+    guest_memory_init_mmu();
+    memory_enable();
 
     return HVMM_STATUS_SUCCESS;
 }
@@ -1269,7 +2205,7 @@ static void memory_hw_free(void *ap)
  * management module.
  * - Disables stage-2 translation by HCR.vm = 0.
  */
-static hvmm_status_t memory_hw_save(void)
+static hvmm_status_t __hot memory_hw_save(void)
 {
     /*
      * We assume VTCR has been configured and initialized
@@ -1289,7 +2225,7 @@ static hvmm_status_t memory_hw_save(void)
  *
  * @param guest Context of the next guest.
  */
-static hvmm_status_t memory_hw_restore(vmid_t vmid)
+static hvmm_status_t __hot memory_hw_restore(vmid_t vmid)
 {
     /*
      * Restore Translation Table for the next guest and
@@ -1301,17 +2237,59 @@ static hvmm_status_t memory_hw_restore(vmid_t vmid)
     return HVMM_STATUS_SUCCESS;
 }
 
-static hvmm_status_t memory_hw_dump(void)
+/**
+ * @brief Gives the init-only code and data(__init, __initdata) to the heap.
+ *
+ * The region keeps the attributes of the image, Strongly-ordered.
+ *
+ * @return HVMM_STATUS_SUCCESS only.
+ */
+static hvmm_status_t __cold memory_hw_free_init(void)
+{
+    uint32_t size = __init_end - __init_start;
+
+    if (size < 2 * sizeof(union header))
+        return HVMM_STATUS_SUCCESS;
+    host_memory_heap_add(__init_start, size);
+    printH("[memory] freed %d bytes of init memory\n", size);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t __cold memory_hw_dump(void)
 {
+    printH("[memory] share: scanned:%d shared:%d unshared:%d passes:%d"
+            " pooled:%d\n", _share_stats.pages_scanned,
+            _share_stats.pages_shared, _share_stats.pages_unshared,
+            _share_stats.passes, _frame_pool_free);
+    printH("[memory] balloon: guest0:%d guest1:%d\n", _balloon_pages[0],
+            _balloon_pages[1]);
+    printH("[memory] wss: guest0:%d/%d guest1:%d/%d\n", _wss_stats[0].wss,
+            _wss_stats[0].pages, _wss_stats[1].wss, _wss_stats[1].pages);
     return HVMM_STATUS_SUCCESS;
 }
 
 struct memory_ops _memory_ops = {
     .init = memory_hw_init,
+    .init_cpu = memory_hw_init_cpu,
     .alloc = memory_hw_alloc,
     .free = memory_hw_free,
     .save = memory_hw_save,
     .restore = memory_hw_restore,
+    .checkpoint = memory_hw_checkpoint,
+    .rollback = memory_hw_rollback,
+    .fault = memory_hw_fault,
+    .share = memory_hw_share,
+    .share_stats = memory_hw_share_stats,
+    .balloon_inflate = memory_hw_balloon_inflate,
+    .balloon_deflate = memory_hw_balloon_deflate,
+    .wss_scan = memory_hw_wss_scan,
+    .wss_stats = memory_hw_wss_stats,
+    .map_shadow = memory_hw_map_shadow,
+    .sync_shadow = memory_hw_sync_range,
+    .translate = memory_hw_translate,
+    .sync_guest = memory_hw_sync_range,
+    .free_init = memory_hw_free_init,
     .dump = memory_hw_dump,
 };
 
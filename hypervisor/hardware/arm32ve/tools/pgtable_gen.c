@@ -0,0 +1,605 @@
+/*
+ * pgtable_gen - builds the translation tables and the pirq routing table
+ * of the hypervisor at build time.
+ *
+ * Runs on the build host, from the directory of a board, with the
+ * configuration of the board: k-hypervisor-config.h and guest_map.h.
+ * It writes there:
+ * - pgtables.S: the hyp stage-1 tables(_hmm_pgtable, _hmm_pgtable_l2,
+ *   _hmm_pgtable_l3) then the stage-2 table of each guest(_ttbl_guestN),
+ *   one after the other in .pgtables from _pgtables, 4KB aligned, and the
+ *   runs of descriptors(struct pgtable_run) in .init.data. .pgtables is
+ *   not zeroed at boot: the runs cover every entry the MMU or the
+ *   hypervisor may read, zero or not, and nothing else. The level 3
+ *   tables of the guest level 2 entries which are invalid and out of the
+ *   guest RAM are not written, most of the ~17MB of tables.
+ * - guest_virqmap.c: _guest_virqmap preinitialized from GUEST_VIRQMAP.
+ *
+ * Every hierarchy is built at address 0: the address of a table
+ * descriptor is the offset of the next-level table from the level 1
+ * table, memory_hw.c adds the link address of the level 1 table at boot
+ * (libhw/pgtable.h).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <k-hypervisor-config.h>
+#include <pgtable.h>
+#include <log/uart_print.h>
+#include "guest_map.h"
+
+#define PGTABLE_ASM         "pgtables.S"
+#define VIRQMAP_SRC         "guest_virqmap.c"
+
+/* lpae.c prints the level 1 blocks it builds */
+void uart_print_hex32(uint32_t v)
+{
+}
+
+void uart_print_hex64(uint64_t v)
+{
+}
+
+static struct memmap_desc **_guest_mdlist[NUM_GUESTS_STATIC] = {
+    guest_mdlist0,
+    guest_mdlist1,
+};
+
+/* Level 1 table of the hierarchy being built */
+static union lpaed *_ttbl_base;
+
+/**
+ * @brief Gets the address of a table of the hierarchy being built.
+ */
+static uint64_t ttbl_offset(union lpaed *table)
+{
+    return (uint64_t) (table - _ttbl_base) * sizeof(union lpaed);
+}
+
+/**
+ * @brief Maps physical address of the guest to level 3 descriptors.
+ *
+ * Maps physical address to the target level 3 translation table descriptor.
+ * Configure bits of the target descriptor whiche are initialized by initial
+ * function. (lpaed_guest_stage2_map_page)
+ *
+ * @param *ttbl3 Level 3 translation table descriptor.
+ * @param offset Offset from the level 3 table descriptor.
+ *        - 0 ~ (2MB - pages * 4KB), start contiguous virtual address within
+ *          level 2 block (2MB).
+ *        - It is aligned L3 descriptor lock size(4KB).
+ * @param pages Number of pages.
+ *        - 0 ~ 512
+ * @param pa Physical address.
+ * @param mattr Memory Attribute.
+ * @return void
+ */
+static void guest_memory_ttbl3_map(union lpaed *ttbl3, uint64_t offset,
+                uint32_t pages, uint64_t pa, enum memattr mattr)
+{
+    int index_l3 = 0;
+    int index_l3_last = 0;
+    /* Initialize the address spaces with 'invalid' state */
+    index_l3 = offset;
+    index_l3_last = index_l3 + pages;
+    for (; index_l3 < index_l3_last; index_l3++) {
+        lpaed_guest_stage2_map_page(&ttbl3[index_l3], pa, mattr);
+        pa += LPAE_PAGE_SIZE;
+    }
+}
+
+/**
+ * @brief Unmap level 3 descriptors.
+ *
+ * Unmap descriptors of ttbl3 which is in between offset and offset + pages and
+ * makes valid bit zero.
+ *
+ * @param *ttbl3 Level 3 translation table descriptor.
+ * @param offset Offset from the level 3 table descriptor.
+ *        - 0 ~ (2MB - pages * 4KB), start contiguous virtual address within
+ *          level 2 block (2MB).
+ *        - It is aligned L3 descriptor lock size(4KB).
+ * @param pages Number of pages.
+ *        - 0 ~ 512
+ * @return void
+ */
+static void guest_memory_ttbl3_unmap(union lpaed *ttbl3, uint64_t offset,
+                uint32_t pages)
+{
+    int index_l3 = 0;
+    int index_l3_last = 0;
+    /* Initialize the address spaces with 'invalid' state */
+    index_l3 = offset >> LPAE_PAGE_SHIFT;
+    index_l3_last = index_l3 + pages;
+    for (; index_l3 < index_l3_last; index_l3++)
+        ttbl3[index_l3].pt.valid = 0;
+}
+
+/**
+ * @brief Unmap ttbl2 and ttbl3 descriptors which is in target virtual
+ *        address area.
+ *
+ * Unmap descriptors of ttbl2 and ttbl3 by making valid bit to zero.
+ *
+ * - First, make level 2 descriptors invalidate.
+ * - Second, if lefts space which can't be covered by level 2 descriptor
+ *   (to small), make level 3 descriptors invalidate.
+ *
+ * @param *ttbl2 Level 2 translation table descriptor.
+ * @param va_offset Offset of the virtual address.
+ *        - 0 ~ (1GB - size), start contiguous virtual address within level 1
+ *          block (1GB).
+ *        - It is aligned L2 descriptor lock size(2MB).
+ * @param size
+ *        - <= 1GB.
+ *        - It is aligned page size.
+ * @return void
+ */
+static void guest_memory_ttbl2_unmap(union lpaed *ttbl2, uint64_t va_offset,
+                uint32_t size)
+{
+    int index_l2 = 0;
+    int index_l2_last = 0;
+    int num_blocks = 0;
+    /* Initialize the address spaces with 'invalid' state */
+    num_blocks = size >> LPAE_BLOCK_L2_SHIFT;
+    index_l2 = va_offset >> LPAE_BLOCK_L2_SHIFT;
+    index_l2_last = index_l2 + num_blocks;
+
+    for (; index_l2 < index_l2_last; index_l2++)
+        ttbl2[index_l2].pt.valid = 0;
+
+    size &= LPAE_BLOCK_L2_MASK;
+    if (size) {
+        /* last partial block */
+        union lpaed *ttbl3 = TTBL_L3(ttbl2, index_l2);
+        guest_memory_ttbl3_unmap(ttbl3, 0x00000000, size >> LPAE_PAGE_SHIFT);
+    }
+}
+
+/**
+ * @brief Map ttbl2 descriptors.
+ *
+ * Maps physical address to ttbl2 and ttbl3 descriptors and apply memory
+ * attributes.
+ *
+ * - First, compute index of the target ttbl2 descriptor and block offset.
+ * - Second, maps physical address to ttbl3 descriptors if head of block is
+ *   not fits size of the ttbl2 descriptor.
+ * - Third, maps left physical address to ttbl2 descriptors.
+ * - Finally, if lefts the memory, maps it to ttbl3 descriptors.
+ *
+ * @param *ttbl2 Level 2 translation table descriptor.
+ * @param va_offset
+ *        - 0 ~ (1GB - size), start contiguous virtual address within level 1
+ *          block (1GB).
+ *        - It is aligned l2 descriptor lock size(2MB).
+ * @param pa Physical address
+ * @param size Size of target memory.
+ *        - <= 1GB.
+ *        - It is aligned page size.
+ * @param Memory Attribute
+ * @return void
+ */
+static void guest_memory_ttbl2_map(union lpaed *ttbl2, uint64_t va_offset,
+                uint64_t pa, uint32_t size, enum memattr mattr)
+{
+    uint64_t block_offset;
+    uint32_t index_l2;
+    uint32_t index_l2_last = 0;
+    uint32_t num_blocks;
+    uint32_t pages;
+    union lpaed *ttbl3;
+    int i;
+
+    index_l2 = va_offset >> LPAE_BLOCK_L2_SHIFT;
+    block_offset = va_offset & LPAE_BLOCK_L2_MASK;
+    /* head < BLOCK */
+    if (block_offset) {
+        uint64_t offset;
+        offset = block_offset >> LPAE_PAGE_SHIFT;
+        pages = size >> LPAE_PAGE_SHIFT;
+        if (pages > VMM_L3_PTE_NUM)
+            pages = VMM_L3_PTE_NUM;
+
+        ttbl3 = TTBL_L3(ttbl2, index_l2);
+        guest_memory_ttbl3_map(ttbl3, offset, pages, pa, mattr);
+        lpaed_guest_stage2_enable_l2_table(&ttbl2[index_l2]);
+        va_offset |= ~LPAE_BLOCK_L2_MASK;
+        size -= pages * LPAE_PAGE_SIZE;
+        pa += pages * LPAE_PAGE_SIZE;
+        index_l2++;
+    }
+    /* body : n BLOCKS */
+    if (size > 0) {
+        num_blocks = size >> LPAE_BLOCK_L2_SHIFT;
+        index_l2_last = index_l2 + num_blocks;
+        for (i = index_l2; i < index_l2_last; i++) {
+            lpaed_guest_stage2_enable_l2_table(&ttbl2[i]);
+            guest_memory_ttbl3_map(TTBL_L3(ttbl2, i), 0,
+                    VMM_L3_PTE_NUM, pa, mattr);
+            pa += LPAE_BLOCK_L2_SIZE;
+            size -= LPAE_BLOCK_L2_SIZE;
+        }
+    }
+    /* tail < BLOCK */
+    if (size > 0) {
+        pages = size >> LPAE_PAGE_SHIFT;
+        if (pages) {
+            ttbl3 = TTBL_L3(ttbl2, index_l2_last);
+            guest_memory_ttbl3_map(ttbl3, 0, pages, pa, mattr);
+            lpaed_guest_stage2_enable_l2_table(&ttbl2[index_l2_last]);
+        }
+    }
+}
+
+/**
+ * @brief Initialize ttbl2 entries.
+ *
+ * Configures ttbl2 descriptor by mapping address of ttbl3 descriptor.
+ * And configure all valid bit of ttbl3 descriptors to zero.
+ *
+ * @param *ttbl2 Level 2 translation table descriptor.
+ * @return void
+ */
+static void guest_memory_ttbl2_init_entries(union lpaed *ttbl2)
+{
+    int i, j;
+    union lpaed *ttbl3;
+    for (i = 0; i < VMM_L2_PTE_NUM; i++) {
+        ttbl3 = TTBL_L3(ttbl2, i);
+        lpaed_guest_stage2_conf_l2_table(&ttbl2[i], ttbl_offset(ttbl3), 0);
+        for (j = 0; j < VMM_L2_PTE_NUM; j++)
+            ttbl3[j].pt.valid = 0;
+    }
+}
+
+/**
+ * @brief Initialize delivered ttbl2 descriptors.
+ *
+ * Initialize ttbl2 descriptors and unmap the descriptors.
+ * Finally, map the ttbl2 descriptors by memory map descriptors.
+ *
+ * @param *ttbl2 Level 2 translation table descriptor.
+ * @param *md Device memory map descriptor.
+ * @return void
+ */
+static void guest_memory_init_ttbl2(union lpaed *ttbl2, struct memmap_desc *md)
+{
+    int i = 0;
+
+    /* construct l2-l3 table hirerachy with invalid pages */
+    guest_memory_ttbl2_init_entries(ttbl2);
+    guest_memory_ttbl2_unmap(ttbl2, 0x00000000, 0x40000000);
+    while (md[i].label != 0) {
+        guest_memory_ttbl2_map(ttbl2, md[i].va, md[i].pa, md[i].size,
+                md[i].attr);
+        i++;
+    }
+}
+
+/**
+ * @brief Configure stage-2 translation table descriptors of guest.
+ *
+ * Configures the translation table based on the memory descriptor list.
+ *
+ * @param *ttbl Target translation table descriptor.
+ * @param *mdlist[] Memory map descriptor list.
+ * @return void
+ */
+static void guest_memory_init_ttbl(union lpaed *ttbl,
+            struct memmap_desc *mdlist[])
+{
+    int i = 0;
+
+    _ttbl_base = ttbl;
+    while (mdlist[i]) {
+        struct memmap_desc *md = mdlist[i];
+        if (md[0].label == 0)
+            lpaed_guest_stage2_conf_l1_table(&ttbl[i], 0, 0);
+        else {
+            lpaed_guest_stage2_conf_l1_table(&ttbl[i],
+                    ttbl_offset(TTBL_L2(ttbl, i)), 1);
+            guest_memory_init_ttbl2(TTBL_L2(ttbl, i), md);
+        }
+        i++;
+    }
+}
+
+/**
+ * @brief Builds the translation tables of the hyp mode.
+ *
+ * PL2, stage-1 translation table, virtual address -> physical address.
+ * \a ttbl holds the level1, level2, and level3 tables in a row.
+ * <pre>
+ * Name         Physical address range    Location     Attribute Index Setting
+ * Partition 0: 0x00000000 ~ 0x3FFFFFFF - Peripheral - ATTR_IDX_DEV_SHARED
+ * Partition 1: 0x40000000 ~ 0x7FFFFFFF - Unused     - ATTR_IDX_UNCACHED
+ * Partition 2: 0x80000000 ~ 0xBFFFFFFF - Guest      - ATTR_IDX_WRITEALLOC
+ * Partition 3: 0xC0000000 ~ 0xFFFFFFFF - Hypervisor
+ *                                      - Level2 blocks, ATTR_IDX_UNCACHED,
+ *                                        the heap ATTR_IDX_WRITEALLOC
+ *                                      - Level3 tables for the image
+ * </pre>
+ *
+ * @return void
+ */
+static void host_memory_init_ttbl(union lpaed *ttbl)
+{
+    int i, j;
+    uint64_t pa = 0x00000000ULL;
+    union lpaed *ttbl_l2 = &ttbl[HMM_L1_PTE_NUM];
+    union lpaed *ttbl_l3 = &ttbl_l2[HMM_L2_PTE_NUM];
+    union lpaed *l3;
+
+    _ttbl_base = ttbl;
+    ttbl[0] = lpaed_host_l1_block(pa, ATTR_IDX_DEV_SHARED);
+    pa += 0x40000000;
+    ttbl[1] = lpaed_host_l1_block(pa, ATTR_IDX_UNCACHED);
+    pa += 0x40000000;
+    ttbl[2] = lpaed_host_l1_block(pa, ATTR_IDX_WRITEALLOC);
+    pa += 0x40000000;
+    /* ttbl[3] refers Lv2 page table address. */
+    ttbl[3] = lpaed_host_l1_table(ttbl_offset(ttbl_l2));
+    for (i = 0; i < HMM_L2_PTE_NUM; i++, pa += LPAE_BLOCK_L2_SIZE) {
+        /* Heap memory, handed out by host_memory_sbrk */
+        if (pa >= HEAP_ADDR && pa < HEAP_END_ADDR) {
+            ttbl_l2[i] = lpaed_host_l2_block(pa, ATTR_IDX_WRITEALLOC);
+            continue;
+        }
+        if (pa < CFG_MEMMAP_MON_OFFSET || pa >= HEAP_ADDR) {
+            ttbl_l2[i] = lpaed_host_l2_block(pa, ATTR_IDX_UNCACHED);
+            continue;
+        }
+        /* The image, memory_hw.c makes its code cacheable page by page */
+        l3 = &ttbl_l3[((pa - CFG_MEMMAP_MON_OFFSET) >> L2_SHIFT)
+                * HMM_L3_PTE_NUM];
+        ttbl_l2[i] = lpaed_host_l2_table(ttbl_offset(l3));
+        for (j = 0; j < HMM_L3_PTE_NUM; j++) {
+            l3[j] = lpaed_host_l3_table(pa + j * LPAE_PAGE_SIZE,
+                    ATTR_IDX_UNCACHED, 1);
+        }
+    }
+}
+
+/**
+ * @brief Checks the host lays union lpaed out as the hypervisor does:
+ * bit fields from the least significant bit of a 64-bit word.
+ */
+static int check_layout(void)
+{
+    union lpaed lpaed = { .bits = 0 };
+
+    lpaed.pt.valid = 1;
+    lpaed.pt.base = 1;
+    lpaed.pt.nst = 1;
+
+    return sizeof(lpaed) == 8 &&
+            lpaed.bits == (1ULL | (1ULL << 12) | (1ULL << 63));
+}
+
+static void write_symbol(FILE *f, const char *name, uint32_t num)
+{
+    uint32_t size = num * sizeof(union lpaed);
+
+    fprintf(f, "    .global %s\n", name);
+    fprintf(f, "    .type %s, %%object\n", name);
+    fprintf(f, "    .size %s, 0x%x\n", name, size);
+    fprintf(f, "%s:\n", name);
+    fprintf(f, "    .space 0x%x\n", size);
+}
+
+/**
+ * @brief Writes the runs of descriptors of \a num entries.
+ *
+ * A run goes on as long as each descriptor is the previous one plus the
+ * stride between its first two descriptors, a run of zero entries has a
+ * stride of 0.
+ *
+ * @param index Index of the first entry from _pgtables.
+ * @return Number of runs written.
+ */
+static uint32_t write_runs(FILE *f, const union lpaed *ttbl, uint32_t num,
+                uint32_t index)
+{
+    uint64_t stride;
+    uint32_t runs = 0;
+    uint32_t i, count;
+
+    for (i = 0; i < num; i += count) {
+        count = 1;
+        stride = 0;
+        if (i + 1 < num && ttbl[i].bits && ttbl[i + 1].bits)
+            stride = ttbl[i + 1].bits - ttbl[i].bits;
+        if (stride > 0xFFFFFFFFULL)
+            stride = 0;
+        while (i + count < num &&
+                ttbl[i + count].bits == ttbl[i].bits + count * stride)
+            count++;
+        fprintf(f, "    .word 0x%x, 0x%x, 0x%08x, 0x%08x, 0x%x, 0\n",
+                index + i, count, (uint32_t) ttbl[i].bits,
+                (uint32_t) (ttbl[i].bits >> 32), (uint32_t) stride);
+        runs++;
+    }
+
+    return runs;
+}
+
+/**
+ * @brief Checks if the guest RAM covers a level 2 entry of a guest.
+ *
+ * The level 3 tables of the guest RAM are written even if their level 2
+ * entry is not valid yet: the RAM pages are looked up at runtime.
+ */
+static int guest_ram_covers(struct memmap_desc *md, uint32_t index_l2)
+{
+    uint64_t start = (uint64_t) index_l2 << LPAE_BLOCK_L2_SHIFT;
+    uint64_t end = start + LPAE_BLOCK_L2_SIZE;
+    int i;
+
+    for (i = 0; md[i].label != 0; i++) {
+        if (!(md[i].attr & MEMATTR_OUTER_MASK))
+            continue;
+        if (md[i].va < end && md[i].va + md[i].size > start)
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Writes the runs of the entries of a guest the MMU or the
+ * hypervisor may read.
+ *
+ * The level 1 entries, the level 2 tables of the valid level 1 entries
+ * and the level 3 tables of their valid or guest RAM level 2 entries.
+ *
+ * @param index Index of the level 1 table from _pgtables.
+ * @return Number of runs written.
+ */
+static uint32_t write_guest_runs(FILE *f, const union lpaed *ttbl,
+                struct memmap_desc *mdlist[], uint32_t index)
+{
+    static uint8_t used[VMM_PTE_NUM_TOTAL];
+    const union lpaed *ttbl2;
+    uint32_t runs = 0;
+    uint32_t i, j, start;
+
+    memset(used, 0, sizeof(used));
+    memset(used, 1, VMM_L1_PTE_NUM);
+    for (i = 0; i < VMM_L1_PTE_NUM; i++) {
+        if (!ttbl[i].pt.valid)
+            continue;
+        ttbl2 = TTBL_L2(ttbl, i);
+        memset(&used[ttbl2 - ttbl], 1, VMM_L2_PTE_NUM);
+        for (j = 0; j < VMM_L2_PTE_NUM; j++) {
+            if (!ttbl2[j].pt.valid && !guest_ram_covers(mdlist[i], j))
+                continue;
+            memset(&used[TTBL_L3(ttbl2, j) - ttbl], 1, VMM_L3_PTE_NUM);
+        }
+    }
+    /* Adjacent tables make one range, their runs go on across them */
+    for (i = 0; i < VMM_PTE_NUM_TOTAL; i = j) {
+        for (start = i; start < VMM_PTE_NUM_TOTAL && !used[start]; start++)
+            ;
+        for (j = start; j < VMM_PTE_NUM_TOTAL && used[j]; j++)
+            ;
+        if (start < j)
+            runs += write_runs(f, &ttbl[start], j - start, index + start);
+    }
+
+    return runs;
+}
+
+static int write_pgtables(void)
+{
+    static union lpaed hyp[HMM_PTE_NUM_TOTAL];
+    static union lpaed guest[NUM_GUESTS_STATIC][VMM_PTE_NUM_TOTAL];
+    char name[32];
+    uint32_t runs;
+    FILE *f;
+    int i;
+
+    host_memory_init_ttbl(hyp);
+    for (i = 0; i < NUM_GUESTS_STATIC; i++)
+        guest_memory_init_ttbl(guest[i], _guest_mdlist[i]);
+
+    f = fopen(PGTABLE_ASM, "w");
+    if (!f)
+        return -1;
+    fprintf(f, "/* Generated by pgtable_gen, do not edit */\n");
+    fprintf(f, "    .section .pgtables, \"aw\", %%nobits\n");
+    fprintf(f, "    .balign 4096\n");
+    fprintf(f, "    .global _pgtables\n");
+    fprintf(f, "_pgtables:\n");
+    write_symbol(f, "_hmm_pgtable", HMM_L1_PTE_NUM);
+    write_symbol(f, "_hmm_pgtable_l2", HMM_L2_PTE_NUM);
+    write_symbol(f, "_hmm_pgtable_l3", HMM_L3_TABLE_NUM * HMM_L3_PTE_NUM);
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        sprintf(name, "_ttbl_guest%d", i);
+        write_symbol(f, name, VMM_PTE_NUM_TOTAL);
+    }
+
+    fprintf(f, "\n    .section .init.data, \"aw\"\n");
+    fprintf(f, "    .balign 8\n");
+    fprintf(f, "    .global _pgtable_runs\n");
+    fprintf(f, "_pgtable_runs:\n");
+    runs = write_runs(f, hyp, HMM_PTE_NUM_TOTAL, 0);
+    for (i = 0; i < NUM_GUESTS_STATIC; i++)
+        runs += write_guest_runs(f, guest[i], _guest_mdlist[i],
+                HMM_PTE_NUM_TOTAL + i * VMM_PTE_NUM_TOTAL);
+    fprintf(f, "    .global _pgtable_runs_end\n");
+    fprintf(f, "_pgtable_runs_end:\n");
+    printf("pgtable_gen: %u runs of descriptors\n", runs);
+
+    return fclose(f) ? -1 : 0;
+}
+
+static int write_virqmap(void)
+{
+    static uint32_t virq[NUM_GUESTS_STATIC][MAX_IRQS];
+    static uint32_t pirq[NUM_GUESTS_STATIC][MAX_IRQS];
+    FILE *f;
+    int i, j;
+
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        for (j = 0; j < MAX_IRQS; j++) {
+            virq[i][j] = VIRQ_INVALID;
+            pirq[i][j] = PIRQ_INVALID;
+        }
+    }
+#define DECLARE_VIRQMAP(id, _pirq, _virq)   \
+    virq[id][_pirq] = _virq;                \
+    pirq[id][_virq] = _pirq;
+    GUEST_VIRQMAP(DECLARE_VIRQMAP)
+#undef DECLARE_VIRQMAP
+
+    f = fopen(VIRQMAP_SRC, "w");
+    if (!f)
+        return -1;
+    fprintf(f, "/* Generated by pgtable_gen from guest_map.h, do not edit */\n");
+    fprintf(f, "#include <k-hypervisor-config.h>\n");
+    fprintf(f, "#include <interrupt.h>\n\n");
+    fprintf(f, "struct guest_virqmap _guest_virqmap[NUM_GUESTS_STATIC] = {\n");
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        fprintf(f, "    [%d].map = {\n", i);
+        fprintf(f, "        [0 ... MAX_IRQS - 1] = { GUEST_IRQ_DISABLE, "
+                "VIRQ_INVALID, PIRQ_INVALID },\n");
+        for (j = 0; j < MAX_IRQS; j++) {
+            if (virq[i][j] == VIRQ_INVALID && pirq[i][j] == PIRQ_INVALID)
+                continue;
+            fprintf(f, "        [%d] = { GUEST_IRQ_DISABLE, ", j);
+            if (virq[i][j] == VIRQ_INVALID)
+                fprintf(f, "VIRQ_INVALID, ");
+            else
+                fprintf(f, "%u, ", virq[i][j]);
+            if (pirq[i][j] == PIRQ_INVALID)
+                fprintf(f, "PIRQ_INVALID },\n");
+            else
+                fprintf(f, "%u },\n", pirq[i][j]);
+        }
+        fprintf(f, "    },\n");
+    }
+    fprintf(f, "};\n");
+
+    return fclose(f) ? -1 : 0;
+}
+
+int main(void)
+{
+    if (!check_layout()) {
+        fprintf(stderr, "pgtable_gen: unexpected union lpaed layout\n");
+        return 1;
+    }
+    if (write_pgtables()) {
+        perror("pgtable_gen: " PGTABLE_ASM);
+        return 1;
+    }
+    if (write_virqmap()) {
+        perror("pgtable_gen: " VIRQMAP_SRC);
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,5 +1,7 @@
 #define DEBUG
 #include <log/print.h>
+#include <armv7_p15.h>
+#include <guest_hw.h>
 
 #include "traps.h"
 
@@ -25,7 +27,27 @@
 /* Do not use it to shift. */
 #define MCR_MRC_DIRECTION_SHIFT 0
 
-void emulate_access_to_cp15(unsigned int iss, unsigned int il)
+/*
+ * ACTLR traps with HCR.TAC. A read returns the physical ACTLR, a write is
+ * ignored: the SMP bit and the rest are set up for the CPU, not the guest.
+ */
+static int emulate_actlr(struct arch_regs *regs, unsigned int Rt,
+        unsigned int dir)
+{
+    if (dir == 0)
+        return 0;
+    if (Rt < ARCH_REGS_NUM_GPR)
+        regs->gpr[Rt] = read_actlr();
+    else if (Rt == 14)
+        regs->lr = read_actlr();
+    else
+        return -1;
+
+    return 0;
+}
+
+void emulate_access_to_cp15(struct arch_regs *regs, unsigned int iss,
+        unsigned int il)
 {
     /* If value of EC bit is equal to 0x3, trapped instruction should be handled here. */
     unsigned int cv = (iss & EC_ZERO_CV_BIT) >> EC_ZERO_CV_SHIFT;
@@ -44,6 +66,10 @@ void emulate_access_to_cp15(unsigned int iss, unsigned int il)
     Rt = (iss & MCR_MRC_RT_BIT) >> MCR_MRC_RT_SHIFT;
     CRm = (iss & MCR_MRC_CRM_BIT) >> MCR_MRC_CRM_SHIFT;
 
+    if (CRn == 1 && Opc1 == 0 && CRm == 0 && Opc2 == 1 &&
+            !emulate_actlr(regs, Rt, dir))
+        return;
+
     /* Print instruction with register ordering */
     if (dir == 0) {
         printh("MCR ");
@@ -2,6 +2,7 @@
 #include <gic_regs.h>
 #include <vdev.h>
 #include <asm-arm_inline.h>
+#include <stddef.h>
 
 #define DEBUG
 #include <log/print.h>
@@ -12,31 +13,32 @@
 #define VGICD_IIDR_DEFAULT  (0x43B) /* Cortex-A15 */
 #define VGICD_NUM_IGROUPR   (VGICD_ITLINESNUM/32)
 #define VGICD_NUM_IENABLER  (VGICD_ITLINESNUM/32)
+#define VGICD_NUM_IPRIORITYR    (VGICD_ITLINESNUM/4)
+#define VGICD_NUM_ITARGETSR     (VGICD_ITLINESNUM/4)
+#define VGICD_NUM_ICFGR         (VGICD_ITLINESNUM/16)
+#define VGICD_NUM_NSACR         (VGICD_ITLINESNUM/16)
+#define VGICD_NUM_SPISR         ((VGICD_ITLINESNUM - 32)/32)
+#define VGICD_NUM_CPENDSGIR     4
+#define VGICD_NUM_IDR           12
+/* CPU interfaces of a guest, the TYPER CPUNumber field plus one */
+#define VGICD_NUM_VCPUS         1
+/*
+ * ITARGETSR of a single vCPU guest: every interrupt targets CPU interface
+ * 0 and the SPI targets are read-only, as on a uniprocessor GIC.
+ */
+#define VGICD_ITARGETSR_VCPU0   0x01010101
+#if VGICD_NUM_VCPUS == 1
+#define VGICD_ITARGETSR_TYPE    VGICD_RO
+#else
+#define VGICD_ITARGETSR_TYPE    VGICD_RW
+#endif
 
 /* return the bit position of the first bit set from msb
  * for example, firstbit32(0x7F = 111 1111) returns 7
  */
 #define firstbit32(word) (31 - asm_clz(word))
-#define NUM_MAX_VIRQS   128
-#define NUM_STATUS_WORDS    (NUM_MAX_VIRQS / 32)
-
-/*
-    1. High Priority Registers to be implemented first for test with linux
-    2. access size support: 8/16/32bit
-    3. notifying enable status changed interrupts to outside
-    4. API for interrupt enable status change callback registeration
-   */
 
 /* Virtual GIC Distributor */
-/* Priority of implementation
-   - [V] CTLR, TYPER
-   - [V] ICFGR
-   - [V] ITARGETSR
-   - [V] IPRIORITYR
-   - [V] ISCENABLER
-   -----------------------
-   - [ ]
- */
 struct gicd_regs {
     uint32_t CTLR;              /*0x000 RW*/
     uint32_t TYPER;             /*      RO*/
@@ -44,140 +46,146 @@ struct gicd_regs {
 
     uint32_t IGROUPR[VGICD_NUM_IGROUPR];       /* 0x080 */
     uint32_t ISCENABLER[VGICD_NUM_IENABLER];    /* 0x100, ISENABLER/ICENABLER */
-    uint32_t ISPENDR[32];       /* 0x200, ISPENDR/ICPENDR */
-    uint32_t ISACTIVER[32];     /* 0x300, ISACTIVER/ICACTIVER */
-    uint32_t IPRIORITYR[128];   /* 0x400 */
-    uint32_t ITARGETSR[128];    /* 0x800 [0]: RO, Otherwise, RW */
-    uint32_t ICFGR[64];         /* 0xC00 */
+    uint32_t ISCPENDR[VGICD_NUM_IENABLER];     /* 0x200, ISPENDR/ICPENDR */
+    uint32_t ISCACTIVER[VGICD_NUM_IENABLER];   /* 0x300, ISACTIVER/ICACTIVER */
+    uint32_t IPRIORITYR[VGICD_NUM_IPRIORITYR];  /* 0x400 */
+    uint32_t ITARGETSR[VGICD_NUM_ITARGETSR];    /* 0x800 [0~7]: RO */
+    uint32_t ICFGR[VGICD_NUM_ICFGR];            /* 0xC00 [0]: RO */
+    uint32_t NSACR[VGICD_NUM_NSACR];            /* 0xE00 RAZ/WI */
+    uint32_t SGIR;                              /* 0xF00 WO */
+    /* 0xF10 CPENDSGIR, 0xF20 SPENDSGIR */
+    uint32_t SCPENDSGIR[VGICD_NUM_CPENDSGIR];
+    /* 0xFD0 ~ 0xFFC RO Cortex-A15 PIDR4~7, PIDR0~3, CIDR0~3 */
+    uint32_t IDR[VGICD_NUM_IDR];
+};
 
-    /* Cortex-A15 */
-    /* 0xD00 GICD_PPISR RO */
-    /* 0xD04 ~ 0xD1C GICD_SPISRn RO */
+/* Peripheral and Component ID of the Cortex-A15 GIC, from 0xFD0 */
+static const uint32_t _gicd_idr[VGICD_NUM_IDR] = {
+    0x04, 0x00, 0x00, 0x00, 0x90, 0xB4, 0x2B, 0x00,
+    0x0D, 0xF0, 0x05, 0xB1,
+};
 
-    uint32_t NSACR[64];         /* 0xE00 */
-    uint32_t SGIR;              /* 0xF00 WO */
-    uint32_t CPENDSGIR[4];      /* 0xF10 CPENDSGIR 0xF20 SPENDGIR */
+/**
+ * @brief Access semantics of a distributor register.
+ */
+enum vgicd_reg_type {
+    VGICD_RW,       /**< Read/write */
+    VGICD_RO,       /**< Writes are ignored */
+    VGICD_WO,       /**< Reads as zero */
+    VGICD_W1S,      /**< Reads the state, writing 1 sets the bit */
+    VGICD_W1C,      /**< Reads the state, writing 1 clears the bit */
+};
+
+/**
+ * @brief Called after a write changed a register word, or on each write
+ * to a write-only register.
+ * @param index Index of the word from the start of the register.
+ */
+typedef void (*vgicd_update_t)(vmid_t vmid, uint32_t index, uint32_t old,
+                uint32_t value);
 
-    /* 0xFD0 ~ 0xFFC RO Cortex-A15 PIDRn, CIDRn */
+/**
+ * @brief Computes the value of a register word instead of the storage.
+ */
+typedef uint32_t (*vgicd_read_t)(vmid_t vmid, uint32_t index);
+
+/**
+ * @brief Descriptor of a range of distributor registers.
+ *
+ * The register words from offset start up to end are stored from word
+ * field of struct gicd_regs. A set/clear pair(ISENABLER/ICENABLER, ...)
+ * is two descriptors of the same field.
+ */
+struct vgicd_reg {
+    uint16_t start;
+    uint16_t end;
+    uint8_t type;
+    /* bits per IRQ, 0 if the register is not per IRQ */
+    uint8_t bits;
+    uint16_t field;
+    vgicd_update_t update;
+    vgicd_read_t read;
 };
 
-struct gicd_handler_entry {
-    uint32_t offset;
-    vdev_callback_t handler;
+#define VGICD_FIELD(name)   (offsetof(struct gicd_regs, name) / 4)
+#define VGICD_REG(_start, _words, _type, _bits, _field, _update, _read) \
+    { .start = (_start), .end = (_start) + (_words) * 4, .type = (_type), \
+      .bits = (_bits), .field = VGICD_FIELD(_field), .update = (_update), \
+      .read = (_read) }
+
+static void vgicd_changed_istatus(vmid_t vmid, uint32_t index, uint32_t old,
+                uint32_t istatus);
+static void vgicd_itargetsr(vmid_t vmid, uint32_t index, uint32_t old,
+                uint32_t value);
+static void vgicd_sgir(vmid_t vmid, uint32_t index, uint32_t old,
+                uint32_t value);
+static uint32_t vgicd_read_ppispisr(vmid_t vmid, uint32_t index);
+
+/* Sorted by offset, the offsets not listed are reserved: RAZ/WI */
+static const struct vgicd_reg _vgicd_regs[] = {
+    VGICD_REG(0x000, 1, VGICD_RW, 0, CTLR, 0, 0),
+    VGICD_REG(0x004, 1, VGICD_RO, 0, TYPER, 0, 0),
+    VGICD_REG(0x008, 1, VGICD_RO, 0, IIDR, 0, 0),
+    VGICD_REG(0x080, VGICD_NUM_IGROUPR, VGICD_RW, 1, IGROUPR, 0, 0),
+    VGICD_REG(0x100, VGICD_NUM_IENABLER, VGICD_W1S, 1, ISCENABLER,
+            vgicd_changed_istatus, 0),
+    VGICD_REG(0x180, VGICD_NUM_IENABLER, VGICD_W1C, 1, ISCENABLER,
+            vgicd_changed_istatus, 0),
+    VGICD_REG(0x200, VGICD_NUM_IENABLER, VGICD_W1S, 1, ISCPENDR, 0, 0),
+    VGICD_REG(0x280, VGICD_NUM_IENABLER, VGICD_W1C, 1, ISCPENDR, 0, 0),
+    VGICD_REG(0x300, VGICD_NUM_IENABLER, VGICD_W1S, 1, ISCACTIVER, 0, 0),
+    VGICD_REG(0x380, VGICD_NUM_IENABLER, VGICD_W1C, 1, ISCACTIVER, 0, 0),
+    VGICD_REG(0x400, VGICD_NUM_IPRIORITYR, VGICD_RW, 8, IPRIORITYR, 0, 0),
+    VGICD_REG(0x800, 8, VGICD_RO, 8, ITARGETSR, 0, 0),
+    VGICD_REG(0x820, VGICD_NUM_ITARGETSR - 8, VGICD_ITARGETSR_TYPE, 8,
+            ITARGETSR[8], vgicd_itargetsr, 0),
+    VGICD_REG(0xC00, 1, VGICD_RO, 2, ICFGR, 0, 0),
+    VGICD_REG(0xC04, VGICD_NUM_ICFGR - 1, VGICD_RW, 2, ICFGR[1], 0, 0),
+    /* Cortex-A15: 0xD00 PPISR, 0xD04 ~ SPISRn */
+    VGICD_REG(0xD00, 1 + VGICD_NUM_SPISR, VGICD_RO, 1, ISCPENDR, 0,
+            vgicd_read_ppispisr),
+    VGICD_REG(0xE00, VGICD_NUM_NSACR, VGICD_RO, 2, NSACR, 0, 0),
+    VGICD_REG(0xF00, 1, VGICD_WO, 0, SGIR, vgicd_sgir, 0),
+    VGICD_REG(0xF10, VGICD_NUM_CPENDSGIR, VGICD_W1C, 8, SCPENDSGIR, 0, 0),
+    VGICD_REG(0xF20, VGICD_NUM_CPENDSGIR, VGICD_W1S, 8, SCPENDSGIR, 0, 0),
+    VGICD_REG(0xFD0, VGICD_NUM_IDR, VGICD_RO, 0, IDR, 0, 0),
 };
 
-static hvmm_status_t handler_000(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size);
-static hvmm_status_t handler_ISCENABLER(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size);
-static hvmm_status_t handler_ISCPENDR(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size);
-static hvmm_status_t handler_ISCACTIVER(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size);
-static hvmm_status_t handler_IPRIORITYR(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size);
-static hvmm_status_t handler_ITARGETSR(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size);
-static hvmm_status_t handler_ICFGR(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size);
-static hvmm_status_t handler_PPISPISR_CA15(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size);
-static hvmm_status_t handler_NSACR(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size);
-static hvmm_status_t handler_F00(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size);
+#define VGICD_NUM_REGS  (sizeof(_vgicd_regs) / sizeof(_vgicd_regs[0]))
+
+/* First descriptor of each 256 bytes of the distributor */
+static uint8_t _vgicd_index[0x10];
+
+/* Access size to byte lane mask */
+static const uint32_t _vgicd_size_mask[VDEV_ACCESS_RESERVED] = {
+    0xFF, 0xFFFF, 0xFFFFFFFF
+};
 
 static struct vdev_memory_map _vdev_gicd_info = {
     .base = CFG_GIC_BASE_PA | GIC_OFFSET_GICD,
     .size = 4096,
 };
 static struct gicd_regs _regs[NUM_GUESTS_STATIC];
+static struct gicd_regs _regs_checkpoint[NUM_GUESTS_STATIC];
 
-static struct gicd_handler_entry _handler_map[0x10] = {
-    /* 0x00 ~ 0x0F */
-    { 0x00, handler_000 },              /* CTLR, TYPER, IIDR, IGROUPR */
-    { 0x01, handler_ISCENABLER },       /* ISENABLER, ICENABLER */
-    { 0x02, handler_ISCPENDR },         /* ISPENDR, ICPENDR */
-    { 0x03, handler_ISCACTIVER },       /* ISACTIVER */
-    { 0x04, handler_IPRIORITYR },       /* IPRIORITYR */
-    { 0x05, handler_IPRIORITYR },
-    { 0x06, handler_IPRIORITYR },
-    { 0x07, handler_IPRIORITYR },
-    { 0x08, handler_ITARGETSR },        /* ITARGETSR */
-    { 0x09, handler_ITARGETSR },
-    { 0x0A, handler_ITARGETSR },
-    { 0x0B, handler_ITARGETSR },
-    { 0x0C, handler_ICFGR },            /* ICFGR */
-    { 0x0D, handler_PPISPISR_CA15 },    /* PPISPISR */
-    { 0x0E, handler_NSACR },            /* NSACR */
-    { 0x0F, handler_F00 },            /* SGIR, CPENDSGIR, SPENDGIR, ICPIDR2 */
-};
-
-/* old status */
-static uint32_t old_vgicd_status[NUM_GUESTS_STATIC][NUM_STATUS_WORDS] = {
-    {0,},
-};
-
-static hvmm_status_t handler_000(uint32_t write, uint32_t offset,
-        uint32_t *pvalue, enum vdev_access_size access_size)
-{
-    /* CTLR;              0x000 RW*/
-    /* TYPER;             RO*/
-    /* IIDR;              RO*/
-    /* IGROUPR[32];       0x080 ~ 0x0FF */
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    vmid_t vmid = guest_current_vmid();
-    struct gicd_regs *regs = &_regs[vmid];
-    uint32_t woffset = offset / 4;
-    switch (woffset) {
-    case GICD_CTLR: /* RW */
-        if (write)
-            regs->CTLR = *pvalue;
-        else
-            *pvalue = regs->CTLR;
-        result = HVMM_STATUS_SUCCESS;
-        break;
-    case GICD_TYPER:    /* RO */
-        if (write == 0) {
-            *pvalue = VGICD_TYPER_DEFAULT;
-            result = HVMM_STATUS_SUCCESS;
-        }
-        break;
-    case GICD_IIDR:     /* RO */
-        if (write == 0) {
-            *pvalue = VGICD_IIDR_DEFAULT;
-            result = HVMM_STATUS_SUCCESS;
-        }
-        break;
-    default: {          /* RW GICD_IGROUPR */
-        int igroup = woffset - GICD_IGROUPR;
-        if (igroup >= 0 && igroup < VGICD_NUM_IGROUPR) {
-            if (write)
-                regs->IGROUPR[igroup] = *pvalue;
-            else
-                *pvalue = regs->IGROUPR[igroup];
-
-            result = HVMM_STATUS_SUCCESS;
-        }
-    }
-        break;
-    }
-    if (result != HVMM_STATUS_SUCCESS)
-        printh("vgicd: invalid access offset:%x write:%d\n", offset, write);
-
-    return result;
-}
+/*
+ * What each word of the distributor reads, mapped read-only into the
+ * guest(vdev_shadow_map()): only the writes trap. None of the registers
+ * changes without a guest write, SGIR and the reserved words read as 0.
+ */
+static uint32_t _shadow[NUM_GUESTS_STATIC][1024]
+        __attribute((__aligned__(4096)));
 
-static void vgicd_changed_istatus(vmid_t vmid, uint32_t istatus,
-                uint8_t word_offset)
+static void vgicd_changed_istatus(vmid_t vmid, uint32_t index, uint32_t old,
+                uint32_t istatus)
 {
     uint32_t cstatus;   /* changed bits only */
     uint32_t minirq;
     int bit;
     /* irq range: 0~31 + word_offset * size_of_istatus_in_bits */
-    minirq = word_offset * 32;
+    minirq = index * 32;
     /* find changed bits */
-    cstatus = old_vgicd_status[vmid][word_offset] ^ istatus;
+    cstatus = old ^ istatus;
     while (cstatus) {
         uint32_t virq;
         uint32_t pirq;
@@ -202,260 +210,187 @@ static void vgicd_changed_istatus(vmid_t vmid, uint32_t istatus,
         }
         cstatus &= ~(1 << bit);
     }
-    old_vgicd_status[vmid][word_offset] = istatus;
 }
 
-static hvmm_status_t handler_ISCENABLER(uint32_t write,
-        uint32_t offset, uint32_t *pvalue, enum vdev_access_size access_size)
+/* Applies the changed SPI targets to the physical distributor */
+static void vgicd_itargetsr(vmid_t vmid, uint32_t index, uint32_t old,
+                uint32_t value)
 {
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    vmid_t vmid = guest_current_vmid();
-    struct gicd_regs *regs = &_regs[vmid];
-    uint32_t *preg_s;
-    uint32_t *preg_c;
-    if (write && *pvalue == 0) {
-        /* Writes 0 -> Has no effect. */
-        result = HVMM_STATUS_SUCCESS;
-        return result;
-    }
-    preg_s = &(regs->ISCENABLER[(offset >> 2) - GICD_ISENABLER]);
-    preg_c = &(regs->ISCENABLER[(offset >> 2) - GICD_ICENABLER]);
-    if (access_size == VDEV_ACCESS_WORD) {
-        if ((offset >> 2) < (GICD_ISENABLER + VGICD_NUM_IENABLER)) {
-            /* ISENABLER */
-            if (write) {
-                *preg_s |= *pvalue;
-                vgicd_changed_istatus(vmid, *preg_s,
-                        (offset >> 2) - GICD_ISENABLER);
-            } else
-                *pvalue = *preg_s;
-
-            result = HVMM_STATUS_SUCCESS;
-        } else if ((offset >> 2) >= GICD_ICENABLER &&
-                (offset >> 2) < (GICD_ICENABLER + VGICD_NUM_IENABLER)) {
-            /* ICENABLER */
-            if (write) {
-                *preg_c &= ~(*pvalue);
-                vgicd_changed_istatus(vmid, *preg_c,
-                        (offset >> 2) - GICD_ICENABLER);
-            } else
-                *pvalue = *preg_c;
-
-            result = HVMM_STATUS_SUCCESS;
-        }
-    } else if (access_size == VDEV_ACCESS_HWORD) {
-        if ((offset >> 2) < (GICD_ISENABLER + VGICD_NUM_IENABLER))  {
-            uint16_t *preg_s16 = (uint16_t *)preg_s;
-            preg_s16 += (offset & 0x3) >> 1;
-            if (write) {
-                *preg_s16 |= (uint16_t)(*pvalue & 0xFFFF);
-                vgicd_changed_istatus(vmid, *preg_s,
-                        (offset >> 2) - GICD_ISENABLER);
-            } else
-                *pvalue = (uint32_t) *preg_s16;
-
-            result = HVMM_STATUS_SUCCESS;
-        } else if ((offset >> 2) >= GICD_ICENABLER &&
-                (offset >> 2) < (GICD_ICENABLER + VGICD_NUM_IENABLER)) {
-            uint16_t *preg_c16 = (uint16_t *)preg_c;
-            preg_c16 += (offset & 0x3) >> 1;
-            if (write) {
-                *preg_c16 &= ~((uint16_t)(*pvalue & 0xFFFF));
-                vgicd_changed_istatus(vmid, *preg_c,
-                        (offset >> 2) - GICD_ICENABLER);
-            } else
-                *pvalue = (uint32_t) *preg_c16;
-
-            result = HVMM_STATUS_SUCCESS;
-        }
-    } else if (access_size == VDEV_ACCESS_BYTE) {
-        if ((offset >> 2) < (GICD_ISENABLER + VGICD_NUM_IENABLER))  {
-            uint8_t *preg_s8 = (uint8_t *)preg_s;
-            preg_s8 += (offset & 0x3);
-            if (write) {
-                *preg_s8 |= (uint8_t)(*pvalue & 0xFF);
-                vgicd_changed_istatus(vmid, *preg_s,
-                        (offset >> 2) - GICD_ISENABLER);
-            } else
-                *pvalue = (uint32_t) *preg_s8;
-
-            result = HVMM_STATUS_SUCCESS;
-        } else if ((offset >> 2) >= GICD_ICENABLER &&
-                (offset >> 2) < (GICD_ICENABLER + VGICD_NUM_IENABLER)) {
-            uint8_t *preg_c8 = (uint8_t *)preg_c;
-            preg_c8 += (offset & 0x3);
-            if (write) {
-                *preg_c8 &= ~((uint8_t)(*pvalue & 0xFF));
-                vgicd_changed_istatus(vmid, *preg_c,
-                        (offset >> 2) - GICD_ICENABLER);
-            } else
-                *pvalue = (uint32_t) *preg_c8;
-
-            result = HVMM_STATUS_SUCCESS;
-        }
+    uint32_t virq = (8 + index) * 4;
+    int i;
+
+    for (i = 0; i < 4; i++, virq++, old >>= 8, value >>= 8) {
+        if ((old & 0xFF) != (value & 0xFF))
+            interrupt_guest_target(vmid, virq, value & 0xFF);
     }
-    return result;
 }
 
-static hvmm_status_t handler_ISCPENDR(uint32_t write, uint32_t offset,
-                        uint32_t *pvalue, enum vdev_access_size access_size)
+/*
+ * Sends the SGI to the vCPUs selected by the target list filter. The
+ * guest has a single vCPU, the CPU interface 0: it is the source of every
+ * SGI and "all but self" targets nobody.
+ */
+static void vgicd_sgir(vmid_t vmid, uint32_t index, uint32_t old,
+                uint32_t value)
 {
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    vmid_t vmid = guest_current_vmid();
-    struct gicd_regs *regs = &_regs[vmid];
-    uint32_t *preg_s;
-    uint32_t *preg_c;
-    preg_s = &(regs->ISPENDR[(offset >> 2) - GICD_ISPENDR]);
-    preg_c = &(regs->ISPENDR[(offset >> 2) - GICD_ICPENDR]);
-    offset >>= 2;
-    if (access_size == VDEV_ACCESS_WORD) {
-        if ((offset >> 2) < (GICD_ISPENDR + VGICD_NUM_IENABLER)) {
-            /* ISPEND */
-            if (write)
-                *preg_s |= *pvalue;
-            else
-                *pvalue = *preg_s;
-            result = HVMM_STATUS_SUCCESS;
-        } else if ((offset >> 2) >= GICD_ICPENDR &&
-                (offset >> 2) < (GICD_ICPENDR + VGICD_NUM_IENABLER)) {
-            /* ICPEND */
-            if (write)
-                *preg_c &= ~(*pvalue);
-            else
-                *pvalue = *preg_c;
-            result = HVMM_STATUS_SUCCESS;
-        }
+    uint32_t sgi = value & GICD_SGIR_SGIINTID_MASK;
+    uint32_t targets;
+    uint32_t vcpu;
+
+    switch ((value & GICD_SGIR_FILTER_MASK) >> GICD_SGIR_FILTER_SHIFT) {
+    case GICD_SGIR_FILTER_LIST:
+        targets = (value & GICD_SGIR_TARGET_MASK) >> GICD_SGIR_TARGET_SHIFT;
+        break;
+    case GICD_SGIR_FILTER_OTHERS:
+        targets = 0;
+        break;
+    case GICD_SGIR_FILTER_SELF:
+        targets = 1;
+        break;
+    default:
+        printh("vgicd: SGIR reserved filter %x, guest %d\n", value, vmid);
+        return;
     }
-    printh("vgicd:%s: not implemented\n", __func__);
-    return result;
-}
 
-static hvmm_status_t handler_ISCACTIVER(uint32_t write,
-        uint32_t offset, uint32_t *pvalue, enum vdev_access_size access_size)
-{
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    printh("vgicd:%s: not implemented\n", __func__);
-    return result;
+    for (vcpu = 0; vcpu < VGICD_NUM_VCPUS; vcpu++) {
+        if (targets & (1 << vcpu))
+            interrupt_guest_sgi(vmid, sgi, 0);
+    }
 }
 
-static hvmm_status_t handler_IPRIORITYR(uint32_t write, uint32_t offset,
-                        uint32_t *pvalue, enum vdev_access_size access_size)
+/* PPISR shows PPI 16~31 in bits 15:0, SPISRn the SPIs as ISPENDRn+1 */
+static uint32_t vgicd_read_ppispisr(vmid_t vmid, uint32_t index)
 {
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    vmid_t vmid;
-    struct gicd_regs *regs;
-    uint32_t *preg;
-    vmid = guest_current_vmid();
-    regs = &_regs[vmid];
-    /* FIXME: Support 8/16/32bit access */
-    offset >>= 2;
-    preg = &(regs->ICFGR[offset - GICD_IPRIORITYR]);
-    if (write)
-        *preg = *pvalue;
-    else
-        *pvalue = *preg;
-
-    result = HVMM_STATUS_SUCCESS;
-    return result;
+    if (index == 0)
+        return _regs[vmid].ISCPENDR[0] >> 16;
+
+    return _regs[vmid].ISCPENDR[index];
 }
 
-static hvmm_status_t handler_ITARGETSR(uint32_t write, uint32_t offset,
-                        uint32_t *pvalue, enum vdev_access_size access_size)
+static const struct vgicd_reg *vgicd_find_reg(uint32_t offset)
 {
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    vmid_t vmid;
-    struct gicd_regs *regs;
-    uint32_t *preg;
-    vmid = guest_current_vmid();
-    regs = &_regs[vmid];
-    preg = &(regs->ITARGETSR[(offset >> 2) - GICD_ITARGETSR]);
-    if (access_size == VDEV_ACCESS_WORD) {
-        offset >>= 2;
-        if (write) {
-            if (offset > (GICD_ITARGETSR + 7)) {
-                /* RO: ITARGETSR0 ~ 7 */
-                *preg = *pvalue;
-            }
-        } else {
-            *pvalue = *preg;
-        }
-    } else if (access_size == VDEV_ACCESS_HWORD) {
-        uint16_t *preg16 = (uint16_t *) preg;
-        preg16 += (offset & 0x3) >> 1;
-        if (write) {
-            if ((offset >> 2) > (GICD_ITARGETSR + 7))
-                *preg16 = (uint16_t)(*pvalue & 0xFFFF);
-        } else
-            *pvalue = (uint32_t) *preg16;
-    } else if (access_size == VDEV_ACCESS_BYTE) {
-        uint8_t *preg8 = (uint8_t *) preg;
-        preg8 += (offset & 0x3);
-        if (write) {
-            if ((offset >> 2) > (GICD_ITARGETSR + 7))
-                *preg8 = (uint8_t)(*pvalue & 0xFF);
-        } else
-            *pvalue = (uint32_t) *preg8;
+    const struct vgicd_reg *reg = &_vgicd_regs[_vgicd_index[offset >> 8]];
+    const struct vgicd_reg *last = &_vgicd_regs[VGICD_NUM_REGS];
+
+    for (; reg < last && reg->start <= offset; reg++) {
+        if (offset < reg->end)
+            return reg;
     }
-    result = HVMM_STATUS_SUCCESS;
-    return result;
+    return 0;
 }
 
-static hvmm_status_t handler_ICFGR(uint32_t write, uint32_t offset,
-                        uint32_t *pvalue, enum vdev_access_size access_size)
+static uint32_t vgicd_read_word(vmid_t vmid, const struct vgicd_reg *reg,
+                uint32_t index)
 {
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    vmid_t vmid;
-    struct gicd_regs *regs;
-    uint32_t *preg;
-    vmid = guest_current_vmid();
-    regs = &_regs[vmid];
-    /* FIXME: Support 8/16/32bit access */
-    offset >>= 2;
-    preg = &(regs->ICFGR[offset - GICD_ICFGR]);
-    if (write)
-        *preg = *pvalue;
-    else
-        *pvalue = *preg;
-    result = HVMM_STATUS_SUCCESS;
-    return result;
-}
+    if (reg->type == VGICD_WO)
+        return 0;
+    if (reg->read)
+        return reg->read(vmid, index);
 
-static hvmm_status_t handler_PPISPISR_CA15(uint32_t write, uint32_t offset,
-                        uint32_t *pvalue, enum vdev_access_size access_size)
-{
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    printh("vgicd:%s: not implemented\n", __func__);
-    return result;
+    return *((uint32_t *) &_regs[vmid] + reg->field + index);
 }
 
-static hvmm_status_t handler_NSACR(uint32_t write, uint32_t offset,
-                        uint32_t *pvalue, enum vdev_access_size access_size)
+/* Rewrites the shadow of every register word stored in word field */
+static void vgicd_shadow_update(vmid_t vmid, uint32_t field)
 {
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    printh("vgicd:%s: not implemented\n", __func__);
-    return result;
+    const struct vgicd_reg *reg;
+    uint32_t index;
+    uint32_t *pshadow;
+
+    for (reg = _vgicd_regs; reg < &_vgicd_regs[VGICD_NUM_REGS]; reg++) {
+        index = field - reg->field;
+        if (field < reg->field || index >= (reg->end - reg->start) >> 2)
+            continue;
+        pshadow = &_shadow[vmid][(reg->start >> 2) + index];
+        *pshadow = vgicd_read_word(vmid, reg, index);
+        vdev_shadow_sync(pshadow, 4);
+    }
 }
 
-static hvmm_status_t handler_F00(uint32_t write, uint32_t offset,
-                        uint32_t *pvalue, enum vdev_access_size access_size)
+static void vgicd_shadow_fill(vmid_t vmid)
 {
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    printh("vgicd:%s: not implemented\n", __func__);
-    return result;
+    const struct vgicd_reg *reg;
+    uint32_t index;
+
+    for (reg = _vgicd_regs; reg < &_vgicd_regs[VGICD_NUM_REGS]; reg++) {
+        for (index = 0; index < (reg->end - reg->start) >> 2; index++)
+            _shadow[vmid][(reg->start >> 2) + index] =
+                vgicd_read_word(vmid, reg, index);
+    }
+    vdev_shadow_sync(_shadow[vmid], sizeof(_shadow[vmid]));
 }
 
+/*
+ * The byte lanes the access covers are merged into the register word:
+ * reads shift them down, writes apply the register semantics to them
+ * only.
+ */
 static hvmm_status_t vdev_gicd_access_handler(uint32_t write, uint32_t offset,
         uint32_t *pvalue, enum vdev_access_size access_size)
 {
-    printh("%s: %s offset:%d value:%x access_size : %d\n", __func__,
-            write ? "write" : "read",
-            offset, write ? *pvalue : (uint32_t) pvalue, access_size);
-    hvmm_status_t result = HVMM_STATUS_BAD_ACCESS;
-    uint8_t offsetidx = (uint8_t)((offset & 0xF00) >> 8);
-    printh("offset_idx : %d\n", offsetidx);
-    result = _handler_map[offsetidx].handler(write, offset, pvalue,
-                                        access_size);
-    return result;
+    vmid_t vmid = guest_current_vmid();
+    const struct vgicd_reg *reg;
+    uint32_t *pword;
+    uint32_t index;
+    uint32_t shift;
+    uint32_t mask;
+    uint32_t value;
+    uint32_t old;
+
+    if (access_size >= VDEV_ACCESS_RESERVED ||
+            (offset & ((1 << access_size) - 1))) {
+        printh("vgicd: unaligned access offset:%x size:%d\n", offset,
+                access_size);
+        return HVMM_STATUS_BAD_ACCESS;
+    }
+
+    shift = (offset & 0x3) * 8;
+    mask = _vgicd_size_mask[access_size] << shift;
+    reg = vgicd_find_reg(offset);
+    if (!reg) {
+        /* Reserved */
+        if (!write)
+            *pvalue = 0;
+        return HVMM_STATUS_SUCCESS;
+    }
+
+    index = (offset - reg->start) >> 2;
+    pword = (uint32_t *) &_regs[vmid] + reg->field + index;
+
+    if (!write) {
+        /* Only if the shadow is not mapped */
+        value = vgicd_read_word(vmid, reg, index);
+        *pvalue = (value & mask) >> shift;
+        return HVMM_STATUS_SUCCESS;
+    }
+
+    old = *pword;
+    value = (*pvalue << shift) & mask;
+    switch (reg->type) {
+    case VGICD_RW:
+    case VGICD_WO:
+        value |= old & ~mask;
+        break;
+    case VGICD_W1S:
+        value |= old;
+        break;
+    case VGICD_W1C:
+        value = old & ~value;
+        break;
+    default:
+        /* RO */
+        return HVMM_STATUS_SUCCESS;
+    }
+
+    if (value == old && reg->type != VGICD_WO)
+        return HVMM_STATUS_SUCCESS;
+    *pword = value;
+    if (value != old)
+        vgicd_shadow_update(vmid, reg->field + index);
+    if (reg->update)
+        reg->update(vmid, index, old, value);
+
+    return HVMM_STATUS_SUCCESS;
 }
 
 static int32_t vdev_gicd_read(struct arch_vdev_trigger_info *info,
@@ -501,28 +436,58 @@ static int32_t vdev_gicd_check(struct arch_vdev_trigger_info *info,
 static hvmm_status_t vdev_gicd_reset_values(void)
 {
     hvmm_status_t result = HVMM_STATUS_SUCCESS;
-    int i;
+    int i, j;
 
     printh("vdev init:'%s'\n", __func__);
 
+    /* Descriptors starting in or before each 256 bytes of offsets */
+    for (i = 0, j = 0; i < 0x10; i++) {
+        while (j + 1 < VGICD_NUM_REGS && _vgicd_regs[j].end <= (i << 8))
+            j++;
+        _vgicd_index[i] = j;
+    }
+
     for (i = 0; i < NUM_GUESTS_STATIC; i++) {
-        /*
-         * ITARGETS[0~ 7], CPU Targets are set to 0,
-         * due to current single-core support design
-         */
-        int j = 0;
-        for (j = 0; j < 7; j++)
-            _regs[i].ITARGETSR[j] = 0;
+        _regs[i].TYPER = VGICD_TYPER_DEFAULT;
+        _regs[i].IIDR = VGICD_IIDR_DEFAULT;
+        for (j = 0; j < VGICD_NUM_IDR; j++)
+            _regs[i].IDR[j] = _gicd_idr[j];
+        /* Every interrupt targets the vCPU */
+        for (j = 0; j < VGICD_NUM_ITARGETSR; j++)
+            _regs[i].ITARGETSR[j] = VGICD_ITARGETSR_VCPU0;
+
+        vgicd_shadow_fill(i);
+        vdev_shadow_map(i, _vdev_gicd_info.base, _shadow[i]);
     }
     return result;
 }
 
+static hvmm_status_t vdev_gicd_checkpoint(vmid_t vmid)
+{
+    _regs_checkpoint[vmid] = _regs[vmid];
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t vdev_gicd_rollback(vmid_t vmid)
+{
+    int i;
+
+    for (i = 8; i < VGICD_NUM_ITARGETSR; i++)
+        vgicd_itargetsr(vmid, i - 8, _regs[vmid].ITARGETSR[i],
+                _regs_checkpoint[vmid].ITARGETSR[i]);
+    _regs[vmid] = _regs_checkpoint[vmid];
+    vgicd_shadow_fill(vmid);
+    return HVMM_STATUS_SUCCESS;
+}
+
 struct vdev_ops _vdev_gicd_ops = {
     .init = vdev_gicd_reset_values,
     .check = vdev_gicd_check,
     .read = vdev_gicd_read,
     .write = vdev_gicd_write,
     .post = vdev_gicd_post,
+    .checkpoint = vdev_gicd_checkpoint,
+    .rollback = vdev_gicd_rollback,
 };
 
 struct vdev_module _vdev_gicd_module = {
@@ -0,0 +1,71 @@
+#include <vdev.h>
+#include <memory.h>
+#define DEBUG
+#include <log/print.h>
+
+/*
+ * hvc #0xFFF9 : inflate, hands the guest RAM pages r0 ~ r0 + r1 pages back
+ *               to the hypervisor
+ * hvc #0xFFF8 : deflate, asks the guest RAM pages r0 ~ r0 + r1 pages back
+ * The number of processed pages is returned in r0.
+ */
+#define HVC_BALLOON_INFLATE     0xFFF9
+#define HVC_BALLOON_DEFLATE     0xFFF8
+
+static int32_t vdev_hvc_balloon_write(struct arch_vdev_trigger_info *info,
+                        struct arch_regs *regs)
+{
+    vmid_t vmid = guest_current_vmid();
+    uint64_t ipa = (uint64_t) regs->gpr[0];
+    uint32_t pages = regs->gpr[1];
+
+    if ((info->iss & 0xFFFF) == HVC_BALLOON_INFLATE)
+        regs->gpr[0] = memory_balloon_inflate(vmid, ipa, pages);
+    else
+        regs->gpr[0] = memory_balloon_deflate(vmid, ipa, pages);
+
+    return 0;
+}
+
+static int32_t vdev_hvc_balloon_check(struct arch_vdev_trigger_info *info,
+                        struct arch_regs *regs)
+{
+    if ((info->iss & 0xFFFF) == HVC_BALLOON_INFLATE ||
+        (info->iss & 0xFFFF) == HVC_BALLOON_DEFLATE)
+        return 0;
+
+    return VDEV_NOT_FOUND;
+}
+
+static hvmm_status_t vdev_hvc_balloon_reset(void)
+{
+    return HVMM_STATUS_SUCCESS;
+}
+
+struct vdev_ops _vdev_hvc_balloon_ops = {
+    .init = vdev_hvc_balloon_reset,
+    .check = vdev_hvc_balloon_check,
+    .write = vdev_hvc_balloon_write,
+};
+
+struct vdev_module _vdev_hvc_balloon_module = {
+    .name = "K-Hypervisor vDevice HVC Balloon Module",
+    .author = "Kookmin Univ.",
+    .ops = &_vdev_hvc_balloon_ops,
+};
+
+hvmm_status_t vdev_hvc_balloon_init()
+{
+    hvmm_status_t result = HVMM_STATUS_BUSY;
+
+    result = vdev_register(VDEV_LEVEL_MIDDLE, &_vdev_hvc_balloon_module);
+    if (result == HVMM_STATUS_SUCCESS)
+        printh("vdev registered:'%s'\n", _vdev_hvc_balloon_module.name);
+    else {
+        printh("%s: Unable to register vdev:'%s' code=%x\n",
+                __func__, _vdev_hvc_balloon_module.name, result);
+    }
+
+    return result;
+}
+vdev_module_middle_init(vdev_hvc_balloon_init);
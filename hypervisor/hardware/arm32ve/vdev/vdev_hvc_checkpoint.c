@@ -0,0 +1,81 @@
+#include <k-hypervisor-config.h>
+#include <vdev.h>
+#define DEBUG
+#include <log/print.h>
+
+/*
+ * hvc #0xFFFB : take a checkpoint of the guest r0
+ * hvc #0xFFFA : roll the guest r0 back to its last checkpoint
+ * The result(hvmm_status_t) is returned in r0.
+ * Only the control guest CFG_CHECKPOINT_GUEST may call them, the others get
+ * HVMM_STATUS_BAD_ACCESS. The target guest must not be the calling one.
+ */
+#define HVC_CHECKPOINT      0xFFFB
+#define HVC_ROLLBACK        0xFFFA
+
+#ifndef CFG_CHECKPOINT_GUEST
+#define CFG_CHECKPOINT_GUEST    0
+#endif
+
+static int32_t vdev_hvc_checkpoint_write(struct arch_vdev_trigger_info *info,
+                        struct arch_regs *regs)
+{
+    vmid_t vmid = (vmid_t) regs->gpr[0];
+
+    if (guest_current_vmid() != CFG_CHECKPOINT_GUEST) {
+        printh("[hyp] _hyp_hvc_service:checkpoint denied to vmid:%d\n\r",
+                guest_current_vmid());
+        regs->gpr[0] = (uint32_t) HVMM_STATUS_BAD_ACCESS;
+    } else if ((info->iss & 0xFFFF) == HVC_CHECKPOINT) {
+        printh("[hyp] _hyp_hvc_service:checkpoint vmid:%d\n\r", vmid);
+        regs->gpr[0] = (uint32_t) guest_checkpoint(vmid);
+    } else {
+        printh("[hyp] _hyp_hvc_service:rollback vmid:%d\n\r", vmid);
+        regs->gpr[0] = (uint32_t) guest_rollback(vmid);
+    }
+
+    return 0;
+}
+
+static int32_t vdev_hvc_checkpoint_check(struct arch_vdev_trigger_info *info,
+                        struct arch_regs *regs)
+{
+    if ((info->iss & 0xFFFF) == HVC_CHECKPOINT ||
+        (info->iss & 0xFFFF) == HVC_ROLLBACK)
+        return 0;
+
+    return VDEV_NOT_FOUND;
+}
+
+static hvmm_status_t vdev_hvc_checkpoint_reset(void)
+{
+    return HVMM_STATUS_SUCCESS;
+}
+
+struct vdev_ops _vdev_hvc_checkpoint_ops = {
+    .init = vdev_hvc_checkpoint_reset,
+    .check = vdev_hvc_checkpoint_check,
+    .write = vdev_hvc_checkpoint_write,
+};
+
+struct vdev_module _vdev_hvc_checkpoint_module = {
+    .name = "K-Hypervisor vDevice HVC Checkpoint Module",
+    .author = "Kookmin Univ.",
+    .ops = &_vdev_hvc_checkpoint_ops,
+};
+
+hvmm_status_t vdev_hvc_checkpoint_init()
+{
+    hvmm_status_t result = HVMM_STATUS_BUSY;
+
+    result = vdev_register(VDEV_LEVEL_MIDDLE, &_vdev_hvc_checkpoint_module);
+    if (result == HVMM_STATUS_SUCCESS)
+        printh("vdev registered:'%s'\n", _vdev_hvc_checkpoint_module.name);
+    else {
+        printh("%s: Unable to register vdev:'%s' code=%x\n",
+                __func__, _vdev_hvc_checkpoint_module.name, result);
+    }
+
+    return result;
+}
+vdev_module_middle_init(vdev_hvc_checkpoint_init);
@@ -2,12 +2,47 @@
 #include <vdev.h>
 #include <log/print.h>
 #include <asm-arm_inline.h>
+#include <memory.h>
+
+/*
+ * hvc #0xFFFC : dumps the registers of the hypervisor, no register of the
+ *               guest is changed
+ * hvc #0xFFF7 : returns the working set estimate of the guest r0 (the
+ *               calling guest if r0 is not a guest):
+ *               r0 working set size in pages, r1 sampled pages,
+ *               r2 ~ r9 pages by age (passes without access)
+ */
+#define HVC_STATUS_DUMP     0xFFFC
+#define HVC_STATUS_WSS      0xFFF7
+
+static void vdev_hvc_status_wss(struct arch_regs *regs)
+{
+    struct memory_wss_stats wss;
+    vmid_t vmid = (vmid_t) regs->gpr[0];
+    int i;
+
+    if (regs->gpr[0] >= NUM_GUESTS_STATIC)
+        vmid = guest_current_vmid();
+    if (memory_wss_stats(vmid, &wss) == HVMM_STATUS_SUCCESS) {
+        printh(" - guest %d working set: %d of %d pages\n", vmid, wss.wss,
+                wss.pages);
+        regs->gpr[0] = wss.wss;
+        regs->gpr[1] = wss.pages;
+        for (i = 0; i < MEMORY_WSS_AGES; i++)
+            regs->gpr[2 + i] = wss.hist[i];
+    }
+}
 
 static int32_t vdev_hvc_status_write(struct arch_vdev_trigger_info *info,
                         struct arch_regs *regs)
 {
     uint32_t spsr, lr, sp;
 
+    if ((info->iss & 0xFFFF) == HVC_STATUS_WSS) {
+        vdev_hvc_status_wss(regs);
+        return 0;
+    }
+
     printh("[hyp] : Dump K-Hypervisor's registers\n\r");
     printh(" - banked regs\n");
     asm volatile(" mrs     %0, sp_usr\n\t" : "=r"(sp) : : "memory", "cc");
@@ -28,7 +63,8 @@ static int32_t vdev_hvc_status_write(struct arch_vdev_trigger_info *info,
 static int32_t vdev_hvc_status_check(struct arch_vdev_trigger_info *info,
                         struct arch_regs *regs)
 {
-    if ((info->iss & 0xFFFF) == 0xFFFC)
+    if ((info->iss & 0xFFFF) == HVC_STATUS_DUMP ||
+        (info->iss & 0xFFFF) == HVC_STATUS_WSS)
         return 0;
 
     return VDEV_NOT_FOUND;
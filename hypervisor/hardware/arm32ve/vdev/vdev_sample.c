@@ -16,6 +16,7 @@ static struct vdev_memory_map _vdev_sample_info = {
 };
 
 static struct vdev_sample_regs sample_regs[NUM_GUESTS_STATIC];
+static struct vdev_sample_regs sample_regs_checkpoint[NUM_GUESTS_STATIC];
 
 static hvmm_status_t vdev_sample_access_handler(uint32_t write, uint32_t offset,
         uint32_t *pvalue, enum vdev_access_size access_size)
@@ -107,12 +108,26 @@ static hvmm_status_t vdev_sample_reset(void)
     return HVMM_STATUS_SUCCESS;
 }
 
+static hvmm_status_t vdev_sample_checkpoint(vmid_t vmid)
+{
+    sample_regs_checkpoint[vmid] = sample_regs[vmid];
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t vdev_sample_rollback(vmid_t vmid)
+{
+    sample_regs[vmid] = sample_regs_checkpoint[vmid];
+    return HVMM_STATUS_SUCCESS;
+}
+
 struct vdev_ops _vdev_sample_ops = {
     .init = vdev_sample_reset,
     .check = vdev_sample_check,
     .read = vdev_sample_read,
     .write = vdev_sample_write,
     .post = vdev_sample_post,
+    .checkpoint = vdev_sample_checkpoint,
+    .rollback = vdev_sample_rollback,
 };
 
 struct vdev_module _vdev_sample_module = {
@@ -126,9 +141,12 @@ hvmm_status_t vdev_sample_init()
     hvmm_status_t result = HVMM_STATUS_BUSY;
 
     result = vdev_register(VDEV_LEVEL_LOW, &_vdev_sample_module);
-    if (result == HVMM_STATUS_SUCCESS)
+    if (result == HVMM_STATUS_SUCCESS) {
         printh("vdev registered:'%s'\n", _vdev_sample_module.name);
-    else {
+        /* The registers are only seen through reads: post the writes */
+        vdev_coalesce_register(&_vdev_sample_module, _vdev_sample_info.base,
+                _vdev_sample_info.size);
+    } else {
         printh("%s: Unable to register vdev:'%s' code=%x\n",
                 __func__, _vdev_sample_module.name, result);
     }
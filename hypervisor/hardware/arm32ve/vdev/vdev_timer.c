@@ -18,6 +18,20 @@ static struct vdev_memory_map _vdev_timer_info = {
 
 static struct vdev_vtimer_regs vtimer_regs[NUM_GUESTS_STATIC];
 static int _timer_status[NUM_GUESTS_STATIC] = {0, };
+static struct vdev_vtimer_regs vtimer_regs_checkpoint[NUM_GUESTS_STATIC];
+static int _timer_status_checkpoint[NUM_GUESTS_STATIC];
+/* Page of the registers mapped read-only in the guest, only writes trap */
+static uint32_t _vtimer_shadow[NUM_GUESTS_STATIC][1024]
+        __attribute((__aligned__(4096)));
+
+static void vtimer_shadow_update(vmid_t vmid)
+{
+    struct vdev_vtimer_regs *shadow =
+        (struct vdev_vtimer_regs *) _vtimer_shadow[vmid];
+
+    *shadow = vtimer_regs[vmid];
+    vdev_shadow_sync(shadow, sizeof(*shadow));
+}
 
 static void vtimer_changed_status(vmid_t vmid, uint32_t status)
 {
@@ -45,6 +59,7 @@ static hvmm_status_t vdev_vtimer_access_handler(uint32_t write,
         switch (offset) {
         case 0x0:
             vtimer_regs[vmid].vtimer_mask = *pvalue;
+            vtimer_shadow_update(vmid);
             vtimer_changed_status(vmid, *pvalue);
             result = HVMM_STATUS_SUCCESS;
                 break;
@@ -106,8 +121,11 @@ static hvmm_status_t vdev_vtimer_reset(void)
     int i;
     struct timer_val timer;
 
-    for (i = 0; i < NUM_GUESTS_STATIC; i++)
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
         _timer_status[i] = 1;
+        vtimer_shadow_update(i);
+        vdev_shadow_map(i, _vdev_timer_info.base, _vtimer_shadow[i]);
+    }
 
     timer.interval_us = GUEST_SCHED_TICK;
     timer.callback = &callback_timer;
@@ -117,12 +135,29 @@ static hvmm_status_t vdev_vtimer_reset(void)
     return HVMM_STATUS_SUCCESS;
 }
 
+static hvmm_status_t vdev_vtimer_checkpoint(vmid_t vmid)
+{
+    vtimer_regs_checkpoint[vmid] = vtimer_regs[vmid];
+    _timer_status_checkpoint[vmid] = _timer_status[vmid];
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t vdev_vtimer_rollback(vmid_t vmid)
+{
+    vtimer_regs[vmid] = vtimer_regs_checkpoint[vmid];
+    _timer_status[vmid] = _timer_status_checkpoint[vmid];
+    vtimer_shadow_update(vmid);
+    return HVMM_STATUS_SUCCESS;
+}
+
 struct vdev_ops _vdev_hvc_vtimer_ops = {
     .init = vdev_vtimer_reset,
     .check = vdev_vtimer_check,
     .read = vdev_vtimer_read,
     .write = vdev_vtimer_write,
     .post = vdev_vtimer_post,
+    .checkpoint = vdev_vtimer_checkpoint,
+    .rollback = vdev_vtimer_rollback,
 };
 
 struct vdev_module _vdev_hvc_vtimer_module = {
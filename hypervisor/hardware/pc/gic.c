@@ -0,0 +1,315 @@
+#include <gic.h>
+#include <gic_regs.h>
+#include <vgic.h>
+#include <armv7_p15.h>
+#include <hvmm_trace.h>
+#include <log/print.h>
+#include <log/uart_print.h>
+#include <k-hypervisor-config.h>
+
+#define GIC_SIGNATURE_INITIALIZED   0x5108EAD7
+#define GIC_PRIORITY_IDLE           0x100
+
+/* Cortex-A15: 25 (PPI6) */
+#define GIC_MAINTENANCE_IRQ         25
+
+#define GICH_LR_STATE(lr)   (((lr) & GICH_LR_STATE_MASK) >> GICH_LR_STATE_SHIFT)
+#define GICH_LR_PRIORITY(lr) \
+            (((lr) & GICH_LR_PRIORITY_MASK) >> GICH_LR_PRIORITY_SHIFT)
+
+/**
+ * @brief State of the simulated GIC.
+ *
+ * - Distributor: enable, pending and active state, priority, trigger
+ *   mode and CPU targets of each interrupt line.
+ * - CPU interface(GICC_CTLR.EOImode = 1): interrupts are acknowledged,
+ *   completed(priority drop) and deactivated separately, "dropped" marks
+ *   the active interrupts that do not hold the running priority anymore.
+ * - Virtual interface control: the GICH register file of one CPU.
+ */
+struct gic_sim {
+    uint8_t enabled[GIC_SIM_NUM_LINES];
+    uint8_t pending[GIC_SIM_NUM_LINES];
+    uint8_t active[GIC_SIM_NUM_LINES];
+    uint8_t dropped[GIC_SIM_NUM_LINES];
+    uint8_t priority[GIC_SIM_NUM_LINES];
+    uint8_t edge[GIC_SIM_NUM_LINES];
+    uint8_t target[GIC_SIM_NUM_LINES];
+    uint32_t gich[GICH_LR + GIC_SIM_NUM_LR];
+    uint32_t initialized;
+};
+
+static struct gic_sim _gic;
+
+/*
+ * Recomputes the status registers of the virtual interface control from
+ * the List Registers and GICH_HCR, and drives the maintenance interrupt
+ * line: it is asserted while the virtual interface is enabled and any
+ * GICH_MISR condition holds.
+ */
+static void gic_vgic_update(void)
+{
+    uint32_t i;
+    uint32_t lr;
+    uint32_t elsr = 0;
+    uint32_t eisr = 0;
+    uint32_t misr = 0;
+    uint32_t valid = 0;
+    uint32_t pending = 0;
+    uint32_t hcr = _gic.gich[GICH_HCR];
+
+    for (i = 0; i < GIC_SIM_NUM_LR; i++) {
+        lr = _gic.gich[GICH_LR + i];
+        if (GICH_LR_STATE(lr) == 0) {
+            /* EOI'd software virqs requesting maintenance stay listed */
+            if ((lr & GICH_LR_HW) || !(lr & GICH_LR_EOI))
+                elsr |= (1u << i);
+            else
+                eisr |= (1u << i);
+        } else {
+            valid++;
+            if (GICH_LR_STATE(lr) & VIRQ_STATE_PENDING)
+                pending++;
+        }
+    }
+    if (eisr)
+        misr |= GICH_MISR_EOI;
+    if ((hcr & GICH_HCR_UIE) && valid <= 1)
+        misr |= GICH_MISR_U;
+    if ((hcr & GICH_HCR_NPIE) && !pending)
+        misr |= GICH_MISR_NP;
+
+    _gic.gich[GICH_ELSR0] = elsr;
+    _gic.gich[GICH_ELSR1] = 0;
+    _gic.gich[GICH_EISR0] = eisr;
+    _gic.gich[GICH_EISR1] = 0;
+    _gic.gich[GICH_MISR] = misr;
+
+    /* level sensitive */
+    if ((hcr & GICH_HCR_EN) && misr)
+        _gic.pending[GIC_MAINTENANCE_IRQ] = 1;
+    else
+        _gic.pending[GIC_MAINTENANCE_IRQ] = 0;
+}
+
+void gic_vgic_lr_update(uint32_t slot)
+{
+    gic_vgic_update();
+}
+
+/* Priority of the highest priority interrupt in service */
+static uint32_t gic_running_priority(void)
+{
+    uint32_t irq;
+    uint32_t running = GIC_PRIORITY_IDLE;
+
+    for (irq = 0; irq < GIC_SIM_NUM_LINES; irq++) {
+        if (_gic.active[irq] && !_gic.dropped[irq] &&
+                _gic.priority[irq] < running)
+            running = _gic.priority[irq];
+    }
+    return running;
+}
+
+/* Highest priority interrupt the CPU interface signals, or spurious */
+static uint32_t gic_highest_pending(void)
+{
+    uint32_t irq;
+    uint32_t found = GIC_SPURIOUS_IRQ;
+    uint32_t priority = gic_running_priority();
+
+    if (_gic.initialized != GIC_SIGNATURE_INITIALIZED)
+        return found;
+
+    gic_vgic_update();
+    for (irq = 0; irq < GIC_SIM_NUM_LINES; irq++) {
+        if (_gic.enabled[irq] && _gic.pending[irq] && !_gic.active[irq] &&
+                _gic.priority[irq] < priority &&
+                (irq < 32 || (_gic.target[irq] & gic_cpumask_current()))) {
+            priority = _gic.priority[irq];
+            found = irq;
+        }
+    }
+    return found;
+}
+
+hvmm_status_t gic_enable_irq(uint32_t irq)
+{
+    if (irq >= GIC_SIM_NUM_LINES)
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    _gic.enabled[irq] = 1;
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t gic_disable_irq(uint32_t irq)
+{
+    if (irq >= GIC_SIM_NUM_LINES)
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    _gic.enabled[irq] = 0;
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t gic_configure_irq(uint32_t irq,
+                enum gic_int_polarity polarity, uint8_t cpumask,
+                uint8_t priority)
+{
+    if (irq >= GIC_SIM_NUM_LINES) {
+        uart_print("invalid irq:");
+        uart_print_hex32(irq);
+        uart_print("\n\r");
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    }
+    gic_disable_irq(irq);
+    _gic.edge[irq] = (polarity == GIC_INT_POLARITY_EDGE);
+    _gic.priority[irq] = priority;
+    if (irq >= 32)
+        _gic.target[irq] = cpumask;
+    return gic_enable_irq(irq);
+}
+
+hvmm_status_t gic_set_target(uint32_t irq, uint8_t cpumask)
+{
+    if (irq < 32 || irq >= GIC_SIM_NUM_LINES)
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    _gic.target[irq] = cpumask;
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t gic_completion_irq(uint32_t irq)
+{
+    if (irq < GIC_SIM_NUM_LINES && _gic.active[irq])
+        _gic.dropped[irq] = 1;
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t gic_deactivate_irq(uint32_t irq)
+{
+    if (irq < GIC_SIM_NUM_LINES) {
+        _gic.active[irq] = 0;
+        _gic.dropped[irq] = 0;
+    }
+    return HVMM_STATUS_SUCCESS;
+}
+
+uint32_t gic_get_irq_number(void)
+{
+    /* ACK - CPU Interface - GICC_IAR read */
+    uint32_t irq = gic_highest_pending();
+
+    if (irq != GIC_SPURIOUS_IRQ) {
+        _gic.pending[irq] = 0;
+        _gic.active[irq] = 1;
+        _gic.dropped[irq] = 0;
+    }
+    return irq;
+}
+
+volatile uint32_t *gic_vgic_baseaddr(void)
+{
+    if (_gic.initialized != GIC_SIGNATURE_INITIALIZED) {
+        HVMM_TRACE_ENTER();
+        uart_print("gic: ERROR - not initialized\n\r");
+        HVMM_TRACE_EXIT();
+    }
+    return _gic.gich;
+}
+
+hvmm_status_t gic_init(void)
+{
+    uint32_t irq;
+
+    HVMM_TRACE_ENTER();
+    for (irq = 0; irq < GIC_SIM_NUM_LINES; irq++) {
+        /* SGIs are always enabled */
+        _gic.enabled[irq] = irq < 16;
+        _gic.pending[irq] = 0;
+        _gic.active[irq] = 0;
+        _gic.dropped[irq] = 0;
+        _gic.priority[irq] = GIC_INT_PRIORITY_DEFAULT;
+        _gic.edge[irq] = 0;
+        _gic.target[irq] = gic_cpumask_current();
+    }
+    for (irq = 0; irq < GICH_LR + GIC_SIM_NUM_LR; irq++)
+        _gic.gich[irq] = 0;
+    _gic.gich[GICH_VTR] = GIC_SIM_NUM_LR - 1;
+    gic_vgic_update();
+    _gic.initialized = GIC_SIGNATURE_INITIALIZED;
+    HVMM_TRACE_EXIT();
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+void gic_sim_raise(uint32_t irq)
+{
+    if (irq < GIC_SIM_NUM_LINES)
+        _gic.pending[irq] = 1;
+}
+
+uint32_t gic_sim_irq_pending(void)
+{
+    return gic_highest_pending() != GIC_SPURIOUS_IRQ;
+}
+
+uint32_t gic_sim_vcpu_pending(void)
+{
+    uint32_t i;
+
+    if (!(_gic.gich[GICH_HCR] & GICH_HCR_EN))
+        return 0;
+
+    for (i = 0; i < GIC_SIM_NUM_LR; i++) {
+        if (GICH_LR_STATE(_gic.gich[GICH_LR + i]) == VIRQ_STATE_PENDING)
+            return 1;
+    }
+    return 0;
+}
+
+uint32_t gic_sim_vcpu_ack(uint32_t *slot)
+{
+    uint32_t i;
+    uint32_t lr;
+    uint32_t found = GIC_SIM_NUM_LR;
+
+    if (!(_gic.gich[GICH_HCR] & GICH_HCR_EN))
+        return GIC_SPURIOUS_IRQ;
+
+    for (i = 0; i < GIC_SIM_NUM_LR; i++) {
+        lr = _gic.gich[GICH_LR + i];
+        if (GICH_LR_STATE(lr) != VIRQ_STATE_PENDING)
+            continue;
+        if (found == GIC_SIM_NUM_LR || GICH_LR_PRIORITY(lr) <
+                GICH_LR_PRIORITY(_gic.gich[GICH_LR + found]))
+            found = i;
+    }
+    if (found == GIC_SIM_NUM_LR)
+        return GIC_SPURIOUS_IRQ;
+
+    lr = _gic.gich[GICH_LR + found];
+    lr &= ~GICH_LR_STATE_MASK;
+    lr |= GICH_LR_STATE_ACTIVE;
+    _gic.gich[GICH_LR + found] = lr;
+    gic_vgic_update();
+    *slot = found;
+
+    return lr & GICH_LR_VIRTUALID_MASK;
+}
+
+void gic_sim_vcpu_eoi(uint32_t slot)
+{
+    uint32_t lr;
+
+    if (slot >= GIC_SIM_NUM_LR)
+        return;
+
+    lr = _gic.gich[GICH_LR + slot];
+    lr &= ~GICH_LR_STATE_MASK;
+    _gic.gich[GICH_LR + slot] = lr;
+    /* hardware virqs deactivate their physical interrupt */
+    if (lr & GICH_LR_HW)
+        gic_deactivate_irq((lr & GICH_LR_PHYSICALID_MASK) >>
+                GICH_LR_PHYSICALID_SHIFT);
+    gic_vgic_update();
+}
@@ -0,0 +1,130 @@
+#include <k-hypervisor-config.h>
+#include <log/print.h>
+#include <hvmm_trace.h>
+#include <guest.h>
+#include <guest_hw.h>
+#include <sim.h>
+
+static void context_copy_regs(struct arch_regs *regs_dst,
+                struct arch_regs *regs_src)
+{
+    int i;
+    regs_dst->cpsr = regs_src->cpsr;
+    regs_dst->pc = regs_src->pc;
+    regs_dst->lr = regs_src->lr;
+    for (i = 0; i < ARCH_REGS_NUM_GPR; i++)
+        regs_dst->gpr[i] = regs_src->gpr[i];
+}
+
+/* Co-processor state management: init/save/restore */
+static void context_init_cops(struct regs_cop *regs_cop)
+{
+    regs_cop->vbar = 0;
+    regs_cop->ttbr0 = 0;
+    regs_cop->ttbr1 = 0;
+    regs_cop->ttbcr = 0;
+    regs_cop->sctlr = 0;
+}
+
+static void context_save_cops(struct regs_cop *regs_cop)
+{
+    *regs_cop = _sim_cpu.cop;
+}
+
+static void context_restore_cops(struct regs_cop *regs_cop)
+{
+    _sim_cpu.cop = *regs_cop;
+}
+
+static hvmm_status_t guest_hw_save(struct guest_struct *guest,
+                struct arch_regs *current_regs)
+{
+    struct arch_regs *regs = &guest->regs;
+    struct arch_context *context = &guest->context;
+
+    if (!current_regs)
+        return HVMM_STATUS_SUCCESS;
+
+    context_copy_regs(regs, current_regs);
+    context_save_cops(&context->regs_cop);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t guest_hw_restore(struct guest_struct *guest,
+                struct arch_regs *current_regs)
+{
+    struct arch_context *context = &guest->context;
+
+    /* init -> hyp mode -> guest: loads the simulated CPU */
+    if (!current_regs)
+        current_regs = &_sim_cpu.regs;
+
+    /* guest -> hyp -> guest */
+    context_copy_regs(current_regs, &guest->regs);
+    context_restore_cops(&context->regs_cop);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t guest_hw_init(struct guest_struct *guest,
+                struct arch_regs *regs)
+{
+    struct arch_context *context = &guest->context;
+
+    regs->pc = 0x80000000;
+    /* supervisor mode */
+    regs->cpsr = 0x1d3;
+    /* regs->gpr[] = whatever */
+    context_init_cops(&context->regs_cop);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t guest_hw_dump(uint8_t verbose, struct arch_regs *regs)
+{
+    if (verbose & GUEST_VERBOSE_LEVEL_0) {
+        uart_print("cpsr: ");
+        uart_print_hex32(regs->cpsr);
+        uart_print("\n\r");
+        uart_print("  pc: ");
+        uart_print_hex32(regs->pc);
+        uart_print("\n\r");
+        uart_print("  lr: ");
+        uart_print_hex32(regs->lr);
+        uart_print("\n\r");
+        {
+            int i;
+            uart_print(" gpr:\n\r");
+            for (i = 0; i < ARCH_REGS_NUM_GPR; i++) {
+                uart_print("     ");
+                uart_print_hex32(regs->gpr[i]);
+                uart_print("\n\r");
+            }
+        }
+    }
+    if (verbose & GUEST_VERBOSE_LEVEL_2) {
+        uint64_t pct = read_cntpct();
+        uint32_t tval = read_cnthp_tval();
+        uart_print("cntpct:");
+        uart_print_hex64(pct);
+        uart_print("\n\r");
+        uart_print("cnth_tval:");
+        uart_print_hex32(tval);
+        uart_print("\n\r");
+    }
+    return HVMM_STATUS_SUCCESS;
+}
+
+struct guest_ops _guest_ops = {
+    .init = guest_hw_init,
+    .save = guest_hw_save,
+    .restore = guest_hw_restore,
+    .dump = guest_hw_dump,
+};
+
+struct guest_module _guest_module = {
+    .name = "K-Hypervisor Guest Module",
+    .author = "Kookmin Univ.",
+    .ops = &_guest_ops,
+};
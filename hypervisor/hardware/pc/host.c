@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <host.h>
+
+static int _console_enabled = 1;
+
+void host_putc(char c)
+{
+    /* the hypervisor prints "\n\r", drop the carriage return */
+    if (_console_enabled && c != '\r')
+        putchar(c);
+}
+
+void host_console_enable(int enable)
+{
+    fflush(stdout);
+    _console_enabled = enable;
+}
+
+void host_puts(const char *str)
+{
+    fputs(str, stdout);
+}
+
+void *host_alloc(unsigned long size)
+{
+    void *ptr = calloc(1, size);
+
+    if (!ptr) {
+        fprintf(stderr, "host: out of memory(%lu bytes)\n", size);
+        exit(1);
+    }
+    return ptr;
+}
+
+void host_free(void *ptr)
+{
+    free(ptr);
+}
+
+unsigned long long host_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+unsigned long long host_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return host_time_ns();
+#endif
+}
+
+unsigned long long host_strtoull(const char *str)
+{
+    return strtoull(str, 0, 0);
+}
+
+struct host_thread {
+    pthread_t thread;
+    void (*fn)(int index);
+    int index;
+};
+
+static void *host_thread_main(void *arg)
+{
+    struct host_thread *thread = arg;
+
+    thread->fn(thread->index);
+    return 0;
+}
+
+void host_run_threads(int count, void (*fn)(int index))
+{
+    struct host_thread *threads = host_alloc(count * sizeof(*threads));
+    int i;
+
+    for (i = 0; i < count; i++) {
+        threads[i].fn = fn;
+        threads[i].index = i;
+        if (pthread_create(&threads[i].thread, 0, host_thread_main,
+                    &threads[i])) {
+            fprintf(stderr, "host: failed creating thread %d\n", i);
+            exit(1);
+        }
+    }
+    for (i = 0; i < count; i++)
+        pthread_join(threads[i].thread, 0);
+    free(threads);
+}
+
+void host_yield(void)
+{
+    sched_yield();
+}
+
+void host_exit(int code)
+{
+    fflush(stdout);
+    exit(code);
+}
@@ -0,0 +1,75 @@
+#ifndef __ARMV7_P15_H__
+#define __ARMV7_P15_H__
+#include "arch_types.h"
+
+/*
+ * System registers of the simulated CPU.
+ *
+ * Stands in for common/include/armv7_p15.h: the accessors the portable
+ * hypervisor code uses read and write the state of the simulator(sim.h)
+ * instead of issuing mrc/mcr.
+ */
+
+/* ARMv7 Registers */
+#define HCR_TGE     (1 << 27)
+#define HCR_TVM     (1 << 26)
+#define HCR_TTLB    (1 << 25)
+#define HCR_TPU     (1 << 24)
+#define HCR_TPC     (1 << 23)
+#define HCR_TSW     (1 << 22)
+#define HCR_TAC     (1 << 21)
+#define HCR_TIDCP   (1 << 20)
+#define HCR_TSC     (1 << 19)
+#define HCR_TID3    (1 << 18)
+#define HCR_TID2    (1 << 17)
+#define HCR_TID1    (1 << 16)
+#define HCR_TID0    (1 << 15)
+#define HCR_TWE     (1 << 14)
+#define HCR_TWI     (1 << 13)
+#define HCR_DC      (1 << 12)
+#define HCR_BSU     (3 << 10)
+#define HCR_FB      (1 << 9)
+#define HCR_VA      (1 << 8)
+#define HCR_VI      (1 << 7)
+#define HCR_VF      (1 << 6)
+#define HCR_AMO     (1 << 5)
+#define HCR_IMO     (1 << 4)
+#define HCR_FMO     (1 << 3)
+#define HCR_PTW     (1 << 2)
+#define HCR_SWIO    (1 << 1)
+#define HCR_VM      (1 << 0)
+
+uint32_t sim_read_sysreg(int reg);
+void sim_write_sysreg(int reg, uint32_t val);
+uint64_t sim_read_counter(void);
+
+enum sim_sysreg {
+    SIM_SYSREG_HCR,
+    SIM_SYSREG_HSR,
+    SIM_SYSREG_HDFAR,
+    SIM_SYSREG_HPFAR,
+    SIM_SYSREG_MIDR,
+    SIM_SYSREG_MPIDR,
+    SIM_SYSREG_CNTFRQ,
+    SIM_SYSREG_CNTHP_CTL,
+    SIM_SYSREG_CNTHP_TVAL,
+};
+
+#define read_hcr()              sim_read_sysreg(SIM_SYSREG_HCR)
+#define write_hcr(val)          sim_write_sysreg(SIM_SYSREG_HCR, (val))
+#define read_hsr()              sim_read_sysreg(SIM_SYSREG_HSR)
+#define read_hdfar()            sim_read_sysreg(SIM_SYSREG_HDFAR)
+#define read_hpfar()            sim_read_sysreg(SIM_SYSREG_HPFAR)
+#define read_midr()             sim_read_sysreg(SIM_SYSREG_MIDR)
+#define read_mpidr()            sim_read_sysreg(SIM_SYSREG_MPIDR)
+
+/* Generic Timer */
+#define read_cntfrq()           sim_read_sysreg(SIM_SYSREG_CNTFRQ)
+#define read_cnthp_ctl()        sim_read_sysreg(SIM_SYSREG_CNTHP_CTL)
+#define write_cnthp_ctl(val)    sim_write_sysreg(SIM_SYSREG_CNTHP_CTL, (val))
+#define read_cnthp_tval()       sim_read_sysreg(SIM_SYSREG_CNTHP_TVAL)
+#define write_cnthp_tval(val)   sim_write_sysreg(SIM_SYSREG_CNTHP_TVAL, (val))
+#define read_cntpct()           sim_read_counter()
+#define read_cntvct()           sim_read_counter()
+
+#endif
@@ -0,0 +1,13 @@
+
+#ifndef __ASM_ARM_INLINE__
+#define __ASM_ARM_INLINE__
+
+/*
+ * Host equivalents of common/include/asm-arm_inline.h: barriers only order
+ * the compiler, there is a single simulated CPU.
+ */
+#define isb() asm volatile("" : : : "memory")
+#define dsb() asm volatile("" : : : "memory")
+#define irq_enable()
+#define asm_clz(x)      ((uint32_t) ((x) ? __builtin_clz(x) : 32))
+#endif
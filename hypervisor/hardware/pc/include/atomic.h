@@ -0,0 +1,59 @@
+#ifndef __ATOMIC_H__
+#define __ATOMIC_H__
+#include "arch_types.h"
+#include <host.h>
+
+/*
+ * Host equivalents of common/include/atomic.h with the GCC __atomic
+ * builtins. The simulated CPU is single, but the operations are real ones:
+ * the lock stress test of the simulator runs them on host threads.
+ */
+
+#define smp_mb()        __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()     asm volatile("pause" : : : "memory")
+#else
+#define cpu_relax()     asm volatile("" : : : "memory")
+#endif
+/* Lets the holder run when the host has fewer CPUs than threads */
+#define wfe()           host_yield()
+#define sev()           smp_mb()
+
+#define atomic_read(ptr)        (*(volatile uint32_t *) (ptr))
+#define atomic_set(ptr, val)    (*(volatile uint32_t *) (ptr) = (val))
+
+static inline uint32_t atomic_add_return(volatile uint32_t *ptr, uint32_t val)
+{
+    return __atomic_add_fetch(ptr, val, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t atomic_cmpxchg(volatile uint32_t *ptr, uint32_t old,
+                uint32_t new)
+{
+    __atomic_compare_exchange_n(ptr, &old, new, 0, __ATOMIC_RELAXED,
+            __ATOMIC_RELAXED);
+    return old;
+}
+
+static inline uint32_t atomic_set_mask(volatile uint32_t *ptr, uint32_t mask)
+{
+    return __atomic_fetch_or(ptr, mask, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t atomic_clear_mask(volatile uint32_t *ptr,
+                uint32_t mask)
+{
+    return __atomic_fetch_and(ptr, ~mask, __ATOMIC_RELAXED);
+}
+
+/* The simulated CPU takes interrupts between events only */
+static inline uint32_t irq_save(void)
+{
+    return 0;
+}
+
+static inline void irq_restore(uint32_t flags)
+{
+}
+
+#endif
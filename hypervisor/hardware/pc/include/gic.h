@@ -0,0 +1,68 @@
+#ifndef __GIC_H__
+#define __GIC_H__
+
+#include <hvmm_types.h>
+#include <arch_types.h>
+#include <smp.h>
+#include <interrupt.h>
+
+/*
+ * Simulated GIC-400: the interface of libhw/gic.h of arm32ve, on top of a
+ * model of the distributor, the CPU interface of one CPU and the virtual
+ * interface control registers(GICH).
+ */
+#define GIC_NUM_MAX_IRQS    1024
+#define GIC_SIM_NUM_LINES   160
+#define GIC_SIM_NUM_LR      4
+#define GIC_SPURIOUS_IRQ    1023
+#define gic_cpumask_current()    (1u << smp_processor_id())
+#define GIC_INT_PRIORITY_DEFAULT        0xa0
+
+enum gic_int_polarity {
+    GIC_INT_POLARITY_LEVEL = 0,
+    GIC_INT_POLARITY_EDGE = 1
+};
+
+hvmm_status_t gic_enable_irq(uint32_t irq);
+hvmm_status_t gic_disable_irq(uint32_t irq);
+hvmm_status_t gic_init(void);
+hvmm_status_t gic_deactivate_irq(uint32_t irq);
+hvmm_status_t gic_completion_irq(uint32_t irq);
+volatile uint32_t *gic_vgic_baseaddr(void);
+hvmm_status_t gic_configure_irq(uint32_t irq,
+                enum gic_int_polarity polarity, uint8_t cpumask,
+                uint8_t priority);
+/** @brief Routes a shared peripheral interrupt, only CPU 0 is modeled */
+hvmm_status_t gic_set_target(uint32_t irq, uint8_t cpumask);
+uint32_t gic_get_irq_number(void);
+
+/**
+ * @brief Updates the derived GICH registers(ELSR, EISR, MISR) after a List
+ * Register was written.
+ *
+ * The simulated GICH is plain memory, so the hardware behaviour of the
+ * status registers following the List Registers is replayed here.
+ */
+void gic_vgic_lr_update(uint32_t slot);
+
+/** @brief Asserts the interrupt line \a irq (edge) */
+void gic_sim_raise(uint32_t irq);
+
+/**
+ * @brief Checks if the CPU interface signals an interrupt to the CPU.
+ * @return 1 if an enabled pending interrupt of a sufficient priority exists.
+ */
+uint32_t gic_sim_irq_pending(void);
+
+/**
+ * @brief Virtual CPU interface, as used by the running guest.
+ *
+ * gic_sim_vcpu_ack() returns the highest priority pending virq(reading
+ * GICV_IAR) and its List Register, or GIC_SPURIOUS_IRQ.
+ * gic_sim_vcpu_eoi() ends it(writing GICV_EOIR).
+ */
+uint32_t gic_sim_vcpu_pending(void);
+uint32_t gic_sim_vcpu_ack(uint32_t *slot);
+void gic_sim_vcpu_eoi(uint32_t slot);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _GUEST_HW_H__
+#define _GUEST_HW_H__
+
+#include <k-hypervisor-config.h>
+#include <version.h>
+#include <log/print.h>
+#include <hvmm_trace.h>
+#include <vgic.h>
+
+#define ARCH_REGS_NUM_GPR    13
+
+/* co-processor registers: cp15, cp2 */
+struct regs_cop {
+    uint32_t vbar;
+    uint32_t ttbr0;
+    uint32_t ttbr1;
+    uint32_t ttbcr;
+    uint32_t sctlr;
+};
+
+/* Defines the architecture specific registers */
+struct arch_regs {
+    uint32_t cpsr; /* CPSR */
+    uint32_t pc; /* Program Counter */
+    uint32_t lr;
+    uint32_t gpr[ARCH_REGS_NUM_GPR]; /* R0 - R12 */
+} __attribute((packed));
+
+/*
+ * Defines the architecture specific information, except general regsiters.
+ * The simulated guests have no banked registers, the co-processor
+ * registers are kept to exercise the same save/restore path.
+ */
+struct arch_context {
+    struct regs_cop regs_cop;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef __HOST_H__
+#define __HOST_H__
+
+/**
+ * @file host.h
+ *
+ * Services of the host operating system used by the PC HAL.
+ *
+ * host.c is the only translation unit linked against the C library. It must
+ * not see arch_types.h (whose fixed width types clash with <stdint.h> on
+ * 64-bit hosts), so this interface only uses the plain C types.
+ */
+
+/** @brief Writes a character to the standard output if the console is on */
+void host_putc(char c);
+
+/** @brief Turns the hypervisor console(uart) output on or off */
+void host_console_enable(int enable);
+
+/** @brief Writes a string to the standard output regardless of the console */
+void host_puts(const char *str);
+
+/** @brief Allocates zeroed host memory, aborts the simulation on failure */
+void *host_alloc(unsigned long size);
+
+void host_free(void *ptr);
+
+/** @brief Monotonic host clock in nanoseconds */
+unsigned long long host_time_ns(void);
+
+/** @brief Time stamp counter of the host CPU, host_time_ns() without one */
+unsigned long long host_cycles(void);
+
+/** @brief Parses a decimal or 0x prefixed hexadecimal number */
+unsigned long long host_strtoull(const char *str);
+
+/**
+ * @brief Runs fn(0) to fn(count - 1) on as many host threads, returns once
+ * all of them returned
+ */
+void host_run_threads(int count, void (*fn)(int index));
+
+/** @brief Gives the host CPU up to the other threads */
+void host_yield(void);
+
+/** @brief Terminates the simulation */
+void host_exit(int code);
+
+#endif
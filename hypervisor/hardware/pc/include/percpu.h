@@ -0,0 +1,26 @@
+#ifndef __PERCPU_H__
+#define __PERCPU_H__
+#include "arch_types.h"
+
+/*
+ * Host equivalent of common/include/percpu.h: the simulated CPU is single,
+ * its per-CPU variables are plain ones.
+ */
+
+#define DEFINE_PER_CPU(type, name)  type per_cpu__##name
+#define DECLARE_PER_CPU(type, name) extern type per_cpu__##name
+
+#define per_cpu_ptr(name, cpu)      (&per_cpu__##name)
+#define this_cpu_ptr(name)          (&per_cpu__##name)
+#define per_cpu(name, cpu)          (*per_cpu_ptr(name, cpu))
+#define this_cpu(name)              (*this_cpu_ptr(name))
+
+static inline void percpu_init(void)
+{
+}
+
+static inline void percpu_cpu_init(uint32_t cpu)
+{
+}
+
+#endif
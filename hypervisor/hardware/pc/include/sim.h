@@ -0,0 +1,198 @@
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <k-hypervisor-config.h>
+#include <arch_types.h>
+#include <hvmm_types.h>
+#include <guest_hw.h>
+
+/**
+ * @file sim.h
+ *
+ * <pre>
+ * Discrete-event simulator of the PC HAL.
+ *
+ * The portable hypervisor core runs unmodified as a host process. The
+ * hardware it drives (one Cortex-A15 like CPU with the virtualization
+ * extensions, GIC with virtual interface control, generic timer and stage-2
+ * translation) is simulated, and the guests are synthetic workloads that
+ * only issue the operations the hypervisor sees: stage-2 faults on emulated
+ * devices, hypervisor calls and interrupt acknowledges.
+ *
+ * Simulated time is counted in ticks of the generic counter(CFG_CNTFRQ)
+ * and only advances from one event to the next, so a run is reproducible
+ * for a given configuration and seed whatever the speed of the host.
+ * </pre>
+ */
+
+#define SIM_TICKS_PER_USEC      COUNT_PER_USEC
+
+enum sim_event_type {
+    SIM_EVENT_TIMER = 0,    /**< Hyp physical timer expired */
+    SIM_EVENT_DEVICE,       /**< Device raised its interrupt */
+    SIM_EVENT_GUEST,        /**< The running guest issues its next operation */
+    SIM_EVENT_NUM_TYPES
+};
+
+/**
+ * @brief Simulated CPU state visible to the hypervisor.
+ *
+ * The registers are read and written through the armv7_p15.h accessors of
+ * this HAL. regs is the exception frame handed to the trap handlers, cop
+ * the guest co-processor registers.
+ */
+struct sim_cpu {
+    struct arch_regs regs;
+    struct regs_cop cop;
+    uint32_t hcr;
+    uint32_t hsr;
+    uint32_t hdfar;
+    uint32_t hpfar;
+    uint32_t vttbr_vmid;
+    uint32_t cnthp_ctl;
+    uint64_t cnthp_cval;
+    uint32_t mpidr;
+};
+
+/**
+ * @brief Cost in ticks of the work of the hypervisor, charged to the
+ * simulated clock on every entry.
+ */
+struct sim_cost {
+    uint32_t trap;          /**< Synchronous exception (trap, hvc) */
+    uint32_t irq;           /**< Physical interrupt */
+    uint32_t switch_guest;  /**< Additional cost of a guest switch */
+};
+
+/**
+ * @brief Statistics of the hypervisor entries.
+ *
+ * host_ns is the host time spent in the hypervisor code itself, a measure
+ * of the cost of the portable core on the host.
+ */
+struct sim_stats {
+    uint64_t events;
+    uint64_t traps;
+    uint64_t irqs;
+    uint64_t switches;
+    uint64_t host_ns_trap;
+    uint64_t host_ns_irq;
+};
+
+extern struct sim_cpu _sim_cpu;
+
+uint64_t sim_now(void);
+void sim_event_post(uint64_t when, uint32_t type, uint32_t arg);
+void sim_set_cost(struct sim_cost *cost);
+void sim_get_stats(struct sim_stats *stats);
+
+/**
+ * @brief Runs the simulation until the simulated time reaches \a until.
+ *
+ * guest_sched_start() must have been called, it loads the first guest on
+ * the simulated CPU and, unlike on the hardware, returns.
+ */
+void sim_run(uint64_t until);
+
+/**
+ * @brief Takes a synchronous exception to Hyp mode from the running guest.
+ *
+ * @param hsr Syndrome of the exception.
+ * @param ipa Faulting intermediate physical address of a data abort.
+ */
+void sim_trap(uint32_t hsr, uint32_t ipa);
+
+/**
+ * @brief Spends the cost of the exception being taken in Hyp mode.
+ *
+ * The handlers of trap.c call it right after guest_account_entry(), the
+ * cost is then charged to the hypervisor like the time of a handler on the
+ * hardware.
+ */
+void sim_hyp_entry(void);
+
+/** @brief IRQ exception entry of the hypervisor(trap.c). */
+hvmm_status_t _hyp_irq(struct arch_regs *regs);
+
+/**
+ * @brief Walks the simulated stage-2 translation tables of a guest.
+ *
+ * @param write Nonzero for a store.
+ * @param pa Output physical address, may be 0.
+ * @return 0 if \a ipa is mapped, otherwise the fault status code of the
+ *         stage-2 fault an access to it takes.
+ */
+uint32_t sim_memory_translate(vmid_t vmid, uint64_t ipa, uint32_t write,
+                uint64_t *pa);
+
+/**
+ * @brief Host address of a word of a shadow page(memory_map_shadow()).
+ *
+ * @return 0 if \a ipa is not in a shadow page of the guest.
+ */
+uint32_t *sim_memory_shadow(vmid_t vmid, uint64_t ipa);
+
+/**
+ * @brief Synthetic guest workload.
+ *
+ * A guest runs compute ticks between two operations. Each operation is
+ * picked at random according to the weights: an access to its RAM, to the
+ * virtual GIC distributor, to the sample virtual device, a ping hypervisor
+ * call or a yield. The guest enables the virqs listed in virqs through the
+ * virtual distributor at boot and spends irq_service ticks in the handler
+ * of each virtual interrupt. The device, if any, raises the physical
+ * interrupt device_pirq every device_period ticks.
+ */
+#define SIM_WORKLOAD_MAX_VIRQS  4
+
+struct sim_workload {
+    const char *name;
+    uint32_t compute;
+    uint32_t weight_ram;
+    uint32_t weight_gicd;
+    uint32_t weight_vdev;
+    uint32_t weight_ping;
+    uint32_t weight_yield;
+    uint32_t irq_service;
+    uint32_t virqs[SIM_WORKLOAD_MAX_VIRQS];
+    uint32_t device_pirq;
+    uint32_t device_period;
+};
+
+/**
+ * @brief Statistics of a synthetic guest.
+ *
+ * Interrupt latency is measured from the device raising the physical
+ * interrupt to the guest acknowledging the virtual one.
+ */
+struct sim_guest_stats {
+    uint64_t ops;
+    uint64_t ram_accesses;
+    uint64_t mmio_accesses;
+    uint64_t hvcs;
+    uint64_t virqs;
+    uint64_t latency_sum;
+    uint64_t latency_max;
+    uint64_t run_ticks;
+};
+
+hvmm_status_t sim_guest_init(vmid_t vmid, struct sim_workload *workload,
+                uint32_t seed);
+void sim_guest_get_stats(vmid_t vmid, struct sim_guest_stats *stats);
+
+/*
+ * Hooks of the simulator into the guest model, called by sim.c.
+ * - sim_guest_step(): a SIM_EVENT_GUEST event posted by the model is due.
+ * - sim_guest_device(): a SIM_EVENT_DEVICE event is due.
+ * - sim_guest_preempt(): the running guest is interrupted, the CPU enters
+ *   Hyp mode before its pending operation.
+ * - sim_guest_run(): the CPU returns to the guest.
+ * - sim_guest_switched(): the hypervisor switched guests.
+ */
+void sim_guest_step(uint32_t arg);
+void sim_guest_device(uint32_t pirq);
+void sim_guest_preempt(vmid_t vmid);
+void sim_guest_run(vmid_t vmid);
+void sim_guest_switched(vmid_t from, vmid_t to);
+
+#endif
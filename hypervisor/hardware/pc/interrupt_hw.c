@@ -0,0 +1,152 @@
+#include <interrupt.h>
+#include <gic.h>
+#include <vgic.h>
+#include <log/print.h>
+#include <log/uart_print.h>
+
+static struct vgic_status _vgic_status[NUM_GUESTS_STATIC];
+static struct vgic_status _vgic_status_checkpoint[NUM_GUESTS_STATIC];
+
+static hvmm_status_t host_interrupt_init(void)
+{
+    hvmm_status_t result = HVMM_STATUS_UNKNOWN_ERROR;
+
+    /* Route IRQ/IFQ to Hyp Exception Vector */
+    write_hcr(read_hcr() | HCR_IMO | HCR_FMO);
+
+    /* Physical Interrupt: GIC Distributor & CPU Interface */
+    result = gic_init();
+
+    return result;
+}
+
+static hvmm_status_t host_interrupt_enable(uint32_t irq)
+{
+    return gic_enable_irq(irq);
+}
+
+static hvmm_status_t host_interrupt_disable(uint32_t irq)
+{
+    return gic_disable_irq(irq);
+}
+
+static hvmm_status_t host_interrupt_configure(uint32_t irq)
+{
+    return gic_configure_irq(irq, GIC_INT_POLARITY_LEVEL,
+            gic_cpumask_current(), GIC_INT_PRIORITY_DEFAULT);
+}
+
+static hvmm_status_t host_interrupt_target(uint32_t irq, uint8_t cpumask)
+{
+    return gic_set_target(irq, cpumask);
+}
+
+static hvmm_status_t host_interrupt_end(uint32_t irq)
+{
+    /* Completion & Deactivation */
+    gic_completion_irq(irq);
+    gic_deactivate_irq(irq);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t host_interrupt_dump(void)
+{
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t guest_interrupt_init(void)
+{
+    hvmm_status_t result = HVMM_STATUS_UNKNOWN_ERROR;
+
+    /* Virtual Interrupt: GIC Virtual Interface Control */
+    result = vgic_init();
+    if (result == HVMM_STATUS_SUCCESS)
+        result = vgic_enable(1);
+
+    virq_init();
+
+    return result;
+}
+
+static hvmm_status_t guest_interrupt_end(uint32_t irq)
+{
+    return gic_completion_irq(irq);
+}
+
+static hvmm_status_t guest_interrupt_deactivate(uint32_t irq)
+{
+    return gic_deactivate_irq(irq);
+}
+
+static hvmm_status_t guest_interrupt_inject(vmid_t vmid, uint32_t virq,
+                        uint32_t pirq, uint8_t hw)
+{
+    return virq_inject(vmid, virq, pirq, hw);
+}
+
+/*
+ * The first switch saves the state of VMID_INVALID, there is nothing to
+ * save then.
+ */
+static hvmm_status_t guest_interrupt_save(vmid_t vmid)
+{
+    if (vmid >= NUM_GUESTS_STATIC)
+        return HVMM_STATUS_IGNORED;
+
+    return vgic_save_status(&_vgic_status[vmid]);
+}
+
+static hvmm_status_t guest_interrupt_restore(vmid_t vmid)
+{
+    if (vmid >= NUM_GUESTS_STATIC)
+        return HVMM_STATUS_BAD_ACCESS;
+
+    return vgic_restore_status(&_vgic_status[vmid], vmid);
+}
+
+static hvmm_status_t guest_interrupt_checkpoint(vmid_t vmid)
+{
+    _vgic_status_checkpoint[vmid] = _vgic_status[vmid];
+    return virq_checkpoint(vmid);
+}
+
+static hvmm_status_t guest_interrupt_rollback(vmid_t vmid)
+{
+    _vgic_status[vmid] = _vgic_status_checkpoint[vmid];
+    return virq_rollback(vmid);
+}
+
+static hvmm_status_t guest_interrupt_dump(void)
+{
+    return HVMM_STATUS_SUCCESS;
+}
+
+struct interrupt_ops _host_interrupt_ops = {
+    .init = host_interrupt_init,
+    .enable = host_interrupt_enable,
+    .disable = host_interrupt_disable,
+    .configure = host_interrupt_configure,
+    .target = host_interrupt_target,
+    .end = host_interrupt_end,
+    .dump = host_interrupt_dump,
+};
+
+struct interrupt_ops _guest_interrupt_ops = {
+    .init = guest_interrupt_init,
+    .end = guest_interrupt_end,
+    .deactivate = guest_interrupt_deactivate,
+    .inject = guest_interrupt_inject,
+    .save = guest_interrupt_save,
+    .restore = guest_interrupt_restore,
+    .checkpoint = guest_interrupt_checkpoint,
+    .rollback = guest_interrupt_rollback,
+    .dump = guest_interrupt_dump,
+};
+
+struct interrupt_module _interrupt_module = {
+    .name = "K-Hypervisor Interrupt Module",
+    .author = "Kookmin Univ.",
+    .host_ops = &_host_interrupt_ops,
+    .guest_ops = &_guest_interrupt_ops,
+};
@@ -0,0 +1,169 @@
+#include <k-hypervisor-config.h>
+#include <memory.h>
+#include <armv7_p15.h>
+#include <trap.h>
+#include <sim.h>
+#include <host.h>
+#include <log/print.h>
+
+/*
+ * Stage-2 translation of the simulated CPU.
+ *
+ * The memory map descriptor lists are kept as they are and walked on each
+ * translation instead of building LPAE tables: the index of a list is the
+ * level 1 entry(1GB) of the IPA, as in arm32ve/memory_hw.c. Shadow pages
+ * (memory_map_shadow()) are looked up before the lists.
+ */
+
+#define SIM_L1_SHIFT        30
+#define SIM_L1_ENTRIES      4
+#define SIM_PAGE_SIZE       0x1000
+#define SIM_SHADOW_PAGES    16
+
+struct sim_shadow {
+    uint64_t ipa;
+    uint32_t *page;
+};
+
+static struct memmap_desc **_guest_mdlist[NUM_GUESTS_STATIC];
+static struct sim_shadow _shadow[NUM_GUESTS_STATIC][SIM_SHADOW_PAGES];
+
+static hvmm_status_t memory_hw_init(struct memmap_desc **guest0,
+            struct memmap_desc **guest1)
+{
+    _guest_mdlist[0] = guest0;
+    _guest_mdlist[1] = guest1;
+    _sim_cpu.vttbr_vmid = VMID_INVALID;
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static struct sim_shadow *sim_memory_find_shadow(vmid_t vmid, uint64_t ipa)
+{
+    int i;
+
+    ipa &= ~((uint64_t) SIM_PAGE_SIZE - 1);
+    for (i = 0; i < SIM_SHADOW_PAGES; i++) {
+        if (_shadow[vmid][i].page && _shadow[vmid][i].ipa == ipa)
+            return &_shadow[vmid][i];
+    }
+    return 0;
+}
+
+uint32_t *sim_memory_shadow(vmid_t vmid, uint64_t ipa)
+{
+    struct sim_shadow *shadow;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return 0;
+    shadow = sim_memory_find_shadow(vmid, ipa);
+    if (!shadow)
+        return 0;
+    return shadow->page + (ipa & (SIM_PAGE_SIZE - 1)) / 4;
+}
+
+uint32_t sim_memory_translate(vmid_t vmid, uint64_t ipa, uint32_t write,
+                uint64_t *pa)
+{
+    struct memmap_desc *md;
+    uint32_t l1 = (uint32_t) (ipa >> SIM_L1_SHIFT);
+    uint64_t offset = ipa & ((1ULL << SIM_L1_SHIFT) - 1);
+    int i;
+
+    if (vmid >= NUM_GUESTS_STATIC || !_guest_mdlist[vmid])
+        return TRANS_FAULT_LEVEL1;
+
+    if (sim_memory_find_shadow(vmid, ipa)) {
+        /* read-only: the writes trap to the emulated device */
+        if (write)
+            return PERMISSION_FAULT_LEVEL3;
+        if (pa)
+            *pa = ipa;
+        return 0;
+    }
+
+    for (i = 0; i < SIM_L1_ENTRIES && _guest_mdlist[vmid][i]; i++) {
+        if (i != l1)
+            continue;
+
+        md = _guest_mdlist[vmid][i];
+        if (md[0].label == 0)
+            return TRANS_FAULT_LEVEL1;
+        for (; md->label != 0; md++) {
+            if (offset >= md->va && offset - md->va < md->size) {
+                if (pa)
+                    *pa = md->pa + (offset - md->va);
+                return 0;
+            }
+        }
+        return TRANS_FAULT_LEVEL3;
+    }
+    return TRANS_FAULT_LEVEL1;
+}
+
+static void *memory_hw_alloc(unsigned long size)
+{
+    return host_alloc(size);
+}
+
+static void memory_hw_free(void *ap)
+{
+    host_free(ap);
+}
+
+static hvmm_status_t memory_hw_save(void)
+{
+    /* Disable Stage 2 Translation: HCR.VM = 0 */
+    write_hcr(read_hcr() & ~HCR_VM);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t memory_hw_restore(vmid_t vmid)
+{
+    _sim_cpu.vttbr_vmid = vmid;
+    write_hcr(read_hcr() | HCR_VM);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t memory_hw_map_shadow(vmid_t vmid, uint64_t ipa,
+            void *page)
+{
+    int i;
+
+    if (vmid >= NUM_GUESTS_STATIC ||
+            (ipa & (SIM_PAGE_SIZE - 1)) || sim_memory_find_shadow(vmid, ipa))
+        return HVMM_STATUS_BAD_ACCESS;
+
+    for (i = 0; i < SIM_SHADOW_PAGES; i++) {
+        if (!_shadow[vmid][i].page) {
+            _shadow[vmid][i].ipa = ipa;
+            _shadow[vmid][i].page = page;
+            return HVMM_STATUS_SUCCESS;
+        }
+    }
+    return HVMM_STATUS_BUSY;
+}
+
+static hvmm_status_t memory_hw_dump(void)
+{
+    printH("[memory] vttbr.vmid:%d\n", _sim_cpu.vttbr_vmid);
+    return HVMM_STATUS_SUCCESS;
+}
+
+struct memory_ops _memory_ops = {
+    .init = memory_hw_init,
+    .alloc = memory_hw_alloc,
+    .free = memory_hw_free,
+    .save = memory_hw_save,
+    .restore = memory_hw_restore,
+    .map_shadow = memory_hw_map_shadow,
+    .dump = memory_hw_dump,
+};
+
+struct memory_module _memory_module = {
+    .name = "K-Hypervisor Memory Module",
+    .author = "Kookmin Univ.",
+    .ops = &_memory_ops,
+};
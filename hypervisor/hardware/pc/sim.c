@@ -0,0 +1,285 @@
+#include <k-hypervisor-config.h>
+#include <armv7_p15.h>
+#include <gic.h>
+#include <guest.h>
+#include <trap.h>
+#include <sim.h>
+#include <host.h>
+#include <log/print.h>
+
+#define SIM_MAX_EVENTS          4096
+/* Number of interrupts taken back to back before the guest runs again */
+#define SIM_MAX_NESTED_IRQS     64
+
+/* GENERIC_TIMER_HYP */
+#define SIM_TIMER_IRQ           26
+#define SIM_MIDR_CORTEXA15      0x412fc0f1
+
+#define GENERIC_TIMER_CTRL_ENABLE       (1 << 0)
+#define GENERIC_TIMER_CTRL_IMASK        (1 << 1)
+#define GENERIC_TIMER_CTRL_ISTATUS      (1 << 2)
+
+/*
+ * Events are kept in a binary min-heap ordered by time. Events due at the
+ * same time are processed in the order they were posted(seq), which keeps
+ * a run deterministic.
+ */
+struct sim_event {
+    uint64_t when;
+    uint32_t seq;
+    uint32_t type;
+    uint32_t arg;
+};
+
+struct sim_cpu _sim_cpu;
+
+static struct sim_event _events[SIM_MAX_EVENTS];
+static uint32_t _num_events;
+static uint32_t _event_seq;
+static uint64_t _now;
+/* outdates the timer event posted before the timer was reprogrammed */
+static uint32_t _timer_gen;
+static struct sim_cost _cost;
+static struct sim_stats _stats;
+/* cost of the exception being taken, spent by sim_hyp_entry() */
+static uint32_t _entry_cost;
+
+static inline int sim_event_before(struct sim_event *a, struct sim_event *b)
+{
+    return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static inline void sim_event_swap(uint32_t i, uint32_t j)
+{
+    struct sim_event ev = _events[i];
+
+    _events[i] = _events[j];
+    _events[j] = ev;
+}
+
+void sim_event_post(uint64_t when, uint32_t type, uint32_t arg)
+{
+    uint32_t i = _num_events;
+
+    if (_num_events >= SIM_MAX_EVENTS) {
+        host_puts("sim: event queue overflow\n");
+        host_exit(1);
+    }
+    _events[i].when = when < _now ? _now : when;
+    _events[i].seq = _event_seq++;
+    _events[i].type = type;
+    _events[i].arg = arg;
+    _num_events++;
+
+    /* sift up */
+    while (i > 0 && sim_event_before(&_events[i], &_events[(i - 1) / 2])) {
+        sim_event_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sim_event_pop(struct sim_event *ev)
+{
+    uint32_t i = 0;
+    uint32_t child;
+
+    *ev = _events[0];
+    _events[0] = _events[--_num_events];
+
+    /* sift down */
+    while ((child = 2 * i + 1) < _num_events) {
+        if (child + 1 < _num_events &&
+                sim_event_before(&_events[child + 1], &_events[child]))
+            child++;
+        if (!sim_event_before(&_events[child], &_events[i]))
+            break;
+        sim_event_swap(i, child);
+        i = child;
+    }
+}
+
+uint64_t sim_now(void)
+{
+    return _now;
+}
+
+uint64_t sim_read_counter(void)
+{
+    return _now;
+}
+
+void sim_hyp_entry(void)
+{
+    _now += _entry_cost;
+    _entry_cost = 0;
+}
+
+void sim_set_cost(struct sim_cost *cost)
+{
+    _cost = *cost;
+}
+
+void sim_get_stats(struct sim_stats *stats)
+{
+    *stats = _stats;
+}
+
+/*
+ * Posts the expiry of the Hyp physical timer for its current
+ * configuration, any event posted before is outdated.
+ */
+static void sim_timer_program(void)
+{
+    _timer_gen++;
+    _sim_cpu.cnthp_ctl &= ~GENERIC_TIMER_CTRL_ISTATUS;
+    if ((_sim_cpu.cnthp_ctl & GENERIC_TIMER_CTRL_ENABLE) &&
+            !(_sim_cpu.cnthp_ctl & GENERIC_TIMER_CTRL_IMASK))
+        sim_event_post(_sim_cpu.cnthp_cval, SIM_EVENT_TIMER, _timer_gen);
+}
+
+static void sim_timer_expire(uint32_t gen)
+{
+    if (gen != _timer_gen)
+        return;
+
+    _sim_cpu.cnthp_ctl |= GENERIC_TIMER_CTRL_ISTATUS;
+    gic_sim_raise(SIM_TIMER_IRQ);
+}
+
+uint32_t sim_read_sysreg(int reg)
+{
+    switch (reg) {
+    case SIM_SYSREG_HCR:
+        return _sim_cpu.hcr;
+    case SIM_SYSREG_HSR:
+        return _sim_cpu.hsr;
+    case SIM_SYSREG_HDFAR:
+        return _sim_cpu.hdfar;
+    case SIM_SYSREG_HPFAR:
+        return _sim_cpu.hpfar;
+    case SIM_SYSREG_MIDR:
+        return SIM_MIDR_CORTEXA15;
+    case SIM_SYSREG_MPIDR:
+        return _sim_cpu.mpidr;
+    case SIM_SYSREG_CNTFRQ:
+        return CFG_CNTFRQ;
+    case SIM_SYSREG_CNTHP_CTL:
+        return _sim_cpu.cnthp_ctl;
+    case SIM_SYSREG_CNTHP_TVAL:
+        return (uint32_t) (_sim_cpu.cnthp_cval - _now);
+    default:
+        break;
+    }
+    printH("sim: reading unknown system register %d\n", reg);
+    return 0;
+}
+
+void sim_write_sysreg(int reg, uint32_t val)
+{
+    switch (reg) {
+    case SIM_SYSREG_HCR:
+        _sim_cpu.hcr = val;
+        break;
+    case SIM_SYSREG_CNTHP_CTL:
+        _sim_cpu.cnthp_ctl = val;
+        sim_timer_program();
+        break;
+    case SIM_SYSREG_CNTHP_TVAL:
+        /* TimerValue is a signed 32-bit down counter */
+        _sim_cpu.cnthp_cval = _now + (int32_t) val;
+        sim_timer_program();
+        break;
+    default:
+        printH("sim: writing unknown system register %d\n", reg);
+        break;
+    }
+}
+
+/*
+ * Back from Hyp mode: accounts a guest switch and resumes the guest that
+ * is current now.
+ */
+static void sim_hyp_exit(vmid_t from)
+{
+    vmid_t to = guest_current_vmid();
+
+    if (from != to) {
+        _now += _cost.switch_guest;
+        _stats.switches++;
+        sim_guest_switched(from, to);
+    }
+    sim_guest_run(to);
+}
+
+void sim_trap(uint32_t hsr, uint32_t ipa)
+{
+    vmid_t vmid = guest_current_vmid();
+    uint64_t start;
+
+    _sim_cpu.hsr = hsr;
+    /* the guests run with the stage-1 MMU off, VA == IPA */
+    _sim_cpu.hdfar = ipa;
+    _sim_cpu.hpfar = (ipa >> HPFAR_FIPA_PAGE_SHIFT) << HPFAR_FIPA_SHIFT;
+    _entry_cost = _cost.trap;
+    _stats.traps++;
+
+    start = host_time_ns();
+    _hyp_hvc_service(&_sim_cpu.regs);
+    _stats.host_ns_trap += host_time_ns() - start;
+
+    sim_hyp_exit(vmid);
+}
+
+/* Takes the physical interrupts the GIC signals to the CPU */
+static void sim_cpu_irq(void)
+{
+    vmid_t vmid;
+    uint64_t start;
+    int nested = 0;
+
+    while ((_sim_cpu.hcr & HCR_IMO) && gic_sim_irq_pending() &&
+            nested++ < SIM_MAX_NESTED_IRQS) {
+        vmid = guest_current_vmid();
+        sim_guest_preempt(vmid);
+        _entry_cost = _cost.irq;
+        _stats.irqs++;
+
+        start = host_time_ns();
+        _hyp_irq(&_sim_cpu.regs);
+        _stats.host_ns_irq += host_time_ns() - start;
+
+        sim_hyp_exit(vmid);
+    }
+}
+
+void sim_run(uint64_t until)
+{
+    struct sim_event ev;
+
+    sim_guest_run(guest_current_vmid());
+    sim_cpu_irq();
+    while (_num_events && _events[0].when <= until) {
+        sim_event_pop(&ev);
+        if (ev.when > _now)
+            _now = ev.when;
+        _stats.events++;
+
+        switch (ev.type) {
+        case SIM_EVENT_TIMER:
+            sim_timer_expire(ev.arg);
+            break;
+        case SIM_EVENT_DEVICE:
+            sim_guest_device(ev.arg);
+            break;
+        case SIM_EVENT_GUEST:
+            sim_guest_step(ev.arg);
+            break;
+        default:
+            printH("sim: unknown event type %d\n", ev.type);
+            break;
+        }
+        sim_cpu_irq();
+    }
+    if (_now < until)
+        _now = until;
+}
@@ -0,0 +1,330 @@
+#include <k-hypervisor-config.h>
+#include <gic.h>
+#include <gic_regs.h>
+#include <guest.h>
+#include <interrupt.h>
+#include <trap.h>
+#include <sim.h>
+#include <log/print.h>
+
+/*
+ * Synthetic guests(sim.h: struct sim_workload).
+ *
+ * A guest is modeled by the time left until its next operation. The model
+ * keeps exactly one SIM_EVENT_GUEST event posted for the running guest:
+ * preemption saves the time left and outdates the event(gen), returning to
+ * the guest posts it again. Before anything else the guest takes the
+ * virtual interrupts pending in the List Registers.
+ */
+
+#define SIM_GUEST_RAM_IPA       0x80000000
+#define SIM_GUEST_RAM_SPAN      0x01000000
+#define SIM_GUEST_GICD_IPA      (CFG_GIC_BASE_PA | GIC_OFFSET_GICD)
+#define SIM_GUEST_SAMPLE_IPA    0x3FFFF000
+#define SIM_GUEST_SRT           2
+
+#define SIM_HVC_PING            0xFFFE
+#define SIM_HVC_YIELD           0xFFFD
+
+#define SIM_HSR_IL              (1 << 25)
+#define SIM_HSR_DABT(wnr, fsc) \
+    ((TRAP_EC_NON_ZERO_DATA_ABORT_FROM_OTHER_MODE << EXTRACT_EC) | \
+     SIM_HSR_IL | ISS_VALID | (ISS_SAS_WORD << ISS_SAS_SHIFT) | \
+     (SIM_GUEST_SRT << ISS_SRT_SHIFT) | ((wnr) ? ISS_WNR : 0) | (fsc))
+#define SIM_HSR_HVC(imm) \
+    ((TRAP_EC_NON_ZERO_HVC << EXTRACT_EC) | SIM_HSR_IL | ((imm) & 0xFFFF))
+
+#define SIM_GUEST_ARG(gen, vmid)    (((gen) << 8) | (vmid))
+
+struct sim_guest {
+    struct sim_workload *workload;
+    uint32_t seed;
+    /* outdates the posted event when the guest is preempted */
+    uint32_t gen;
+    uint8_t scheduled;
+    uint64_t next;
+    /* ticks left until the next operation, and in the virq handler */
+    uint64_t remaining;
+    uint64_t irq_remaining;
+    uint8_t in_irq;
+    uint32_t irq_slot;
+    /* virqs enabled so far at boot */
+    uint32_t boot;
+    struct sim_guest_stats stats;
+};
+
+static struct sim_guest _guests[NUM_GUESTS_STATIC];
+/* Time each physical interrupt was raised by its device, 0 if not */
+static uint64_t _raised[GIC_SIM_NUM_LINES];
+static vmid_t _running = VMID_INVALID;
+static uint64_t _running_since;
+
+static uint32_t sim_guest_random(struct sim_guest *guest)
+{
+    /* xorshift32 */
+    uint32_t x = guest->seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    guest->seed = x;
+    return x;
+}
+
+static void sim_guest_post(vmid_t vmid, uint64_t ticks)
+{
+    struct sim_guest *guest = &_guests[vmid];
+
+    guest->scheduled = 1;
+    guest->next = sim_now() + ticks;
+    sim_event_post(guest->next, SIM_EVENT_GUEST,
+            SIM_GUEST_ARG(guest->gen, vmid));
+}
+
+/* Accounts the time the CPU ran the previous guest */
+static void sim_guest_account(vmid_t vmid)
+{
+    if (_running == vmid)
+        return;
+    if (_running < NUM_GUESTS_STATIC)
+        _guests[_running].stats.run_ticks += sim_now() - _running_since;
+    _running = vmid;
+    _running_since = sim_now();
+}
+
+void sim_guest_preempt(vmid_t vmid)
+{
+    struct sim_guest *guest;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return;
+
+    guest = &_guests[vmid];
+    if (!guest->scheduled)
+        return;
+
+    if (guest->in_irq)
+        guest->irq_remaining = guest->next - sim_now();
+    else
+        guest->remaining = guest->next - sim_now();
+    guest->scheduled = 0;
+    guest->gen++;
+}
+
+void sim_guest_switched(vmid_t from, vmid_t to)
+{
+    sim_guest_preempt(from);
+}
+
+void sim_guest_run(vmid_t vmid)
+{
+    struct sim_guest *guest;
+    uint32_t virq;
+    uint32_t pirq;
+    uint64_t latency;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return;
+
+    sim_guest_account(vmid);
+    guest = &_guests[vmid];
+    if (!guest->workload)
+        return;
+    if (guest->scheduled) {
+        /* virtual IRQ exception, unless already in the handler */
+        if (guest->in_irq || !gic_sim_vcpu_pending())
+            return;
+        sim_guest_preempt(vmid);
+    }
+
+    if (guest->in_irq) {
+        sim_guest_post(vmid, guest->irq_remaining);
+        return;
+    }
+
+    virq = gic_sim_vcpu_ack(&guest->irq_slot);
+    if (virq != GIC_SPURIOUS_IRQ) {
+        guest->stats.virqs++;
+        pirq = interrupt_virq_to_pirq(vmid, virq);
+        if (pirq < GIC_SIM_NUM_LINES && _raised[pirq]) {
+            latency = sim_now() - _raised[pirq];
+            guest->stats.latency_sum += latency;
+            if (latency > guest->stats.latency_max)
+                guest->stats.latency_max = latency;
+            _raised[pirq] = 0;
+        }
+        guest->in_irq = 1;
+        sim_guest_post(vmid, guest->workload->irq_service);
+        return;
+    }
+
+    sim_guest_post(vmid, guest->remaining);
+}
+
+/* Load or store of a word the hypervisor emulates */
+static uint32_t sim_guest_mmio(vmid_t vmid, uint32_t ipa, uint32_t write,
+                uint32_t value)
+{
+    uint32_t fsc = sim_memory_translate(vmid, ipa, write, 0);
+    uint32_t *shadow;
+
+    _guests[vmid].stats.mmio_accesses++;
+    if (!fsc) {
+        /* passed through to the device, the hypervisor does not see it */
+        shadow = sim_memory_shadow(vmid, ipa);
+        return shadow ? *shadow : 0;
+    }
+    _sim_cpu.regs.gpr[SIM_GUEST_SRT] = value;
+    sim_trap(SIM_HSR_DABT(write, fsc), ipa);
+    return _sim_cpu.regs.gpr[SIM_GUEST_SRT];
+}
+
+static void sim_guest_hvc(vmid_t vmid, uint32_t imm)
+{
+    _guests[vmid].stats.hvcs++;
+    sim_trap(SIM_HSR_HVC(imm), 0);
+}
+
+static void sim_guest_ram(vmid_t vmid)
+{
+    struct sim_guest *guest = &_guests[vmid];
+    uint32_t ipa;
+    uint32_t fsc;
+
+    ipa = SIM_GUEST_RAM_IPA + ((sim_guest_random(guest) %
+                SIM_GUEST_RAM_SPAN) & ~0x3);
+    guest->stats.ram_accesses++;
+    fsc = sim_memory_translate(vmid, ipa, 0, 0);
+    if (fsc)
+        sim_trap(SIM_HSR_DABT(0, fsc), ipa);
+}
+
+static void sim_guest_op(vmid_t vmid)
+{
+    struct sim_guest *guest = &_guests[vmid];
+    struct sim_workload *workload = guest->workload;
+    uint32_t total;
+    uint32_t pick;
+
+    total = workload->weight_ram + workload->weight_gicd +
+            workload->weight_vdev + workload->weight_ping +
+            workload->weight_yield;
+    if (!total)
+        return;
+
+    pick = sim_guest_random(guest) % total;
+    if (pick < workload->weight_ram) {
+        sim_guest_ram(vmid);
+        return;
+    }
+    pick -= workload->weight_ram;
+    if (pick < workload->weight_gicd) {
+        /* GICD_TYPER or GICD_ISENABLER0 */
+        sim_guest_mmio(vmid, SIM_GUEST_GICD_IPA + ((pick & 1) ?
+                    GICD_TYPER * 4 : 0x100), 0, 0);
+        return;
+    }
+    pick -= workload->weight_gicd;
+    if (pick < workload->weight_vdev) {
+        if (pick & 1)
+            sim_guest_mmio(vmid, SIM_GUEST_SAMPLE_IPA, 1, pick);
+        else
+            sim_guest_mmio(vmid, SIM_GUEST_SAMPLE_IPA + 0x8, 0, 0);
+        return;
+    }
+    pick -= workload->weight_vdev;
+    if (pick < workload->weight_ping)
+        sim_guest_hvc(vmid, SIM_HVC_PING);
+    else
+        sim_guest_hvc(vmid, SIM_HVC_YIELD);
+}
+
+void sim_guest_step(uint32_t arg)
+{
+    vmid_t vmid = arg & 0xFF;
+    struct sim_guest *guest;
+    uint32_t virq;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return;
+
+    guest = &_guests[vmid];
+    if (!guest->scheduled || (arg >> 8) != (guest->gen & 0xFFFFFF))
+        return;
+    guest->scheduled = 0;
+
+    if (guest->in_irq) {
+        /* End of the handler: GICV_EOIR */
+        guest->in_irq = 0;
+        gic_sim_vcpu_eoi(guest->irq_slot);
+    } else if (guest->boot < SIM_WORKLOAD_MAX_VIRQS &&
+            guest->workload->virqs[guest->boot]) {
+        /* Boot: enables its virqs through GICD_ISENABLER */
+        virq = guest->workload->virqs[guest->boot++];
+        guest->remaining = guest->workload->compute;
+        sim_guest_mmio(vmid, SIM_GUEST_GICD_IPA + 0x100 + (virq / 32) * 4, 1,
+                1u << (virq % 32));
+    } else {
+        guest->stats.ops++;
+        guest->remaining = guest->workload->compute;
+        sim_guest_op(vmid);
+    }
+
+    /* Nothing to do if the trap already returned to the guest */
+    sim_guest_run(guest_current_vmid());
+}
+
+void sim_guest_device(uint32_t pirq)
+{
+    int i;
+    struct sim_workload *workload;
+
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        workload = _guests[i].workload;
+        if (!workload || workload->device_pirq != pirq)
+            continue;
+
+        if (pirq < GIC_SIM_NUM_LINES && !_raised[pirq])
+            _raised[pirq] = sim_now();
+        gic_sim_raise(pirq);
+        sim_event_post(sim_now() + workload->device_period,
+                SIM_EVENT_DEVICE, pirq);
+        return;
+    }
+}
+
+hvmm_status_t sim_guest_init(vmid_t vmid, struct sim_workload *workload,
+                uint32_t seed)
+{
+    struct sim_guest *guest;
+
+    if (vmid >= NUM_GUESTS_STATIC)
+        return HVMM_STATUS_BAD_ACCESS;
+
+    guest = &_guests[vmid];
+    guest->workload = workload;
+    /* xorshift32 never leaves 0 */
+    guest->seed = seed ? seed : 1;
+    guest->gen = 0;
+    guest->scheduled = 0;
+    guest->remaining = workload->compute;
+    guest->in_irq = 0;
+    guest->boot = 0;
+    guest->stats = (struct sim_guest_stats) { 0, };
+
+    if (workload->device_pirq && workload->device_period)
+        sim_event_post(sim_now() + workload->device_period,
+                SIM_EVENT_DEVICE, workload->device_pirq);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+void sim_guest_get_stats(vmid_t vmid, struct sim_guest_stats *stats)
+{
+    if (vmid >= NUM_GUESTS_STATIC)
+        return;
+
+    if (vmid == _running)
+        sim_guest_account(VMID_INVALID);
+    *stats = _guests[vmid].stats;
+}
@@ -0,0 +1,75 @@
+#include <k-hypervisor-config.h>
+#include <armv7_p15.h>
+#include <timer.h>
+#include <log/uart_print.h>
+#include <asm-arm_inline.h>
+#include <hvmm_trace.h>
+#include <interrupt.h>
+
+/*
+ * Hyp physical timer(IRQ 26) of the simulated CPU, the simulator posts
+ * its expiry when CNTHP_CTL or CNTHP_TVAL is written.
+ */
+
+#define GENERIC_TIMER_CTRL_ENABLE       (1 << 0)
+#define GENERIC_TIMER_CTRL_IMASK        (1 << 1)
+#define GENERIC_TIMER_CTRL_ISTATUS      (1 << 2)
+
+static hvmm_status_t timer_disable()
+{
+    uint32_t ctrl;
+
+    ctrl = read_cnthp_ctl();
+    ctrl &= ~GENERIC_TIMER_CTRL_ENABLE;
+    ctrl |= GENERIC_TIMER_CTRL_IMASK;
+    write_cnthp_ctl(ctrl);
+    isb();
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t timer_enable()
+{
+    uint32_t ctrl;
+
+    ctrl = read_cnthp_ctl();
+    ctrl |= GENERIC_TIMER_CTRL_ENABLE;
+    ctrl &= ~GENERIC_TIMER_CTRL_IMASK;
+    write_cnthp_ctl(ctrl);
+    isb();
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t timer_set_tval(uint64_t tval)
+{
+    write_cnthp_tval(tval);
+    isb();
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static hvmm_status_t timer_dump(void)
+{
+    uart_print("cntpct:");
+    uart_print_hex64(read_cntpct());
+    uart_print(" cnthp_ctl:");
+    uart_print_hex32(read_cnthp_ctl());
+    uart_print(" cnthp_tval:");
+    uart_print_hex32(read_cnthp_tval());
+    uart_print("\n\r");
+    return HVMM_STATUS_SUCCESS;
+}
+
+struct timer_ops _timer_ops = {
+    .enable = timer_enable,
+    .disable = timer_disable,
+    .set_interval = timer_set_tval,
+    .dump = timer_dump,
+};
+
+struct timer_module _timer_module = {
+    .name = "K-Hypervisor Timer Module",
+    .author = "Kookmin Univ.",
+    .ops = &_timer_ops,
+};
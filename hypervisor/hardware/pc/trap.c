@@ -0,0 +1,125 @@
+#include <hvmm_trace.h>
+#include <armv7_p15.h>
+#include <gic.h>
+#include <trap.h>
+#include <guest.h>
+#include <trace.h>
+#include <stats.h>
+#include <vdev.h>
+#include <interrupt.h>
+#include <memory.h>
+#include <sim.h>
+#include <host.h>
+
+#include <log/print.h>
+
+/*
+ * Exception entries of the simulated CPU, the counterpart of
+ * arm32ve/libhw/trap.c. The simulator calls them instead of the vector
+ * table; a trap the hypervisor cannot handle ends the simulation instead
+ * of spinning.
+ */
+
+static void trap_error(struct arch_regs *regs)
+{
+    uart_print("[hyp] unhandled trap, hsr:");
+    uart_print_hex32(read_hsr());
+    uart_print(" hdfar:");
+    uart_print_hex32(read_hdfar());
+    uart_print("\n");
+    guest_dump_regs(regs);
+    host_exit(1);
+}
+
+/**@brief Handles IRQ exception when interrupt is occured by a device.
+ * This funcntion calls gic interrupt, context switch.
+ * @param regs ARM registers for current virtual machine.
+ * @return Returns HVMM_STATUS_SUCCESS only.
+ */
+hvmm_status_t _hyp_irq(struct arch_regs *regs)
+{
+    uint32_t irq;
+    guest_account_entry();
+    sim_hyp_entry();
+    irq = gic_get_irq_number();
+    interrupt_service_routine(irq, (void *)regs, 0);
+    guest_perform_switch(regs);
+    return HVMM_STATUS_SUCCESS;
+}
+
+static int32_t trap_vdev_access(int level, uint32_t iss,
+                struct arch_vdev_trigger_info *info, struct arch_regs *regs)
+{
+    int32_t vdev_num = vdev_find(level, info, regs);
+
+    if (vdev_num < 0) {
+        printh("[hvc] cann't search vdev number\n");
+        return VDEV_NOT_FOUND;
+    }
+    if (iss & ISS_WNR) {
+        if (vdev_write(level, vdev_num, info, regs) < 0)
+            return VDEV_ERROR;
+    } else {
+        if (vdev_read(level, vdev_num, info, regs) < 0)
+            return VDEV_ERROR;
+    }
+    vdev_post(level, vdev_num, info, regs);
+    return 0;
+}
+
+/**@brief Handles the synchronous exceptions the synthetic guests take:
+ * hypervisor calls, stage-2 data aborts and trapped WFI.
+ * @param regs ARM registers for current virtual machine.
+ * @return Returns HYP_RESULT_ERET.
+ */
+enum hyp_hvc_result _hyp_hvc_service(struct arch_regs *regs)
+{
+    uint32_t hsr = read_hsr();
+    uint32_t ec = (hsr & HSR_EC_BIT) >> EXTRACT_EC;
+    uint32_t iss = hsr & HSR_ISS_BIT;
+    uint32_t far = read_hdfar();
+    uint32_t fipa;
+    uint32_t srt;
+    struct arch_vdev_trigger_info info;
+
+    guest_account_entry();
+    sim_hyp_entry();
+    fipa = (read_hpfar() & HPFAR_FIPA_MASK) >> HPFAR_FIPA_SHIFT;
+    fipa = fipa << HPFAR_FIPA_PAGE_SHIFT;
+    fipa = fipa | (far & HPFAR_FIPA_PAGE_MASK);
+    info.ec = ec;
+    info.iss = iss;
+    info.fipa = fipa;
+    info.sas = (iss & ISS_SAS_MASK) >> ISS_SAS_SHIFT;
+    srt = (iss & ISS_SRT_MASK) >> ISS_SRT_SHIFT;
+    info.value = &(regs->gpr[srt]);
+    trace_event(TRACE_EVENT_TRAP, ec, iss, fipa);
+    stats_trap(ec);
+
+    switch (ec) {
+    case TRAP_EC_ZERO_WFI_WFE:
+        regs->pc += 4;
+        break;
+    case TRAP_EC_NON_ZERO_HVC:
+        if (trap_vdev_access(VDEV_LEVEL_MIDDLE, iss, &info, regs) < 0)
+            trap_error(regs);
+        break;
+    case TRAP_EC_NON_ZERO_DATA_ABORT_FROM_OTHER_MODE:
+        /* Stage-2 faults on guest RAM replay the access once resolved */
+        if (memory_fault(guest_current_vmid(), fipa, iss) ==
+                HVMM_STATUS_SUCCESS)
+            break;
+        /* Posted write to a coalesced zone */
+        if ((iss & ISS_WNR) && !vdev_coalesce_write(&info, regs))
+            break;
+        if (trap_vdev_access(VDEV_LEVEL_LOW, iss, &info, regs) < 0)
+            trap_error(regs);
+        break;
+    default:
+        trap_error(regs);
+        break;
+    }
+
+    guest_perform_switch(regs);
+    return HYP_RESULT_ERET;
+}
@@ -0,0 +1,56 @@
+#ifndef __BOOT_PROFILE_H__
+#define __BOOT_PROFILE_H__
+
+#include <k-hypervisor-config.h>
+#include <arch_types.h>
+
+/**
+ * @file boot_profile.h
+ *
+ * Boot profiler: timestamps(CNTPCT) of the init phases of main_cpu_init()
+ * and of their sub-phases, printed as one table once the first guest is
+ * about to run.
+ *
+ * The register dumps of the init functions go through boot_log(). With
+ * the fast-boot profile, CFG_BOOT_QUIET, they are kept in memory and
+ * printed after the table, once the console is drained by the UART TX
+ * interrupt, instead of busy-waiting on the UART during the boot.
+ *
+ * All of it is __init: memory_free_init() reclaims it after
+ * boot_profile_print().
+ */
+
+/** @brief Maximum number of phases and sub-phases recorded */
+#define BOOT_PHASE_MAX      32
+/** @brief Maximum number of deferred boot_log() records */
+#define BOOT_LOG_MAX        32
+
+/**
+ * @brief Starts the phase \a name of main_cpu_init(), ending the previous
+ * phase and its sub-phases.
+ */
+void boot_phase(const char *name);
+
+/**
+ * @brief Starts the sub-phase \a name of the current phase, ending the
+ * previous sub-phase.
+ */
+void boot_subphase(const char *name);
+
+/**
+ * @brief Logs the register \a label of an init function.
+ *
+ * Printed right away as "label:value", or deferred to boot_profile_print()
+ * with CFG_BOOT_QUIET.
+ */
+void boot_log(const char *label, uint32_t value);
+
+/**
+ * @brief Ends the last phase and prints the table of the phases, then the
+ * deferred records.
+ *
+ * Called once, right before switching to the first guest.
+ */
+void boot_profile_print(void);
+
+#endif
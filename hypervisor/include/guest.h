@@ -7,6 +7,7 @@
 #include <hvmm_types.h>
 #include <vgic.h>
 #include <guest_hw.h>
+#include <sections.h>
 
 enum hyp_hvc_result {
     HYP_RESULT_ERET = 0,
@@ -23,10 +24,41 @@ enum hyp_hvc_result {
 #define GUEST_VERBOSE_LEVEL_6   0x40
 #define GUEST_VERBOSE_LEVEL_7   0x80
 
+/* One per guest, saved and restored at each switch */
 struct guest_struct {
     struct arch_regs regs;
     struct arch_context context;
     vmid_t vmid;
+} __cacheline_aligned;
+
+/**
+ * @brief CPU time of a guest, in CNTPCT ticks.
+ */
+struct guest_time_stats {
+    /** Running the guest */
+    uint64_t run;
+    /** In the hypervisor for the exceptions taken while the guest ran */
+    uint64_t hyp;
+    /** Runnable while another guest ran */
+    uint64_t wait;
+    /** Times the guest was switched in */
+    uint32_t switches;
+} __cacheline_aligned;
+
+/**
+ * @brief Steal time page of a guest, at CFG_GUEST_STEAL_TIME_IPA.
+ *
+ * Updated on each return to the guest. sequence is odd while the
+ * hypervisor writes the page: a reader retries until it reads the same
+ * even sequence before and after the times. steal is hyp + wait.
+ */
+struct guest_steal_time {
+    uint32_t sequence;
+    uint32_t reserved;
+    uint64_t run;
+    uint64_t hyp;
+    uint64_t wait;
+    uint64_t steal;
 };
 
 struct guest_ops {
@@ -39,6 +71,9 @@ struct guest_ops {
     /** Restore registers for context switch */
     hvmm_status_t (*restore)(struct guest_struct *, struct arch_regs *);
 
+    /** Write back the state of a guest switched lazily, still in the CPU */
+    hvmm_status_t (*sync)(struct guest_struct *);
+
     /** Dump state of the guest */
     hvmm_status_t (*dump)(uint8_t, struct arch_regs *regs);
 };
@@ -82,9 +117,18 @@ extern struct guest_struct *_current_guest;
  * sched_policy_determ_next() should be used to determine next virtual
  * machin. Currently, K-Hypervisor scheduler is a round robin, so
  * it has been implemented very simply by increasing the vmid number.
+ * Guests whose affinity excludes the calling CPU are skipped.
  */
 vmid_t sched_policy_determ_next(void);
 
+/**
+ * guest_set_affinity() restricts the physical CPUs the vCPU of a guest
+ * may run on, all of them by default. The pirqs of the guest follow its
+ * vCPU(interrupt_guest_migrate()).
+ */
+hvmm_status_t guest_set_affinity(vmid_t vmid, uint8_t cpumask);
+uint8_t guest_affinity(vmid_t vmid);
+
 /**
  * guest_perform_switch() perform the exchange of register from old virtual
  * to new virtual machine. Mainly, this function is called by trap and
@@ -93,6 +137,12 @@ vmid_t sched_policy_determ_next(void);
 hvmm_status_t guest_perform_switch(struct arch_regs *regs);
 
 void guest_dump_regs(struct arch_regs *regs);
+
+/**
+ * guest_context() gives the architecture context a guest was switched out
+ * with, the registers of the running guest are live instead.
+ */
+struct arch_context *guest_context(vmid_t vmid);
 void guest_sched_start(void);
 vmid_t guest_first_vmid(void);
 vmid_t guest_last_vmid(void);
@@ -100,6 +150,21 @@ vmid_t guest_next_vmid(vmid_t ofvmid);
 vmid_t guest_current_vmid(void);
 vmid_t guest_waiting_vmid(void);
 hvmm_status_t guest_switchto(vmid_t vmid, uint8_t locked);
+
+/**
+ * guest_account_entry() is called on each exception entry to the
+ * hypervisor, it charges the time since the last return to the running
+ * guest. guest_time_stats() gives the time accounted to a guest so far.
+ */
+void guest_account_entry(void);
+hvmm_status_t guest_time_stats(vmid_t vmid, struct guest_time_stats *stats);
+
+/**
+ * guest_checkpoint() copies the state of a guest that is not running aside,
+ * guest_rollback() brings the guest back to that state in place.
+ */
+hvmm_status_t guest_checkpoint(vmid_t vmid);
+hvmm_status_t guest_rollback(vmid_t vmid);
 extern void __mon_switch_to_guest_context(struct arch_regs *regs);
 hvmm_status_t guest_init();
 
@@ -11,6 +11,16 @@
 #define INJECT_SW 0
 #define INJECT_HW 1
 
+/* Virtual SGIs: software injected, the pirq is the source vCPU */
+#define VIRQ_NUM_SGIS 16
+
+/**
+ * SGI a CPU sends to another one running a vCPU it queued a virtual
+ * interrupt for: the exception return to the vCPU flushes the queue.
+ * Always a host irq with nothing but an EOI, no virqmap may route it.
+ */
+#define INTERRUPT_SGI_KICK 15
+
 /**
  * @breif   Saves a mapping information to find a virq for injection.
  *
@@ -29,24 +39,80 @@ struct guest_virqmap {
     struct virqmap_entry map[MAX_IRQS];
 };
 
+/**
+ * @brief   Routing counters of the passthrough pirqs of a guest.
+ */
+struct interrupt_route_stats {
+    uint32_t local;     /**< Taken on the CPU running the guest's vCPU */
+    uint32_t remote;    /**< Taken on another CPU */
+    uint32_t retargets; /**< Physical target changes */
+};
+
+/**
+ * @brief   Throttling policy of a passthrough virq of a guest.
+ *
+ * A tick is CFG_INTERRUPT_THROTTLE_TICK microseconds. Each injection takes
+ * a token from a bucket of burst tokens, refilled with rate tokens every
+ * tick. With a coalescing window, the virq is not injected again before
+ * window ticks have passed since its last injection.
+ */
+struct interrupt_throttle_policy {
+    uint32_t rate;      /**< Tokens added per tick, 0 for no rate limit */
+    uint32_t burst;     /**< Size of the bucket */
+    uint32_t window;    /**< Coalescing window in ticks, 0 for none */
+};
+
+/**
+ * @brief   Counters of a throttled virq.
+ *
+ * The pirq of an interrupt that is not injected is masked at the physical
+ * distributor until a tick lets it through again. A level-sensitive line
+ * raises it again then, an edge-triggered pirq is set pending again: the
+ * edges taken while it was held make one interrupt.
+ */
+struct interrupt_throttle_stats {
+    uint32_t injected;
+    uint32_t dropped;   /**< Not injected, the virq queue was full */
+    uint32_t deferred;  /**< Not injected, the bucket was empty */
+    uint32_t merged;    /**< Taken in a coalescing window */
+};
+
+/* Throttled virqs in the whole system */
+#define INTERRUPT_THROTTLE_MAX  16
+
 typedef void (*interrupt_handler_t)(int irq, void *regs, void *pdata);
 
 struct interrupt_ops {
     /** Initalize interrupt state */
     hvmm_status_t (*init)(void);
 
+    /** Initialize the interrupt state of a CPU other than the boot CPU */
+    hvmm_status_t (*init_cpu)(void);
+
     /** Enable interrupt */
     hvmm_status_t (*enable)(uint32_t);
 
     /** Disable interrupt */
     hvmm_status_t (*disable)(uint32_t);
 
+    /** Make an edge-triggered interrupt pending again */
+    hvmm_status_t (*pend)(uint32_t);
+
     /** Cofigure interrupt */
     hvmm_status_t (*configure)(uint32_t);
 
+    /** Route interrupt to a CPU mask */
+    hvmm_status_t (*target)(uint32_t, uint8_t);
+
+    /** Send a software generated interrupt to a CPU mask */
+    hvmm_status_t (*sgi)(uint32_t, uint8_t);
+
     /** End of interrupt */
     hvmm_status_t (*end)(uint32_t);
 
+    /** Deactivate an interrupt whose priority was dropped by end */
+    hvmm_status_t (*deactivate)(uint32_t);
+
     /** Inject to guest */
     hvmm_status_t (*inject)(vmid_t, uint32_t, uint32_t, uint8_t);
 
@@ -56,6 +122,12 @@ struct interrupt_ops {
     /** Restore interrupt state */
     hvmm_status_t (*restore)(vmid_t vmid);
 
+    /** Take a checkpoint of the saved interrupt state */
+    hvmm_status_t (*checkpoint)(vmid_t vmid);
+
+    /** Roll the saved interrupt state back to the last checkpoint */
+    hvmm_status_t (*rollback)(vmid_t vmid);
+
     /** Dump state of the interrupt */
     hvmm_status_t (*dump)(void);
 };
@@ -102,20 +174,75 @@ extern struct interrupt_module _interrupt_module;
  *    registers injection callback function that is called
  *    when flushs virtual irq.
  * </pre>
- * @return  If all initialization is success, then returns "success"
+ * @return  If all initialization is success, then returns "success",
+ *          "bad access" if a virqmap routed INTERRUPT_SGI_KICK(the
+ *          entry is dropped),
  *          otherwise returns "unknown error"
  */
 hvmm_status_t interrupt_init(struct guest_virqmap *virqmap);
+/**
+ * @brief   Initializes the banked GIC and VGIC state of a CPU other than
+ *          the boot CPU: its CPU interface, SGIs and PPIs, and its virtual
+ *          interface control. Not __init, a CPU may come up after
+ *          memory_free_init().
+ * @return  HVMM_STATUS_SUCCESS if the CPU has no state of its own.
+ */
+hvmm_status_t interrupt_init_cpu(void);
 hvmm_status_t interrupt_request(uint32_t irq, interrupt_handler_t handler);
 hvmm_status_t interrupt_host_enable(uint32_t irq);
 hvmm_status_t interrupt_host_disable(uint32_t irq);
 hvmm_status_t interrupt_host_configure(uint32_t irq);
+hvmm_status_t interrupt_host_target(uint32_t irq, uint8_t cpumask);
 hvmm_status_t interrupt_guest_inject(vmid_t vmid, uint32_t virq, uint32_t pirq,
                 uint8_t hw);
 hvmm_status_t interrupt_guest_enable(vmid_t vmid, uint32_t irq);
 hvmm_status_t interrupt_guest_disable(vmid_t vmid, uint32_t irq);
+
+/**
+ * @brief   Affinity routing of the passthrough pirqs.
+ *
+ * A pirq of a guest is targeted at the physical CPU running the guest's
+ * vCPU, so it is taken where it is injected. interrupt_guest_migrate()
+ * is called when the vCPU runs on a CPU, it retargets the pirqs of the
+ * guest if the CPU changed. interrupt_guest_target() applies the
+ * virtual GICD_ITARGETSR of a virq. An empty target mask is ignored: a
+ * pirq is never programmed with physical target 0.
+ */
+void interrupt_guest_migrate(vmid_t vmid, uint8_t cpumask);
+hvmm_status_t interrupt_guest_target(vmid_t vmid, uint32_t virq,
+                uint8_t vcpumask);
+hvmm_status_t interrupt_guest_route_stats(vmid_t vmid,
+                struct interrupt_route_stats *stats);
+
+/**
+ * @brief   Sends the virtual SGI \a sgi of vCPU \a source to the vCPU of a
+ *          guest.
+ *
+ * The SGI is queued with the other virqs of the guest. If the vCPU last ran
+ * on another physical CPU, that CPU is kicked(INTERRUPT_SGI_KICK) so the
+ * SGI is taken now rather than at its next exception.
+ */
+hvmm_status_t interrupt_guest_sgi(vmid_t vmid, uint32_t sgi, uint32_t source);
+
+/**
+ * @brief   Interrupt storm throttling of the passthrough virqs.
+ *
+ * interrupt_guest_throttle() sets the policy of the virq \a virq of a
+ * guest, the other virqs are injected as they come. A level-triggered pirq
+ * is not taken again before the guest EOIs its virq anyway: the List
+ * Register deactivates it at the physical GIC(GICH_LR.HW). The policy
+ * bounds how soon after that the device may interrupt the guest again.
+ * interrupt_throttle_init() starts the tick, after timer_init().
+ */
+hvmm_status_t interrupt_throttle_init(void);
+hvmm_status_t interrupt_guest_throttle(vmid_t vmid, uint32_t virq,
+                const struct interrupt_throttle_policy *policy);
+hvmm_status_t interrupt_guest_throttle_stats(vmid_t vmid, uint32_t virq,
+                struct interrupt_throttle_stats *stats);
 hvmm_status_t interrupt_save(vmid_t vmid);
 hvmm_status_t interrupt_restore(vmid_t vmid);
+hvmm_status_t interrupt_checkpoint(vmid_t vmid);
+hvmm_status_t interrupt_rollback(vmid_t vmid);
 void interrupt_service_routine(int irq, void *current_regs, void *pdata);
 const int32_t interrupt_check_guest_irq(uint32_t pirq);
 const uint32_t interrupt_pirq_to_virq(vmid_t vmid, uint32_t pirq);
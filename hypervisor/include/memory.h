@@ -38,10 +38,64 @@ struct memmap_desc {
     enum memattr attr;
 };
 
+/**
+ * @brief Statistics of the content-based page sharing.
+ *
+ * - pages_scanned Guest pages hashed by the scanner.
+ * - pages_shared Guest pages merged into a shared frame.
+ * - pages_unshared Shared guest pages given a private copy on write.
+ * - passes Complete passes over the RAM of all guests.
+ * - frames_pooled Physical frames currently freed by sharing.
+ */
+struct memory_share_stats {
+    uint32_t pages_scanned;
+    uint32_t pages_shared;
+    uint32_t pages_unshared;
+    uint32_t passes;
+    uint32_t frames_pooled;
+};
+
+#define MEMORY_WSS_AGES     8
+
+/**
+ * @brief Working set estimate of a guest.
+ *
+ * Result of the last complete pass of the access flag sampler.
+ * - pages Mapped guest RAM pages sampled.
+ * - wss Pages accessed since the previous pass (working set size).
+ * - hist Pages by the number of passes they have not been accessed for,
+ *   saturating at MEMORY_WSS_AGES - 1.
+ * - passes Complete passes over the guest RAM.
+ */
+struct memory_wss_stats {
+    uint32_t pages;
+    uint32_t wss;
+    uint32_t hist[MEMORY_WSS_AGES];
+    uint32_t passes;
+};
+
+/**
+ * @brief Guest addresses of memory_translate() and memory_copy_*_guest().
+ *
+ * - MEMORY_GUEST_IPA The address is an intermediate physical address.
+ * - MEMORY_GUEST_VA The address is a virtual address of the guest's
+ *   current stage-1 translation regime.
+ * - MEMORY_GUEST_WRITE Translates for a write.
+ * - MEMORY_GUEST_NOCACHE Bypasses the translation cache, for guest
+ *   tables that may change without a TTBR0/TTBR1/TTBCR change.
+ */
+#define MEMORY_GUEST_IPA        0
+#define MEMORY_GUEST_VA         (1 << 0)
+#define MEMORY_GUEST_WRITE      (1 << 1)
+#define MEMORY_GUEST_NOCACHE    (1 << 2)
+
 struct memory_ops {
     /** Initalize Memory state */
     hvmm_status_t (*init)(struct memmap_desc **, struct memmap_desc **);
 
+    /** Initialize the MMU of a CPU other than the boot CPU */
+    hvmm_status_t (*init_cpu)(void);
+
     /** Allocate heap memory */
     void * (*alloc)(unsigned long size);
 
@@ -54,6 +108,49 @@ struct memory_ops {
     /** Restore guest memory structure */
     hvmm_status_t (*restore)(vmid_t);
 
+    /** Copy the guest RAM pages changed since the last checkpoint aside */
+    hvmm_status_t (*checkpoint)(vmid_t);
+
+    /** Copy the guest RAM pages changed since the last checkpoint back */
+    hvmm_status_t (*rollback)(vmid_t);
+
+    /** Resolve a stage-2 fault of the current guest */
+    hvmm_status_t (*fault)(vmid_t, uint64_t ipa, uint32_t iss);
+
+    /** Scan a number of guest RAM pages for identical content */
+    hvmm_status_t (*share)(uint32_t pages);
+
+    /** Get the statistics of the page sharing */
+    hvmm_status_t (*share_stats)(struct memory_share_stats *);
+
+    /** Unmap guest RAM pages and put their frames into the frame pool */
+    uint32_t (*balloon_inflate)(vmid_t, uint64_t ipa, uint32_t pages);
+
+    /** Map frames from the frame pool at ballooned guest RAM pages */
+    uint32_t (*balloon_deflate)(vmid_t, uint64_t ipa, uint32_t pages);
+
+    /** Sample the access flags of a number of guest RAM pages */
+    hvmm_status_t (*wss_scan)(uint32_t pages);
+
+    /** Get the working set estimate of a guest */
+    hvmm_status_t (*wss_stats)(vmid_t, struct memory_wss_stats *);
+
+    /** Map a hypervisor page read-only at a guest page */
+    hvmm_status_t (*map_shadow)(vmid_t, uint64_t ipa, void *page);
+
+    /** Make hypervisor writes to a shadow page visible to the guests */
+    hvmm_status_t (*sync_shadow)(void *addr, uint32_t size);
+
+    /** Translate a guest address to a physical address */
+    hvmm_status_t (*translate)(vmid_t, uint32_t addr, uint32_t flags,
+                    uint64_t *pa);
+
+    /** Make a range of guest memory coherent with the guest's view */
+    hvmm_status_t (*sync_guest)(void *addr, uint32_t size);
+
+    /** Give the init-only code and data to the heap */
+    hvmm_status_t (*free_init)(void);
+
     /** Dump state of the memory */
     hvmm_status_t (*dump)(void);
 };
@@ -94,7 +191,28 @@ void memory_free(void *ap);
 void *memory_alloc(unsigned long size);
 hvmm_status_t memory_save(void);
 hvmm_status_t memory_restore(vmid_t vmid);
+hvmm_status_t memory_checkpoint(vmid_t vmid);
+hvmm_status_t memory_rollback(vmid_t vmid);
+hvmm_status_t memory_fault(vmid_t vmid, uint64_t ipa, uint32_t iss);
+hvmm_status_t memory_share(uint32_t pages);
+hvmm_status_t memory_share_stats(struct memory_share_stats *stats);
+hvmm_status_t memory_share_init(void);
+uint32_t memory_balloon_inflate(vmid_t vmid, uint64_t ipa, uint32_t pages);
+uint32_t memory_balloon_deflate(vmid_t vmid, uint64_t ipa, uint32_t pages);
+hvmm_status_t memory_wss_scan(uint32_t pages);
+hvmm_status_t memory_wss_stats(vmid_t vmid, struct memory_wss_stats *stats);
+hvmm_status_t memory_wss_init(void);
+hvmm_status_t memory_map_shadow(vmid_t vmid, uint64_t ipa, void *page);
+hvmm_status_t memory_sync_shadow(void *addr, uint32_t size);
+hvmm_status_t memory_translate(vmid_t vmid, uint32_t addr, uint32_t flags,
+                    uint64_t *pa);
+hvmm_status_t memory_copy_from_guest(vmid_t vmid, void *dst, uint32_t addr,
+                    uint32_t size, uint32_t flags);
+hvmm_status_t memory_copy_to_guest(vmid_t vmid, uint32_t addr,
+                    const void *src, uint32_t size, uint32_t flags);
 hvmm_status_t memory_init(struct memmap_desc **guest0,
                     struct memmap_desc **guest1);
+hvmm_status_t memory_init_cpu(void);
+hvmm_status_t memory_free_init(void);
 
 #endif
@@ -0,0 +1,87 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <k-hypervisor-config.h>
+#include <hvmm_types.h>
+#include <guest.h>
+#include <stats_page.h>
+
+/**
+ * @file stats.h
+ *
+ * Statistics pages of the guests, the writer side of
+ * common/include/stats_page.h.
+ *
+ * Enabled by CFG_STATS_IPA, where the page of each guest is mapped in the
+ * guest. The counters of a guest are written by the CPU running it, or by
+ * the CPU about to run it: a page has a single writer at a time.
+ */
+
+#ifdef CFG_STATS_IPA
+
+/**
+ * @brief Initializes the pages and maps each one in its guest.
+ * @return HVMM_STATUS_BAD_ACCESS if a page can not be mapped.
+ */
+hvmm_status_t stats_init(void);
+
+/**
+ * @brief Counts a trap of the current guest, by HSR.EC \a ec.
+ */
+void stats_trap(uint32_t ec);
+
+/**
+ * @brief Counts a virq injected in the guest \a vmid.
+ */
+void stats_virq(vmid_t vmid);
+
+/**
+ * @brief Counts a callback of a hypervisor timer.
+ */
+void stats_timer(void);
+
+/**
+ * @brief Publishes the counters of the guest \a vmid and of the system in
+ * its page, with its times \a time.
+ *
+ * Called on each return to the guest.
+ */
+void stats_update(vmid_t vmid, const struct guest_time_stats *time);
+
+/**
+ * @brief Page of the guest \a vmid, to read it from the hypervisor.
+ */
+volatile struct stats_page *stats_page(vmid_t vmid);
+
+#else
+
+static inline hvmm_status_t stats_init(void)
+{
+    return HVMM_STATUS_SUCCESS;
+}
+
+static inline void stats_trap(uint32_t ec)
+{
+}
+
+static inline void stats_virq(vmid_t vmid)
+{
+}
+
+static inline void stats_timer(void)
+{
+}
+
+static inline void stats_update(vmid_t vmid,
+                const struct guest_time_stats *time)
+{
+}
+
+static inline volatile struct stats_page *stats_page(vmid_t vmid)
+{
+    return 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <k-hypervisor-config.h>
+#include <hvmm_types.h>
+#include <trace_buffer.h>
+
+/**
+ * @file trace.h
+ *
+ * Binary event trace, the writer side of common/include/trace_buffer.h.
+ *
+ * Enabled by CFG_TRACE_IPA, where the buffers are mapped in the guest
+ * CFG_TRACE_GUEST. CFG_TRACE_RECORD_PAGES, a power of 2, sets the size of
+ * the ring of each CPU, CFG_TRACE_EVENTS the events traced(all by default).
+ * Tracing an event costs a few stores and two barriers, it is meant to stay
+ * on in production, unlike printh().
+ */
+
+#ifdef CFG_TRACE_IPA
+
+/**
+ * @brief Initializes the buffers and maps them in the control guest.
+ * @return HVMM_STATUS_BAD_ACCESS if a page can not be mapped.
+ */
+hvmm_status_t trace_init(void);
+
+/**
+ * @brief Records an event of the current guest in the buffer of the
+ * current CPU.
+ *
+ * Called from Hyp mode only, with IRQs masked: each buffer has a single
+ * writer, its CPU.
+ */
+void trace_event(uint32_t event, uint32_t arg0, uint32_t arg1,
+                uint32_t arg2);
+
+/**
+ * @brief Buffer of the CPU \a cpu, to read it from the hypervisor.
+ */
+volatile struct trace_header *trace_buffer(uint32_t cpu);
+
+#else
+
+static inline hvmm_status_t trace_init(void)
+{
+    return HVMM_STATUS_SUCCESS;
+}
+
+static inline void trace_event(uint32_t event, uint32_t arg0, uint32_t arg1,
+                uint32_t arg2)
+{
+}
+
+static inline volatile struct trace_header *trace_buffer(uint32_t cpu)
+{
+    return 0;
+}
+
+#endif
+
+#endif
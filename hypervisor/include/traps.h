@@ -1,7 +1,10 @@
 #ifndef _TRAPS_H_
 #define _TRAPS_H_
 
-void emulate_access_to_cp15(unsigned int iss, unsigned int il);
+struct arch_regs;
+
+void emulate_access_to_cp15(struct arch_regs *regs, unsigned int iss,
+        unsigned int il);
 void emulate_access_to_cp14(unsigned int iss, unsigned int il);
 void emulate_access_to_cp10(unsigned int iss, unsigned int il);
 void emulate_wfi_wfe(unsigned int iss, unsigned int il);
@@ -44,6 +44,23 @@ struct vdev_memory_map {
     unsigned int size;
 };
 
+/*
+ * Coalesced MMIO: the writes of the guest to a zone registered with
+ * vdev_coalesce_register() are posted to a per-guest buffer, and replayed
+ * in order to the write operation of the device, with regs 0, when the
+ * buffer is full, before any other access to a coalesced zone and at the
+ * next world switch.
+ */
+#define VDEV_MAX_COALESCED_ZONES        8
+#define VDEV_COALESCED_ENTRIES          64
+
+struct vdev_coalesced_entry {
+    uint32_t fipa;
+    uint32_t value;
+    uint8_t sas;
+    uint8_t zone;
+};
+
 typedef int (*initcall_t)(void);
 
 extern initcall_t __vdev_module_high_start[];
@@ -96,6 +113,12 @@ struct vdev_ops {
     /** Restore virtual device state */
     hvmm_status_t (*restore)(vmid_t vmid);
 
+    /** Take a checkpoint of the virtual device state */
+    hvmm_status_t (*checkpoint)(vmid_t vmid);
+
+    /** Roll the virtual device state back to the last checkpoint */
+    hvmm_status_t (*rollback)(vmid_t vmid);
+
     /** Dump state of the vdev */
     hvmm_status_t (*dump)(void);
 
@@ -141,6 +164,15 @@ hvmm_status_t vdev_post(int level, int num, struct arch_vdev_trigger_info *info,
             struct arch_regs *regs);
 hvmm_status_t vdev_save(vmid_t vmid);
 hvmm_status_t vdev_restore(vmid_t vmid);
+hvmm_status_t vdev_checkpoint(vmid_t vmid);
+hvmm_status_t vdev_rollback(vmid_t vmid);
+hvmm_status_t vdev_shadow_map(vmid_t vmid, uint32_t base, void *shadow);
+hvmm_status_t vdev_shadow_sync(void *addr, uint32_t size);
+hvmm_status_t vdev_coalesce_register(struct vdev_module *module,
+            uint32_t base, uint32_t size);
+int32_t vdev_coalesce_write(struct arch_vdev_trigger_info *info,
+            struct arch_regs *regs);
+hvmm_status_t vdev_coalesce_flush(vmid_t vmid);
 hvmm_status_t vdev_init(void);
 
 #endif /* __VDEV_H_ */
@@ -4,6 +4,14 @@
 #include <hvmm_trace.h>
 #include <log/uart_print.h>
 #include <interrupt.h>
+#include <rwlock.h>
+#include <spinlock.h>
+#include <timer.h>
+#include <trace.h>
+#include <stats.h>
+#include <smp.h>
+#include <boot_profile.h>
+#include <sections.h>
 
 #define VIRQ_MIN_VALID_PIRQ 16
 #define VIRQ_NUM_MAX_PIRQS  MAX_IRQS
@@ -20,6 +28,38 @@ static struct guest_virqmap *_guest_virqmap;
 /**< IRQ handler */
 static interrupt_handler_t _host_handlers[MAX_IRQS];
 
+/**< virqmap enabled flags at the last checkpoint */
+static uint8_t _virqmap_enabled_checkpoint[NUM_GUESTS_STATIC][MAX_IRQS];
+
+/**< Physical CPU the vCPU of each guest runs on */
+static uint8_t _guest_cpumask[NUM_GUESTS_STATIC];
+/**< Physical target of each pirq, never 0: a pirq is always forwarded */
+static uint8_t _pirq_target[MAX_IRQS];
+static struct interrupt_route_stats _route_stats[NUM_GUESTS_STATIC];
+
+/*
+ * Serializes the updates of the routing: the virqmap enabled flags, the
+ * guests' CPUs and the pirq targets. Injection reads them without it, each
+ * is a single byte.
+ */
+static DEFINE_RWLOCK(_route_lock);
+
+struct interrupt_throttle {
+    vmid_t vmid;
+    uint32_t pirq;
+    struct interrupt_throttle_policy policy;
+    uint32_t tokens;
+    uint32_t window;    /* Ticks left in the coalescing window */
+    uint32_t held;      /* The pirq is masked until a tick */
+    struct interrupt_throttle_stats stats;
+};
+
+static struct interrupt_throttle _throttles[INTERRUPT_THROTTLE_MAX];
+static uint32_t _num_throttles;
+/**< Index in _throttles plus one of each pirq, 0 if it is not throttled */
+static uint8_t _pirq_throttle[MAX_IRQS];
+static DEFINE_SPINLOCK(_throttle_lock);
+
 const int32_t interrupt_check_guest_irq(uint32_t pirq)
 {
     int i;
@@ -64,6 +104,8 @@ hvmm_status_t interrupt_guest_inject(vmid_t vmid, uint32_t virq, uint32_t pirq,
 {
     hvmm_status_t ret = HVMM_STATUS_UNKNOWN_ERROR;
 
+    trace_event(TRACE_EVENT_VIRQ_INJECT, virq, pirq, (hw << 8) | vmid);
+    stats_virq(vmid);
     if (_guest_ops->inject)
         ret = _guest_ops->inject(vmid, virq, pirq, hw);
 
@@ -101,8 +143,23 @@ hvmm_status_t interrupt_host_configure(uint32_t irq)
 {
     hvmm_status_t ret = HVMM_STATUS_UNKNOWN_ERROR;
 
+    write_lock(&_route_lock);
     if (_host_ops->configure)
         ret = _host_ops->configure(irq);
+    /* configure routes it to this CPU */
+    if (ret == HVMM_STATUS_SUCCESS)
+        _pirq_target[irq] = 1u << smp_processor_id();
+    write_unlock(&_route_lock);
+
+    return ret;
+}
+
+hvmm_status_t interrupt_host_target(uint32_t irq, uint8_t cpumask)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNKNOWN_ERROR;
+
+    if (_host_ops->target)
+        ret = _host_ops->target(irq, cpumask);
 
     return ret;
 }
@@ -112,7 +169,9 @@ hvmm_status_t interrupt_guest_enable(vmid_t vmid, uint32_t irq)
     hvmm_status_t ret = HVMM_STATUS_UNKNOWN_ERROR;
     struct virqmap_entry *map = _guest_virqmap[vmid].map;
 
+    write_lock(&_route_lock);
     map[irq].enabled = GUEST_IRQ_ENABLE;
+    write_unlock(&_route_lock);
 
     return ret;
 }
@@ -122,30 +181,287 @@ hvmm_status_t interrupt_guest_disable(vmid_t vmid, uint32_t irq)
     hvmm_status_t ret = HVMM_STATUS_UNKNOWN_ERROR;
     struct virqmap_entry *map = _guest_virqmap[vmid].map;
 
+    write_lock(&_route_lock);
     map[irq].enabled = GUEST_IRQ_DISABLE;
+    write_unlock(&_route_lock);
 
     return ret;
 }
 
-static void interrupt_inject_enabled_guest(int num_of_guests, uint32_t irq)
+/* Called with _route_lock held for writing */
+static void interrupt_pirq_retarget(vmid_t vmid, uint32_t pirq,
+                uint8_t cpumask)
+{
+    if (!cpumask || _pirq_target[pirq] == cpumask)
+        return;
+    if (interrupt_host_target(pirq, cpumask) != HVMM_STATUS_SUCCESS)
+        return;
+    _pirq_target[pirq] = cpumask;
+    _route_stats[vmid].retargets++;
+}
+
+void interrupt_guest_migrate(vmid_t vmid, uint8_t cpumask)
+{
+    struct virqmap_entry *map = _guest_virqmap[vmid].map;
+    uint32_t pirq;
+
+    if (_guest_cpumask[vmid] == cpumask)
+        return;
+
+    write_lock(&_route_lock);
+    _guest_cpumask[vmid] = cpumask;
+
+    /* Only the SPIs can be routed, the guest's own mask is kept as is */
+    for (pirq = 32; pirq < MAX_IRQS; pirq++) {
+        if (map[pirq].virq == VIRQ_INVALID)
+            continue;
+        interrupt_pirq_retarget(vmid, pirq, cpumask);
+    }
+    write_unlock(&_route_lock);
+}
+
+hvmm_status_t interrupt_guest_target(vmid_t vmid, uint32_t virq,
+                uint8_t vcpumask)
+{
+    uint32_t pirq = interrupt_virq_to_pirq(vmid, virq);
+
+    if (pirq < 32 || pirq >= MAX_IRQS)
+        return HVMM_STATUS_NOT_FOUND;
+
+    /*
+     * One vCPU per guest: any vCPU target means the guest's CPU. No target
+     * is ignored, the pirq stays forwarded to the guest's CPU.
+     */
+    if (!vcpumask)
+        return HVMM_STATUS_SUCCESS;
+
+    write_lock(&_route_lock);
+    interrupt_pirq_retarget(vmid, pirq, _guest_cpumask[vmid]);
+    write_unlock(&_route_lock);
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t interrupt_guest_route_stats(vmid_t vmid,
+                struct interrupt_route_stats *stats)
+{
+    if (vmid >= NUM_GUESTS_STATIC)
+        return HVMM_STATUS_BAD_ACCESS;
+
+    *stats = _route_stats[vmid];
+    return HVMM_STATUS_SUCCESS;
+}
+
+hvmm_status_t interrupt_guest_sgi(vmid_t vmid, uint32_t sgi, uint32_t source)
+{
+    hvmm_status_t ret;
+    uint8_t cpumask;
+
+    if (vmid >= NUM_GUESTS_STATIC || sgi >= VIRQ_NUM_SGIS)
+        return HVMM_STATUS_BAD_ACCESS;
+
+    ret = interrupt_guest_inject(vmid, sgi, source, INJECT_SW);
+    if (ret != HVMM_STATUS_SUCCESS)
+        return ret;
+
+    read_lock(&_route_lock);
+    cpumask = _guest_cpumask[vmid] & ~(1u << smp_processor_id());
+    read_unlock(&_route_lock);
+    /* A kick of a CPU that switched the vCPU out meanwhile is harmless */
+    if (cpumask && _host_ops->sgi)
+        ret = _host_ops->sgi(INTERRUPT_SGI_KICK, cpumask);
+
+    return ret;
+}
+
+static struct interrupt_throttle *interrupt_find_throttle(vmid_t vmid,
+                uint32_t pirq)
+{
+    struct interrupt_throttle *t;
+
+    if (!_pirq_throttle[pirq])
+        return 0;
+    t = &_throttles[_pirq_throttle[pirq] - 1];
+
+    return t->vmid == vmid ? t : 0;
+}
+
+/*
+ * Injects the pirq unless the policy holds it back. A held pirq is masked
+ * at the distributor and deactivated, interrupt_throttle_tick() pends it
+ * again if it is edge-triggered and unmasks it.
+ */
+static void interrupt_throttle_inject(struct interrupt_throttle *t,
+                uint32_t virq)
+{
+    uint32_t *count = 0;
+
+    spin_lock(&_throttle_lock);
+    if (t->window)
+        count = &t->stats.merged;
+    else if (t->policy.rate && !t->tokens)
+        count = &t->stats.deferred;
+    else if (interrupt_guest_inject(t->vmid, virq, t->pirq, INJECT_HW))
+        count = &t->stats.dropped;
+    else {
+        if (t->policy.rate)
+            t->tokens--;
+        t->window = t->policy.window;
+        t->stats.injected++;
+    }
+
+    if (count) {
+        (*count)++;
+        t->held = 1;
+        _host_ops->disable(t->pirq);
+        if (_guest_ops->deactivate)
+            _guest_ops->deactivate(t->pirq);
+    }
+    spin_unlock(&_throttle_lock);
+}
+
+#ifdef CFG_INTERRUPT_THROTTLE_TICK
+static void interrupt_throttle_tick(void *pdata)
+{
+    struct interrupt_throttle *t;
+    uint32_t i;
+
+    spin_lock(&_throttle_lock);
+    for (i = 0; i < _num_throttles; i++) {
+        t = &_throttles[i];
+        if (t->policy.rate) {
+            t->tokens += t->policy.rate;
+            if (t->tokens > t->policy.burst)
+                t->tokens = t->policy.burst;
+        }
+        if (t->window)
+            t->window--;
+        if (!t->held || t->window || (t->policy.rate && !t->tokens))
+            continue;
+        t->held = 0;
+        /* The edge was taken, nothing raises it again */
+        if (_host_ops->pend)
+            _host_ops->pend(t->pirq);
+        /* Unless the guest disabled the virq meanwhile */
+        if (interrupt_pirq_to_enabled_virq(t->vmid, t->pirq) != VIRQ_INVALID)
+            _host_ops->enable(t->pirq);
+    }
+    spin_unlock(&_throttle_lock);
+}
+#endif
+
+/**
+ * @brief Starts the tick of the interrupt throttling.
+ *
+ * Must be called after timer_init().
+ *
+ * @return HVMM_STATUS_SUCCESS, or HVMM_STATUS_UNSUPPORTED_FEATURE if the
+ *         throttling is not configured.
+ */
+hvmm_status_t interrupt_throttle_init(void)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+#ifdef CFG_INTERRUPT_THROTTLE_TICK
+    struct timer_val timer;
+
+    timer.interval_us = CFG_INTERRUPT_THROTTLE_TICK;
+    timer.callback = &interrupt_throttle_tick;
+    ret = timer_set(&timer);
+    if (ret != HVMM_STATUS_SUCCESS)
+        printh("[%s] timer startup failed...\n", __func__);
+#endif
+
+    return ret;
+}
+
+hvmm_status_t interrupt_guest_throttle(vmid_t vmid, uint32_t virq,
+                const struct interrupt_throttle_policy *policy)
+{
+    hvmm_status_t ret = HVMM_STATUS_SUCCESS;
+    struct interrupt_throttle *t;
+    uint32_t pirq;
+    uint32_t flags;
+
+    if (vmid >= NUM_GUESTS_STATIC || virq >= MAX_IRQS)
+        return HVMM_STATUS_BAD_ACCESS;
+    pirq = interrupt_virq_to_pirq(vmid, virq);
+    if (!VALID_PIRQ(pirq))
+        return HVMM_STATUS_BAD_ACCESS;
+
+    flags = spin_lock_irqsave(&_throttle_lock);
+    t = interrupt_find_throttle(vmid, pirq);
+    if (!t && _pirq_throttle[pirq])
+        ret = HVMM_STATUS_BAD_ACCESS;
+    else if (!t && _num_throttles == INTERRUPT_THROTTLE_MAX)
+        ret = HVMM_STATUS_BUSY;
+    else {
+        if (!t) {
+            t = &_throttles[_num_throttles++];
+            t->vmid = vmid;
+            t->pirq = pirq;
+        }
+        t->policy = *policy;
+        t->tokens = policy->burst;
+        t->window = 0;
+        /* The injection may see the entry once it is filled in */
+        smp_mb();
+        _pirq_throttle[pirq] = t - _throttles + 1;
+    }
+    spin_unlock_irqrestore(&_throttle_lock, flags);
+
+    return ret;
+}
+
+hvmm_status_t interrupt_guest_throttle_stats(vmid_t vmid, uint32_t virq,
+                struct interrupt_throttle_stats *stats)
+{
+    struct interrupt_throttle *t;
+    uint32_t pirq;
+
+    if (vmid >= NUM_GUESTS_STATIC || virq >= MAX_IRQS)
+        return HVMM_STATUS_BAD_ACCESS;
+    pirq = interrupt_virq_to_pirq(vmid, virq);
+    if (!VALID_PIRQ(pirq))
+        return HVMM_STATUS_BAD_ACCESS;
+
+    t = interrupt_find_throttle(vmid, pirq);
+    if (!t)
+        return HVMM_STATUS_NOT_FOUND;
+    *stats = t->stats;
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+static void __hot interrupt_inject_enabled_guest(int num_of_guests,
+                uint32_t irq)
 {
     int i;
     uint32_t virq;
+    uint8_t cpumask = 1u << smp_processor_id();
+    struct interrupt_throttle *t;
 
     for (i = 0; i < num_of_guests; i++) {
         virq = interrupt_pirq_to_enabled_virq(i, irq);
         if (virq == VIRQ_INVALID)
             continue;
-        interrupt_guest_inject(i, virq, irq, INJECT_HW);
+        if (_guest_cpumask[i] & cpumask)
+            _route_stats[i].local++;
+        else
+            _route_stats[i].remote++;
+        t = interrupt_find_throttle(i, irq);
+        if (t)
+            interrupt_throttle_inject(t, virq);
+        else
+            interrupt_guest_inject(i, virq, irq, INJECT_HW);
     }
 }
 
-void interrupt_service_routine(int irq, void *current_regs, void *pdata)
+void __hot interrupt_service_routine(int irq, void *current_regs, void *pdata)
 {
     struct arch_regs *regs = (struct arch_regs *)current_regs;
 
     if (irq < MAX_IRQS) {
-        if (interrupt_check_guest_irq(irq) == GUEST_IRQ) {
+        if (irq != INTERRUPT_SGI_KICK &&
+                interrupt_check_guest_irq(irq) == GUEST_IRQ) {
             /* IRQ INJECTION */
             /* priority drop only for hanlding irq in guest */
             _guest_ops->end(irq);
@@ -180,26 +496,113 @@ hvmm_status_t interrupt_restore(vmid_t vmid)
     return ret;
 }
 
-hvmm_status_t interrupt_init(struct guest_virqmap *virqmap)
+/**
+ * @brief   Takes a checkpoint of the interrupt state of a guest that is
+ *          not running.
+ *
+ * Records the enabled flags of the guest's virqmap and lets the guest
+ * interrupt module copy its saved (virtual interface) state.
+ */
+hvmm_status_t interrupt_checkpoint(vmid_t vmid)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNKNOWN_ERROR;
+    struct virqmap_entry *map = _guest_virqmap[vmid].map;
+    int i;
+
+    read_lock(&_route_lock);
+    for (i = 0; i < MAX_IRQS; i++)
+        _virqmap_enabled_checkpoint[vmid][i] = map[i].enabled;
+    read_unlock(&_route_lock);
+
+    if (_guest_ops->checkpoint)
+        ret = _guest_ops->checkpoint(vmid);
+
+    return ret;
+}
+
+/**
+ * @brief   Rolls the interrupt state of a guest back to its last checkpoint.
+ */
+hvmm_status_t interrupt_rollback(vmid_t vmid)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNKNOWN_ERROR;
+    struct virqmap_entry *map = _guest_virqmap[vmid].map;
+    int i;
+
+    write_lock(&_route_lock);
+    for (i = 0; i < MAX_IRQS; i++)
+        map[i].enabled = _virqmap_enabled_checkpoint[vmid][i];
+    write_unlock(&_route_lock);
+
+    if (_guest_ops->rollback)
+        ret = _guest_ops->rollback(vmid);
+
+    return ret;
+}
+
+hvmm_status_t __init interrupt_init(struct guest_virqmap *virqmap)
 {
     hvmm_status_t ret = HVMM_STATUS_UNKNOWN_ERROR;
+    hvmm_status_t kick = HVMM_STATUS_SUCCESS;
+    struct virqmap_entry *map;
+    int i;
 
     _host_ops = _interrupt_module.host_ops;
     _guest_ops = _interrupt_module.guest_ops;
 
+    /* The kick SGI is the hypervisor's own, its entries are dropped */
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        map = virqmap[i].map;
+        if (map[INTERRUPT_SGI_KICK].virq == VIRQ_INVALID)
+            continue;
+        printh("interrupt: guest %d maps pirq %d, the kick SGI\n",
+                i, INTERRUPT_SGI_KICK);
+        if (map[INTERRUPT_SGI_KICK].virq < MAX_IRQS)
+            map[map[INTERRUPT_SGI_KICK].virq].pirq = PIRQ_INVALID;
+        map[INTERRUPT_SGI_KICK].virq = VIRQ_INVALID;
+        kick = HVMM_STATUS_BAD_ACCESS;
+    }
+
     _guest_virqmap = virqmap;
 
+    /* The distributor routes every SPI to the boot CPU first */
+    for (i = 0; i < NUM_GUESTS_STATIC; i++)
+        _guest_cpumask[i] = 1u << smp_processor_id();
+    for (i = 0; i < MAX_IRQS; i++)
+        _pirq_target[i] = 1u << smp_processor_id();
+
     if (_host_ops->init) {
+        boot_subphase("host irq");
         ret = _host_ops->init();
         if (ret)
             printh("host initial failed:'%s'\n", _interrupt_module.name);
     }
 
     if (_guest_ops->init) {
+        boot_subphase("guest irq");
         ret = _guest_ops->init();
         if (ret)
             printh("guest initial failed:'%s'\n", _interrupt_module.name);
     }
 
+    return ret ? ret : kick;
+}
+
+hvmm_status_t interrupt_init_cpu(void)
+{
+    hvmm_status_t ret = HVMM_STATUS_SUCCESS;
+
+    if (_host_ops->init_cpu) {
+        ret = _host_ops->init_cpu();
+        if (ret)
+            printh("host cpu initial failed:'%s'\n", _interrupt_module.name);
+    }
+
+    if (ret == HVMM_STATUS_SUCCESS && _guest_ops->init_cpu) {
+        ret = _guest_ops->init_cpu();
+        if (ret)
+            printh("guest cpu initial failed:'%s'\n", _interrupt_module.name);
+    }
+
     return ret;
 }
@@ -1,8 +1,13 @@
 #include <k-hypervisor-config.h>
 #include <memory.h>
+#include <timer.h>
 #include <arch_types.h>
 #include <log/print.h>
 #include <log/uart_print.h>
+#include <log/string.h>
+#include <sections.h>
+
+#define MEMORY_GUEST_PAGE_SIZE  4096
 
 static struct memory_ops *_memory_ops;
 
@@ -60,7 +65,317 @@ hvmm_status_t memory_restore(vmid_t vmid)
     return ret;
 }
 
-hvmm_status_t memory_init(struct memmap_desc **guest0,
+hvmm_status_t memory_checkpoint(vmid_t vmid)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    if (_memory_ops->checkpoint)
+        ret = _memory_ops->checkpoint(vmid);
+
+    return ret;
+}
+
+hvmm_status_t memory_rollback(vmid_t vmid)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    if (_memory_ops->rollback)
+        ret = _memory_ops->rollback(vmid);
+
+    return ret;
+}
+
+/**
+ * @brief Gives the memory module a chance to resolve a stage-2 fault.
+ *
+ * @param vmid Guest that took the fault.
+ * @param ipa Faulting intermediate physical address.
+ * @param iss Instruction specific syndrome of the data abort.
+ * @return HVMM_STATUS_SUCCESS if the fault was resolved and the faulting
+ *         access has to be replayed, HVMM_STATUS_NOT_FOUND if the fault
+ *         belongs to somebody else (e.g. an emulated device).
+ */
+hvmm_status_t memory_fault(vmid_t vmid, uint64_t ipa, uint32_t iss)
+{
+    hvmm_status_t ret = HVMM_STATUS_NOT_FOUND;
+
+    if (_memory_ops->fault)
+        ret = _memory_ops->fault(vmid, ipa, iss);
+
+    return ret;
+}
+
+hvmm_status_t memory_share(uint32_t pages)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    if (_memory_ops->share)
+        ret = _memory_ops->share(pages);
+
+    return ret;
+}
+
+hvmm_status_t memory_share_stats(struct memory_share_stats *stats)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    if (_memory_ops->share_stats)
+        ret = _memory_ops->share_stats(stats);
+
+    return ret;
+}
+
+/**
+ * @brief Takes contiguous RAM pages away from a guest (balloon inflate).
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the first page.
+ * @param pages Number of pages.
+ * @return Number of pages processed.
+ */
+uint32_t memory_balloon_inflate(vmid_t vmid, uint64_t ipa, uint32_t pages)
+{
+    if (_memory_ops->balloon_inflate)
+        return _memory_ops->balloon_inflate(vmid, ipa, pages);
+
+    return 0;
+}
+
+/**
+ * @brief Gives contiguous RAM pages back to a guest (balloon deflate).
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the first page.
+ * @param pages Number of pages.
+ * @return Number of pages processed.
+ */
+uint32_t memory_balloon_deflate(vmid_t vmid, uint64_t ipa, uint32_t pages)
+{
+    if (_memory_ops->balloon_deflate)
+        return _memory_ops->balloon_deflate(vmid, ipa, pages);
+
+    return 0;
+}
+
+/**
+ * @brief Maps a hypervisor page read-only at a guest page.
+ *
+ * The guest reads the page directly, its writes take a stage-2 permission
+ * fault that memory_fault() leaves to the emulated devices.
+ *
+ * @param vmid Guest.
+ * @param ipa Intermediate physical address of the page, nothing may be
+ *        mapped there yet.
+ * @param page Page aligned hypervisor page.
+ * @return HVMM_STATUS_SUCCESS if mapped.
+ */
+hvmm_status_t memory_map_shadow(vmid_t vmid, uint64_t ipa, void *page)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    if (_memory_ops->map_shadow)
+        ret = _memory_ops->map_shadow(vmid, ipa, page);
+
+    return ret;
+}
+
+/**
+ * @brief Makes hypervisor writes to a shadow page visible to the guests,
+ * which may read it with other memory attributes.
+ *
+ * @param addr Start of the written range.
+ * @param size Size of the written range in bytes.
+ * @return HVMM_STATUS_SUCCESS.
+ */
+hvmm_status_t memory_sync_shadow(void *addr, uint32_t size)
+{
+    hvmm_status_t ret = HVMM_STATUS_SUCCESS;
+
+    if (_memory_ops->sync_shadow)
+        ret = _memory_ops->sync_shadow(addr, size);
+
+    return ret;
+}
+
+/**
+ * @brief Translates a guest address to a physical address.
+ *
+ * The stage-2 faults the hypervisor resolves itself(access flag, copy on
+ * write of shared and checkpointed pages) are resolved as for a guest
+ * access. Translations are kept in a small per guest cache, invalidated
+ * by any stage-2 update and, for virtual addresses, by a change of the
+ * guest's TTBR0, TTBR1 or TTBCR.
+ *
+ * @param vmid Guest, running or not.
+ * @param addr Guest address, see MEMORY_GUEST_IPA.
+ * @param flags MEMORY_GUEST_* flags.
+ * @param pa Physical address.
+ * @return HVMM_STATUS_BAD_ACCESS if the guest can not access the address.
+ */
+hvmm_status_t memory_translate(vmid_t vmid, uint32_t addr, uint32_t flags,
+                    uint64_t *pa)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    if (_memory_ops->translate)
+        ret = _memory_ops->translate(vmid, addr, flags, pa);
+
+    return ret;
+}
+
+static hvmm_status_t memory_copy_guest(vmid_t vmid, uint8_t *buf,
+                    uint32_t addr, uint32_t size, uint32_t flags)
+{
+    hvmm_status_t ret;
+    uint64_t pa;
+    uint8_t *hyp;
+    uint32_t chunk;
+
+    while (size) {
+        chunk = MEMORY_GUEST_PAGE_SIZE - (addr & (MEMORY_GUEST_PAGE_SIZE - 1));
+        if (chunk > size)
+            chunk = size;
+        ret = memory_translate(vmid, addr, flags, &pa);
+        if (ret != HVMM_STATUS_SUCCESS)
+            return ret;
+
+        /* The hypervisor maps the physical address space flat */
+        hyp = (uint8_t *) (unsigned long) pa;
+        if (flags & MEMORY_GUEST_WRITE) {
+            memcpy(hyp, buf, chunk);
+            if (_memory_ops->sync_guest)
+                _memory_ops->sync_guest(hyp, chunk);
+        } else {
+            if (_memory_ops->sync_guest)
+                _memory_ops->sync_guest(hyp, chunk);
+            memcpy(buf, hyp, chunk);
+        }
+        buf += chunk;
+        addr += chunk;
+        size -= chunk;
+    }
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Copies from the memory of a guest.
+ *
+ * @param vmid Guest, running or not.
+ * @param dst Hypervisor buffer.
+ * @param addr Guest address, see MEMORY_GUEST_IPA.
+ * @param size Size in bytes, the range may cross pages.
+ * @param flags MEMORY_GUEST_VA or MEMORY_GUEST_IPA, MEMORY_GUEST_NOCACHE.
+ * @return HVMM_STATUS_BAD_ACCESS if a page of the range is not readable,
+ *         the pages before it are copied.
+ */
+hvmm_status_t memory_copy_from_guest(vmid_t vmid, void *dst, uint32_t addr,
+                    uint32_t size, uint32_t flags)
+{
+    return memory_copy_guest(vmid, dst, addr, size,
+            flags & ~MEMORY_GUEST_WRITE);
+}
+
+/**
+ * @brief Copies to the memory of a guest, as memory_copy_from_guest().
+ */
+hvmm_status_t memory_copy_to_guest(vmid_t vmid, uint32_t addr,
+                    const void *src, uint32_t size, uint32_t flags)
+{
+    return memory_copy_guest(vmid, (uint8_t *) src, addr, size,
+            flags | MEMORY_GUEST_WRITE);
+}
+
+#ifdef CFG_MEMORY_SHARE_SCAN_TICK
+static void memory_share_scan(void *pdata)
+{
+    memory_share(CFG_MEMORY_SHARE_SCAN_PAGES);
+}
+#endif
+
+/**
+ * @brief Starts the background scanner of the page sharing.
+ *
+ * The scanner hashes CFG_MEMORY_SHARE_SCAN_PAGES guest pages every
+ * CFG_MEMORY_SHARE_SCAN_TICK microseconds. Must be called after
+ * timer_init().
+ *
+ * @return HVMM_STATUS_SUCCESS, or HVMM_STATUS_UNSUPPORTED_FEATURE if the
+ *         page sharing is not configured.
+ */
+hvmm_status_t memory_share_init(void)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+#ifdef CFG_MEMORY_SHARE_SCAN_TICK
+    struct timer_val timer;
+
+    if (!_memory_ops->share)
+        return ret;
+    timer.interval_us = CFG_MEMORY_SHARE_SCAN_TICK;
+    timer.callback = &memory_share_scan;
+    ret = timer_set(&timer);
+    if (ret != HVMM_STATUS_SUCCESS)
+        printh("[%s] timer startup failed...\n", __func__);
+#endif
+
+    return ret;
+}
+
+hvmm_status_t memory_wss_scan(uint32_t pages)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    if (_memory_ops->wss_scan)
+        ret = _memory_ops->wss_scan(pages);
+
+    return ret;
+}
+
+hvmm_status_t memory_wss_stats(vmid_t vmid, struct memory_wss_stats *stats)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    if (_memory_ops->wss_stats)
+        ret = _memory_ops->wss_stats(vmid, stats);
+
+    return ret;
+}
+
+#ifdef CFG_MEMORY_WSS_SCAN_TICK
+static void memory_wss_sample(void *pdata)
+{
+    memory_wss_scan(CFG_MEMORY_WSS_SCAN_PAGES);
+}
+#endif
+
+/**
+ * @brief Starts the working set sampler.
+ *
+ * The sampler visits at most CFG_MEMORY_WSS_SCAN_PAGES guest pages every
+ * CFG_MEMORY_WSS_SCAN_TICK microseconds. Must be called after
+ * timer_init().
+ *
+ * @return HVMM_STATUS_SUCCESS, or HVMM_STATUS_UNSUPPORTED_FEATURE if the
+ *         sampler is not configured.
+ */
+hvmm_status_t memory_wss_init(void)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+#ifdef CFG_MEMORY_WSS_SCAN_TICK
+    struct timer_val timer;
+
+    if (!_memory_ops->wss_scan)
+        return ret;
+    timer.interval_us = CFG_MEMORY_WSS_SCAN_TICK;
+    timer.callback = &memory_wss_sample;
+    ret = timer_set(&timer);
+    if (ret != HVMM_STATUS_SUCCESS)
+        printh("[%s] timer startup failed...\n", __func__);
+#endif
+
+    return ret;
+}
+
+hvmm_status_t __init memory_init(struct memmap_desc **guest0,
                 struct memmap_desc **guest1)
 {
     hvmm_status_t ret = HVMM_STATUS_UNKNOWN_ERROR;
@@ -74,3 +389,39 @@ hvmm_status_t memory_init(struct memmap_desc **guest0,
 
     return ret;
 }
+
+/**
+ * @brief Initializes the MMU of a CPU other than the boot CPU, on the
+ * tables memory_init() set up.
+ *
+ * Not __init: a CPU may come up after memory_free_init().
+ *
+ * @return HVMM_STATUS_SUCCESS if the CPU has no MMU state of its own.
+ */
+hvmm_status_t memory_init_cpu(void)
+{
+    hvmm_status_t ret = HVMM_STATUS_SUCCESS;
+
+    if (_memory_ops->init_cpu)
+        ret = _memory_ops->init_cpu();
+
+    return ret;
+}
+
+/**
+ * @brief Gives the init-only code and data(__init, __initdata) to the heap.
+ *
+ * Called once, when the boot CPU is about to run the first guest: nothing
+ * may call an __init function after it, the other CPUs included.
+ *
+ * @return HVMM_STATUS_UNSUPPORTED_FEATURE if the memory is kept.
+ */
+hvmm_status_t memory_free_init(void)
+{
+    hvmm_status_t ret = HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    if (_memory_ops->free_init)
+        ret = _memory_ops->free_init();
+
+    return ret;
+}
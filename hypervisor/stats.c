@@ -0,0 +1,98 @@
+#include <k-hypervisor-config.h>
+#include <stats.h>
+#include <guest.h>
+#include <memory.h>
+#include <log/print.h>
+
+#ifdef CFG_STATS_IPA
+
+static uint32_t _stats_pages[NUM_GUESTS_STATIC][STATS_PAGE_SIZE / 4]
+        __attribute((__aligned__(STATS_PAGE_SIZE)));
+
+/*
+ * Counted on any CPU, published in the page of a guest when it is about
+ * to run
+ */
+static struct stats_global _stats_global;
+static uint32_t _stats_virqs[NUM_GUESTS_STATIC];
+
+volatile struct stats_page *stats_page(vmid_t vmid)
+{
+    return (volatile struct stats_page *) _stats_pages[vmid];
+}
+
+void stats_trap(uint32_t ec)
+{
+    vmid_t vmid = guest_current_vmid();
+    volatile struct stats_page *page;
+    volatile uint32_t *counter;
+
+    _stats_global.traps++;
+    if (vmid >= NUM_GUESTS_STATIC)
+        return;
+
+    page = stats_page(vmid);
+    counter = &page->guest.traps[ec & (STATS_NUM_EC - 1)];
+    page->sequence++;
+    smp_mb();
+    (*counter)++;
+    smp_mb();
+    page->sequence++;
+    memory_sync_shadow((void *) counter, sizeof(*counter));
+    memory_sync_shadow((void *) &page->sequence, sizeof(page->sequence));
+}
+
+void stats_virq(vmid_t vmid)
+{
+    _stats_global.virqs++;
+    if (vmid < NUM_GUESTS_STATIC)
+        _stats_virqs[vmid]++;
+}
+
+void stats_timer(void)
+{
+    _stats_global.timer_expiries++;
+}
+
+void stats_update(vmid_t vmid, const struct guest_time_stats *time)
+{
+    volatile struct stats_page *page = stats_page(vmid);
+
+    page->sequence++;
+    smp_mb();
+    page->global = _stats_global;
+    page->guest.run = time->run;
+    page->guest.hyp = time->hyp;
+    page->guest.wait = time->wait;
+    page->guest.switches = time->switches;
+    page->guest.virqs = _stats_virqs[vmid];
+    smp_mb();
+    page->sequence++;
+    memory_sync_shadow((void *) page, sizeof(*page));
+}
+
+hvmm_status_t stats_init(void)
+{
+    volatile struct stats_page *page;
+    vmid_t vmid;
+
+    for (vmid = 0; vmid < NUM_GUESTS_STATIC; vmid++) {
+        page = stats_page(vmid);
+        page->magic = STATS_MAGIC;
+        page->version = STATS_VERSION;
+        page->size = sizeof(struct stats_page);
+        page->vmid = vmid;
+        page->sequence = 0;
+        memory_sync_shadow((void *) page, sizeof(*page));
+
+        if (memory_map_shadow(vmid, CFG_STATS_IPA, _stats_pages[vmid])) {
+            printh("stats: failed mapping ipa %x to guest %d\n",
+                    CFG_STATS_IPA, vmid);
+            return HVMM_STATUS_BAD_ACCESS;
+        }
+    }
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+#endif
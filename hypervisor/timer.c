@@ -10,6 +10,9 @@
 #include <hvmm_trace.h>
 #include <timer.h>
 #include <interrupt.h>
+#include <spinlock.h>
+#include <trace.h>
+#include <stats.h>
 #include <log/print.h>
 
 struct timer {
@@ -19,6 +22,8 @@ struct timer {
 
 static struct timer _timers[MAX_TIMER];
 uint32_t _timers_index;
+/* Serializes timer_set(), the timer interrupt reads _timers without it */
+static DEFINE_SPINLOCK(_timers_lock);
 static struct timer_ops *_ops;
 
 /*
@@ -90,6 +95,9 @@ static void timer_check_each_timers(void *pregs)
 
             if (_timers[i].count_per_irq < 0) {
                 /* calls callback with pregs */
+                trace_event(TRACE_EVENT_TIMER, i,
+                        _timers[i].timer_info.interval_us, 0);
+                stats_timer();
                 _timers[i].timer_info.callback(pregs);
 
                 /* re-calculates count_per_irq. */
@@ -132,20 +140,23 @@ static hvmm_status_t timer_requset_irq(uint32_t irq)
 
 hvmm_status_t timer_set(struct timer_val *timer)
 {
-    /* checks it first. */
-    if (timer_is_full())
-        return HVMM_STATUS_UNSUPPORTED_FEATURE;
-
     struct timer stimer;
+    uint32_t flags;
+
     stimer.timer_info.callback = timer->callback;
     stimer.timer_info.interval_us = timer->interval_us;
     stimer.count_per_irq = timer_count_per_irq(timer->interval_us);
 
-    /*
-     * TODO: Storing time_val into array of timers needs a lock mechanism
-     * for preventing concurrent access.
-     */
-    _timers[_timers_index++] = stimer;
+    flags = spin_lock_irqsave(&_timers_lock);
+    if (timer_is_full()) {
+        spin_unlock_irqrestore(&_timers_lock, flags);
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    }
+    /* The timer interrupt may see the index once the entry is filled in */
+    _timers[_timers_index] = stimer;
+    smp_mb();
+    _timers_index++;
+    spin_unlock_irqrestore(&_timers_lock, flags);
 
     return HVMM_STATUS_SUCCESS;
 }
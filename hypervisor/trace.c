@@ -0,0 +1,94 @@
+#include <k-hypervisor-config.h>
+#include <trace.h>
+#include <guest.h>
+#include <memory.h>
+#include <armv7_p15.h>
+#include <smp.h>
+#include <log/print.h>
+
+#ifdef CFG_TRACE_IPA
+
+#ifndef CFG_TRACE_GUEST
+#define CFG_TRACE_GUEST         0
+#endif
+#ifndef CFG_TRACE_RECORD_PAGES
+#define CFG_TRACE_RECORD_PAGES  8
+#endif
+#ifndef CFG_TRACE_EVENTS
+#define CFG_TRACE_EVENTS        TRACE_EVENTS_ALL
+#endif
+
+#define TRACE_BUFFER_SIZE       trace_buffer_size(CFG_TRACE_RECORD_PAGES)
+#define TRACE_CAPACITY          trace_buffer_capacity(CFG_TRACE_RECORD_PAGES)
+
+static uint8_t _trace_buffer[CFG_NUMBER_OF_CPUS][TRACE_BUFFER_SIZE]
+        __attribute((__aligned__(TRACE_PAGE_SIZE)));
+
+volatile struct trace_header *trace_buffer(uint32_t cpu)
+{
+    return (volatile struct trace_header *) _trace_buffer[cpu];
+}
+
+void trace_event(uint32_t event, uint32_t arg0, uint32_t arg1,
+                uint32_t arg2)
+{
+    uint32_t cpu = smp_processor_id();
+    volatile struct trace_header *header;
+    volatile struct trace_record *record;
+    uint32_t seq;
+
+    if (!(CFG_TRACE_EVENTS & (1u << event)))
+        return;
+
+    header = trace_buffer(cpu);
+    seq = header->head;
+    record = &trace_buffer_records(header)[seq & (TRACE_CAPACITY - 1)];
+    record->seq = TRACE_SEQ_BUSY;
+    smp_mb();
+    record->event = event;
+    record->vmid = guest_current_vmid();
+    record->cpu = cpu;
+    record->time = read_cntpct();
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+    record->arg2 = arg2;
+    smp_mb();
+    record->seq = seq;
+    memory_sync_shadow((void *) record, sizeof(*record));
+    header->head = seq + 1;
+    memory_sync_shadow((void *) &header->head, sizeof(header->head));
+}
+
+hvmm_status_t trace_init(void)
+{
+    volatile struct trace_header *header;
+    uint64_t ipa = CFG_TRACE_IPA;
+    uint32_t cpu, offset;
+
+    for (cpu = 0; cpu < CFG_NUMBER_OF_CPUS; cpu++) {
+        header = trace_buffer(cpu);
+        header->magic = TRACE_MAGIC;
+        header->version = TRACE_VERSION;
+        header->record_size = sizeof(struct trace_record);
+        header->cpu = cpu;
+        header->capacity = TRACE_CAPACITY;
+        header->mask = CFG_TRACE_EVENTS;
+        header->head = 0;
+        memory_sync_shadow((void *) header, sizeof(*header));
+
+        for (offset = 0; offset < TRACE_BUFFER_SIZE;
+                offset += TRACE_PAGE_SIZE) {
+            if (memory_map_shadow(CFG_TRACE_GUEST, ipa,
+                        &_trace_buffer[cpu][offset])) {
+                printh("trace: failed mapping ipa %x to guest %d\n",
+                        (uint32_t) ipa, CFG_TRACE_GUEST);
+                return HVMM_STATUS_BAD_ACCESS;
+            }
+            ipa += TRACE_PAGE_SIZE;
+        }
+    }
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+#endif
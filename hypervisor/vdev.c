@@ -1,5 +1,8 @@
 #include <vdev.h>
+#include <memory.h>
 #include <hvmm_trace.h>
+#include <rwlock.h>
+#include <trace.h>
 #define DEBUG
 #include <log/print.h>
 
@@ -7,6 +10,35 @@
 
 static struct vdev_module *_vdev_module[VDEV_LEVEL_MAX][MAX_VDEV];
 static int _vdev_size[VDEV_LEVEL_MAX];
+/*
+ * Serializes the registrations. The trap path looks the tables up without
+ * it: an entry is published by a single store once complete.
+ */
+static DEFINE_RWLOCK(_vdev_lock);
+
+struct vdev_coalesced_zone {
+    uint32_t base;
+    uint32_t size;
+    struct vdev_module *module;
+};
+
+static struct vdev_coalesced_zone _coalesced_zone[VDEV_MAX_COALESCED_ZONES];
+static int _coalesced_zones;
+/* Posted writes of each guest, only the running guest has any */
+static struct vdev_coalesced_entry _coalesced[NUM_GUESTS_STATIC]
+                                [VDEV_COALESCED_ENTRIES];
+static uint32_t _coalesced_count[NUM_GUESTS_STATIC];
+
+static int vdev_coalesced_module(struct vdev_module *vdev)
+{
+    int i;
+
+    for (i = 0; i < _coalesced_zones; i++) {
+        if (_coalesced_zone[i].module == vdev)
+            return 1;
+    }
+    return 0;
+}
 
 /**
  * \brief Register the virtual deivce \a module. Level \a level is
@@ -21,6 +53,7 @@ hvmm_status_t vdev_register(int level, struct vdev_module *module)
     int i;
     hvmm_status_t result = HVMM_STATUS_BUSY;
 
+    write_lock(&_vdev_lock);
     for (i = 0; i < MAX_VDEV; i++) {
         if (!_vdev_module[level][i]) {
             _vdev_module[level][i] = module;
@@ -28,6 +61,7 @@ hvmm_status_t vdev_register(int level, struct vdev_module *module)
             break;
         }
     }
+    write_unlock(&_vdev_lock);
 
     if (result != HVMM_STATUS_SUCCESS) {
         printh("vdev : Failed registering vdev '%s', max %d full\n",
@@ -92,8 +126,11 @@ int32_t vdev_read(int level, int num, struct arch_vdev_trigger_info *info,
         return VDEV_ERROR;
     }
 
+    if (_coalesced_count[guest_current_vmid()] && vdev_coalesced_module(vdev))
+        vdev_coalesce_flush(guest_current_vmid());
     if (vdev->ops->read)
         size = vdev->ops->read(info, regs);
+    trace_event(TRACE_EVENT_VDEV, info->fipa, *info->value, 0);
 
     return size;
 }
@@ -116,6 +153,9 @@ int32_t vdev_write(int level, int num, struct arch_vdev_trigger_info *info,
         return VDEV_ERROR;
     }
 
+    if (_coalesced_count[guest_current_vmid()] && vdev_coalesced_module(vdev))
+        vdev_coalesce_flush(guest_current_vmid());
+    trace_event(TRACE_EVENT_VDEV, info->fipa, *info->value, 1);
     if (vdev->ops->write)
         size = vdev->ops->write(info, regs);
 
@@ -152,6 +192,8 @@ hvmm_status_t vdev_save(vmid_t vmid)
     struct vdev_module *vdev;
     hvmm_status_t result = HVMM_STATUS_UNKNOWN_ERROR;
 
+    vdev_coalesce_flush(vmid);
+
     /* TODO : change one level iteration */
     for (i = 0; i < VDEV_LEVEL_MAX; i++) {
         for (j = 0; j < _vdev_size[i]; j++) {
@@ -194,6 +236,210 @@ hvmm_status_t vdev_restore(vmid_t vmid)
     return result;
 }
 
+/**
+ * \brief Take a checkpoint of every virtual device's state of the guest
+ * \a vmid. Devices without a checkpoint operation keep no per-guest state
+ * and are skipped.
+ *
+ * \retval 0 on success
+ */
+hvmm_status_t vdev_checkpoint(vmid_t vmid)
+{
+    int i, j;
+    struct vdev_module *vdev;
+    hvmm_status_t result = HVMM_STATUS_SUCCESS;
+
+    vdev_coalesce_flush(vmid);
+
+    for (i = 0; i < VDEV_LEVEL_MAX; i++) {
+        for (j = 0; j < _vdev_size[i]; j++) {
+            vdev = _vdev_module[i][j];
+            if (!vdev->ops->checkpoint)
+                continue;
+
+            result = vdev->ops->checkpoint(vmid);
+            if (result) {
+                printh("vdev : checkpoint error, name : %s\n", vdev->name);
+                return result;
+            }
+        }
+    }
+
+    return result;
+}
+
+/**
+ * \brief Roll every virtual device's state of the guest \a vmid back to
+ * the last checkpoint.
+ *
+ * \retval 0 on success
+ */
+hvmm_status_t vdev_rollback(vmid_t vmid)
+{
+    int i, j;
+    struct vdev_module *vdev;
+    hvmm_status_t result = HVMM_STATUS_SUCCESS;
+
+    /* The posted writes are younger than the checkpoint */
+    _coalesced_count[vmid] = 0;
+
+    for (i = 0; i < VDEV_LEVEL_MAX; i++) {
+        for (j = 0; j < _vdev_size[i]; j++) {
+            vdev = _vdev_module[i][j];
+            if (!vdev->ops->rollback)
+                continue;
+
+            result = vdev->ops->rollback(vmid);
+            if (result) {
+                printh("vdev : rollback error, name : %s\n", vdev->name);
+                return result;
+            }
+        }
+    }
+
+    return result;
+}
+
+/**
+ * \brief Back the register page \a base of a virtual device of the guest
+ * \a vmid with the page aligned \a shadow, mapped read-only: the guest
+ * reads the registers from \a shadow without trapping, only its writes
+ * reach the write operation of the device.
+ *
+ * The module keeps \a shadow holding what each register word reads, and
+ * calls vdev_shadow_sync() after each change. A register that changes
+ * without a guest write, or whose read has side effects, cannot be read
+ * from a shadow: a module with such registers in the page does not map
+ * it, and keeps trapping every access.
+ *
+ * \retval 0 if mapped, the device keeps trapping reads otherwise
+ */
+hvmm_status_t vdev_shadow_map(vmid_t vmid, uint32_t base, void *shadow)
+{
+    hvmm_status_t result;
+
+    result = memory_map_shadow(vmid, base, shadow);
+    if (result)
+        printh("vdev : shadow map error, base : %x, guest : %d\n",
+                base, vmid);
+
+    return result;
+}
+
+/**
+ * \brief Publish the words \a addr to \a addr + \a size of a shadow page
+ * written by the hypervisor to the guest.
+ */
+hvmm_status_t vdev_shadow_sync(void *addr, uint32_t size)
+{
+    return memory_sync_shadow(addr, size);
+}
+
+/**
+ * \brief Post the guest writes to \a base to \a base + \a size of the
+ * virtual device \a module instead of dispatching them one by one. Only
+ * for a device whose writes have no effect the guest can see before it
+ * reads the device again or is switched out, e.g. a transmit register
+ * or a doorbell.
+ *
+ * \retval 0 if registered
+ */
+hvmm_status_t vdev_coalesce_register(struct vdev_module *module,
+            uint32_t base, uint32_t size)
+{
+    struct vdev_coalesced_zone *zone;
+
+    write_lock(&_vdev_lock);
+    if (_coalesced_zones == VDEV_MAX_COALESCED_ZONES) {
+        write_unlock(&_vdev_lock);
+        printh("vdev : Failed registering coalesced zone '%s', max %d\n",
+                module->name, VDEV_MAX_COALESCED_ZONES);
+        return HVMM_STATUS_BUSY;
+    }
+
+    zone = &_coalesced_zone[_coalesced_zones];
+    zone->base = base;
+    zone->size = size;
+    zone->module = module;
+    /* vdev_coalesce_write() may see the zone once it is filled in */
+    smp_mb();
+    _coalesced_zones++;
+    write_unlock(&_vdev_lock);
+
+    return HVMM_STATUS_SUCCESS;
+}
+
+/**
+ * \brief Post a guest write if it targets a coalesced zone, flushing the
+ * buffer if full. The post operation of the device runs at once.
+ *
+ * \retval 0 if posted
+ * \retval VDEV_NOT_FOUND if not in a coalesced zone
+ */
+int32_t vdev_coalesce_write(struct arch_vdev_trigger_info *info,
+            struct arch_regs *regs)
+{
+    vmid_t vmid = guest_current_vmid();
+    struct vdev_coalesced_entry *entry;
+    struct vdev_module *vdev;
+    int i;
+
+    for (i = 0; i < _coalesced_zones; i++) {
+        if (info->fipa - _coalesced_zone[i].base < _coalesced_zone[i].size)
+            break;
+    }
+    if (i == _coalesced_zones)
+        return VDEV_NOT_FOUND;
+
+    trace_event(TRACE_EVENT_VDEV, info->fipa, *info->value, 1);
+    if (_coalesced_count[vmid] == VDEV_COALESCED_ENTRIES)
+        vdev_coalesce_flush(vmid);
+    entry = &_coalesced[vmid][_coalesced_count[vmid]++];
+    entry->fipa = info->fipa;
+    entry->value = *info->value;
+    entry->sas = info->sas;
+    entry->zone = i;
+
+    vdev = _coalesced_zone[i].module;
+    if (vdev->ops->post)
+        vdev->ops->post(info, regs);
+
+    return 0;
+}
+
+/**
+ * \brief Replay the posted writes of the guest \a vmid, which has to be
+ * the running guest if it has any.
+ *
+ * \retval 0 on success
+ */
+hvmm_status_t vdev_coalesce_flush(vmid_t vmid)
+{
+    struct arch_vdev_trigger_info info;
+    struct vdev_coalesced_entry *entry;
+    struct vdev_module *vdev;
+    uint32_t count = _coalesced_count[vmid];
+    uint32_t i;
+
+    /* The write operations may post nothing more */
+    _coalesced_count[vmid] = 0;
+    info.ec = 0;
+    info.iss = 0;
+    info.il = 0;
+    for (i = 0; i < count; i++) {
+        entry = &_coalesced[vmid][i];
+        vdev = _coalesced_zone[entry->zone].module;
+        info.fipa = entry->fipa;
+        info.sas = entry->sas;
+        info.value = &entry->value;
+        if (vdev->ops->write && vdev->ops->write(&info, 0) < 0)
+            printh("vdev : posted write error, name : %s, fipa : %x\n",
+                    vdev->name, entry->fipa);
+    }
+
+    return HVMM_STATUS_SUCCESS;
+}
+
 hvmm_status_t vdev_module_initcall(initcall_t fn)
 {
     return  fn();
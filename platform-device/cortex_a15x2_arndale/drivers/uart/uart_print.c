@@ -2,6 +2,8 @@
 #include "exynos-uart.h"
 
 #include <k-hypervisor-config.h>
+#include <interrupt.h>
+#include <log/uart_print.h>
 
 #ifdef CFG_EXYNOS5250
 #ifdef CFG_BOARD_ARNDALE
@@ -17,8 +19,27 @@
 
 #define TX_FIFO_FULL_MASK       (1 << 24)
 #define    readl(a)         (*(volatile unsigned int *)(a))
+#define    writel(v, a)         (*(volatile unsigned int *)(a) = (v))
 #define    writeb(v, a)         (*(volatile unsigned char *)(a) = (v))
 
+/* Interrupt pending and mask registers, not in struct s5p_uart */
+#define UINTP       0x30
+#define UINTM       0x38
+#define UINT_TXD    (1 << 2)
+
+/*
+ * Console transmit ring, drained by the TX interrupt once
+ * uart_console_init() ran. The hypervisor runs with IRQs masked, the
+ * interrupt is only taken while a guest runs: the ring is never
+ * accessed concurrently on one CPU.
+ */
+static char _tx_ring[CFG_UART_CONSOLE_TX_BUFFER];
+static uint32_t _tx_head;
+static uint32_t _tx_tail;
+static uint8_t _tx_buffered;
+
+#define UART_TX_RING_MASK   (CFG_UART_CONSOLE_TX_BUFFER - 1)
+
 static int serial_err_check(int op)
 {
     struct s5p_uart *const uart = (struct s5p_uart *) UART2_BASE;
@@ -30,13 +51,108 @@ static int serial_err_check(int op)
     return readl(&uart->uerstat) & mask;
 }
 
-void uart_putc(const char c)
+/* Waits for space in the TX FIFO, 1 on a transmit error */
+static int uart_tx_wait(void)
 {
     struct s5p_uart *const uart = (struct s5p_uart *) UART2_BASE;
     while ((readl(&uart->ufstat) & TX_FIFO_FULL_MASK)) {
         if (serial_err_check(1))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Moves characters from the ring to the FIFO until either is full/empty.
+ * The TX interrupt is level triggered, it is unmasked only while the
+ * ring holds characters.
+ */
+static void uart_tx_fill(void)
+{
+    struct s5p_uart *const uart = (struct s5p_uart *) UART2_BASE;
+
+    while (_tx_tail != _tx_head &&
+            !(readl(&uart->ufstat) & TX_FIFO_FULL_MASK))
+        writeb(_tx_ring[_tx_tail++ & UART_TX_RING_MASK], &uart->utxh);
+
+    if (_tx_tail == _tx_head)
+        writel(readl(UART2_BASE + UINTM) | UINT_TXD, UART2_BASE + UINTM);
+    else
+        writel(readl(UART2_BASE + UINTM) & ~UINT_TXD, UART2_BASE + UINTM);
+}
+
+static void uart_tx_handler(int irq, void *regs, void *pdata)
+{
+    uart_tx_fill();
+    writel(UINT_TXD, UART2_BASE + UINTP);
+}
+
+void uart_console_flush(void)
+{
+    struct s5p_uart *const uart = (struct s5p_uart *) UART2_BASE;
+
+    while (_tx_tail != _tx_head) {
+        if (uart_tx_wait()) {
+            /* Drops what is left, as the polling output does */
+            _tx_tail = _tx_head;
+            return;
+        }
+        writeb(_tx_ring[_tx_tail++ & UART_TX_RING_MASK], &uart->utxh);
+    }
+}
+
+void uart_console_sync(void)
+{
+    _tx_buffered = 0;
+    writel(readl(UART2_BASE + UINTM) | UINT_TXD, UART2_BASE + UINTM);
+    uart_console_flush();
+}
+
+hvmm_status_t uart_console_init(void)
+{
+#ifdef CFG_UART_CONSOLE_IRQ
+    /* The UART is shared with a guest that owns its interrupt */
+    if (interrupt_check_guest_irq(CFG_UART_CONSOLE_IRQ) == GUEST_IRQ)
+        return HVMM_STATUS_BUSY;
+    if (interrupt_request(CFG_UART_CONSOLE_IRQ, &uart_tx_handler))
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    if (interrupt_host_configure(CFG_UART_CONSOLE_IRQ))
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    _tx_buffered = 1;
+    return HVMM_STATUS_SUCCESS;
+#else
+    return HVMM_STATUS_UNSUPPORTED_FEATURE;
+#endif
+}
+
+static void uart_tx_queue(const char c)
+{
+    struct s5p_uart *const uart = (struct s5p_uart *) UART2_BASE;
+
+    /* Ring full: makes room at the speed of the line */
+    if (_tx_head - _tx_tail == CFG_UART_CONSOLE_TX_BUFFER) {
+        if (uart_tx_wait())
             return;
+        writeb(_tx_ring[_tx_tail++ & UART_TX_RING_MASK], &uart->utxh);
     }
+    _tx_ring[_tx_head++ & UART_TX_RING_MASK] = c;
+}
+
+void uart_putc(const char c)
+{
+    struct s5p_uart *const uart = (struct s5p_uart *) UART2_BASE;
+
+    if (_tx_buffered) {
+        uart_tx_queue(c);
+        if (c == '\n')
+            uart_tx_queue('\r');
+        uart_tx_fill();
+        return;
+    }
+
+    if (uart_tx_wait())
+        return;
     writeb(c, &uart->utxh);
     if (c == '\n')
         uart_putc('\r');
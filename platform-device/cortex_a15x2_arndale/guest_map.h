@@ -0,0 +1,178 @@
+#ifndef __GUEST_MAP_H__
+#define __GUEST_MAP_H__
+#include <k-hypervisor-config.h>
+#include <memory.h>
+#include <gic_regs.h>
+
+/*
+ * Static configuration of the guests: the memory maps their stage-2
+ * translation tables are built from and the routing of the pirqs.
+ * pgtable_gen(hypervisor/hardware/arm32ve/tools) builds the translation
+ * tables and _guest_virqmap from it at build time, main.c still hands the
+ * memory maps to memory_init() for the RAM regions of the guests.
+ */
+
+static struct memmap_desc guest_md_empty[] = {
+    {       0, 0, 0, 0,  0},
+};
+
+/*  label, ipa, pa, size, attr */
+static struct memmap_desc guest_device_md0[] = {
+    { "pl330.0", 0x11C10000, 0x11C10000, SZ_64K, MEMATTR_DM },
+    { "pl330.1", 0x121A0000, 0x121A0000, SZ_64K, MEMATTR_DM },
+    { "pl330.2", 0x121B0000, 0x121B0000, SZ_64K, MEMATTR_DM },
+    { "uart.0", 0x12C00000, 0x12C00000, SZ_64K, MEMATTR_DM },
+    { "uart.1", 0x12C10000, 0x12C10000, SZ_64K, MEMATTR_DM },
+    { "uart.2", 0x12C20000, 0x12C20000, SZ_64K, MEMATTR_DM },
+    { "uart.3", 0x12C30000, 0x12C30000, SZ_64K, MEMATTR_DM },
+    { "chipid", 0x10000000, 0x10000000, SZ_4K, MEMATTR_DM },
+    { "syscon", 0x10050000, 0x10050000, SZ_64K, MEMATTR_DM },
+    { "timer", 0x12DD0000, 0x12DD0000, SZ_16K, MEMATTR_DM },
+    { "wdt", 0x101D0000, 0x101D0000, SZ_4K, MEMATTR_DM },
+    { "sromc", 0x12250000, 0x12250000, SZ_4K, MEMATTR_DM },
+    { "hsphy", 0x12130000, 0x12130000, SZ_4K, MEMATTR_DM },
+    { "systimer", 0x101C0000, 0x101C0000, SZ_4K, MEMATTR_DM },
+    { "sysram", 0x02020000, 0x02020000, SZ_4K, MEMATTR_DM },
+    { "cmu", 0x10010000, 0x10010000, 144 * SZ_1K, MEMATTR_DM },
+    { "pmu", 0x10040000, 0x10040000, SZ_64K, MEMATTR_DM },
+    { "combiner", 0x10440000, 0x10440000, SZ_4K, MEMATTR_DM },
+    { "gpio1", 0x11400000, 0x11400000, SZ_4K, MEMATTR_DM },
+    { "gpio2", 0x13400000, 0x13400000, SZ_4K, MEMATTR_DM },
+    { "gpio3", 0x10D10000, 0x10D10000, SZ_256, MEMATTR_DM },
+    { "gpio4", 0x03860000, 0x03860000, SZ_256, MEMATTR_DM },
+    { "audss", 0x03810000, 0x03810000, SZ_4K, MEMATTR_DM },
+    { "hsphy", 0x12130000, 0x12130000, SZ_4K, MEMATTR_DM },
+    { "ss_phy", 0x12100000, 0x12100000, SZ_4K, MEMATTR_DM },
+    { "sysram_ns", 0x0204F000, 0x0204F000, SZ_4K, MEMATTR_DM },
+    { "ppmu_cpu", 0x10C60000, 0x10C60000, SZ_8K, MEMATTR_DM },
+    { "ppmu_ddr_c", 0x10C40000, 0x10C40000, SZ_8K, MEMATTR_DM },
+    { "ppmu_ddr_r1", 0x10C50000, 0x10C50000, SZ_8K, MEMATTR_DM },
+    { "ppmu_ddr_l", 0x10CB0000, 0x10CB0000, SZ_8K, MEMATTR_DM },
+    { "ppmu_right0_bus", 0x13660000, 0x13660000, SZ_8K, MEMATTR_DM},
+    { "fimc_lite0", 0x13C00000, 0x13C00000, SZ_4K, MEMATTR_DM },
+    { "fimc_lite1", 0x13C10000, 0x13C10000, SZ_4K, MEMATTR_DM },
+    { "fimc_lite2", 0x13C90000, 0x13C90000, SZ_4K, MEMATTR_DM },
+    { "mipi_csis0", 0x13C20000, 0x13C20000, SZ_4K, MEMATTR_DM },
+    { "mipi_csis1", 0x13C30000, 0x13C30000, SZ_4K, MEMATTR_DM },
+    { "gicc", CFG_GIC_BASE_PA | GIC_OFFSET_GICC,
+        CFG_GIC_BASE_PA | GIC_OFFSET_GICVI, 0x2000, MEMATTR_DM },
+    { 0, 0, 0, 0, 0 }
+};
+
+static struct memmap_desc guest_device_md1[] = {
+    { "uart", 0x12C10000, 0x12C20000, 0x1000, MEMATTR_DM },
+    { "pwm_timer", 0x3FD10000, 0x12DD0000, 0x1000, MEMATTR_DM },
+    { "gicc", CFG_GIC_BASE_PA | GIC_OFFSET_GICC,
+        CFG_GIC_BASE_PA | GIC_OFFSET_GICVI, 0x2000, MEMATTR_DM },
+    { 0, 0, 0, 0, 0 }
+};
+
+static struct memmap_desc guest_memory_md0[] = {
+    /* 756MB */
+    {"start", 0x00000000, CFG_MEMMAP_GUEST_OFFSET, 0x30000000,
+     MEMATTR_NORMAL_OWB | MEMATTR_NORMAL_IWB
+    },
+    {0, 0, 0, 0,  0},
+};
+
+static struct memmap_desc guest_memory_md1[] = {
+    /* 256MB */
+    {"start", 0x00000000, CFG_MEMMAP_GUEST2_OFFSET, 0x10000000,
+     MEMATTR_NORMAL_OWB | MEMATTR_NORMAL_IWB
+    },
+    {0, 0, 0, 0,  0},
+};
+
+/* Memory Map for Guest 0 */
+static struct memmap_desc *guest_mdlist0[] = {
+    guest_device_md0,   /* 0x0000_0000 */
+    guest_md_empty,     /* 0x4000_0000 */
+    guest_memory_md0,
+    guest_md_empty,     /* 0xC000_0000 PA:0x40000000*/
+    0
+};
+
+/* Memory Map for Guest 0 */
+static struct memmap_desc *guest_mdlist1[] = {
+    guest_device_md1,
+    guest_md_empty,
+    guest_memory_md1,
+    guest_md_empty,
+    0
+};
+
+/*
+ * Mapping of between pirq and virq: virqmap(vmid, pirq, virq) routes the
+ * pirq to the guest vmid as virq. The UART2 interrupt(85) is left to the
+ * hypervisor console(CFG_UART_CONSOLE_IRQ).
+ */
+#define GUEST_VIRQMAP(virqmap) \
+    virqmap(0, 32, 32)         \
+    virqmap(0, 33, 33)         \
+    virqmap(0, 34, 34)         \
+    virqmap(0, 35, 35)         \
+    virqmap(0, 36, 36)         \
+    virqmap(0, 37, 37)         \
+    virqmap(0, 38, 38)         \
+    virqmap(0, 39, 39)         \
+    virqmap(0, 40, 40)         \
+    virqmap(0, 41, 41)         \
+    virqmap(0, 42, 42)         \
+    virqmap(0, 43, 43)         \
+    virqmap(0, 44, 44)         \
+    virqmap(0, 45, 45)         \
+    virqmap(0, 46, 46)         \
+    virqmap(0, 47, 47)         \
+    virqmap(0, 48, 48)         \
+    virqmap(0, 49, 49)         \
+    virqmap(0, 50, 50)         \
+    virqmap(0, 51, 51)         \
+    virqmap(0, 52, 52)         \
+    virqmap(0, 53, 53)         \
+    virqmap(0, 54, 54)         \
+    virqmap(0, 55, 55)         \
+    virqmap(0, 56, 56)         \
+    virqmap(0, 57, 57)         \
+    virqmap(0, 58, 58)         \
+    virqmap(0, 59, 59)         \
+    virqmap(0, 60, 60)         \
+    virqmap(0, 61, 61)         \
+    virqmap(0, 62, 62)         \
+    virqmap(0, 63, 63)         \
+    virqmap(0, 64, 64)         \
+    virqmap(0, 65, 65)         \
+    virqmap(0, 66, 66)         \
+    virqmap(0, 67, 67)         \
+    virqmap(0, 68, 68)         \
+    virqmap(0, 69, 69)         \
+    virqmap(0, 70, 70)         \
+    virqmap(0, 71, 71)         \
+    virqmap(0, 72, 72)         \
+    virqmap(0, 73, 73)         \
+    virqmap(0, 74, 74)         \
+    virqmap(0, 75, 75)         \
+    virqmap(0, 76, 76)         \
+    virqmap(0, 77, 77)         \
+    virqmap(0, 78, 78)         \
+    virqmap(0, 79, 79)         \
+    virqmap(0, 80, 80)         \
+    virqmap(0, 81, 81)         \
+    virqmap(0, 82, 82)         \
+    virqmap(0, 83, 83)         \
+    virqmap(0, 84, 84)         \
+    virqmap(0, 86, 86)         \
+    virqmap(0, 87, 87)         \
+    virqmap(0, 88, 88)         \
+    virqmap(0, 89, 89)         \
+    virqmap(0, 90, 90)         \
+    virqmap(0, 91, 91)         \
+    virqmap(0, 92, 92)         \
+    virqmap(0, 93, 93)         \
+    virqmap(0, 94, 94)         \
+    virqmap(0, 95, 95)         \
+    virqmap(0, 96, 96)         \
+    virqmap(0, 97, 97)         \
+    virqmap(0, 98, 98)         \
+    virqmap(0, 99, 99)
+
+#endif
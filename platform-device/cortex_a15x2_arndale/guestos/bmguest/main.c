@@ -6,6 +6,10 @@
 #include <drivers/pwm_timer.h>
 
 /* #define TESTS_ENABLE_PWM_TIMER */
+/* #define TESTS_BALLOON */
+#define TESTS_VBENCH
+#define TESTS_TRACE
+#define TESTS_STATS
 
 int main()
 {
@@ -13,6 +17,18 @@ int main()
     uart_print("=== Starting platform main n\r");
 #ifdef TESTS_ENABLE_PWM_TIMER
     hvmm_tests_pwm_timer();
+#endif
+#ifdef TESTS_BALLOON
+    test_balloon();
+#endif
+#ifdef TESTS_VBENCH
+    test_vbench();
+#endif
+#ifdef TESTS_TRACE
+    test_trace();
+#endif
+#ifdef TESTS_STATS
+    test_stats();
 #endif
     while (1)
         ;
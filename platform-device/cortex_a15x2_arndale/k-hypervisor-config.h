@@ -37,6 +37,49 @@
 #define CFG_MEMMAP_MON_OFFSET      0xA0000000
 #define CFG_MEMMAP_GUEST_OFFSET    0x60000000
 #define CFG_MEMMAP_GUEST2_OFFSET   0x90000000
+/*
+ * Guest checkpoint store, split evenly among the guests, and the only guest
+ * allowed to checkpoint and roll back the others. A checkpoint keeps the
+ * first CFG_CHECKPOINT_RAM_SIZE bytes of the guest RAM, at most a slice.
+ * The rest of the RAM is not rolled back.
+ */
+#define CFG_CHECKPOINT_GUEST           0
+#define CFG_MEMMAP_CHECKPOINT_OFFSET   0x50000000
+#define CFG_MEMMAP_CHECKPOINT_SIZE     0x10000000
+#define CFG_CHECKPOINT_RAM_SIZE        0x08000000
+/* Content-based page sharing: pages scanned per scan tick(us) */
+#define CFG_MEMORY_SHARE_SCAN_PAGES    64
+#define CFG_MEMORY_SHARE_SCAN_TICK     10000
+/* Working set sampler: guest pages visited per sample tick(us) */
+#define CFG_MEMORY_WSS_SCAN_PAGES      512
+#define CFG_MEMORY_WSS_SCAN_TICK       10000
+/* Steal time page(struct guest_steal_time), mapped read-only in each guest */
+#define CFG_GUEST_STEAL_TIME_IPA       0x3FFFD000
+/*
+ * Event trace(common/include/trace_buffer.h): buffers of the CPUs mapped
+ * read-only in the control guest from CFG_TRACE_IPA, record pages per CPU
+ */
+#define CFG_TRACE_IPA                  0x3FFE0000
+#define CFG_TRACE_GUEST                0
+#define CFG_TRACE_RECORD_PAGES         8
+/*
+ * Statistics page(common/include/stats_page.h) of each guest, mapped
+ * read-only in the guest
+ */
+#define CFG_STATS_IPA                  0x3FFFC000
+/*
+ * Interrupt storm throttling(interrupt_guest_throttle()): tick(us) of the
+ * token refill and of the coalescing windows
+ */
+#define CFG_INTERRUPT_THROTTLE_TICK    1000
+/* Console: UART2 TX interrupt(SPI 53), transmit ring size, a power of 2 */
+#define CFG_UART_CONSOLE_IRQ           85
+#define CFG_UART_CONSOLE_TX_BUFFER     4096
+/*
+ * Fast boot: the init-time register dumps(boot_log()) are printed after
+ * the boot profile, once the first guest is about to run
+ */
+#define CFG_BOOT_QUIET
 
 #define SZ_1                0x00000001
 #define SZ_2                0x00000002
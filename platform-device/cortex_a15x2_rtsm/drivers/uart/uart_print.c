@@ -1,5 +1,7 @@
 #include "arch_types.h"
 #include <k-hypervisor-config.h>
+#include <interrupt.h>
+#include <log/uart_print.h>
 
 
 #ifdef CFG_GENERIC_CA15
@@ -10,22 +12,104 @@
    " GENERIC_CA15 but board is unknown."
 #endif
 
+/* PL011 registers */
+#define UART_DR         0x000
+#define UART_FR         0x018
+#define UART_IMSC       0x038
+#define UART_ICR        0x044
+#define UART_FR_TXFF    (1 << 5)
+#define UART_INT_TX     (1 << 5)
+
+#define uart_reg(offset)    (*(volatile uint32_t *) (UART0_BASE + (offset)))
+
+/*
+ * Console transmit ring, drained by the TX interrupt once
+ * uart_console_init() ran. The hypervisor runs with IRQs masked, the
+ * interrupt is only taken while a guest runs: the ring is never
+ * accessed concurrently on one CPU.
+ */
+static char _tx_ring[CFG_UART_CONSOLE_TX_BUFFER];
+static uint32_t _tx_head;
+static uint32_t _tx_tail;
+static uint8_t _tx_buffered;
+
+#define UART_TX_RING_MASK   (CFG_UART_CONSOLE_TX_BUFFER - 1)
+
+/* Moves characters from the ring to the FIFO until either is full/empty */
+static void uart_tx_fill(void)
+{
+    while (_tx_tail != _tx_head && !(uart_reg(UART_FR) & UART_FR_TXFF))
+        uart_reg(UART_DR) = _tx_ring[_tx_tail++ & UART_TX_RING_MASK];
+
+    if (_tx_tail == _tx_head)
+        uart_reg(UART_IMSC) &= ~UART_INT_TX;
+    else
+        uart_reg(UART_IMSC) |= UART_INT_TX;
+}
+
+static void uart_tx_handler(int irq, void *regs, void *pdata)
+{
+    uart_reg(UART_ICR) = UART_INT_TX;
+    uart_tx_fill();
+}
+
+void uart_console_flush(void)
+{
+    while (_tx_tail != _tx_head) {
+        while (uart_reg(UART_FR) & UART_FR_TXFF)
+            ;
+        uart_reg(UART_DR) = _tx_ring[_tx_tail++ & UART_TX_RING_MASK];
+    }
+}
+
+void uart_console_sync(void)
+{
+    _tx_buffered = 0;
+    uart_reg(UART_IMSC) &= ~UART_INT_TX;
+    uart_console_flush();
+}
+
+hvmm_status_t uart_console_init(void)
+{
+#ifdef CFG_UART_CONSOLE_IRQ
+    if (interrupt_check_guest_irq(CFG_UART_CONSOLE_IRQ) == GUEST_IRQ)
+        return HVMM_STATUS_BUSY;
+    if (interrupt_request(CFG_UART_CONSOLE_IRQ, &uart_tx_handler))
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+    if (interrupt_host_configure(CFG_UART_CONSOLE_IRQ))
+        return HVMM_STATUS_UNSUPPORTED_FEATURE;
+
+    _tx_buffered = 1;
+    return HVMM_STATUS_SUCCESS;
+#else
+    return HVMM_STATUS_UNSUPPORTED_FEATURE;
+#endif
+}
 
 void uart_print(const char *str)
 {
-    volatile char *pUART = (char *) UART0_BASE;
     while (*str)
-        *pUART = *str++;
+        uart_putc(*str++);
 }
 
 void uart_putc(const char c)
 {
-    /* Wait until there is space in the FIFO */
-    while (*((uint32_t *)(UART0_BASE + 0x18)) & 0x20)
-        ;
-    /* Send the character */
-    volatile char *pUART = (char *) UART0_BASE;
-    *pUART = c;
+    if (!_tx_buffered) {
+        /* Wait until there is space in the FIFO */
+        while (uart_reg(UART_FR) & UART_FR_TXFF)
+            ;
+        uart_reg(UART_DR) = c;
+        return;
+    }
+
+    /* Ring full: makes room at the speed of the line */
+    if (_tx_head - _tx_tail == CFG_UART_CONSOLE_TX_BUFFER) {
+        while (uart_reg(UART_FR) & UART_FR_TXFF)
+            ;
+        uart_reg(UART_DR) = _tx_ring[_tx_tail++ & UART_TX_RING_MASK];
+    }
+    _tx_ring[_tx_head++ & UART_TX_RING_MASK] = c;
+    uart_tx_fill();
 }
 
 void uart_print_hex32(uint32_t v)
@@ -0,0 +1,144 @@
+#ifndef __GUEST_MAP_H__
+#define __GUEST_MAP_H__
+#include <k-hypervisor-config.h>
+#include <memory.h>
+#include <gic_regs.h>
+
+/*
+ * Static configuration of the guests: the memory maps their stage-2
+ * translation tables are built from and the routing of the pirqs.
+ * pgtable_gen(hypervisor/hardware/arm32ve/tools) builds the translation
+ * tables and _guest_virqmap from it at build time, main.c still hands the
+ * memory maps to memory_init() for the RAM regions of the guests.
+ */
+
+/**
+ * \defgroup Guest_memory_map_descriptor
+ *
+ * Descriptor setting order
+ * - label
+ * - Intermediate Physical Address (IPA)
+ * - Physical Address (PA)
+ * - Size of memory region
+ * - Memory Attribute
+ * @{
+ */
+static struct memmap_desc guest_md_empty[] = {
+    {       0, 0, 0, 0,  0},
+};
+/*  label, ipa, pa, size, attr */
+static struct memmap_desc guest_device_md0[] = {
+    { "sysreg", 0x1C010000, 0x1C010000, SZ_4K, MEMATTR_DM },
+    { "sysctl", 0x1C020000, 0x1C020000, SZ_4K, MEMATTR_DM },
+    { "aaci", 0x1C040000, 0x1C040000, SZ_4K, MEMATTR_DM },
+    { "mmci", 0x1C050000, 0x1C050000, SZ_4K, MEMATTR_DM },
+    { "kmi", 0x1C060000, 0x1C060000,  SZ_4K, MEMATTR_DM },
+    { "kmi2", 0x1C070000, 0x1C070000, SZ_4K, MEMATTR_DM },
+    { "v2m_serial0", 0x1C090000, 0x1C0A0000, SZ_4K, MEMATTR_DM },
+    { "v2m_serial1", 0x1C0A0000, 0x1C090000, SZ_4K, MEMATTR_DM },
+    { "v2m_serial2", 0x1C0B0000, 0x1C0B0000, SZ_4K, MEMATTR_DM },
+    { "v2m_serial3", 0x1C0C0000, 0x1C0C0000, SZ_4K, MEMATTR_DM },
+    { "wdt", 0x1C0F0000, 0x1C0F0000, SZ_4K, MEMATTR_DM },
+    { "v2m_timer01(sp804)", 0x1C110000, 0x1C110000, SZ_4K,
+            MEMATTR_DM },
+    { "v2m_timer23", 0x1C120000, 0x1C120000, SZ_4K, MEMATTR_DM },
+    { "rtc", 0x1C170000, 0x1C170000, SZ_4K, MEMATTR_DM },
+    { "clcd", 0x1C1F0000, 0x1C1F0000, SZ_4K, MEMATTR_DM },
+    { "gicc", CFG_GIC_BASE_PA | GIC_OFFSET_GICC,
+            CFG_GIC_BASE_PA | GIC_OFFSET_GICVI, SZ_8K,
+            MEMATTR_DM },
+    { 0, 0, 0, 0, 0 }
+};
+
+static struct memmap_desc guest_device_md1[] = {
+    { "uart", 0x1C090000, 0x1C0B0000, SZ_4K, MEMATTR_DM },
+    { "sp804", 0x1C110000, 0x1C120000, SZ_4K, MEMATTR_DM },
+    { "gicc", 0x2C000000 | GIC_OFFSET_GICC,
+       CFG_GIC_BASE_PA | GIC_OFFSET_GICVI, SZ_8K, MEMATTR_DM },
+    {0, 0, 0, 0, 0}
+};
+
+/**
+ * @brief Memory map for guest 0.
+ */
+static struct memmap_desc guest_memory_md0[] = {
+    /* 756MB */
+    {"start", 0x00000000, CFG_MEMMAP_GUEST_OFFSET, 0x30000000,
+     MEMATTR_NORMAL_OWB | MEMATTR_NORMAL_IWB
+    },
+    {0, 0, 0, 0,  0},
+};
+
+/**
+ * @brief Memory map for guest 1.
+ */
+static struct memmap_desc guest_memory_md1[] = {
+    /* 256MB */
+    {"start", 0x00000000, CFG_MEMMAP_GUEST2_OFFSET, 0x10000000,
+     MEMATTR_NORMAL_OWB | MEMATTR_NORMAL_IWB
+    },
+    {0, 0, 0, 0,  0},
+};
+
+/* Memory Map for Guest 0 */
+static struct memmap_desc *guest_mdlist0[] = {
+    guest_device_md0,   /* 0x0000_0000 */
+    guest_md_empty,     /* 0x4000_0000 */
+    guest_memory_md0,
+    guest_md_empty,     /* 0xC000_0000 PA:0x40000000*/
+    0
+};
+
+/* Memory Map for Guest 1 */
+static struct memmap_desc *guest_mdlist1[] = {
+    guest_device_md1,
+    guest_md_empty,
+    guest_memory_md1,
+    guest_md_empty,
+    0
+};
+
+/** @}*/
+
+/*
+ * Mapping of between pirq and virq: virqmap(vmid, pirq, virq) routes the
+ * pirq to the guest vmid as virq.
+ */
+/*
+ * NOTE(wonseok):
+ * referenced by
+ * https://github.com/kesl/khypervisor/wiki/Hardware-Resources
+ * -of-Guest-Linux-on-FastModels-RTSM_VE-Cortex-A15x1
+ * */
+/*
+ *  vimm-0, pirq-69, virq-69 = pwm timer driver
+ *  vimm-0, pirq-32, virq-32 = WDT: shared driver
+ *  vimm-0, pirq-34, virq-34 = SP804: shared driver
+ *  vimm-0, pirq-35, virq-35 = SP804: shared driver
+ *  vimm-0, pirq-36, virq-36 = RTC: shared driver
+ *  vimm-0, pirq-38, virq-37 = UART: dedicated driver IRQ 37 for guest 0
+ *  vimm-1, pirq-39, virq-37 = UART: dedicated driver IRQ 37 for guest 1
+ *  vimm-0, pirq-43, virq-43 = ACCI: shared driver
+ *  vimm-0, pirq-44, virq-44 = KMI: shared driver
+ *  vimm-0, pirq-45, virq-45 = KMI: shared driver
+ */
+#define GUEST_VIRQMAP(virqmap) \
+    virqmap(0, 1, 1)           \
+    virqmap(0, 31, 31)         \
+    virqmap(0, 33, 33)         \
+    virqmap(0, 16, 16)         \
+    virqmap(0, 17, 17)         \
+    virqmap(0, 18, 18)         \
+    virqmap(0, 19, 19)         \
+    virqmap(0, 69, 69)         \
+    virqmap(0, 32, 32)         \
+    virqmap(0, 34, 34)         \
+    virqmap(0, 35, 35)         \
+    virqmap(0, 36, 36)         \
+    virqmap(0, 38, 37)         \
+    virqmap(1, 39, 37)         \
+    virqmap(0, 43, 43)         \
+    virqmap(0, 44, 44)         \
+    virqmap(0, 45, 45)
+
+#endif
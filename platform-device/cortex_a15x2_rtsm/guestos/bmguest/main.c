@@ -13,6 +13,10 @@
 #define TESTS_TRAP_SCTLR
 #define TESTS_TRAP_DDCISW
 #define TESTS_TRAP_ACTLR
+/* #define TESTS_BALLOON */
+#define TESTS_VBENCH
+#define TESTS_TRACE
+#define TESTS_STATS
 
 int main()
 {
@@ -42,6 +46,18 @@ int main()
     WRITE_ACTLR(val);
     READ_ACTLR(val);
 #endif
+#ifdef TESTS_BALLOON
+    test_balloon();
+#endif
+#ifdef TESTS_VBENCH
+    test_vbench();
+#endif
+#ifdef TESTS_TRACE
+    test_trace();
+#endif
+#ifdef TESTS_STATS
+    test_stats();
+#endif
 
     while (1)
         ;
@@ -3,10 +3,15 @@
 #include <interrupt.h>
 #include <timer.h>
 #include <vdev.h>
+#include <trace.h>
+#include <stats.h>
 #include <memory.h>
 #include <gic_regs.h>
 #include <test/tests.h>
 #include <smp.h>
+#include <percpu.h>
+#include <boot_profile.h>
+#include "guest_map.h"
 
 #define DEBUG
 #include "hvmm_trace.h"
@@ -15,171 +20,11 @@
 
 #define PLATFORM_BASIC_TESTS 0
 
-#define DECLARE_VIRQMAP(name, id, _pirq, _virq) \
-    do {                                        \
-        name[id].map[_pirq].virq = _virq;       \
-        name[id].map[_virq].pirq = _pirq;       \
-    } while (0)
-
-
-static struct guest_virqmap _guest_virqmap[NUM_GUESTS_STATIC];
-
-/**
- * \defgroup Guest_memory_map_descriptor
- *
- * Descriptor setting order
- * - label
- * - Intermediate Physical Address (IPA)
- * - Physical Address (PA)
- * - Size of memory region
- * - Memory Attribute
- * @{
- */
-static struct memmap_desc guest_md_empty[] = {
-    {       0, 0, 0, 0,  0},
-};
-/*  label, ipa, pa, size, attr */
-static struct memmap_desc guest_device_md0[] = {
-    { "sysreg", 0x1C010000, 0x1C010000, SZ_4K, MEMATTR_DM },
-    { "sysctl", 0x1C020000, 0x1C020000, SZ_4K, MEMATTR_DM },
-    { "aaci", 0x1C040000, 0x1C040000, SZ_4K, MEMATTR_DM },
-    { "mmci", 0x1C050000, 0x1C050000, SZ_4K, MEMATTR_DM },
-    { "kmi", 0x1C060000, 0x1C060000,  SZ_4K, MEMATTR_DM },
-    { "kmi2", 0x1C070000, 0x1C070000, SZ_4K, MEMATTR_DM },
-    { "v2m_serial0", 0x1C090000, 0x1C0A0000, SZ_4K, MEMATTR_DM },
-    { "v2m_serial1", 0x1C0A0000, 0x1C090000, SZ_4K, MEMATTR_DM },
-    { "v2m_serial2", 0x1C0B0000, 0x1C0B0000, SZ_4K, MEMATTR_DM },
-    { "v2m_serial3", 0x1C0C0000, 0x1C0C0000, SZ_4K, MEMATTR_DM },
-    { "wdt", 0x1C0F0000, 0x1C0F0000, SZ_4K, MEMATTR_DM },
-    { "v2m_timer01(sp804)", 0x1C110000, 0x1C110000, SZ_4K,
-            MEMATTR_DM },
-    { "v2m_timer23", 0x1C120000, 0x1C120000, SZ_4K, MEMATTR_DM },
-    { "rtc", 0x1C170000, 0x1C170000, SZ_4K, MEMATTR_DM },
-    { "clcd", 0x1C1F0000, 0x1C1F0000, SZ_4K, MEMATTR_DM },
-    { "gicc", CFG_GIC_BASE_PA | GIC_OFFSET_GICC,
-            CFG_GIC_BASE_PA | GIC_OFFSET_GICVI, SZ_8K,
-            MEMATTR_DM },
-    { 0, 0, 0, 0, 0 }
-};
-
-static struct memmap_desc guest_device_md1[] = {
-    { "uart", 0x1C090000, 0x1C0B0000, SZ_4K, MEMATTR_DM },
-    { "sp804", 0x1C110000, 0x1C120000, SZ_4K, MEMATTR_DM },
-    { "gicc", 0x2C000000 | GIC_OFFSET_GICC,
-       CFG_GIC_BASE_PA | GIC_OFFSET_GICVI, SZ_8K, MEMATTR_DM },
-    {0, 0, 0, 0, 0}
-};
-
-/**
- * @brief Memory map for guest 0.
- */
-static struct memmap_desc guest_memory_md0[] = {
-    /* 756MB */
-    {"start", 0x00000000, 0, 0x30000000,
-     MEMATTR_NORMAL_OWB | MEMATTR_NORMAL_IWB
-    },
-    {0, 0, 0, 0,  0},
-};
-
-/**
- * @brief Memory map for guest 1.
- */
-static struct memmap_desc guest_memory_md1[] = {
-    /* 256MB */
-    {"start", 0x00000000, 0, 0x10000000,
-     MEMATTR_NORMAL_OWB | MEMATTR_NORMAL_IWB
-    },
-    {0, 0, 0, 0,  0},
-};
-
-/* Memory Map for Guest 0 */
-static struct memmap_desc *guest_mdlist0[] = {
-    guest_device_md0,   /* 0x0000_0000 */
-    guest_md_empty,     /* 0x4000_0000 */
-    guest_memory_md0,
-    guest_md_empty,     /* 0xC000_0000 PA:0x40000000*/
-    0
-};
-
-/* Memory Map for Guest 1 */
-static struct memmap_desc *guest_mdlist1[] = {
-    guest_device_md1,
-    guest_md_empty,
-    guest_memory_md1,
-    guest_md_empty,
-    0
-};
-
-/** @}*/
+/* Generated from GUEST_VIRQMAP by pgtable_gen, guest_virqmap.c */
+extern struct guest_virqmap _guest_virqmap[NUM_GUESTS_STATIC];
 
 static uint32_t _timer_irq;
 
-/*
- * Creates a mapping table between PIRQ and VIRQ.vmid/pirq/coreid.
- * Mapping of between pirq and virq is hard-coded.
- */
-void setup_interrupt()
-{
-    int i, j;
-    struct virqmap_entry *map;
-
-    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
-        map = _guest_virqmap[i].map;
-        for (j = 0; j < MAX_IRQS; j++) {
-            map[j].enabled = GUEST_IRQ_DISABLE;
-            map[j].virq = VIRQ_INVALID;
-            map[j].pirq = PIRQ_INVALID;
-        }
-    }
-
-    /*
-     * NOTE(wonseok):
-     * referenced by
-     * https://github.com/kesl/khypervisor/wiki/Hardware-Resources
-     * -of-Guest-Linux-on-FastModels-RTSM_VE-Cortex-A15x1
-     * */
-    /*
-     *  vimm-0, pirq-69, virq-69 = pwm timer driver
-     *  vimm-0, pirq-32, virq-32 = WDT: shared driver
-     *  vimm-0, pirq-34, virq-34 = SP804: shared driver
-     *  vimm-0, pirq-35, virq-35 = SP804: shared driver
-     *  vimm-0, pirq-36, virq-36 = RTC: shared driver
-     *  vimm-0, pirq-38, virq-37 = UART: dedicated driver IRQ 37 for guest 0
-     *  vimm-1, pirq-39, virq-37 = UART: dedicated driver IRQ 37 for guest 1
-     *  vimm-0, pirq-43, virq-43 = ACCI: shared driver
-     *  vimm-0, pirq-44, virq-44 = KMI: shared driver
-     *  vimm-0, pirq-45, virq-45 = KMI: shared driver
-     */
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 1, 1);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 31, 31);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 33, 33);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 16, 16);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 17, 17);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 18, 18);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 19, 19);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 69, 69);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 32, 32);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 34, 34);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 35, 35);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 36, 36);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 38, 37);
-    DECLARE_VIRQMAP(_guest_virqmap, 1, 39, 37);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 43, 43);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 44, 44);
-    DECLARE_VIRQMAP(_guest_virqmap, 0, 45, 45);
-}
-
-void setup_memory()
-{
-    /*
-     * VA: 0x00000000 ~ 0x3FFFFFFF,   1GB
-     * PA: 0xA0000000 ~ 0xDFFFFFFF    guest_bin_start
-     * PA: 0xB0000000 ~ 0xEFFFFFFF    guest2_bin_start
-     */
-    guest_memory_md0[0].pa = (uint64_t)((uint32_t) &_guest_bin_start);
-    guest_memory_md1[0].pa = (uint64_t)((uint32_t) &_guest2_bin_start);
-}
-
 /** @brief Registers generic timer irqs such as hypervisor timer event
  *  (GENERIC_TIMER_HYP), non-secure physical timer event(GENERIC_TIMER_NSP)
  *  and virtual timer event(GENERIC_TIMER_NSP).
@@ -198,42 +43,109 @@ void setup_timer()
     _timer_irq = 26; /* GENERIC_TIMER_HYP */
 }
 
+/*
+ * Interrupt storm policies of the passthrough devices: the UART of each
+ * guest(virq 37) may raise a burst of 32 interrupts, then 8 per tick.
+ */
+static const struct interrupt_throttle_policy _uart_throttle = {
+    .rate = 8,
+    .burst = 32,
+    .window = 0,
+};
+
+void setup_throttle()
+{
+    int i;
+
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        if (interrupt_guest_throttle(i, 37, &_uart_throttle))
+            printh("[start_guest] guest %d UART is not throttled...\n", i);
+    }
+}
+
 int main_cpu_init()
 {
+    /* Before anything touches a per-CPU variable */
+    boot_phase("percpu");
+    percpu_init();
+    percpu_cpu_init(smp_processor_id());
     init_print();
     printH("[%s : %d] Starting...Main CPU : #%d\n", __func__, __LINE__);
 
     /* Initialize Memory Management */
-    setup_memory();
+    boot_phase("memory");
     if (memory_init(guest_mdlist0, guest_mdlist1))
         printh("[start_guest] virtual memory initialization failed...\n");
 
-    /* Initialize PIRQ to VIRQ mapping */
-    setup_interrupt();
     /* Initialize Interrupt Management */
+    boot_phase("interrupt");
     if (interrupt_init(_guest_virqmap))
         printh("[start_guest] interrupt initialization failed...\n");
 
+    /* Console output drained by the UART TX interrupt from here */
+    boot_phase("console");
+    if (uart_console_init())
+        printh("[start_guest] console stays synchronous...\n");
+
     /* Initialize Timer */
+    boot_phase("timer");
     setup_timer();
     if (timer_init(_timer_irq))
         printh("[start_guest] timer initialization failed...\n");
 
     /* Initialize Guests */
+    boot_phase("guest");
     if (guest_init())
         printh("[start_guest] guest initialization failed...\n");
 
     /* Initialize Virtual Devices */
+    boot_phase("vdev");
     if (vdev_init())
         printh("[start_guest] virtual device initialization failed...\n");
 
+    /* Map the event trace buffers in the control guest */
+    boot_phase("trace");
+    if (trace_init())
+        printh("[start_guest] event trace initialization failed...\n");
+
+    /* Map the statistics page in each guest */
+    boot_phase("stats");
+    if (stats_init())
+        printh("[start_guest] statistics pages are not mapped...\n");
+
+    /* Start merging identical guest pages in the background */
+    boot_phase("memory share");
+    if (memory_share_init())
+        printh("[start_guest] page sharing is not running...\n");
+
+    /* Start estimating the working sets of the guests */
+    boot_phase("memory wss");
+    if (memory_wss_init())
+        printh("[start_guest] working set sampler is not running...\n");
+
+    /* Bound the interrupt rate of the passthrough devices */
+    boot_phase("irq throttle");
+    if (interrupt_throttle_init())
+        printh("[start_guest] interrupt throttling is not running...\n");
+    else
+        setup_throttle();
+
     /* Begin running test code for newly implemented features */
+    boot_phase("tests");
     if (basic_tests_run(PLATFORM_BASIC_TESTS))
         printh("[start_guest] basic testing failed...\n");
 
     /* Print Banner */
+    boot_phase("banner");
     printH("%s", BANNER_STRING);
 
+    /* Time of each phase, then the deferred register dumps */
+    boot_profile_print();
+
+    /* Nothing runs the init-only code past this point */
+    if (memory_free_init())
+        printh("[start_guest] init memory is kept...\n");
+
     /* Switch to the first guest */
     guest_sched_start();
 
@@ -248,20 +160,17 @@ void secondary_cpu_init(uint32_t cpu)
     if (cpu >= CFG_NUMBER_OF_CPUS)
         hyp_abort_infinite();
 
+    percpu_cpu_init(cpu);
     init_print();
     printH("[%s : %d] Starting...CPU : #%d\n", __func__, __LINE__, cpu);
 
     hyp_abort_infinite();
 
-    /* Initialize Memory Management */
-    setup_memory();
-    if (memory_init(guest_mdlist0, guest_mdlist1))
+    /* The boot CPU set the tables and the distributor up, banked state */
+    if (memory_init_cpu())
         printh("[start_guest] virtual memory initialization failed...\n");
 
-    /* Initialize PIRQ to VIRQ mapping */
-    setup_interrupt();
-    /* Initialize Interrupt Management */
-    if (interrupt_init(_guest_virqmap))
+    if (interrupt_init_cpu())
         printh("[start_guest] interrupt initialization failed...\n");
 
     /* Initialize Timer */
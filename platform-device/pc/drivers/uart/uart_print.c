@@ -0,0 +1,55 @@
+#include "arch_types.h"
+#include <k-hypervisor-config.h>
+#include <host.h>
+#include <log/uart_print.h>
+
+/*
+ * The console of the simulated board is the standard output of the host,
+ * it has no transmit interrupt: it is always synchronous.
+ */
+
+hvmm_status_t uart_console_init(void)
+{
+    return HVMM_STATUS_UNSUPPORTED_FEATURE;
+}
+
+void uart_console_flush(void)
+{
+}
+
+void uart_console_sync(void)
+{
+}
+
+void uart_print(const char *str)
+{
+    while (*str)
+        host_putc(*str++);
+}
+
+void uart_putc(const char c)
+{
+    host_putc(c);
+}
+
+void uart_print_hex32(uint32_t v)
+{
+    unsigned int mask8 = 0xF;
+    unsigned int c;
+    int i;
+    uart_print("0x");
+    for (i = 7; i >= 0; i--) {
+        c = ((v >> (i * 4)) & mask8);
+        if (c < 10)
+            c += '0';
+        else
+            c += 'A' - 10;
+        uart_putc((char) c);
+    }
+}
+
+void uart_print_hex64(uint64_t v)
+{
+    uart_print_hex32(v >> 32);
+    uart_print_hex32((uint32_t)(v & 0xFFFFFFFF));
+}
@@ -1,4 +1,78 @@
 #ifndef KHYPERVISOR_CONFIG_H
 #define KHYPERVISOR_CONFIG_H
 
+/*
+ *  BOARD param: simulated board(hypervisor/hardware/pc)
+ */
+#define CFG_BOARD_PC_SIM
+#define CFG_CNTFRQ          100000000
+
+#define CFG_NUMBER_OF_CPUS  1
+
+/*
+ *  SOC param
+ */
+#define CFG_GIC_BASE_PA   0x2c000000
+
+#define USEC 1000000
+#define NUM_GUESTS_STATIC       2
+#define COUNT_PER_USEC (CFG_CNTFRQ/USEC)
+#define GUEST_SCHED_TICK 1000
+#define MAX_IRQS 1024
+/* Steal time page(struct guest_steal_time), mapped read-only in each guest */
+#define CFG_GUEST_STEAL_TIME_IPA       0x3FFFD000
+/*
+ * Event trace(common/include/trace_buffer.h): buffers of the CPUs mapped
+ * read-only in the control guest from CFG_TRACE_IPA, record pages per CPU
+ */
+#define CFG_TRACE_IPA                  0x3FFE0000
+#define CFG_TRACE_GUEST                0
+#define CFG_TRACE_RECORD_PAGES         8
+/*
+ * Statistics page(common/include/stats_page.h) of each guest, mapped
+ * read-only in the guest
+ */
+#define CFG_STATS_IPA                  0x3FFFC000
+/*
+ * Interrupt storm throttling(interrupt_guest_throttle()): tick(us) of the
+ * token refill and of the coalescing windows
+ */
+#define CFG_INTERRUPT_THROTTLE_TICK    1000
+
+#define SZ_1                0x00000001
+#define SZ_2                0x00000002
+#define SZ_4                0x00000004
+#define SZ_8                0x00000008
+#define SZ_16               0x00000010
+#define SZ_32               0x00000020
+#define SZ_64               0x00000040
+#define SZ_128              0x00000080
+#define SZ_256              0x00000100
+#define SZ_512              0x00000200
+
+#define SZ_1K               0x00000400
+#define SZ_2K               0x00000800
+#define SZ_4K               0x00001000
+#define SZ_8K               0x00002000
+#define SZ_16K              0x00004000
+#define SZ_32K              0x00008000
+#define SZ_64K              0x00010000
+#define SZ_128K             0x00020000
+#define SZ_256K             0x00040000
+#define SZ_512K             0x00080000
+
+#define SZ_1M               0x00100000
+#define SZ_2M               0x00200000
+#define SZ_4M               0x00400000
+#define SZ_8M               0x00800000
+#define SZ_16M              0x01000000
+#define SZ_32M              0x02000000
+#define SZ_64M              0x04000000
+#define SZ_128M             0x08000000
+#define SZ_256M             0x10000000
+#define SZ_512M             0x20000000
+
+#define SZ_1G               0x40000000
+#define SZ_2G               0x80000000
+
 #endif  /* KHYPERVISOR_CONFIG_H */
@@ -1,10 +1,532 @@
-#include "timer.h"
+#include <k-hypervisor-config.h>
+#include <guest.h>
+#include <interrupt.h>
+#include <timer.h>
+#include <vdev.h>
+#include <trace.h>
+#include <stats.h>
+#include <memory.h>
+#include <boot_profile.h>
+#include <gic_regs.h>
+#include <trap.h>
+#include <sim.h>
+#include <host.h>
+#include "sync_stress.h"
 
-int main(void)
+#define DEBUG
+#include "hvmm_trace.h"
+#include <log/uart_print.h>
+
+/*
+ * Simulated board: the hypervisor runs two synthetic guests on the
+ * discrete-event simulator of hypervisor/hardware/pc.
+ *
+ * Usage: pc [-t ms] [-s seed] [-v] [-d us] [-b count]
+ *  -t  Simulated time to run, in milliseconds(default 100)
+ *  -s  Seed of the guest workloads(default 1)
+ *  -v  Keeps the hypervisor console on while the guests run
+ *  -d  Period of the device of guest 0 in microseconds(default 500), an
+ *      interrupt storm below the rate its throttling policy allows
+ *  -b  Times count emulated accesses per virtual GIC distributor register
+ *      instead of running the guests
+ */
+
+#define DECLARE_VIRQMAP(name, id, _pirq, _virq) \
+    do {                                        \
+        name[id].map[_pirq].virq = _virq;       \
+        name[id].map[_virq].pirq = _pirq;       \
+    } while (0)
+
+#define SIM_DEFAULT_MSEC    100
+#define BENCH_ROUNDS        5
+
+static struct guest_virqmap _guest_virqmap[NUM_GUESTS_STATIC];
+
+/**
+ * \defgroup Guest_memory_map_descriptor
+ *
+ * Descriptor setting order
+ * - label
+ * - Intermediate Physical Address (IPA)
+ * - Physical Address (PA)
+ * - Size of memory region
+ * - Memory Attribute
+ * @{
+ */
+static struct memmap_desc guest_md_empty[] = {
+    {       0, 0, 0, 0,  0},
+};
+/*  label, ipa, pa, size, attr */
+static struct memmap_desc guest_device_md0[] = {
+    { "uart", 0x1C090000, 0x1C0A0000, SZ_4K, MEMATTR_DM },
+    { "gicc", CFG_GIC_BASE_PA | GIC_OFFSET_GICC,
+            CFG_GIC_BASE_PA | GIC_OFFSET_GICVI, SZ_8K,
+            MEMATTR_DM },
+    { 0, 0, 0, 0, 0 }
+};
+
+static struct memmap_desc guest_device_md1[] = {
+    { "uart", 0x1C090000, 0x1C0B0000, SZ_4K, MEMATTR_DM },
+    { "gicc", CFG_GIC_BASE_PA | GIC_OFFSET_GICC,
+            CFG_GIC_BASE_PA | GIC_OFFSET_GICVI, SZ_8K,
+            MEMATTR_DM },
+    {0, 0, 0, 0, 0}
+};
+
+/**
+ * @brief Memory map for guest 0.
+ */
+static struct memmap_desc guest_memory_md0[] = {
+    /* 256MB */
+    {"start", 0x00000000, 0xA0000000, 0x10000000,
+     MEMATTR_NORMAL_OWB | MEMATTR_NORMAL_IWB
+    },
+    {0, 0, 0, 0,  0},
+};
+
+/**
+ * @brief Memory map for guest 1.
+ */
+static struct memmap_desc guest_memory_md1[] = {
+    /* 256MB */
+    {"start", 0x00000000, 0xB0000000, 0x10000000,
+     MEMATTR_NORMAL_OWB | MEMATTR_NORMAL_IWB
+    },
+    {0, 0, 0, 0,  0},
+};
+
+/* Memory Map for Guest 0 */
+static struct memmap_desc *guest_mdlist0[] = {
+    guest_device_md0,   /* 0x0000_0000 */
+    guest_md_empty,     /* 0x4000_0000 */
+    guest_memory_md0,   /* 0x8000_0000 */
+    guest_md_empty,     /* 0xC000_0000 */
+    0
+};
+
+/* Memory Map for Guest 1 */
+static struct memmap_desc *guest_mdlist1[] = {
+    guest_device_md1,
+    guest_md_empty,
+    guest_memory_md1,
+    guest_md_empty,
+    0
+};
+
+/** @}*/
+
+/**
+ * @brief Workloads of the guests.
+ *
+ * Guest 0 is interrupt driven: its device raises pirq 38(virq 37) every
+ * 500us. Guest 1 is a compute bound guest that accesses emulated devices
+ * and yields now and then.
+ */
+static struct sim_workload _workloads[NUM_GUESTS_STATIC] = {
+    {
+        .name = "io",
+        .compute = 20 * COUNT_PER_USEC,
+        .weight_ram = 60,
+        .weight_gicd = 10,
+        .weight_vdev = 20,
+        .weight_ping = 10,
+        .weight_yield = 0,
+        .irq_service = 5 * COUNT_PER_USEC,
+        .virqs = { 37 },
+        .device_pirq = 38,
+        .device_period = 500 * COUNT_PER_USEC,
+    },
+    {
+        .name = "compute",
+        .compute = 50 * COUNT_PER_USEC,
+        .weight_ram = 80,
+        .weight_gicd = 5,
+        .weight_vdev = 10,
+        .weight_ping = 4,
+        .weight_yield = 1,
+        .irq_service = 5 * COUNT_PER_USEC,
+    },
+};
+
+/* Cost of the hypervisor entries on a Cortex-A15 at 100MHz counter */
+static struct sim_cost _cost = {
+    .trap = 1 * COUNT_PER_USEC,
+    .irq = 2 * COUNT_PER_USEC,
+    .switch_guest = 5 * COUNT_PER_USEC,
+};
+
+/*
+ * Interrupt storm policy of the device of guest 0: a burst of 8 interrupts,
+ * then 4 per tick(CFG_INTERRUPT_THROTTLE_TICK).
+ */
+static const struct interrupt_throttle_policy _device_throttle = {
+    .rate = 4,
+    .burst = 8,
+    .window = 0,
+};
+
+static uint32_t _timer_irq;
+
+/**
+ * @brief Accesses of the virtual GIC distributor benchmark.
+ *
+ * An access with offset2 alternates between the two registers, the
+ * enable pair changes the state of virq 37 and runs its side effects.
+ */
+struct bench_access {
+    const char *name;
+    uint32_t offset;
+    uint32_t offset2;
+    uint32_t write;
+    enum vdev_access_size sas;
+    uint32_t value;
+};
+
+static struct bench_access _bench_accesses[] = {
+    { "typer", 0x004, 0, 0, VDEV_ACCESS_WORD, 0 },
+    { "isenabler", 0x104, 0, 1, VDEV_ACCESS_WORD, 1 << (37 % 32) },
+    { "isenabler-icenabler", 0x104, 0x184, 1, VDEV_ACCESS_WORD,
+        1 << (37 % 32) },
+    { "ipriorityr-byte", 0x425, 0, 1, VDEV_ACCESS_BYTE, 0xA0 },
+    { "itargetsr-byte", 0x825, 0, 0, VDEV_ACCESS_BYTE, 0 },
+    { "icfgr", 0xC08, 0, 0, VDEV_ACCESS_WORD, 0 },
+    { "ispendr-hword", 0x206, 0, 0, VDEV_ACCESS_HWORD, 0 },
+    { "pidr2", 0xFE8, 0, 0, VDEV_ACCESS_WORD, 0 },
+};
+
+/*
+ * Creates a mapping table between PIRQ and VIRQ.vmid/pirq/coreid.
+ * Mapping of between pirq and virq is hard-coded.
+ */
+void setup_interrupt()
+{
+    int i, j;
+    struct virqmap_entry *map;
+
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        map = _guest_virqmap[i].map;
+        for (j = 0; j < MAX_IRQS; j++) {
+            map[j].enabled = GUEST_IRQ_DISABLE;
+            map[j].virq = VIRQ_INVALID;
+            map[j].pirq = PIRQ_INVALID;
+        }
+    }
+
+    /*
+     *  vimm-0, pirq-38, virq-37 = UART: dedicated driver IRQ 37 for guest 0
+     *  vimm-1, pirq-39, virq-37 = UART: dedicated driver IRQ 37 for guest 1
+     */
+    DECLARE_VIRQMAP(_guest_virqmap, 0, 38, 37);
+    DECLARE_VIRQMAP(_guest_virqmap, 1, 39, 37);
+}
+
+void setup_timer()
+{
+    _timer_irq = 26; /* GENERIC_TIMER_HYP */
+}
+
+static void print_usec(const char *name, uint64_t ticks)
+{
+    printH("%s%dus", name, (uint32_t) (ticks / COUNT_PER_USEC));
+}
+
+static void print_report(uint64_t until, uint64_t host_ns)
+{
+    struct sim_stats stats;
+    struct sim_guest_stats gstats;
+    struct guest_time_stats time;
+    struct interrupt_route_stats route;
+    struct interrupt_throttle_stats throttle;
+    int i;
+
+    sim_get_stats(&stats);
+    printH("[sim] simulated %dms in %dms of host time, %d events\n",
+            (uint32_t) (until / (1000 * COUNT_PER_USEC)),
+            (uint32_t) (host_ns / 1000000), (uint32_t) stats.events);
+    printH("[sim] traps:%d irqs:%d switches:%d\n", (uint32_t) stats.traps,
+            (uint32_t) stats.irqs, (uint32_t) stats.switches);
+    if (stats.traps)
+        printH("[sim] host ns/trap:%d\n",
+                (uint32_t) (stats.host_ns_trap / stats.traps));
+    if (stats.irqs)
+        printH("[sim] host ns/irq:%d\n",
+                (uint32_t) (stats.host_ns_irq / stats.irqs));
+
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        sim_guest_get_stats(i, &gstats);
+        printH("[sim] guest%d(%s): ops:%d ram:%d mmio:%d hvc:%d virqs:%d",
+                i, _workloads[i].name, (uint32_t) gstats.ops,
+                (uint32_t) gstats.ram_accesses,
+                (uint32_t) gstats.mmio_accesses, (uint32_t) gstats.hvcs,
+                (uint32_t) gstats.virqs);
+        print_usec(" run:", gstats.run_ticks);
+        if (gstats.virqs) {
+            print_usec(" latency avg:", gstats.latency_sum / gstats.virqs);
+            print_usec(" max:", gstats.latency_max);
+        }
+        printH("\n");
+        if (guest_time_stats(i, &time))
+            continue;
+        printH("[sim] guest%d time: switches:%d", i, time.switches);
+        print_usec(" run:", time.run);
+        print_usec(" hyp:", time.hyp);
+        print_usec(" wait:", time.wait);
+        printH("\n");
+        if (interrupt_guest_route_stats(i, &route))
+            continue;
+        printH("[sim] guest%d irqs: local:%d remote:%d retargets:%d\n", i,
+                route.local, route.remote, route.retargets);
+        if (interrupt_guest_throttle_stats(i, 37, &throttle))
+            continue;
+        printH("[sim] guest%d throttle: injected:%d dropped:%d deferred:%d "
+                "merged:%d\n", i, throttle.injected, throttle.dropped,
+                throttle.deferred, throttle.merged);
+    }
+}
+
+#ifdef CFG_TRACE_IPA
+/* Reads the trace as the control guest sees it, at CFG_TRACE_IPA */
+static void print_trace(void)
 {
-    start_timer();
+    static const char *names[TRACE_EVENT_MAX] = {
+        0, "switch", "trap", "inject", "flush", "eoi", "timer", "vdev"
+    };
+    volatile struct trace_header *header;
+    struct trace_record record;
+    uint32_t count[TRACE_EVENT_MAX] = { 0, };
+    uint32_t seq, head;
+    int i;
+
+    header = (volatile struct trace_header *)
+        sim_memory_shadow(CFG_TRACE_GUEST, CFG_TRACE_IPA);
+    if (!header || header->magic != TRACE_MAGIC) {
+        printH("[sim] trace: no buffer at %x\n", CFG_TRACE_IPA);
+        return;
+    }
+
+    head = header->head;
+    seq = head > header->capacity ? head - header->capacity : 0;
+    printH("[sim] trace cpu%d: records:%d, the last %d:", header->cpu, head,
+            head - seq);
+    for (; seq != head; seq++) {
+        if (trace_buffer_read(header, seq, &record))
+            continue;
+        if (record.event < TRACE_EVENT_MAX)
+            count[record.event]++;
+    }
+    for (i = 1; i < TRACE_EVENT_MAX; i++)
+        printH(" %s:%d", names[i], count[i]);
+    printH("\n");
+}
+#endif
+
+#ifdef CFG_STATS_IPA
+/* Reads the statistics page of each guest as the guest sees it */
+static void print_stats(void)
+{
+    volatile struct stats_page *page;
+    struct stats_page copy;
+    int i, ec;
+
+    for (i = 0; i < NUM_GUESTS_STATIC; i++) {
+        page = (volatile struct stats_page *)
+            sim_memory_shadow(i, CFG_STATS_IPA);
+        if (!page || page->magic != STATS_MAGIC) {
+            printH("[sim] stats: no page at %x in guest%d\n", CFG_STATS_IPA,
+                    i);
+            continue;
+        }
+        while (stats_page_read(page, &copy))
+            ;
+        printH("[sim] guest%d stats: switches:%d virqs:%d", i,
+                copy.guest.switches, copy.guest.virqs);
+        print_usec(" run:", copy.guest.run);
+        print_usec(" hyp:", copy.guest.hyp);
+        print_usec(" wait:", copy.guest.wait);
+        printH(" traps");
+        for (ec = 0; ec < STATS_NUM_EC; ec++) {
+            if (copy.guest.traps[ec])
+                printH(" ec%x:%d", ec, copy.guest.traps[ec]);
+        }
+        printH("\n");
+    }
+    printH("[sim] stats: timer expiries:%d traps:%d virqs:%d\n",
+            copy.global.timer_expiries, copy.global.traps, copy.global.virqs);
+}
+#endif
+
+/* Same path as a trapped data abort of the guest: find, read or write */
+static int32_t bench_vgicd_access(struct bench_access *access, uint32_t offset,
+                struct arch_regs *regs)
+{
+    struct arch_vdev_trigger_info info;
+    uint32_t value = access->value;
+    int32_t num;
+
+    info.fipa = (CFG_GIC_BASE_PA | GIC_OFFSET_GICD) + offset;
+    info.iss = access->write ? ISS_WNR : 0;
+    info.sas = access->sas;
+    info.value = &value;
+    num = vdev_find(VDEV_LEVEL_LOW, &info, regs);
+    if (num < 0)
+        return num;
+    if (access->write)
+        return vdev_write(VDEV_LEVEL_LOW, num, &info, regs);
+    return vdev_read(VDEV_LEVEL_LOW, num, &info, regs);
+}
+
+static void bench_vgicd(uint32_t count)
+{
+    struct arch_regs regs = { 0, };
+    struct bench_access *access;
+    unsigned long long ns, cycles, best_ns, best_cycles;
+    uint32_t i, j, round;
+
+    for (i = 0; i < sizeof(_bench_accesses) / sizeof(_bench_accesses[0]);
+            i++) {
+        access = &_bench_accesses[i];
+        best_ns = best_cycles = ~0ULL;
+        /* The best of a few rounds, the host is not quiet */
+        for (round = 0; round < BENCH_ROUNDS; round++) {
+            host_console_enable(0);
+            ns = host_time_ns();
+            cycles = host_cycles();
+            for (j = 0; j < count; j++) {
+                if (bench_vgicd_access(access, (access->offset2 && (j & 1)) ?
+                            access->offset2 : access->offset, &regs) < 0) {
+                    host_console_enable(1);
+                    printH("[bench] vgicd %s: access failed\n",
+                            access->name);
+                    return;
+                }
+            }
+            cycles = host_cycles() - cycles;
+            ns = host_time_ns() - ns;
+            host_console_enable(1);
+            if (cycles < best_cycles)
+                best_cycles = cycles;
+            if (ns < best_ns)
+                best_ns = ns;
+        }
+        printH("[bench] vgicd %s: %d cycles/access, %d ns/access\n",
+                access->name, (uint32_t) (best_cycles / count),
+                (uint32_t) (best_ns / count));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t until = SIM_DEFAULT_MSEC;
+    uint32_t seed = 1;
+    int verbose = 0;
+    uint32_t bench = 0;
+    uint32_t stress = 0;
+    unsigned long long start;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 't' && i + 1 < argc)
+            until = host_strtoull(argv[++i]);
+        else if (argv[i][0] == '-' && argv[i][1] == 's' && i + 1 < argc)
+            seed = host_strtoull(argv[++i]);
+        else if (argv[i][0] == '-' && argv[i][1] == 'v')
+            verbose = 1;
+        else if (argv[i][0] == '-' && argv[i][1] == 'd' && i + 1 < argc)
+            _workloads[0].device_period = host_strtoull(argv[++i]) *
+                COUNT_PER_USEC;
+        else if (argv[i][0] == '-' && argv[i][1] == 'b' && i + 1 < argc)
+            bench = host_strtoull(argv[++i]);
+        else if (argv[i][0] == '-' && argv[i][1] == 'l' && i + 1 < argc)
+            stress = host_strtoull(argv[++i]);
+        else {
+            host_puts("usage: pc [-t ms] [-s seed] [-v] [-d us] [-b count] "
+                    "[-l iterations]\n");
+            return 1;
+        }
+    }
+    until *= 1000 * COUNT_PER_USEC;
+
+    init_print();
+    if (stress)
+        return sync_stress_run(stress);
+
+    printH("[%s : %d] Starting...Main CPU\n", __func__, __LINE__);
+
+    boot_phase("memory");
+    if (memory_init(guest_mdlist0, guest_mdlist1))
+        printh("[start_guest] virtual memory initialization failed...\n");
+
+    /* Initialize PIRQ to VIRQ mapping */
+    boot_phase("interrupt");
+    setup_interrupt();
+    /* Initialize Interrupt Management */
+    if (interrupt_init(_guest_virqmap))
+        printh("[start_guest] interrupt initialization failed...\n");
+
+    /* Initialize Timer */
+    boot_phase("timer");
+    setup_timer();
+    if (timer_init(_timer_irq))
+        printh("[start_guest] timer initialization failed...\n");
+
+    /* Initialize Guests */
+    boot_phase("guest");
+    if (guest_init())
+        printh("[start_guest] guest initialization failed...\n");
+
+    /* Initialize Virtual Devices */
+    boot_phase("vdev");
+    if (vdev_init())
+        printh("[start_guest] virtual device initialization failed...\n");
+
+    /* Map the event trace buffers in the control guest */
+    boot_phase("trace");
+    if (trace_init())
+        printh("[start_guest] event trace initialization failed...\n");
+
+    /* Map the statistics page in each guest */
+    boot_phase("stats");
+    if (stats_init())
+        printh("[start_guest] statistics pages are not mapped...\n");
+
+    /* Bound the interrupt rate of the device of guest 0 */
+    boot_phase("irq throttle");
+    if (interrupt_throttle_init())
+        printh("[start_guest] interrupt throttling is not running...\n");
+    else if (interrupt_guest_throttle(0, 37, &_device_throttle))
+        printh("[start_guest] guest 0 device is not throttled...\n");
+
+    sim_set_cost(&_cost);
+    for (i = 0; i < NUM_GUESTS_STATIC; i++)
+        sim_guest_init(i, &_workloads[i], seed + i);
+
+    /* Print Banner */
+    boot_phase("banner");
+    printH("%s", BANNER_STRING);
+
+    /* Time of each phase */
+    boot_profile_print();
+
+    /* Switch to the first guest */
+    guest_sched_start();
+
+    if (bench) {
+        bench_vgicd(bench);
+        return 0;
+    }
+
+    host_console_enable(verbose);
+    start = host_time_ns();
+    sim_run(until);
+    start = host_time_ns() - start;
+    host_console_enable(1);
 
-    while (1)
-        ;
+    print_report(until, start);
+#ifdef CFG_TRACE_IPA
+    print_trace();
+#endif
+#ifdef CFG_STATS_IPA
+    print_stats();
+#endif
     return 0;
 }
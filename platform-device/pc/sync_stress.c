@@ -0,0 +1,158 @@
+#include <arch_types.h>
+#include <stdatomic.h>
+#include <spinlock.h>
+#include <rwlock.h>
+#include <bitmap.h>
+#include <host.h>
+#include <log/print.h>
+#include "sync_stress.h"
+
+/*
+ * Stress test of spinlock.h, rwlock.h, bitmap.h and atomic.h.
+ *
+ * The pc stand-in of atomic.h runs the same lock algorithms as the ARM one
+ * with the __atomic builtins, on real host threads here. Each thread, for
+ * each iteration:
+ *  - increments a plain counter under the spinlock(irqsave every other
+ *    time), another one with atomic_add_return(), and a C11 atomic counter
+ *    as the reference;
+ *  - writes a pair of words under the write lock(thread 0, every
+ *    STRESS_WRITE_PERIOD iterations) or checks under the read lock that the
+ *    pair is consistent;
+ *  - sets and clears a bit of its own in words shared with the other
+ *    threads, checking nobody else's update lost its.
+ * At the end the threads race for every bit of a bitmap with
+ * bitmap_test_and_set(), each bit has to be won exactly once.
+ */
+
+#define STRESS_THREADS          4
+#define STRESS_WRITE_PERIOD     8
+#define STRESS_BITS             1024
+/* Widens the critical sections, so that a broken lock loses updates */
+#define STRESS_HOLD             16
+
+static uint32_t _iterations;
+
+static DEFINE_SPINLOCK(_lock);
+static volatile uint32_t _counter;
+static volatile uint32_t _atomic_counter;
+static _Atomic uint32_t _reference;
+
+static DEFINE_RWLOCK(_rwlock);
+static volatile uint32_t _pair[2];
+static _Atomic uint32_t _pair_writes;
+static _Atomic uint32_t _pair_torn;
+
+static DECLARE_BITMAP(_shared, STRESS_BITS);
+static DECLARE_BITMAP(_claimed, STRESS_BITS);
+static _Atomic uint32_t _bits_lost;
+static _Atomic uint32_t _claims;
+
+static void sync_stress_increment(void)
+{
+    uint32_t value = _counter;
+    int i;
+
+    for (i = 0; i < STRESS_HOLD; i++)
+        cpu_relax();
+    _counter = value + 1;
+}
+
+static void sync_stress_thread(int index)
+{
+    uint32_t i, flags, bit;
+    uint32_t claims = 0;
+
+    for (i = 0; i < _iterations; i++) {
+        if (i & 1) {
+            flags = spin_lock_irqsave(&_lock);
+            sync_stress_increment();
+            spin_unlock_irqrestore(&_lock, flags);
+        } else {
+            spin_lock(&_lock);
+            sync_stress_increment();
+            spin_unlock(&_lock);
+        }
+        atomic_add_return(&_atomic_counter, 1);
+        atomic_fetch_add(&_reference, 1);
+
+        if (!index && !(i % STRESS_WRITE_PERIOD)) {
+            write_lock(&_rwlock);
+            _pair[0]++;
+            for (bit = 0; bit < STRESS_HOLD; bit++)
+                cpu_relax();
+            _pair[1] = ~_pair[0];
+            write_unlock(&_rwlock);
+            atomic_fetch_add(&_pair_writes, 1);
+        } else {
+            read_lock(&_rwlock);
+            if (_pair[1] != ~_pair[0])
+                atomic_fetch_add(&_pair_torn, 1);
+            read_unlock(&_rwlock);
+        }
+
+        /* Neighbouring bits belong to the other threads */
+        bit = (i * STRESS_THREADS + index) % STRESS_BITS;
+        bitmap_set(_shared, bit);
+        if (!bitmap_test(_shared, bit))
+            atomic_fetch_add(&_bits_lost, 1);
+        bitmap_clear(_shared, bit);
+        if (bitmap_test(_shared, bit))
+            atomic_fetch_add(&_bits_lost, 1);
+    }
+
+    for (bit = 0; bit < STRESS_BITS; bit++) {
+        if (!bitmap_test_and_set(_claimed, bit))
+            claims++;
+    }
+    atomic_fetch_add(&_claims, claims);
+}
+
+static int sync_stress_check(const char *name, uint32_t value,
+                uint32_t expected)
+{
+    printH("[stress] %s: %d, expected %d: %s\n", name, value, expected,
+            value == expected ? "ok" : "FAILED");
+
+    return value != expected;
+}
+
+int sync_stress_run(uint32_t iterations)
+{
+    unsigned long long ns;
+    uint32_t reference;
+    uint32_t words = 0;
+    int failed = 0;
+    int i;
+
+    _iterations = iterations;
+    ns = host_time_ns();
+    host_run_threads(STRESS_THREADS, sync_stress_thread);
+    ns = host_time_ns() - ns;
+
+    reference = atomic_load(&_reference);
+    printH("[stress] %d threads x %d iterations, %d ms\n", STRESS_THREADS,
+            iterations, (uint32_t) (ns / 1000000));
+    failed |= sync_stress_check("reference", reference,
+            STRESS_THREADS * iterations);
+    failed |= sync_stress_check("spinlock counter", _counter, reference);
+    failed |= sync_stress_check("atomic counter", _atomic_counter, reference);
+    failed |= sync_stress_check("spinlock released", spin_is_locked(&_lock),
+            0);
+    failed |= sync_stress_check("rwlock writes", _pair[0],
+            atomic_load(&_pair_writes));
+    failed |= sync_stress_check("rwlock torn reads", atomic_load(&_pair_torn),
+            0);
+    failed |= sync_stress_check("rwlock released", _rwlock.lock, 0);
+    failed |= sync_stress_check("bitmap lost updates",
+            atomic_load(&_bits_lost), 0);
+    for (i = 0; i < BITMAP_WORDS(STRESS_BITS); i++) {
+        if (_shared[i])
+            words++;
+    }
+    failed |= sync_stress_check("bitmap words left set", words, 0);
+    failed |= sync_stress_check("bitmap claims", atomic_load(&_claims),
+            STRESS_BITS);
+
+    return failed;
+}
@@ -0,0 +1,14 @@
+#ifndef __SYNC_STRESS_H__
+#define __SYNC_STRESS_H__
+#include <arch_types.h>
+
+/**
+ * @brief Stress test of the locks and atomics of common/include on host
+ * threads, against C11 atomics.
+ *
+ * @param iterations Iterations of each thread.
+ * @return 0 if every check passed.
+ */
+int sync_stress_run(uint32_t iterations);
+
+#endif
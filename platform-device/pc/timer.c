@@ -1,5 +0,0 @@
-#include "timer.h"
-
-void start_timer()
-{
-}
@@ -1,8 +0,0 @@
-#ifndef __PC_TIMER_H__
-#define __PC_TIMER_H__
-
-#include <hypervisor/timer.h>
-
-void start_timer(void);
-
-#endif